@@ -0,0 +1,111 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/math/box.h"
+#include "gdt/parallel/parallel_for.h"
+#include <vector>
+
+/*! host-side bounding volume hierarchies, for answering ray (and
+    other spatial) queries without the GPU */
+namespace gdt {
+
+  /*! a node of a binary BVH. Inner nodes have count == 0, and their
+      two children at nodes[offset] and nodes[offset+1]; leaves list
+      their 'count' primitives at primIDs[offset..offset+count) */
+  struct BVHNode {
+    inline bool isLeaf() const { return count != 0; }
+
+    box3f    bounds;
+    uint32_t offset;
+    uint32_t count;
+  };
+
+  /*! a binary BVH over some set of primitives, root at nodes[0].
+      Children always come after their parents */
+  struct BVH {
+    inline bool empty() const { return nodes.empty(); }
+    inline const box3f &bounds() const { return nodes[0].bounds; }
+
+    std::vector<BVHNode>  nodes;
+    std::vector<uint32_t> primIDs;
+  };
+
+  /*! a primitive as the builder sees it: its bounds, and its ID */
+  struct BVHPrimRef {
+    box3f    bounds;
+    uint32_t primID;
+    uint32_t pad;
+  };
+
+  struct BVHBuildConfig {
+    /*! number of bins per axis that split candidates get evaluated
+        for; more bins make for slightly better trees, built slightly
+        slower */
+    int   numBins          { 32 };
+    /*! ranges of more primitives than that always get split */
+    int   maxLeafSize      { 8 };
+    /*! @{ cost of traversing a node, and of intersecting one
+        primitive, in the surface area heuristic */
+    float traversalCost    { 1.f };
+    float intersectionCost { 1.f };
+    /*! @} */
+  };
+
+  /*! build a binned SAH BVH over the given primitives (which get
+      reordered, and whose bounds must not be empty). Both the binning
+      of large ranges and the two halves of each split get processed
+      on all threads */
+  void buildBVH(BVH &bvh,
+                std::vector<BVHPrimRef> &prims,
+                const BVHBuildConfig &config = BVHBuildConfig());
+
+  /*! build a binned SAH BVH over primitives 0..numPrims-1, with
+      getBounds(primID) returning the bounds of each */
+  template<typename GetBoundsT>
+  inline void buildBVH(BVH &bvh,
+                       size_t numPrims,
+                       const GetBoundsT &getBounds,
+                       const BVHBuildConfig &config = BVHBuildConfig())
+  {
+    std::vector<BVHPrimRef> prims(numPrims);
+    parallel_for_blocked(numPrims,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) {
+          prims[i].bounds = getBounds(i);
+          prims[i].primID = (uint32_t)i;
+          prims[i].pad    = 0;
+        }
+      });
+    buildBVH(bvh,prims,config);
+  }
+
+  /*! build a binned SAH BVH over the triangles of an indexed
+      triangle mesh; primIDs are indices into 'index' */
+  void buildTriangleBVH(BVH &bvh,
+                        const vec3f *vertex,
+                        const vec3i *index,
+                        size_t numTriangles,
+                        const BVHBuildConfig &config = BVHBuildConfig());
+
+  /*! the tree's expected cost per ray, according to the surface area
+      heuristic (with the given config's costs): the sum over all
+      nodes of their cost, weighted by the probability of a random
+      ray that hits the root to also hit that node */
+  float computeSAHCost(const BVH &bvh,
+                       const BVHBuildConfig &config = BVHBuildConfig());
+
+}
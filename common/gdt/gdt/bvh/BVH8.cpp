@@ -0,0 +1,856 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "BVH8.h"
+#if defined(__AVX2__)
+# include <immintrin.h>
+# define GDT_BVH8_AVX2 1
+#elif defined(__SSE__) || defined(_M_X64)
+# include <xmmintrin.h>
+# define GDT_BVH8_SSE 1
+#endif
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+namespace gdt {
+
+  /*! deepest a collapsed BVH may be; every level can leave at most
+      BVH8_WIDTH-1 children on the traversal stack */
+  enum { BVH8_MAX_DEPTH = 128,
+         BVH8_STACK_SIZE = BVH8_MAX_DEPTH*(BVH8_WIDTH-1)+1 };
+
+  // =======================================================
+  // collapsing binary BVHs
+  // =======================================================
+
+  struct BVH8Collapser {
+    BVH8Collapser(BVH8 &wide, const BVH &bvh, bool primLeaves)
+      : wide(wide), bvh(bvh), primLeaves(primLeaves),
+        maxLeafSize(primLeaves ? 1 : BVH8_WIDTH),
+        numPrims(bvh.nodes.size())
+    {
+      // children come after their parents, so one backwards pass
+      // does all subtrees before their parents
+      for (size_t nodeID=bvh.nodes.size();nodeID-- > 0;) {
+        const BVHNode &node = bvh.nodes[nodeID];
+        if (node.isLeaf() && node.count > maxLeafSize)
+          throw std::runtime_error(primLeaves
+                                   ? "collapseBVH8: leaves must have one primitive"
+                                   : "collapseBVH8: leaves must not have"
+                                   " more than 8 primitives");
+        numPrims[nodeID]
+          = node.isLeaf()
+          ? node.count
+          : numPrims[node.offset]+numPrims[node.offset+1];
+      }
+
+      for (int dim=0;dim<3;dim++)
+        for (int i=0;i<BVH8_WIDTH;i++) {
+          emptyNode.lower[dim][i] = +INFINITY;
+          emptyNode.upper[dim][i] = -INFINITY;
+          emptyBlock.v0[dim][i] = emptyBlock.e1[dim][i] = emptyBlock.e2[dim][i] = 0.f;
+        }
+      for (int i=0;i<BVH8_WIDTH;i++) {
+        emptyNode.child[i]   = BVH8Node::EMPTY;
+        emptyBlock.primID[i] = BVH8TriangleBlock::INVALID;
+      }
+    }
+
+    void collapse()
+    {
+      wide.nodes.clear();
+      wide.blocks.clear();
+      wide.bounds = box3f();
+      if (bvh.empty()) return;
+
+      wide.bounds = bvh.bounds();
+      if (numPrims[0] > maxLeafSize)
+        collapse(0,1);
+      else {
+        // a root that is small enough to be a leaf still gets a node
+        wide.nodes.push_back(emptyNode);
+        setChild(0,0,0);
+      }
+    }
+
+    void gatherPrims(uint32_t nodeID, BVH8TriangleBlock &block, int &lane) const
+    {
+      const BVHNode &node = bvh.nodes[nodeID];
+      if (node.isLeaf())
+        for (uint32_t i=0;i<node.count;i++)
+          block.primID[lane++] = bvh.primIDs[node.offset+i];
+      else {
+        gatherPrims(node.offset+0,block,lane);
+        gatherPrims(node.offset+1,block,lane);
+      }
+    }
+
+    /*! make binary node 'nodeID' child 'slot' of wide node 'wideID' */
+    void setChild(size_t wideID, int slot, uint32_t nodeID, int depth=0)
+    {
+      const box3f &bounds = bvh.nodes[nodeID].bounds;
+      for (int dim=0;dim<3;dim++) {
+        wide.nodes[wideID].lower[dim][slot] = bounds.lower[dim];
+        wide.nodes[wideID].upper[dim][slot] = bounds.upper[dim];
+      }
+
+      uint32_t ref;
+      if (primLeaves && numPrims[nodeID] == 1)
+        ref = BVH8Node::LEAF_BIT | bvh.primIDs[bvh.nodes[nodeID].offset];
+      else if (numPrims[nodeID] <= maxLeafSize) {
+        ref = BVH8Node::LEAF_BIT | (uint32_t)wide.blocks.size();
+        wide.blocks.push_back(emptyBlock);
+        int lane = 0;
+        gatherPrims(nodeID,wide.blocks.back(),lane);
+      } else
+        ref = collapse(nodeID,depth+1);
+      wide.nodes[wideID].child[slot] = ref;
+    }
+
+    /*! turn the subtree under (inner) binary node 'nodeID' into wide
+        nodes, returning the index of the topmost one */
+    uint32_t collapse(uint32_t nodeID, int depth)
+    {
+      if (depth > BVH8_MAX_DEPTH)
+        throw std::runtime_error("collapseBVH8: BVH too deep");
+
+      uint32_t kids[BVH8_WIDTH];
+      int numKids = 0;
+      kids[numKids++] = bvh.nodes[nodeID].offset+0;
+      kids[numKids++] = bvh.nodes[nodeID].offset+1;
+      // keep opening up the largest kid that will not become a leaf
+      while (numKids < BVH8_WIDTH) {
+        int   largest     = -1;
+        float largestArea = -1.f;
+        for (int i=0;i<numKids;i++) {
+          if (numPrims[kids[i]] <= maxLeafSize) continue;
+          const float kidArea = area(bvh.nodes[kids[i]].bounds);
+          if (kidArea > largestArea) {
+            largest     = i;
+            largestArea = kidArea;
+          }
+        }
+        if (largest < 0) break;
+        const BVHNode &opened = bvh.nodes[kids[largest]];
+        kids[largest]   = opened.offset+0;
+        kids[numKids++] = opened.offset+1;
+      }
+
+      const size_t wideID = wide.nodes.size();
+      wide.nodes.push_back(emptyNode);
+      for (int i=0;i<numKids;i++)
+        setChild(wideID,i,kids[i],depth);
+      return (uint32_t)wideID;
+    }
+
+    BVH8                 &wide;
+    const BVH            &bvh;
+    const bool            primLeaves;
+    const uint32_t        maxLeafSize;
+    /*! number of primitives in the subtree under each binary node */
+    std::vector<uint32_t> numPrims;
+    BVH8Node              emptyNode;
+    BVH8TriangleBlock     emptyBlock;
+  };
+
+  void collapseBVH8(BVH8 &wide, const BVH &bvh, bool primLeaves)
+  {
+    BVH8Collapser(wide,bvh,primLeaves).collapse();
+  }
+
+  // =======================================================
+  // refitting, and cost
+  // =======================================================
+
+  /*! subtrees of at least that many nodes get their children's
+      subtrees refit in parallel */
+  enum { PARALLEL_REFIT_THRESHOLD = 4096 };
+
+  /*! refit the subtree under node 'begin' - which is nodes
+      [begin,end), as the collapser lays out nodes depth first */
+  static void refitSubtree(BVH8 &wide, const box3f *blockBounds,
+                           box3f *nodeBounds, size_t begin, size_t end)
+  {
+    if (end-begin >= PARALLEL_REFIT_THRESHOLD) {
+      // the inner children's subtrees follow one another (in slot
+      // order) right after the node itself; insertion-sorted, as
+      // there are at most eight of them
+      size_t kids[BVH8_WIDTH+1];
+      int numKids = 0;
+      for (int slot=0;slot<BVH8_WIDTH;slot++) {
+        const uint32_t child = wide.nodes[begin].child[slot];
+        if (child == BVH8Node::EMPTY || (child & BVH8Node::LEAF_BIT))
+          continue;
+        int i = numKids++;
+        for (;i > 0 && kids[i-1] > child;i--)
+          kids[i] = kids[i-1];
+        kids[i] = child;
+      }
+      kids[numKids] = end;
+      parallel_for(numKids,[&](size_t i){
+          refitSubtree(wide,blockBounds,nodeBounds,kids[i],kids[i+1]);
+        });
+      // ... which leaves the node itself
+      end = begin+1;
+    }
+
+    for (size_t nodeID=end;nodeID-- > begin;) {
+      BVH8Node &node = wide.nodes[nodeID];
+      box3f bounds;
+      for (int slot=0;slot<BVH8_WIDTH;slot++) {
+        const uint32_t child = node.child[slot];
+        if (child == BVH8Node::EMPTY) continue;
+        const box3f &childBounds
+          = (child & BVH8Node::LEAF_BIT)
+          ? blockBounds[child & ~BVH8Node::LEAF_BIT]
+          : nodeBounds[child];
+        for (int dim=0;dim<3;dim++) {
+          node.lower[dim][slot] = childBounds.lower[dim];
+          node.upper[dim][slot] = childBounds.upper[dim];
+        }
+        bounds.extend(childBounds);
+      }
+      nodeBounds[nodeID] = bounds;
+    }
+  }
+
+  void refitBVH8Nodes(BVH8 &wide, const box3f *blockBounds)
+  {
+    std::vector<box3f> nodeBounds(wide.nodes.size());
+    if (!wide.empty())
+      refitSubtree(wide,blockBounds,nodeBounds.data(),0,wide.nodes.size());
+    wide.bounds = wide.empty() ? box3f() : nodeBounds[0];
+  }
+
+  float computeSAHCost(const BVH8 &bvh, const BVHBuildConfig &config)
+  {
+    if (bvh.empty()) return 0.f;
+    const double rootArea = area(bvh.bounds);
+    if (!(rootArea > 0.))
+      // see computeSAHCost() for binary BVHs
+      return 0.f;
+
+    double cost = rootArea*config.traversalCost;
+    for (auto &node : bvh.nodes)
+      for (int slot=0;slot<BVH8_WIDTH;slot++) {
+        const uint32_t child = node.child[slot];
+        if (child == BVH8Node::EMPTY) continue;
+        const box3f bounds(vec3f(node.lower[0][slot],node.lower[1][slot],node.lower[2][slot]),
+                           vec3f(node.upper[0][slot],node.upper[1][slot],node.upper[2][slot]));
+        if (!(child & BVH8Node::LEAF_BIT)) {
+          cost += area(bounds)*config.traversalCost;
+          continue;
+        }
+        const BVH8TriangleBlock &block = bvh.blocks[child & ~BVH8Node::LEAF_BIT];
+        int numTriangles = 0;
+        for (int lane=0;lane<BVH8_WIDTH;lane++)
+          numTriangles += (block.primID[lane] != BVH8TriangleBlock::INVALID);
+        cost += area(bounds)*config.intersectionCost*numTriangles;
+      }
+    return float(cost/rootArea);
+  }
+
+  // =======================================================
+  // just enough of a SIMD float to test one ray against several
+  // boxes or triangles at once: eight lanes with AVX2, four with
+  // SSE, and one without either
+  // =======================================================
+
+#if GDT_BVH8_AVX2
+  struct vfloat {
+    enum { width = 8 };
+    inline vfloat(__m256 v) : v(v) {}
+    explicit inline vfloat(float f) : v(_mm256_set1_ps(f)) {}
+    static inline vfloat load(const float *ptr) { return _mm256_loadu_ps(ptr); }
+    inline void store(float *ptr) const { _mm256_storeu_ps(ptr,v); }
+    __m256 v;
+  };
+  inline vfloat operator+(vfloat a, vfloat b) { return _mm256_add_ps(a.v,b.v); }
+  inline vfloat operator-(vfloat a, vfloat b) { return _mm256_sub_ps(a.v,b.v); }
+  inline vfloat operator*(vfloat a, vfloat b) { return _mm256_mul_ps(a.v,b.v); }
+  inline vfloat operator/(vfloat a, vfloat b) { return _mm256_div_ps(a.v,b.v); }
+  inline vfloat min(vfloat a, vfloat b) { return _mm256_min_ps(a.v,b.v); }
+  inline vfloat max(vfloat a, vfloat b) { return _mm256_max_ps(a.v,b.v); }
+  /*! @{ lane i's comparison result in bit i */
+  inline int le(vfloat a, vfloat b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v,b.v,_CMP_LE_OQ)); }
+  inline int lt(vfloat a, vfloat b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v,b.v,_CMP_LT_OQ)); }
+  /*! @} */
+#elif GDT_BVH8_SSE
+  struct vfloat {
+    enum { width = 4 };
+    inline vfloat(__m128 v) : v(v) {}
+    explicit inline vfloat(float f) : v(_mm_set1_ps(f)) {}
+    static inline vfloat load(const float *ptr) { return _mm_loadu_ps(ptr); }
+    inline void store(float *ptr) const { _mm_storeu_ps(ptr,v); }
+    __m128 v;
+  };
+  inline vfloat operator+(vfloat a, vfloat b) { return _mm_add_ps(a.v,b.v); }
+  inline vfloat operator-(vfloat a, vfloat b) { return _mm_sub_ps(a.v,b.v); }
+  inline vfloat operator*(vfloat a, vfloat b) { return _mm_mul_ps(a.v,b.v); }
+  inline vfloat operator/(vfloat a, vfloat b) { return _mm_div_ps(a.v,b.v); }
+  inline vfloat min(vfloat a, vfloat b) { return _mm_min_ps(a.v,b.v); }
+  inline vfloat max(vfloat a, vfloat b) { return _mm_max_ps(a.v,b.v); }
+  /*! @{ lane i's comparison result in bit i */
+  inline int le(vfloat a, vfloat b) { return _mm_movemask_ps(_mm_cmple_ps(a.v,b.v)); }
+  inline int lt(vfloat a, vfloat b) { return _mm_movemask_ps(_mm_cmplt_ps(a.v,b.v)); }
+  /*! @} */
+#else
+  struct vfloat {
+    enum { width = 1 };
+    explicit inline vfloat(float v) : v(v) {}
+    static inline vfloat load(const float *ptr) { return vfloat(*ptr); }
+    inline void store(float *ptr) const { *ptr = v; }
+    float v;
+  };
+  inline vfloat operator+(vfloat a, vfloat b) { return vfloat(a.v+b.v); }
+  inline vfloat operator-(vfloat a, vfloat b) { return vfloat(a.v-b.v); }
+  inline vfloat operator*(vfloat a, vfloat b) { return vfloat(a.v*b.v); }
+  inline vfloat operator/(vfloat a, vfloat b) { return vfloat(a.v/b.v); }
+  inline vfloat min(vfloat a, vfloat b) { return vfloat(a.v < b.v ? a.v : b.v); }
+  inline vfloat max(vfloat a, vfloat b) { return vfloat(a.v > b.v ? a.v : b.v); }
+  /*! @{ the comparison's result in bit 0 */
+  inline int le(vfloat a, vfloat b) { return a.v <= b.v; }
+  inline int lt(vfloat a, vfloat b) { return a.v < b.v; }
+  /*! @} */
+#endif
+
+  /*! @{ index of the lowest set bit of a (non-zero) mask */
+  static inline int firstBit(int mask)
+  {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index,(unsigned long)mask);
+    return (int)index;
+#else
+    return __builtin_ctz((unsigned)mask);
+#endif
+  }
+  static inline int firstBit(uint64_t mask)
+  {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index,mask);
+    return (int)index;
+#else
+    return __builtin_ctzll(mask);
+#endif
+  }
+  /*! @} */
+
+  // =======================================================
+  // traversal
+  // =======================================================
+
+  /*! box tests - and the culling of stack entries against the
+      closest hit so far - scale the ray's far distance by that much,
+      so that rounding never makes a ray miss a box that it hits (Ize,
+      "Robust BVH Ray Traversal"), and single rays and packets agree
+      on what they find */
+  static const float ROBUST_FAR = 1.f+2.f*3.f*float(1./(1<<24));
+
+  /*! what the box tests need to know about a ray: per axis, which of
+      the two slabs it enters through */
+  struct RayBoxTest {
+    RayBoxTest(const BVHRay &ray)
+    {
+      for (int dim=0;dim<3;dim++) {
+        // no zero directions, so we never get 0*inf
+        float dir = ray.dir[dim];
+        if (fabsf(dir) < 1e-18f) dir = dir < 0.f ? -1e-18f : 1e-18f;
+        org[dim]         = ray.org[dim];
+        invDir[dim]      = 1.f/dir;
+        nearIsLower[dim] = dir > 0.f;
+      }
+    }
+
+    /*! test all children of the node; returns the mask of those
+        hit, and writes all of their entry distances */
+    inline int intersect(const BVH8Node &node, float tmin, float tmax,
+                         float *tnear) const
+    {
+      int mask = 0;
+      for (int i=0;i<BVH8_WIDTH;i+=vfloat::width) {
+        vfloat nearT(tmin), farT(tmax);
+        for (int dim=0;dim<3;dim++) {
+          const float *nearPlane = nearIsLower[dim] ? node.lower[dim] : node.upper[dim];
+          const float *farPlane  = nearIsLower[dim] ? node.upper[dim] : node.lower[dim];
+          nearT = max(nearT,(vfloat::load(nearPlane+i)-vfloat(org[dim]))*vfloat(invDir[dim]));
+          farT  = min(farT, (vfloat::load(farPlane+i) -vfloat(org[dim]))*vfloat(invDir[dim]));
+        }
+        mask |= le(nearT,farT*vfloat(ROBUST_FAR)) << i;
+        nearT.store(tnear+i);
+      }
+      return mask;
+    }
+
+    float org[3];
+    float invDir[3];
+    bool  nearIsLower[3];
+  };
+
+  /*! test all triangles of the block (Moeller-Trumbore); returns the
+      mask of those hit within (tmin,tmax), and writes all of their
+      distances and barycentrics */
+  static inline int intersect(const BVH8TriangleBlock &block, const BVHRay &ray,
+                              float tmax, float *t, float *u, float *v)
+  {
+    const vfloat zero(0.f), one(1.f);
+    const vfloat dx(ray.dir.x), dy(ray.dir.y), dz(ray.dir.z);
+    int mask = 0;
+    for (int i=0;i<BVH8_WIDTH;i+=vfloat::width) {
+      const vfloat e1x = vfloat::load(block.e1[0]+i);
+      const vfloat e1y = vfloat::load(block.e1[1]+i);
+      const vfloat e1z = vfloat::load(block.e1[2]+i);
+      const vfloat e2x = vfloat::load(block.e2[0]+i);
+      const vfloat e2y = vfloat::load(block.e2[1]+i);
+      const vfloat e2z = vfloat::load(block.e2[2]+i);
+      // p = cross(dir,e2)
+      const vfloat px = dy*e2z - dz*e2y;
+      const vfloat py = dz*e2x - dx*e2z;
+      const vfloat pz = dx*e2y - dy*e2x;
+      // zero for unused lanes, whose u then is nan, which fails all
+      // of the tests below
+      const vfloat invDet = one/(e1x*px + e1y*py + e1z*pz);
+      const vfloat sx = vfloat(ray.org.x) - vfloat::load(block.v0[0]+i);
+      const vfloat sy = vfloat(ray.org.y) - vfloat::load(block.v0[1]+i);
+      const vfloat sz = vfloat(ray.org.z) - vfloat::load(block.v0[2]+i);
+      const vfloat uu = (sx*px + sy*py + sz*pz)*invDet;
+      // q = cross(s,e1)
+      const vfloat qx = sy*e1z - sz*e1y;
+      const vfloat qy = sz*e1x - sx*e1z;
+      const vfloat qz = sx*e1y - sy*e1x;
+      const vfloat vv = (dx*qx + dy*qy + dz*qz)*invDet;
+      const vfloat tt = (e2x*qx + e2y*qy + e2z*qz)*invDet;
+      const int hit
+        = le(zero,uu) & le(zero,vv) & le(uu+vv,one)
+        & lt(vfloat(ray.tmin),tt) & lt(tt,vfloat(tmax));
+      mask |= hit << i;
+      tt.store(t+i);
+      uu.store(u+i);
+      vv.store(v+i);
+    }
+    return mask;
+  }
+
+  struct StackEntry {
+    uint32_t ref;
+    float    tnear;
+  };
+
+  /*! push the node's children that got hit far to near, so that
+      the nearest one gets popped first */
+  static inline void pushOrdered(StackEntry *stack, int &stackSize,
+                                 const BVH8Node &node, int mask,
+                                 const float *tnear)
+  {
+    StackEntry *pushed = stack+stackSize;
+    int numPushed = 0;
+    for (;mask;mask &= mask-1) {
+      const int lane = firstBit(mask);
+      const StackEntry child = { node.child[lane], tnear[lane] };
+      int i = numPushed++;
+      for (;i > 0 && pushed[i-1].tnear < child.tnear;--i)
+        pushed[i] = pushed[i-1];
+      pushed[i] = child;
+    }
+    stackSize += numPushed;
+  }
+
+  /*! intersect the ray with the triangles of leaf 'ref' */
+  static inline bool intersectLeaf(const BVH8 &bvh, uint32_t ref,
+                                   BVHRay &ray, BVHHit &hit)
+  {
+    const BVH8TriangleBlock &block = bvh.blocks[ref & ~BVH8Node::LEAF_BIT];
+    float t[BVH8_WIDTH], u[BVH8_WIDTH], v[BVH8_WIDTH];
+    bool found = false;
+    for (int mask = intersect(block,ray,ray.tmax,t,u,v);mask;mask &= mask-1) {
+      const int lane = firstBit(mask);
+      if (t[lane] >= ray.tmax) continue;
+      ray.tmax   = t[lane];
+      hit.primID = block.primID[lane];
+      hit.t      = t[lane];
+      hit.u      = u[lane];
+      hit.v      = v[lane];
+      found      = true;
+    }
+    return found;
+  }
+
+  /*! intersect() the ray with the subtree under 'ref' (a node or a
+      leaf) only */
+  static bool intersectSubtree(const BVH8 &bvh, uint32_t ref,
+                               BVHRay &ray, BVHHit &hit)
+  {
+    const RayBoxTest boxTest(ray);
+    StackEntry stack[BVH8_STACK_SIZE];
+    int  stackSize = 0;
+    bool found     = false;
+    stack[stackSize++] = { ref, ray.tmin };
+    while (stackSize > 0) {
+      const StackEntry entry = stack[--stackSize];
+      if (entry.tnear > ray.tmax*ROBUST_FAR) continue;
+
+      if (entry.ref & BVH8Node::LEAF_BIT) {
+        found |= intersectLeaf(bvh,entry.ref,ray,hit);
+        continue;
+      }
+
+      const BVH8Node &node = bvh.nodes[entry.ref];
+      float tnear[BVH8_WIDTH];
+      int mask = boxTest.intersect(node,ray.tmin,ray.tmax,tnear);
+      pushOrdered(stack,stackSize,node,mask,tnear);
+    }
+    return found;
+  }
+
+  bool intersect(const BVH8 &bvh, BVHRay &ray, BVHHit &hit)
+  {
+    if (bvh.empty()) return false;
+    return intersectSubtree(bvh,0,ray,hit);
+  }
+
+  bool occluded(const BVH8 &bvh, const BVHRay &ray)
+  {
+    if (bvh.empty()) return false;
+
+    const RayBoxTest boxTest(ray);
+    StackEntry stack[BVH8_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, ray.tmin };
+    while (stackSize > 0) {
+      const uint32_t ref = stack[--stackSize].ref;
+      if (ref & BVH8Node::LEAF_BIT) {
+        float t[BVH8_WIDTH], u[BVH8_WIDTH], v[BVH8_WIDTH];
+        if (intersect(bvh.blocks[ref & ~BVH8Node::LEAF_BIT],ray,ray.tmax,t,u,v))
+          return true;
+        continue;
+      }
+
+      const BVH8Node &node = bvh.nodes[ref];
+      float tnear[BVH8_WIDTH];
+      int mask = boxTest.intersect(node,ray.tmin,ray.tmax,tnear);
+      pushOrdered(stack,stackSize,node,mask,tnear);
+    }
+    return false;
+  }
+
+  // =======================================================
+  // packet traversal
+  // =======================================================
+
+  /*! a packet diverges - and its rays get traced one by one from
+      then on - once it has visited more leaves that none of its rays
+      hit than that many more than leaves that some did */
+  enum { PACKET_DIVERGENCE_SLACK = 8 };
+
+  /*! a packet of rays that go the same way along each axis, as
+      structure-of-arrays (padded with rays that never hit anything),
+      and the intervals its origins and inverse directions lie in */
+  struct RayPacket {
+    enum { maxSize = ((BVH_MAX_PACKET_SIZE+vfloat::width-1)/vfloat::width)*vfloat::width };
+
+    /*! whether all rays go the same way along each axis (which the
+        interval test requires), and if so, set up the packet */
+    bool init(const BVHRay *rays, int numRays)
+    {
+      const RayBoxTest first(rays[0]);
+      for (int dim=0;dim<3;dim++) {
+        nearIsLower[dim] = first.nearIsLower[dim];
+        orgLo[dim] = invLo[dim] = +INFINITY;
+        orgHi[dim] = invHi[dim] = -INFINITY;
+      }
+      minTmin = +INFINITY;
+      for (int i=0;i<numRays;i++) {
+        const RayBoxTest boxTest(rays[i]);
+        for (int dim=0;dim<3;dim++) {
+          if (boxTest.nearIsLower[dim] != nearIsLower[dim]) return false;
+          org[dim][i]    = rays[i].org[dim];
+          invDir[dim][i] = boxTest.invDir[dim];
+          orgLo[dim] = std::min(orgLo[dim],org[dim][i]);
+          orgHi[dim] = std::max(orgHi[dim],org[dim][i]);
+          invLo[dim] = std::min(invLo[dim],invDir[dim][i]);
+          invHi[dim] = std::max(invHi[dim],invDir[dim][i]);
+        }
+        tmin[i] = rays[i].tmin;
+        tmax[i] = rays[i].tmax;
+        minTmin = std::min(minTmin,tmin[i]);
+      }
+      size = numRays;
+      paddedSize = ((numRays+vfloat::width-1)/vfloat::width)*vfloat::width;
+      for (int i=numRays;i<paddedSize;i++) {
+        for (int dim=0;dim<3;dim++) {
+          org[dim][i]    = org[dim][0];
+          invDir[dim][i] = invDir[dim][0];
+        }
+        tmin[i] = +INFINITY;
+        tmax[i] = -INFINITY;
+      }
+      updateMaxTmax();
+      return true;
+    }
+
+    void updateMaxTmax()
+    {
+      maxTmax = -INFINITY;
+      for (int i=0;i<size;i++)
+        maxTmax = std::max(maxTmax,tmax[i]);
+    }
+
+    /*! one test for all rays against all children of the node: with
+        interval arithmetic, the lowest distance at which any ray
+        could enter a child, and the highest at which any could leave
+        it. Conservative - a child that any ray hits always passes */
+    inline int intersect(const BVH8Node &node, float *tnear) const
+    {
+      int mask = 0;
+      for (int i=0;i<BVH8_WIDTH;i+=vfloat::width) {
+        vfloat nearT(minTmin), farT(maxTmax);
+        for (int dim=0;dim<3;dim++) {
+          const float *nearPlane = nearIsLower[dim] ? node.lower[dim] : node.upper[dim];
+          const float *farPlane  = nearIsLower[dim] ? node.upper[dim] : node.lower[dim];
+          const vfloat lo(invLo[dim]), hi(invHi[dim]);
+          // (plane - org) lies in [plane-orgHi,plane-orgLo]
+          const vfloat nearA = vfloat::load(nearPlane+i) - vfloat(orgHi[dim]);
+          const vfloat nearB = vfloat::load(nearPlane+i) - vfloat(orgLo[dim]);
+          nearT = max(nearT,min(min(nearA*lo,nearA*hi),min(nearB*lo,nearB*hi)));
+          const vfloat farA  = vfloat::load(farPlane+i) - vfloat(orgHi[dim]);
+          const vfloat farB  = vfloat::load(farPlane+i) - vfloat(orgLo[dim]);
+          farT  = min(farT, max(max(farA*lo,farA*hi),max(farB*lo,farB*hi)));
+        }
+        mask |= le(nearT,farT*vfloat(ROBUST_FAR)) << i;
+        nearT.store(tnear+i);
+      }
+      return mask;
+    }
+
+    /*! each ray against child 'slot' of the node; returns the mask of
+        rays that hit it */
+    inline uint64_t intersect(const BVH8Node &node, int slot) const
+    {
+      uint64_t mask = 0;
+      for (int i=0;i<paddedSize;i+=vfloat::width) {
+        vfloat nearT = vfloat::load(tmin+i), farT = vfloat::load(tmax+i);
+        for (int dim=0;dim<3;dim++) {
+          const vfloat lower(node.lower[dim][slot]), upper(node.upper[dim][slot]);
+          const vfloat o   = vfloat::load(org[dim]+i);
+          const vfloat inv = vfloat::load(invDir[dim]+i);
+          nearT = max(nearT,((nearIsLower[dim] ? lower : upper) - o)*inv);
+          farT  = min(farT, ((nearIsLower[dim] ? upper : lower) - o)*inv);
+        }
+        mask |= uint64_t(le(nearT,farT*vfloat(ROBUST_FAR))) << i;
+      }
+      return mask;
+    }
+
+    float org[3][maxSize];
+    float invDir[3][maxSize];
+    float tmin[maxSize];
+    float tmax[maxSize];
+    int   size, paddedSize;
+    bool  nearIsLower[3];
+    float orgLo[3], orgHi[3];
+    float invLo[3], invHi[3];
+    float minTmin, maxTmax;
+  };
+
+  struct PacketStackEntry {
+    uint32_t        ref;
+    float           tnear;
+    /*! the node, and which of its children this is */
+    const BVH8Node *parent;
+    int             slot;
+  };
+
+  uint64_t intersect(const BVH8 &bvh, BVHRay *rays, BVHHit *hits, int numRays)
+  {
+    if (numRays > BVH_MAX_PACKET_SIZE)
+      throw std::runtime_error("intersect: too many rays for one packet");
+    uint64_t hitMask = 0;
+    if (bvh.empty() || numRays <= 0) return hitMask;
+
+    RayPacket packet;
+    if (numRays == 1 || !packet.init(rays,numRays)) {
+      for (int i=0;i<numRays;i++)
+        if (intersectSubtree(bvh,0,rays[i],hits[i]))
+          hitMask |= uint64_t(1) << i;
+      return hitMask;
+    }
+
+    PacketStackEntry stack[BVH8_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, packet.minTmin, nullptr, 0 };
+    int usefulLeaves = 0, uselessLeaves = 0;
+    while (stackSize > 0) {
+      const PacketStackEntry entry = stack[--stackSize];
+      if (entry.tnear > packet.maxTmax*ROBUST_FAR) continue;
+
+      if (entry.ref & BVH8Node::LEAF_BIT) {
+        uint64_t rayMask = packet.intersect(*entry.parent,entry.slot);
+        (rayMask ? usefulLeaves : uselessLeaves)++;
+        for (;rayMask;rayMask &= rayMask-1) {
+          const int i = firstBit(rayMask);
+          if (intersectLeaf(bvh,entry.ref,rays[i],hits[i])) {
+            packet.tmax[i] = rays[i].tmax;
+            hitMask |= uint64_t(1) << i;
+          }
+        }
+        packet.updateMaxTmax();
+
+        if (uselessLeaves > usefulLeaves+PACKET_DIVERGENCE_SLACK) {
+          // the packet's rays have gone separate ways: trace each of
+          // them through what is left on the stack on its own
+          for (int i=0;i<numRays;i++)
+            for (int j=stackSize-1;j>=0;--j)
+              if (stack[j].tnear <= rays[i].tmax*ROBUST_FAR
+                  && intersectSubtree(bvh,stack[j].ref,rays[i],hits[i]))
+                hitMask |= uint64_t(1) << i;
+          return hitMask;
+        }
+        continue;
+      }
+
+      const BVH8Node &node = bvh.nodes[entry.ref];
+      float tnear[BVH8_WIDTH];
+      int mask = packet.intersect(node,tnear);
+      // push far to near, as for single rays
+      PacketStackEntry *pushed = stack+stackSize;
+      int numPushed = 0;
+      for (;mask;mask &= mask-1) {
+        const int slot = firstBit(mask);
+        const PacketStackEntry child = { node.child[slot], tnear[slot], &node, slot };
+        int i = numPushed++;
+        for (;i > 0 && pushed[i-1].tnear < child.tnear;--i)
+          pushed[i] = pushed[i-1];
+        pushed[i] = child;
+      }
+      stackSize += numPushed;
+    }
+    return hitMask;
+  }
+
+  // =======================================================
+  // two-level BVHs
+  // =======================================================
+
+  void buildTLAS(TwoLevelBVH8 &bvh, const BVHBuildConfig &config)
+  {
+    BVHBuildConfig tlasConfig = config;
+    tlasConfig.maxLeafSize = 1;
+
+    const size_t numInstances = bvh.instances.size();
+    bvh.worldToInstance.resize(numInstances);
+    parallel_for_blocked(numInstances,16*1024,[&](size_t begin, size_t end){
+        for (size_t instanceID=begin;instanceID<end;instanceID++)
+          bvh.worldToInstance[instanceID] = rcp(bvh.instances[instanceID].xfm);
+      });
+
+    buildBVH(bvh.tlasBinary,numInstances,[&](size_t instanceID){
+        const BVHInstance &instance = bvh.instances[instanceID];
+        const BVH8 &blas = *bvh.blas[instance.blasID];
+        // the builder wants no empty bounds
+        box3f bounds(instance.xfm.p);
+        if (blas.empty()) return bounds;
+
+        bounds = box3f();
+        const box3f &box = blas.bounds;
+        for (int corner=0;corner<8;corner++)
+          bounds.extend(xfmPoint(instance.xfm,
+                                 vec3f((corner&1) ? box.upper.x : box.lower.x,
+                                       (corner&2) ? box.upper.y : box.lower.y,
+                                       (corner&4) ? box.upper.z : box.lower.z)));
+        return bounds;
+      },tlasConfig);
+    collapseBVH8(bvh.tlas,bvh.tlasBinary,true);
+  }
+
+  /*! the ray in the given instance's space; its direction does not
+      get normalized, so distances along it stay the same */
+  static inline BVHRay instanceRay(const TwoLevelBVH8 &bvh, uint32_t instanceID,
+                                   const BVHRay &ray)
+  {
+    const affine3f &xfm = bvh.worldToInstance[instanceID];
+    BVHRay local;
+    local.org  = xfmPoint(xfm,ray.org);
+    local.dir  = xfmVector(xfm,ray.dir);
+    local.tmin = ray.tmin;
+    local.tmax = ray.tmax;
+    return local;
+  }
+
+  bool intersect(const TwoLevelBVH8 &bvh, BVHRay &ray, BVHHit &hit, uint32_t rayMask)
+  {
+    if (bvh.empty()) return false;
+
+    const RayBoxTest boxTest(ray);
+    StackEntry stack[BVH8_STACK_SIZE];
+    int  stackSize = 0;
+    bool found     = false;
+    stack[stackSize++] = { 0, ray.tmin };
+    while (stackSize > 0) {
+      const StackEntry entry = stack[--stackSize];
+      if (entry.tnear > ray.tmax*ROBUST_FAR) continue;
+
+      if (entry.ref & BVH8Node::LEAF_BIT) {
+        const uint32_t     instanceID = entry.ref & ~BVH8Node::LEAF_BIT;
+        const BVHInstance &instance   = bvh.instances[instanceID];
+        if (!(instance.mask & rayMask)) continue;
+
+        BVHRay local = instanceRay(bvh,instanceID,ray);
+        if (intersect(*bvh.blas[instance.blasID],local,hit)) {
+          ray.tmax       = local.tmax;
+          hit.instanceID = instanceID;
+          found          = true;
+        }
+        continue;
+      }
+
+      const BVH8Node &node = bvh.tlas.nodes[entry.ref];
+      float tnear[BVH8_WIDTH];
+      int mask = boxTest.intersect(node,ray.tmin,ray.tmax,tnear);
+      pushOrdered(stack,stackSize,node,mask,tnear);
+    }
+    return found;
+  }
+
+  bool occluded(const TwoLevelBVH8 &bvh, const BVHRay &ray, uint32_t rayMask)
+  {
+    if (bvh.empty()) return false;
+
+    const RayBoxTest boxTest(ray);
+    StackEntry stack[BVH8_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, ray.tmin };
+    while (stackSize > 0) {
+      const uint32_t ref = stack[--stackSize].ref;
+      if (ref & BVH8Node::LEAF_BIT) {
+        const uint32_t     instanceID = ref & ~BVH8Node::LEAF_BIT;
+        const BVHInstance &instance   = bvh.instances[instanceID];
+        if ((instance.mask & rayMask)
+            && occluded(*bvh.blas[instance.blasID],instanceRay(bvh,instanceID,ray)))
+          return true;
+        continue;
+      }
+
+      const BVH8Node &node = bvh.tlas.nodes[ref];
+      float tnear[BVH8_WIDTH];
+      int mask = boxTest.intersect(node,ray.tmin,ray.tmax,tnear);
+      pushOrdered(stack,stackSize,node,mask,tnear);
+    }
+    return false;
+  }
+
+}
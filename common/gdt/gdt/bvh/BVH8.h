@@ -0,0 +1,243 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/bvh/BVH.h"
+#include "gdt/math/AffineSpace.h"
+
+namespace gdt {
+
+  enum { BVH8_WIDTH = 8 };
+
+  /*! a node of an 8-wide BVH. The children's bounds are stored as
+      structure-of-arrays, so that one ray can be tested against all
+      of them at once; unused children have empty bounds, which no
+      ray ever hits */
+  struct BVH8Node {
+    /*! a child is either another node (by index), or a leaf
+        (LEAF_BIT | index of its triangle block) */
+    enum : uint32_t { EMPTY = 0xffffffffu, LEAF_BIT = 0x80000000u };
+
+    float    lower[3][BVH8_WIDTH];
+    float    upper[3][BVH8_WIDTH];
+    uint32_t child[BVH8_WIDTH];
+  };
+
+  /*! the (up to eight) triangles of a leaf, structure-of-arrays as
+      well: each triangle's first vertex, and the two edges leaving
+      it. Unused lanes have zero edges, which no ray ever hits */
+  struct BVH8TriangleBlock {
+    enum : uint32_t { INVALID = 0xffffffffu };
+
+    inline void setTriangle(int lane, const vec3f &a, const vec3f &b, const vec3f &c)
+    {
+      for (int dim=0;dim<3;dim++) {
+        v0[dim][lane] = a[dim];
+        e1[dim][lane] = b[dim]-a[dim];
+        e2[dim][lane] = c[dim]-a[dim];
+      }
+    }
+
+    float    v0[3][BVH8_WIDTH];
+    float    e1[3][BVH8_WIDTH];
+    float    e2[3][BVH8_WIDTH];
+    uint32_t primID[BVH8_WIDTH];
+  };
+
+  /*! an 8-wide BVH over triangles, collapsed from a binary one; root
+      at nodes[0], children always after their parents */
+  struct BVH8 {
+    inline bool empty() const { return nodes.empty(); }
+
+    std::vector<BVH8Node>          nodes;
+    std::vector<BVH8TriangleBlock> blocks;
+    box3f                          bounds;
+  };
+
+  struct BVHRay {
+    vec3f org;
+    float tmin;
+    vec3f dir;
+    float tmax;
+  };
+
+  struct BVHHit {
+    uint32_t primID;
+    /*! the instance hit - only set by two-level BVHs */
+    uint32_t instanceID;
+    /*! distance along the ray (in multiples of its direction), and
+        barycentric coordinates of the hit point */
+    float    t, u, v;
+  };
+
+  /*! turn a binary BVH (with leaves of at most BVH8_WIDTH
+      primitives) into the nodes and leaves of an 8-wide one, by
+      pulling up the largest grandchildren of each node until it has
+      eight children. Every subtree of at most BVH8_WIDTH primitives
+      becomes one leaf. The leaves get their primIDs, but no
+      triangles yet - see buildBVH8(). With 'primLeaves', every leaf
+      of the binary BVH has to have one primitive, and becomes a
+      child (LEAF_BIT | primID) with no block at all - for BVHs over
+      things other than triangles */
+  void collapseBVH8(BVH8 &wide, const BVH &bvh, bool primLeaves = false);
+
+  /*! (re-)set the triangles of all leaves of an 8-wide BVH, with
+      getTriangle(primID,a,b,c) returning each triangle's vertices;
+      if 'blockBounds' is given, also write the bounds of each leaf's
+      triangles there */
+  template<typename GetTriangleT>
+  inline void setBVH8Triangles(BVH8 &wide, const GetTriangleT &getTriangle,
+                               box3f *blockBounds = nullptr)
+  {
+    parallel_for_blocked(wide.blocks.size(),16*1024,[&](size_t begin, size_t end){
+        for (size_t blockID=begin;blockID<end;blockID++) {
+          BVH8TriangleBlock &block = wide.blocks[blockID];
+          box3f bounds;
+          for (int lane=0;lane<BVH8_WIDTH;lane++) {
+            if (block.primID[lane] == BVH8TriangleBlock::INVALID) continue;
+            vec3f a, b, c;
+            getTriangle(block.primID[lane],a,b,c);
+            block.setTriangle(lane,a,b,c);
+            bounds.extend(a); bounds.extend(b); bounds.extend(c);
+          }
+          if (blockBounds) blockBounds[blockID] = bounds;
+        }
+      });
+  }
+
+  /*! build an 8-wide BVH from a binary one over triangles, with
+      getTriangle(primID,a,b,c) returning each triangle's vertices */
+  template<typename GetTriangleT>
+  inline void buildBVH8(BVH8 &wide, const BVH &bvh, const GetTriangleT &getTriangle)
+  {
+    collapseBVH8(wide,bvh);
+    setBVH8Triangles(wide,getTriangle);
+  }
+
+  /*! build an 8-wide BVH from a binary one over the triangles of an
+      indexed triangle mesh (see buildTriangleBVH()) */
+  inline void buildTriangleBVH8(BVH8 &wide, const BVH &bvh,
+                                const vec3f *vertex, const vec3i *index)
+  {
+    buildBVH8(wide,bvh,[&](uint32_t primID, vec3f &a, vec3f &b, vec3f &c){
+        const vec3i &tri = index[primID];
+        a = vertex[tri.x]; b = vertex[tri.y]; c = vertex[tri.z];
+      });
+  }
+
+  /*! set the bounds of all children of all nodes from those of the
+      leaves' triangles, as given by 'blockBounds' - bottom-up, in
+      backwards passes over the nodes, as children always come after
+      their parents; large subtrees refit their children's subtrees
+      in parallel */
+  void refitBVH8Nodes(BVH8 &wide, const box3f *blockBounds);
+
+  /*! refit an 8-wide BVH over triangles to their vertices having
+      moved: the leaves get their triangles (and bounds) anew, in
+      parallel, and the nodes their children's bounds. The tree
+      itself stays as it was built, so the more the triangles move
+      relative to each other, the worse it gets - see
+      computeSAHCost() */
+  template<typename GetTriangleT>
+  inline void refitBVH8(BVH8 &wide, const GetTriangleT &getTriangle)
+  {
+    std::vector<box3f> blockBounds(wide.blocks.size());
+    setBVH8Triangles(wide,getTriangle,blockBounds.data());
+    refitBVH8Nodes(wide,blockBounds.data());
+  }
+
+  /*! the 8-wide BVH's expected cost per ray, according to the
+      surface area heuristic - as computeSAHCost() for binary BVHs,
+      with every node costing 'traversalCost', and every leaf the
+      number of its triangles times 'intersectionCost'. Not
+      comparable to the cost of the binary BVH it came from, but to
+      that of the same BVH after refitting */
+  float computeSAHCost(const BVH8 &bvh,
+                       const BVHBuildConfig &config = BVHBuildConfig());
+
+  /*! find the closest triangle the ray hits within (tmin,tmax); if
+      there is one, set the ray's tmax to its distance, and fill in
+      'hit'. Children get visited nearest first. Uses AVX2 where the
+      compiler may (eight children or triangles at a time), else SSE
+      (four at a time) */
+  bool intersect(const BVH8 &bvh, BVHRay &ray, BVHHit &hit);
+
+  /*! whether the ray hits any triangle within (tmin,tmax) */
+  bool occluded(const BVH8 &bvh, const BVHRay &ray);
+
+  enum { BVH_MAX_PACKET_SIZE = 64 };
+
+  /*! intersect() up to BVH_MAX_PACKET_SIZE rays at once; returns the
+      mask of those that hit something. Coherent rays - say, the
+      primary rays of an 8x8 pixel tile - share one conservative
+      (interval arithmetic) test per node, and only get tested one by
+      one against the leaves. Rays that do not all go the same way
+      along each axis get traced one by one right away, and so do
+      packets that turn out to diverge on the way down */
+  uint64_t intersect(const BVH8 &bvh, BVHRay *rays, BVHHit *hits, int numRays);
+
+  // =======================================================
+  // two-level BVHs
+  // =======================================================
+
+  /*! one placement of a bottom-level BVH */
+  struct BVHInstance {
+    /*! from the bottom-level BVH's space to world space */
+    affine3f xfm;
+    uint32_t blasID;
+    /*! rays only see instances whose mask shares a bit with theirs */
+    uint32_t mask;
+  };
+
+  /*! a top-level BVH over instances of 8-wide bottom-level BVHs.
+      Those are not owned, and have to stay where they are; moving
+      instances only takes setting their transforms and calling
+      buildTLAS() again, and none of the bottom-level BVHs change */
+  struct TwoLevelBVH8 {
+    inline bool empty() const { return tlas.empty(); }
+
+    std::vector<const BVH8 *> blas;
+    std::vector<BVHInstance>  instances;
+
+    /*! @{ what buildTLAS() makes of the instances: their inverse
+        transforms, a binary BVH over their world bounds with one
+        instance per leaf, and the same collapsed to 8 wide - whose
+        leaves are (LEAF_BIT | instanceID) */
+    std::vector<affine3f> worldToInstance;
+    BVH                   tlasBinary;
+    BVH8                  tlas;
+    /*! @} */
+  };
+
+  /*! (re-)build the top-level BVH over the instances as they are
+      now; the config's maxLeafSize does not matter, every instance
+      gets a leaf of its own */
+  void buildTLAS(TwoLevelBVH8 &bvh,
+                 const BVHBuildConfig &config = BVHBuildConfig());
+
+  /*! intersect() the ray with all instances that 'rayMask' sees;
+      the hit's instanceID is that of the instance hit, and its
+      primID that of the triangle within its bottom-level BVH */
+  bool intersect(const TwoLevelBVH8 &bvh, BVHRay &ray, BVHHit &hit,
+                 uint32_t rayMask = ~0u);
+
+  /*! whether the ray hits any triangle of any instance that
+      'rayMask' sees within (tmin,tmax) */
+  bool occluded(const TwoLevelBVH8 &bvh, const BVHRay &ray,
+                uint32_t rayMask = ~0u);
+
+}
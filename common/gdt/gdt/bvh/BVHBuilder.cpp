@@ -0,0 +1,385 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "BVH.h"
+//std
+#include <atomic>
+
+namespace gdt {
+
+  /*! ranges of at least that many primitives get binned (and their
+      bounds get computed) on all threads, in blocks of BLOCK_SIZE -
+      as long as there are not already enough subtrees being built in
+      parallel to keep all threads busy */
+  enum { PARALLEL_BINNING_THRESHOLD = 256*1024, BLOCK_SIZE = 64*1024 };
+
+  /*! below this depth, ranges get split by SAH; beyond it, in the
+      middle - so that no input, however degenerate, can make for an
+      arbitrarily deep tree */
+  enum { MAX_SAH_DEPTH = 64 };
+
+  /*! upper limit for BVHBuildConfig::numBins */
+  enum { MAX_BINS = 64 };
+
+  /*! smallest depth at which a (balanced) binary tree has at least
+      'n' nodes */
+  static inline int depthFor(int n)
+  {
+    int depth = 0;
+    while ((1<<depth) < n) depth++;
+    return depth;
+  }
+
+  static inline vec3f centroid(const BVHPrimRef &prim)
+  { return .5f*(prim.bounds.lower+prim.bounds.upper); }
+
+  /*! bounds of a range of primitives, and of their centroids */
+  struct RangeBounds {
+    void extend(const BVHPrimRef &prim)
+    { bounds.extend(prim.bounds); centBounds.extend(centroid(prim)); }
+    void extend(const RangeBounds &other)
+    { bounds.extend(other.bounds); centBounds.extend(other.centBounds); }
+
+    box3f bounds;
+    box3f centBounds;
+  };
+
+  /*! one bin of one axis: the bounds of all primitives whose
+      centroids fall into it, and their number. Bins live in arrays
+      on the stack that are much larger than most nodes need, so
+      they do not initialize themselves - see clear() */
+  struct Bin {
+    inline void clear()
+    {
+      lower = centLower = vec3f(+INFINITY);
+      upper = centUpper = vec3f(-INFINITY);
+      count = 0;
+    }
+    inline void extend(const BVHPrimRef &prim, const vec3f &c)
+    {
+      lower = min(lower,prim.bounds.lower); upper = max(upper,prim.bounds.upper);
+      centLower = min(centLower,c); centUpper = max(centUpper,c);
+      count++;
+    }
+    inline void extend(const Bin &other)
+    {
+      lower = min(lower,other.lower); upper = max(upper,other.upper);
+      centLower = min(centLower,other.centLower);
+      centUpper = max(centUpper,other.centUpper);
+      count += other.count;
+    }
+    inline box3f bounds() const { return box3f(lower,upper); }
+    inline RangeBounds rangeBounds() const
+    {
+      RangeBounds result;
+      result.bounds     = box3f(lower,upper);
+      result.centBounds = box3f(centLower,centUpper);
+      return result;
+    }
+
+    vec3f  lower, upper, centLower, centUpper;
+    size_t count;
+  };
+
+  /*! maps centroids to bins - the same way for binning and for
+      partitioning, so both always agree on which side of a split a
+      primitive goes */
+  struct BinMapping {
+    BinMapping(const box3f &centBounds, int numBins)
+      : lower(centBounds.lower), numBins(numBins)
+    {
+      const vec3f extent = centBounds.span();
+      for (int dim=0;dim<3;dim++)
+        scale[dim]
+          = extent[dim] > 0.f
+          ? .99999f*numBins/extent[dim]
+          : 0.f;
+    }
+
+    inline int bin(const vec3f &c, int dim) const
+    {
+      const int b = int((c[dim]-lower[dim])*scale[dim]);
+      return std::min(std::max(b,0),numBins-1);
+    }
+
+    vec3f lower, scale;
+    int   numBins;
+  };
+
+  struct BVHBuilder {
+    BVHBuilder(BVH &bvh,
+               std::vector<BVHPrimRef> &prims,
+               const BVHBuildConfig &config)
+      : bvh(bvh), prims(prims), config(config),
+        numBins(std::min(std::max(config.numBins,2),(int)MAX_BINS)),
+        maxLeafSize(std::max(config.maxLeafSize,1)),
+        // make for about eight tasks per thread, but do not bother
+        // for small ranges
+        parallelThreshold(std::max((size_t)4096,
+                                   prims.size()/(8*getNumThreads()))),
+        // beyond that depth, the parallel recursion keeps all threads
+        // busy without binning in parallel, too
+        parallelBinningDepth(depthFor(getNumThreads()))
+    {}
+
+    void build()
+    {
+      bvh.nodes.clear();
+      bvh.primIDs.clear();
+      if (prims.empty()) return;
+
+      // a binary tree with N leaves has 2N-1 nodes
+      bvh.nodes.resize(2*prims.size());
+      numNodes = 1;
+      const RangeBounds root = computeBounds(0,prims.size());
+      bvh.nodes[0].bounds = root.bounds;
+      build(0,0,prims.size(),root.centBounds,0);
+      bvh.nodes.resize(numNodes);
+      bvh.nodes.shrink_to_fit();
+
+      bvh.primIDs.resize(prims.size());
+      parallel_for_blocked(prims.size(),BLOCK_SIZE,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++)
+            bvh.primIDs[i] = prims[i].primID;
+        });
+    }
+
+    RangeBounds computeBounds(size_t begin, size_t end,
+                              bool parallel=true) const
+    {
+      RangeBounds result;
+      if (!parallel || end-begin < PARALLEL_BINNING_THRESHOLD) {
+        for (size_t i=begin;i<end;i++)
+          result.extend(prims[i]);
+        return result;
+      }
+      std::vector<RangeBounds> blockBounds(divRoundUp((uint64_t)(end-begin),
+                                                      (uint64_t)BLOCK_SIZE));
+      parallel_for_blocked(end-begin,BLOCK_SIZE,[&](size_t blockBegin, size_t blockEnd){
+          RangeBounds &block = blockBounds[blockBegin/BLOCK_SIZE];
+          for (size_t i=begin+blockBegin;i<begin+blockEnd;i++)
+            block.extend(prims[i]);
+        });
+      for (auto &block : blockBounds)
+        result.extend(block);
+      return result;
+    }
+
+    /*! bin [begin,end) into bins[dim*mapping.numBins+binID] */
+    void binRange(Bin *bins, const BinMapping &mapping,
+                  size_t begin, size_t end) const
+    {
+      for (int i=0;i<3*mapping.numBins;i++)
+        bins[i].clear();
+      for (size_t i=begin;i<end;i++) {
+        const BVHPrimRef &prim = prims[i];
+        const vec3f c = centroid(prim);
+        for (int dim=0;dim<3;dim++)
+          bins[dim*mapping.numBins+mapping.bin(c,dim)].extend(prim,c);
+      }
+    }
+
+    /*! bin [begin,end) into 'bins' (3*mapping.numBins of them) */
+    void computeBins(Bin *bins, const BinMapping &mapping,
+                     size_t begin, size_t end, bool parallel) const
+    {
+      if (!parallel || end-begin < PARALLEL_BINNING_THRESHOLD)
+        return binRange(bins,mapping,begin,end);
+
+      const int    binsPerBlock = 3*mapping.numBins;
+      const size_t numBlocks
+        = divRoundUp((uint64_t)(end-begin),(uint64_t)BLOCK_SIZE);
+      std::vector<Bin> blockBins(numBlocks*binsPerBlock);
+      parallel_for_blocked(end-begin,BLOCK_SIZE,[&](size_t blockBegin, size_t blockEnd){
+          binRange(&blockBins[(blockBegin/BLOCK_SIZE)*binsPerBlock],mapping,
+                   begin+blockBegin,begin+blockEnd);
+        });
+      for (int i=0;i<binsPerBlock;i++) {
+        bins[i].clear();
+        for (size_t block=0;block<numBlocks;block++)
+          bins[i].extend(blockBins[block*binsPerBlock+i]);
+      }
+    }
+
+    /*! the best split of a range of primitives: all whose centroids
+        fall into bins [0,bin) along axis 'dim' go to the left */
+    struct Split {
+      int         dim  { -1 };
+      int         bin  { -1 };
+      /*! sum over both sides of their area times their number of
+          primitives - not normalized by the node's area, as that
+          might well be zero */
+      float       cost { INFINITY };
+      RangeBounds left, right;
+    };
+
+    Split findSplit(const BinMapping &mapping, size_t begin, size_t end,
+                    bool parallel) const
+    {
+      Bin bins[3*MAX_BINS];
+      computeBins(bins,mapping,begin,end,parallel);
+
+      const int numBins = mapping.numBins;
+      Split best;
+      float rightCost[MAX_BINS];
+      for (int dim=0;dim<3;dim++) {
+        const Bin *dimBins = &bins[dim*numBins];
+        box3f  right;
+        size_t numRight = 0;
+        for (int i=numBins-1;i>0;--i) {
+          right.extend(dimBins[i].bounds());
+          numRight += dimBins[i].count;
+          rightCost[i] = numRight ? area(right)*numRight : 0.f;
+        }
+        box3f  left;
+        size_t numLeft = 0;
+        for (int i=1;i<numBins;i++) {
+          left.extend(dimBins[i-1].bounds());
+          numLeft += dimBins[i-1].count;
+          if (numLeft == 0 || numLeft == end-begin) continue;
+          const float cost = area(left)*numLeft + rightCost[i];
+          if (cost < best.cost) {
+            best.cost = cost;
+            best.dim  = dim;
+            best.bin  = i;
+          }
+        }
+      }
+
+      if (best.dim >= 0)
+        for (int i=0;i<numBins;i++)
+          (i < best.bin ? best.left : best.right)
+            .extend(bins[best.dim*numBins+i].rangeBounds());
+      return best;
+    }
+
+    void makeLeaf(size_t nodeID, size_t begin, size_t end)
+    {
+      bvh.nodes[nodeID].offset = (uint32_t)begin;
+      bvh.nodes[nodeID].count  = (uint32_t)(end-begin);
+    }
+
+    /*! build the subtree over prims [begin,end) into node 'nodeID',
+        whose bounds have already been set */
+    void build(size_t nodeID, size_t begin, size_t end,
+               const box3f &centBounds, int depth)
+    {
+      const size_t numPrims = end-begin;
+      if (numPrims == 1)
+        return makeLeaf(nodeID,begin,end);
+
+      // small ranges do not need that many bins
+      const BinMapping mapping(centBounds,
+                               std::min(numBins,4+int(numPrims/4)));
+      const bool parallelBinning = depth < parallelBinningDepth;
+      Split split;
+      if (depth < MAX_SAH_DEPTH && reduce_max(centBounds.span()) > 0.f)
+        split = findSplit(mapping,begin,end,parallelBinning);
+
+      const float nodeArea = area(bvh.nodes[nodeID].bounds);
+      const float leafCost = config.intersectionCost*numPrims*nodeArea;
+      const float splitCost
+        = config.traversalCost*nodeArea
+        + config.intersectionCost*split.cost;
+      if (numPrims <= (size_t)maxLeafSize
+          && (split.dim < 0 || leafCost <= splitCost))
+        return makeLeaf(nodeID,begin,end);
+
+      size_t mid;
+      if (split.dim >= 0) {
+        mid = std::partition(prims.begin()+begin,prims.begin()+end,
+                             [&](const BVHPrimRef &prim){
+                               return mapping.bin(centroid(prim),split.dim) < split.bin;
+                             }) - prims.begin();
+      } else {
+        // all centroids in the same place (or too deep down): any
+        // split is as good as any other
+        mid = begin+numPrims/2;
+        split.left  = computeBounds(begin,mid,parallelBinning);
+        split.right = computeBounds(mid,end,parallelBinning);
+      }
+      const RangeBounds &leftBounds  = split.left;
+      const RangeBounds &rightBounds = split.right;
+
+      const size_t childID = numNodes.fetch_add(2);
+      bvh.nodes[nodeID].offset = (uint32_t)childID;
+      bvh.nodes[nodeID].count  = 0;
+      bvh.nodes[childID+0].bounds = leftBounds.bounds;
+      bvh.nodes[childID+1].bounds = rightBounds.bounds;
+
+      if (numPrims >= parallelThreshold)
+        parallel_for(2,[&](size_t side){
+            if (side == 0)
+              build(childID+0,begin,mid,leftBounds.centBounds,depth+1);
+            else
+              build(childID+1,mid,end,rightBounds.centBounds,depth+1);
+          });
+      else {
+        build(childID+0,begin,mid,leftBounds.centBounds,depth+1);
+        build(childID+1,mid,end,rightBounds.centBounds,depth+1);
+      }
+    }
+
+    BVH                     &bvh;
+    std::vector<BVHPrimRef> &prims;
+    const BVHBuildConfig     config;
+    const int                numBins;
+    const int                maxLeafSize;
+    const size_t             parallelThreshold;
+    const int                parallelBinningDepth;
+    std::atomic<size_t>      numNodes;
+  };
+
+  void buildBVH(BVH &bvh,
+                std::vector<BVHPrimRef> &prims,
+                const BVHBuildConfig &config)
+  {
+    BVHBuilder(bvh,prims,config).build();
+  }
+
+  void buildTriangleBVH(BVH &bvh,
+                        const vec3f *vertex,
+                        const vec3i *index,
+                        size_t numTriangles,
+                        const BVHBuildConfig &config)
+  {
+    buildBVH(bvh,numTriangles,[&](size_t primID){
+        const vec3i &tri = index[primID];
+        return box3f(vertex[tri.x])
+          .including(vertex[tri.y])
+          .including(vertex[tri.z]);
+      },config);
+  }
+
+  float computeSAHCost(const BVH &bvh, const BVHBuildConfig &config)
+  {
+    if (bvh.empty()) return 0.f;
+    const double rootArea = area(bvh.bounds());
+    if (!(rootArea > 0.))
+      // all primitives in the same point (or line): no ray can hit
+      // any node but by chance
+      return 0.f;
+
+    double cost = 0.;
+    for (auto &node : bvh.nodes)
+      cost += area(node.bounds)
+        * (node.isLeaf()
+           ? config.intersectionCost*node.count
+           : config.traversalCost);
+    return float(cost/rootArea);
+  }
+
+}
@@ -22,15 +22,48 @@
 
 namespace gdt {
 
-  /*! a n-bit fixed-point float in the [0..1] region */
+  /*! a n-bit fixed-point float in the [0..1] region (or, if signed,
+      in the [-1..+1] region, with the most negative value being
+      clamped to -1, the way GPUs treat snorm's) */
   template<typename storageT, int Nbits, int is_signed>
   struct FixedPoint {
-    FixedPoint();
+    /*! the (integer) value that represents 1.f */
+    static inline __both__ float one()
+    { return float(is_signed ? (1ULL << (Nbits-1))-1 : (1ULL << Nbits)-1); }
 
-    float operator float() const {
-      return bits / float((1ULL << Nbits)-1);
+    inline __both__ FixedPoint() = default;
+
+    /*! quantize given float (which gets clamped to the representable
+        range), rounding to nearest */
+    explicit inline __both__ FixedPoint(float f)
+    {
+      const float lo = is_signed ? -1.f : 0.f;
+      f = f < lo ? lo : (f > 1.f ? 1.f : f);
+      const float scaled = f*one();
+      bits = storageT(scaled < 0.f ? scaled-.5f : scaled+.5f);
+    }
+
+    inline __both__ operator float() const
+    {
+      const float f = bits / one();
+      return (is_signed && f < -1.f) ? -1.f : f;
     }
+
     storageT bits;
   };
+
+  using unorm8  = FixedPoint<uint8_t, 8, 0>;
+  using unorm16 = FixedPoint<uint16_t,16,0>;
+  using snorm8  = FixedPoint<int8_t,  8, 1>;
+  using snorm16 = FixedPoint<int16_t, 16,1>;
+
+  template<typename storageT, int Nbits, int is_signed>
+  inline std::ostream &operator<<(std::ostream &o,
+                                  const FixedPoint<storageT,Nbits,is_signed> &f)
+  {
+#ifndef __CUDACC__
+    o << float(f);
+#endif
+    return o;
+  }
 }
- 
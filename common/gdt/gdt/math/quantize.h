@@ -0,0 +1,185 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/math/fixedpoint.h"
+#include "gdt/math/box.h"
+
+/*! compact (quantized) encodings of the usual vertex attributes, all
+    of which can be decoded on both host and device */
+namespace gdt {
+
+  /*! @{ bit casts between floats and their IEEE representation */
+  inline __both__ uint32_t floatAsBits(float f)
+  { union { float f; uint32_t u; } v; v.f = f; return v.u; }
+  inline __both__ float bitsAsFloat(uint32_t u)
+  { union { float f; uint32_t u; } v; v.u = u; return v.f; }
+  /*! @} */
+
+  /*! a IEEE 754 half-precision float - storage only, all arithmetic
+      has to be done on floats. Conversion from float rounds to
+      nearest even, and handles denormals, infinities, and NaNs */
+  struct half {
+    inline __both__ half() = default;
+
+    explicit inline __both__ half(float f)
+    {
+      uint32_t x = floatAsBits(f);
+      const uint32_t sign = x & 0x80000000u;
+      x ^= sign;
+      uint32_t h;
+      if (x >= 0x47800000u)
+        // too large for a half (or inf/nan)
+        h = x > 0x7f800000u ? 0x7e00 : 0x7c00;
+      else if (x < 0x38800000u)
+        // denormal (or zero) as a half: let the float adder do the
+        // rounding, by adding 0.5f
+        h = floatAsBits(bitsAsFloat(x)+bitsAsFloat(126u << 23)) - (126u << 23);
+      else {
+        const uint32_t mantissaOdd = (x >> 13) & 1;
+        x += (uint32_t(15-127) << 23) + 0xfff;
+        x += mantissaOdd;
+        h = x >> 13;
+      }
+      bits = uint16_t(h | (sign >> 16));
+    }
+
+    inline __both__ operator float() const
+    {
+      const uint32_t magicDenormal = 113u << 23;
+      uint32_t o = uint32_t(bits & 0x7fff) << 13;
+      const uint32_t exponent = o & (0x7c00u << 13);
+      o += uint32_t(127-15) << 23;
+      if (exponent == (0x7c00u << 13))
+        // inf/nan
+        o += uint32_t(128-16) << 23;
+      else if (exponent == 0)
+        // zero/denormal
+        o = floatAsBits(bitsAsFloat(o + (1u << 23)) - bitsAsFloat(magicDenormal));
+      return bitsAsFloat(o | (uint32_t(bits & 0x8000) << 16));
+    }
+
+    uint16_t bits;
+  };
+
+  /*! a unit vector in 2x16 bits, stored as the (signed, 16-bit fixed
+      point) coordinates of its projection onto the octahedron,
+      unfolded into the [-1,1]^2 square. Max angular error is about
+      0.004 degrees */
+  struct octNormal16 {
+    inline __both__ octNormal16() = default;
+
+    /*! encode given (not necessarily normalized, but non-zero)
+        vector */
+    explicit inline __both__ octNormal16(const vec3f &n)
+    {
+      const float l1 = fabsf(n.x)+fabsf(n.y)+fabsf(n.z);
+      float px = n.x/l1, py = n.y/l1;
+      if (n.z < 0.f) {
+        const float ox = px;
+        px = copysignf(1.f-fabsf(py),ox);
+        py = copysignf(1.f-fabsf(ox),py);
+      }
+      x = snorm16(px);
+      y = snorm16(py);
+    }
+
+    /*! decode to a normalized vector */
+    inline __both__ operator vec3f() const
+    {
+      // (branch-free: the signs of random normals are anything but
+      // predictable)
+      vec3f n(float(x),float(y),0.f);
+      n.z = 1.f-fabsf(n.x)-fabsf(n.y);
+      const float t = fmaxf(-n.z,0.f);
+      n.x -= copysignf(t,n.x);
+      n.y -= copysignf(t,n.y);
+      return normalize(n);
+    }
+
+    snorm16 x, y;
+  };
+
+  /*! a texture coordinate in 2x16 bits: either as two 16-bit unorms
+      (exact to 1/65535, but only for coordinates in [0,1]) or as two
+      halfs (any range, but less precise the farther it is from 0);
+      which of the two is used is up to whoever stores them */
+  struct texcoord16 {
+    inline __both__ texcoord16() = default;
+
+    inline __both__ texcoord16(const vec2f &tc, bool asHalf)
+    {
+      if (asHalf) {
+        bits[0] = half(tc.x).bits;
+        bits[1] = half(tc.y).bits;
+      } else {
+        bits[0] = unorm16(tc.x).bits;
+        bits[1] = unorm16(tc.y).bits;
+      }
+    }
+
+    inline __both__ vec2f decode(bool asHalf) const
+    {
+      if (asHalf) {
+        half hx, hy;
+        hx.bits = bits[0];
+        hy.bits = bits[1];
+        return vec2f(float(hx),float(hy));
+      }
+      unorm16 ux, uy;
+      ux.bits = bits[0];
+      uy.bits = bits[1];
+      return vec2f(float(ux),float(uy));
+    }
+
+    uint16_t bits[2];
+  };
+
+  /*! maps positions inside a given box to three 16-bit unorms (and
+      back); max error per axis is 1/131070th of the box's extent in
+      that axis */
+  struct PositionQuantizer {
+    inline __both__ PositionQuantizer() = default;
+
+    inline __both__ PositionQuantizer(const box3f &bounds)
+      : origin(bounds.lower),
+        scale((bounds.upper-bounds.lower)*(1.f/65535.f))
+    {}
+
+    inline __both__ vec3us encode(const vec3f &p) const
+    {
+      const vec3f rel = p-origin;
+      return vec3us(encodeAxis(rel.x,scale.x),
+                    encodeAxis(rel.y,scale.y),
+                    encodeAxis(rel.z,scale.z));
+    }
+
+    inline __both__ vec3f decode(const vec3us &q) const
+    { return origin + vec3f(q)*scale; }
+
+    static inline __both__ uint16_t encodeAxis(float rel, float scale)
+    {
+      if (!(scale > 0.f)) return 0;
+      const float q = rel/scale;
+      return uint16_t(q < 0.f ? 0.f : (q > 65535.f ? 65535.f : q+.5f));
+    }
+
+    vec3f origin;
+    vec3f scale;
+  };
+
+}
@@ -0,0 +1,87 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/math/box.h"
+#include "gdt/parallel/parallel_for.h"
+#if defined(__SSE__) || defined(_M_X64)
+# include <xmmintrin.h>
+# define GDT_BOUNDS_SSE 1
+#endif
+
+namespace gdt {
+
+  /*! bounding box of 'numPoints' points, on the calling thread. With
+      SSE, four points (twelve floats, ie, three registers) get
+      processed per iteration; since twelve is a multiple of both
+      three and four, every register lane always sees the same
+      coordinate, and lanes only get sorted out once at the end */
+  inline box3f computeBounds_serial(const vec3f *point, size_t numPoints)
+  {
+    box3f bounds;
+    size_t i = 0;
+#if GDT_BOUNDS_SSE
+    static_assert(sizeof(vec3f) == 3*sizeof(float),
+                  "computeBounds expects tightly packed vec3f's");
+    if (numPoints >= 4) {
+      const float *f = (const float *)point;
+      __m128 lo0 = _mm_loadu_ps(f+0), hi0 = lo0; // x y z x
+      __m128 lo1 = _mm_loadu_ps(f+4), hi1 = lo1; // y z x y
+      __m128 lo2 = _mm_loadu_ps(f+8), hi2 = lo2; // z x y z
+      for (i=4;i+4<=numPoints;i+=4) {
+        const __m128 v0 = _mm_loadu_ps(f+3*i+0);
+        const __m128 v1 = _mm_loadu_ps(f+3*i+4);
+        const __m128 v2 = _mm_loadu_ps(f+3*i+8);
+        lo0 = _mm_min_ps(lo0,v0); hi0 = _mm_max_ps(hi0,v0);
+        lo1 = _mm_min_ps(lo1,v1); hi1 = _mm_max_ps(hi1,v1);
+        lo2 = _mm_min_ps(lo2,v2); hi2 = _mm_max_ps(hi2,v2);
+      }
+      float lo[12], hi[12];
+      _mm_storeu_ps(lo+0,lo0); _mm_storeu_ps(hi+0,hi0);
+      _mm_storeu_ps(lo+4,lo1); _mm_storeu_ps(hi+4,hi1);
+      _mm_storeu_ps(lo+8,lo2); _mm_storeu_ps(hi+8,hi2);
+      for (int k=0;k<4;k++)
+        bounds.extend(box3f(vec3f(lo[3*k+0],lo[3*k+1],lo[3*k+2]),
+                            vec3f(hi[3*k+0],hi[3*k+1],hi[3*k+2])));
+    }
+#endif
+    for (;i<numPoints;i++)
+      bounds.extend(point[i]);
+    return bounds;
+  }
+
+  /*! bounding box of 'numPoints' points, with blocks of points being
+      reduced on all threads, and the per-block boxes merged at the
+      end */
+  inline box3f computeBounds(const vec3f *point, size_t numPoints)
+  {
+    const size_t blockSize = 64*1024;
+    if (numPoints <= blockSize)
+      return computeBounds_serial(point,numPoints);
+
+    const size_t numBlocks = divRoundUp((uint64_t)numPoints,(uint64_t)blockSize);
+    std::vector<box3f> blockBounds(numBlocks);
+    parallel_for_blocked(numPoints,blockSize,[&](size_t begin, size_t end){
+        blockBounds[begin/blockSize] = computeBounds_serial(point+begin,end-begin);
+      });
+    box3f bounds;
+    for (auto &block : blockBounds)
+      bounds.extend(block);
+    return bounds;
+  }
+
+}
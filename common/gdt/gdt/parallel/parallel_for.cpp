@@ -0,0 +1,156 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "parallel_for.h"
+//std
+#include <condition_variable>
+#include <deque>
+
+namespace gdt {
+  namespace detail {
+
+    /*! one parallel_for's worth of jobs; lives on the stack of the
+        thread that called parallel_for */
+    struct ParallelJob {
+      size_t              numJobs;
+      void              (*run)(const void *task, size_t jobID);
+      const void         *task;
+      std::atomic<size_t> nextJob { 0 };
+      /*! number of threads (other than the caller) currently
+          running jobs of this; guarded by the pool's mutex */
+      int                 numHelpers { 0 };
+      std::exception_ptr  firstError;
+      std::mutex          errorMutex;
+
+      bool allHandedOut() const { return nextJob >= numJobs; }
+
+      /*! run jobs until there are no more to hand out */
+      void runJobs()
+      {
+        while (true) {
+          const size_t jobID = nextJob++;
+          if (jobID >= numJobs) return;
+          try {
+            run(task,jobID);
+          } catch (...) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!firstError) firstError = std::current_exception();
+            nextJob = numJobs;
+          }
+        }
+      }
+    };
+
+    /*! the getNumThreads()-1 worker threads shared by all
+        parallel_for's, and the parallel_for's that still have jobs
+        to hand out */
+    struct ThreadPool {
+      ThreadPool()
+      {
+        for (int i=1;i<getNumThreads();i++)
+          workers.push_back(std::thread([this](){ workerLoop(); }));
+      }
+      
+      ~ThreadPool()
+      {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          shutDown = true;
+        }
+        changed.notify_all();
+        for (auto &worker : workers)
+          worker.join();
+      }
+
+      /*! (with the lock held) first pending parallel_for that still
+          has jobs to hand out, dropping those that do not */
+      ParallelJob *pendingJob()
+      {
+        while (!pending.empty() && pending.front()->allHandedOut())
+          pending.pop_front();
+        return pending.empty() ? nullptr : pending.front();
+      }
+
+      /*! (with the lock held) help with 'job' for a while */
+      void help(ParallelJob *job, std::unique_lock<std::mutex> &lock)
+      {
+        job->numHelpers++;
+        lock.unlock();
+        job->runJobs();
+        lock.lock();
+        // whoever waits for that job may be done now
+        if (--job->numHelpers == 0)
+          changed.notify_all();
+      }
+      
+      void workerLoop()
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!shutDown) {
+          if (ParallelJob *job = pendingJob())
+            help(job,lock);
+          else
+            changed.wait(lock);
+        }
+      }
+
+      void run(ParallelJob &job)
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        pending.push_back(&job);
+        changed.notify_all();
+        lock.unlock();
+
+        job.runJobs();
+
+        // the last of our jobs may still be running on other threads;
+        // rather than idling until they are done, help with others
+        // (say, the parallel_for's nested in those jobs)
+        lock.lock();
+        for (auto it=pending.begin();it!=pending.end();++it)
+          if (*it == &job) { pending.erase(it); break; }
+        while (job.numHelpers > 0) {
+          if (ParallelJob *other = pendingJob())
+            help(other,lock);
+          else
+            changed.wait(lock);
+        }
+      }
+
+      std::vector<std::thread>  workers;
+      std::deque<ParallelJob *> pending;
+      std::mutex                mutex;
+      std::condition_variable   changed;
+      bool                      shutDown { false };
+    };
+    
+    void parallel_for(size_t numJobs,
+                      void (*run)(const void *task, size_t jobID),
+                      const void *task)
+    {
+      static ThreadPool pool;
+      ParallelJob job;
+      job.numJobs = numJobs;
+      job.run     = run;
+      job.task    = task;
+      pool.run(job);
+      if (job.firstError)
+        std::rethrow_exception(job.firstError);
+    }
+    
+  } // ::gdt::detail
+} // ::gdt
@@ -0,0 +1,82 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/gdt.h"
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gdt {
+
+  /*! number of threads that parallel_for will use */
+  inline int getNumThreads()
+  {
+    const int numThreads = (int)std::thread::hardware_concurrency();
+    return numThreads > 0 ? numThreads : 1;
+  }
+
+  namespace detail {
+    /*! the type-erased part of parallel_for: calls 'run(task,jobID)'
+        for every jobID in [0..numJobs), on the calling thread and on
+        gdt's shared worker threads */
+    void parallel_for(size_t numJobs,
+                      void (*run)(const void *task, size_t jobID),
+                      const void *task);
+  }
+  
+  /*! simple, dependency-free replacement for tbb::parallel_for:
+      calls 'task(jobID)' for every jobID in [0..numJobs), with jobs
+      being handed out to the calling thread and to a pool of
+      getNumThreads()-1 worker threads that is shared by all
+      parallel_for's - so nested parallel_for's (say, per-file loaders
+      that are parallel themselves) do not multiply the number of
+      threads; a thread waiting for its own jobs to finish helps with
+      whatever other jobs are pending. The first exception thrown by
+      any job gets re-thrown to the caller once all jobs are done. */
+  template<typename TaskT>
+  inline void parallel_for(size_t numJobs, const TaskT &task)
+  {
+    if (numJobs <= 1 || getNumThreads() <= 1) {
+      for (size_t jobID=0;jobID<numJobs;jobID++)
+        task(jobID);
+      return;
+    }
+    detail::parallel_for(numJobs,
+                         [](const void *task, size_t jobID)
+                         { (*(const TaskT *)task)(jobID); },
+                         &task);
+  }
+
+  /*! same as parallel_for, but hands out jobs in blocks of (at most)
+      'blockSize' consecutive IDs, calling 'task(begin,end)' once per
+      block - useful when individual jobs are too cheap to be
+      scheduled one by one */
+  template<typename TaskT>
+  inline void parallel_for_blocked(size_t numJobs, size_t blockSize,
+                                   const TaskT &task)
+  {
+    const size_t numBlocks = divRoundUp((uint64_t)numJobs,(uint64_t)blockSize);
+    parallel_for(numBlocks,[&](size_t blockID){
+        const size_t begin = blockID*blockSize;
+        const size_t end   = std::min(begin+blockSize,numJobs);
+        task(begin,end);
+      });
+  }
+}
@@ -22,28 +22,91 @@
 #include "3rdParty/stb_image.h"
 
 //std
-#include <set>
-
-namespace tinyobj {
-  inline bool operator<(const tinyobj::index_t &a,
-                        const tinyobj::index_t &b)
-  {
-    if (a.vertex_index < b.vertex_index) return true;
-    if (a.vertex_index > b.vertex_index) return false;
-    
-    if (a.normal_index < b.normal_index) return true;
-    if (a.normal_index > b.normal_index) return false;
-    
-    if (a.texcoord_index < b.texcoord_index) return true;
-    if (a.texcoord_index > b.texcoord_index) return false;
-    
-    return false;
-  }
-}
+#include <algorithm>
 
 /*! \namespace osc - Optix Siggraph Course */
 namespace osc {
   
+  /*! open-addressing hash table that maps a tinyobj (vertex,normal,
+      texcoord) index triple to the ID that vertex got in the mesh
+      we're currently building. Slots are tagged with a 'generation'
+      counter, so clear() is O(1) and the same table (and its
+      allocated memory) gets re-used across all meshes of a model */
+  struct KnownVertices {
+    struct Slot {
+      tinyobj::index_t key;
+      int              value;
+      uint32_t         generation;
+    };
+
+    KnownVertices() { slots.resize(1024); }
+
+    /*! forget all known vertices, but keep the memory */
+    void clear()
+    {
+      numUsed = 0;
+      if (++generation == 0) {
+        for (auto &slot : slots) slot.generation = 0;
+        generation = 1;
+      }
+    }
+
+    /*! return reference to the value stored for given key; if the
+        key was not yet known it gets inserted with a value of -1 */
+    int &findOrInsert(const tinyobj::index_t &idx)
+    {
+      if (2*(numUsed+1) > slots.size())
+        grow();
+      Slot *slot = lookup(idx);
+      if (slot->generation != generation) {
+        slot->key        = idx;
+        slot->value      = -1;
+        slot->generation = generation;
+        numUsed++;
+      }
+      return slot->value;
+    }
+
+  private:
+    static inline size_t hash(const tinyobj::index_t &idx)
+    {
+      uint64_t h
+        = uint64_t(uint32_t(idx.vertex_index))
+        | (uint64_t(uint32_t(idx.normal_index)) << 32);
+      h ^= uint64_t(uint32_t(idx.texcoord_index)) * 0xc2b2ae3d27d4eb4fULL;
+      h *= 0x9e3779b97f4a7c15ULL;
+      return size_t(h ^ (h >> 32));
+    }
+
+    /*! linear probing; returns either the slot holding this key, or
+        the first free one (for the current generation) */
+    inline Slot *lookup(const tinyobj::index_t &idx)
+    {
+      const size_t mask = slots.size()-1;
+      for (size_t i = hash(idx) & mask;; i = (i+1) & mask) {
+        Slot &slot = slots[i];
+        if (slot.generation != generation)
+          return &slot;
+        if (slot.key.vertex_index   == idx.vertex_index &&
+            slot.key.normal_index   == idx.normal_index &&
+            slot.key.texcoord_index == idx.texcoord_index)
+          return &slot;
+      }
+    }
+
+    void grow()
+    {
+      std::vector<Slot> oldSlots(2*slots.size());
+      oldSlots.swap(slots);
+      for (auto &old : oldSlots)
+        if (old.generation == generation)
+          *lookup(old.key) = old;
+    }
+
+    std::vector<Slot> slots;
+    size_t            numUsed    { 0 };
+    uint32_t          generation { 1 };
+  };
 
 
   /*! find vertex with given position, normal, texcoord, and return
@@ -52,17 +115,18 @@ namespace osc {
   int addVertex(TriangleMesh *mesh,
                 tinyobj::attrib_t &attributes,
                 const tinyobj::index_t &idx,
-                std::map<tinyobj::index_t,int> &knownVertices)
+                KnownVertices &knownVertices)
   {
-    if (knownVertices.find(idx) != knownVertices.end())
-      return knownVertices[idx];
+    int &knownID = knownVertices.findOrInsert(idx);
+    if (knownID >= 0)
+      return knownID;
 
     const vec3f *vertex_array   = (const vec3f*)attributes.vertices.data();
     const vec3f *normal_array   = (const vec3f*)attributes.normals.data();
     const vec2f *texcoord_array = (const vec2f*)attributes.texcoords.data();
     
     int newID = (int)mesh->vertex.size();
-    knownVertices[idx] = newID;
+    knownID = newID;
 
     mesh->vertex.push_back(vertex_array[idx.vertex_index]);
     if (idx.normal_index >= 0) {
@@ -74,12 +138,13 @@ namespace osc {
         mesh->texcoord.push_back(texcoord_array[idx.texcoord_index]);
     }
 
-    // just for sanity's sake:
+    // just for sanity's sake (and so that vertices without a
+    // texcoord or normal, in a mesh whose other vertices have them,
+    // get zeroes rather than whatever was in memory):
     if (mesh->texcoord.size() > 0)
-      mesh->texcoord.resize(mesh->vertex.size());
-    // just for sanity's sake:
+      mesh->texcoord.resize(mesh->vertex.size(),vec2f(0.f));
     if (mesh->normal.size() > 0)
-      mesh->normal.resize(mesh->vertex.size());
+      mesh->normal.resize(mesh->vertex.size(),vec3f(0.f));
     
     return newID;
   }
@@ -120,10 +185,7 @@ namespace osc {
       for (int y=0;y<res.y/2;y++) {
         uint32_t *line_y = texture->pixel + y * res.x;
         uint32_t *mirrored_y = texture->pixel + (res.y-1-y) * res.x;
-        int mirror_y = res.y-1-y;
-        for (int x=0;x<res.x;x++) {
-          std::swap(line_y[x],mirrored_y[x]);
-        }
+        std::swap_ranges(line_y,line_y+res.x,mirrored_y);
       }
       
       model->textures.push_back(texture);
@@ -167,20 +229,62 @@ namespace osc {
 
     std::cout << "Done loading obj file - found " << shapes.size() << " shapes with " << materials.size() << " materials" << std::endl;
     std::map<std::string, int>      knownTextures;
+    const double startTime = getCurrentTime();
+    size_t numTriangles = 0;
+    KnownVertices knownVertices;
+    // per-material face buckets; allocated once, re-used for all shapes
+    std::vector<int> facesInBucket(materials.size()+1,0);
+    std::vector<int> bucketEnd(materials.size()+1);
+    std::vector<int> usedBuckets;
+    std::vector<int> sortedFaces;
     for (int shapeID=0;shapeID<(int)shapes.size();shapeID++) {
       tinyobj::shape_t &shape = shapes[shapeID];
+      const int numFaces = (int)shape.mesh.material_ids.size();
 
-      std::set<int> materialIDs;
-      for (auto faceMatID : shape.mesh.material_ids)
-        materialIDs.insert(faceMatID);
-      
+      // bucket all faces of this shape by material in a single linear
+      // sweep (counting sort), rather than re-scanning all faces once
+      // per material. bucket 0 is for faces without a material (ID -1)
+      usedBuckets.clear();
+      for (int faceID=0;faceID<numFaces;faceID++) {
+        const int bucket = shape.mesh.material_ids[faceID]+1;
+        if (facesInBucket[bucket]++ == 0)
+          usedBuckets.push_back(bucket);
+      }
+      std::sort(usedBuckets.begin(),usedBuckets.end());
+      int numSorted = 0;
+      for (int bucket : usedBuckets) {
+        bucketEnd[bucket] = numSorted;
+        numSorted += facesInBucket[bucket];
+      }
+      sortedFaces.resize(numFaces);
+      for (int faceID=0;faceID<numFaces;faceID++)
+        sortedFaces[bucketEnd[shape.mesh.material_ids[faceID]+1]++] = faceID;
       
-      for (int materialID : materialIDs) {
-        std::map<tinyobj::index_t,int> knownVertices;
+      for (int bucket : usedBuckets) {
+        const int materialID = bucket-1;
+        const int end        = bucketEnd[bucket];
+        const int begin      = end - facesInBucket[bucket];
+        facesInBucket[bucket] = 0;
+        
+        knownVertices.clear();
         TriangleMesh *mesh = new TriangleMesh;
+        mesh->index.reserve(end-begin);
+        // faces without a material (bucket 0) get a light grey, and
+        // no texture
+        mesh->diffuse
+          = materialID < 0
+          ? vec3f(.8f)
+          : (const vec3f&)materials[materialID].diffuse;
+        mesh->diffuseTextureID
+          = materialID < 0
+          ? -1
+          : loadTexture(model,
+                        knownTextures,
+                        materials[materialID].diffuse_texname,
+                        modelDir);
         
-        for (int faceID=0;faceID<shape.mesh.material_ids.size();faceID++) {
-          if (shape.mesh.material_ids[faceID] != materialID) continue;
+        for (int i=begin;i<end;i++) {
+          const int faceID = sortedFaces[i];
           tinyobj::index_t idx0 = shape.mesh.indices[3*faceID+0];
           tinyobj::index_t idx1 = shape.mesh.indices[3*faceID+1];
           tinyobj::index_t idx2 = shape.mesh.indices[3*faceID+2];
@@ -189,13 +293,9 @@ namespace osc {
                     addVertex(mesh, attributes, idx1, knownVertices),
                     addVertex(mesh, attributes, idx2, knownVertices));
           mesh->index.push_back(idx);
-          mesh->diffuse = (const vec3f&)materials[materialID].diffuse;
-          mesh->diffuseTextureID = loadTexture(model,
-                                               knownTextures,
-                                               materials[materialID].diffuse_texname,
-                                               modelDir);
         }
 
+        numTriangles += mesh->index.size();
         if (mesh->vertex.empty())
           delete mesh;
         else
@@ -209,7 +309,11 @@ namespace osc {
       for (auto vtx : mesh->vertex)
         model->bounds.extend(vtx);
 
-    std::cout << "created a total of " << model->meshes.size() << " meshes" << std::endl;
+    const double buildTime = getCurrentTime()-startTime;
+    std::cout << "created a total of " << model->meshes.size() << " meshes"
+              << " with " << numTriangles << " triangles"
+              << " (" << prettyDouble(numTriangles/std::max(buildTime,1e-6))
+              << " triangles/s)" << std::endl;
     return model;
   }
 }
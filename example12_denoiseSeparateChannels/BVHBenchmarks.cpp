@@ -0,0 +1,669 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Benchmarks.h"
+#include "gdt/random/random.h"
+//std
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <stdexcept>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  void benchmarkBVHBuild(const Model *model)
+  {
+    ModelBVH modelBVH;
+    buildModelBVH(modelBVH,model);
+
+    const gdt::BVH &bvh = modelBVH.bvh;
+    const bool instanced = !model->instances.empty();
+    const size_t numTriangles = modelBVH.primBegin.back();
+    std::vector<bool> seen(numTriangles,false);
+    std::vector<uint32_t> stack(1,0);
+    size_t numReached = 0, numLeaves = 0;
+    while (!stack.empty()) {
+      const uint32_t nodeID = stack.back();
+      stack.pop_back();
+      numReached++;
+      const gdt::BVHNode &node = bvh.nodes[nodeID];
+      if (node.isLeaf()) {
+        numLeaves++;
+        if (size_t(node.offset)+node.count > bvh.primIDs.size())
+          throw std::runtime_error("benchmarkBVHBuild: leaf out of range");
+        for (uint32_t i=node.offset;i<node.offset+node.count;i++) {
+          const uint32_t primID = bvh.primIDs[i];
+          if (primID >= numTriangles || seen[primID])
+            throw std::runtime_error("benchmarkBVHBuild: triangle "+std::to_string(primID)
+                                     +" is in more than one leaf");
+          seen[primID] = true;
+          int partID, triangleID;
+          modelBVH.locate(primID,partID,triangleID);
+          const int meshID = instanced ? model->instances[partID].meshID : partID;
+          const TriangleMesh &mesh = *model->meshes[meshID];
+          const vec3i &tri = mesh.index[triangleID];
+          for (int k=0;k<3;k++) {
+            const vec3f v = meshVertex(mesh,tri[k]);
+            if (!node.bounds.contains(instanced ? xfmPoint(model->instances[partID].xfm,v) : v))
+              throw std::runtime_error("benchmarkBVHBuild: triangle "+std::to_string(primID)
+                                       +" sticks out of its leaf");
+          }
+        }
+      } else {
+        if (node.offset <= nodeID || size_t(node.offset)+1 >= bvh.nodes.size())
+          throw std::runtime_error("benchmarkBVHBuild: children out of range");
+        for (uint32_t childID=node.offset;childID<=node.offset+1;childID++) {
+          if (box3f(node.bounds).extend(bvh.nodes[childID].bounds) != node.bounds)
+            throw std::runtime_error("benchmarkBVHBuild: node "+std::to_string(childID)
+                                     +" sticks out of its parent");
+          stack.push_back(childID);
+        }
+      }
+    }
+    if (numReached != bvh.nodes.size())
+      throw std::runtime_error("benchmarkBVHBuild: not all nodes are in the tree");
+    if (std::find(seen.begin(),seen.end(),false) != seen.end())
+      throw std::runtime_error("benchmarkBVHBuild: not all triangles are in the tree");
+    std::cout << "checked host BVH: every triangle in exactly one leaf, and every node"
+              << " inside its parent (" << numLeaves << " leaves, "
+              << double(numTriangles)/numLeaves << " triangles each)" << std::endl;
+  }
+
+  /*! trace 'numRays' rays on all threads, with makeRay(rayID,ray,random)
+      setting up each of them, and trace(rayID,ray) tracing it;
+      returns the number of millions of rays per second */
+  template<typename MakeRayT, typename TraceT>
+  static double traceRays(size_t numRays, const MakeRayT &makeRay, const TraceT &trace)
+  {
+    const size_t blockSize = 4096;
+    const double startTime = getCurrentTime();
+    parallel_for_blocked(numRays,blockSize,[&](size_t begin, size_t end){
+        LCG<16> random((unsigned)(begin/blockSize),0);
+        for (size_t rayID=begin;rayID<end;rayID++) {
+          BVHRay ray;
+          makeRay(rayID,ray,random);
+          trace(rayID,ray);
+        }
+      });
+    return numRays/(getCurrentTime()-startTime)*1e-6;
+  }
+
+  /*! the renderer's pinhole camera (see SampleRenderer::setCamera()),
+      for a frame of given size */
+  struct PinholeCamera {
+    PinholeCamera(const Camera &camera, const vec2i &frameSize)
+      : position(camera.from),
+        direction(normalize(camera.at-camera.from))
+    {
+      const float cosFovy = 0.66f;
+      const float aspect  = float(frameSize.x)/float(frameSize.y);
+      horizontal = cosFovy * aspect * normalize(cross(direction,camera.up));
+      vertical   = cosFovy * normalize(cross(horizontal,direction));
+    }
+
+    /*! the ray through the given point of the screen, in [0,1]^2 */
+    inline void makeRay(const vec2f &screen, BVHRay &ray) const
+    {
+      ray.org  = position;
+      ray.dir  = normalize(direction
+                           + (screen.x - 0.5f) * horizontal
+                           + (screen.y - 0.5f) * vertical);
+      ray.tmin = 0.f;
+      ray.tmax = INFINITY;
+    }
+
+    vec3f position, direction, horizontal, vertical;
+  };
+
+  /*! a camera looking down at the model's bounds from above one of
+      their corners, from far enough away to see all of it */
+  static Camera overviewCamera(const box3f &bounds)
+  {
+    const vec3f at = bounds.center();
+    return { /*from*/at + .8f*length(bounds.span())*normalize(vec3f(-.5f,.7f,-.5f)),
+             /* at */at,
+             /* up */vec3f(0.f,1.f,0.f) };
+  }
+
+  /*! a quad light a tenth the size of the model's bounds, above
+      their center */
+  static QuadLight overheadLight(const box3f &bounds)
+  {
+    const vec3f span = bounds.span();
+    const vec3f center(bounds.center().x,bounds.upper.y+.5f*length(span),bounds.center().z);
+    return { /* origin */ center-vec3f(.05f*span.x,0.f,.05f*span.z),
+             /* edge 1 */ vec3f(.1f*span.x,0.f,0.f),
+             /* edge 2 */ vec3f(0.f,0.f,.1f*span.z),
+             /* power */  vec3f(3000000.f) };
+  }
+
+  /*! trace primary rays for a frame of the given size, shadow rays
+      from all of their hit points to the light's center, and as many
+      random rays through the model's bounds, on all threads of the
+      host; and report how many rays per second each of them got */
+  static void benchmarkModelBVH(const ModelBVH &modelBVH, const Model *model,
+                                const Camera &camera, const QuadLight &light,
+                                const vec2i &frameSize)
+  {
+    const size_t numPixels = size_t(frameSize.x)*frameSize.y;
+
+    // primary rays through the pixel centers
+    const PinholeCamera pinhole(camera,frameSize);
+    std::vector<vec3f> hitPoint(numPixels);
+    std::vector<char>  isHit(numPixels);
+    const double primaryRate = traceRays(numPixels,[&](size_t pixelID, BVHRay &ray, LCG<16> &){
+        pinhole.makeRay(vec2f((pixelID % frameSize.x + .5f)/frameSize.x,
+                              (pixelID / frameSize.x + .5f)/frameSize.y),ray);
+      },[&](size_t pixelID, BVHRay &ray){
+        BVHHit hit;
+        isHit[pixelID] = intersect(modelBVH.bvh8,ray,hit);
+        if (isHit[pixelID])
+          hitPoint[pixelID] = ray.org + hit.t*ray.dir;
+      });
+
+    // shadow rays from those hit points to the light's center
+    std::vector<vec3f> shadowOrigin;
+    for (size_t pixelID=0;pixelID<numPixels;pixelID++)
+      if (isHit[pixelID]) shadowOrigin.push_back(hitPoint[pixelID]);
+    const vec3f lightCenter = light.origin + .5f*(light.du+light.dv);
+    const float epsilon     = 1e-5f*length(model->bounds.span());
+    std::atomic<size_t> numOccluded(0);
+    const double shadowRate = traceRays(shadowOrigin.size(),[&](size_t rayID, BVHRay &ray, LCG<16> &){
+        const vec3f toLight = lightCenter-shadowOrigin[rayID];
+        ray.org  = shadowOrigin[rayID];
+        ray.dir  = normalize(toLight);
+        ray.tmin = epsilon;
+        ray.tmax = length(toLight)-epsilon;
+      },[&](size_t, BVHRay &ray){
+        if (occluded(modelBVH.bvh8,ray))
+          numOccluded++;
+      });
+
+    // random rays: uniformly distributed origins in the model's
+    // bounds, and directions
+    const box3f &bounds = model->bounds;
+    const double randomRate = traceRays(numPixels,[&](size_t, BVHRay &ray, LCG<16> &random){
+        ray.org = bounds.lower + vec3f(random(),random(),random())*bounds.span();
+        const float z   = 1.f-2.f*random();
+        const float r   = sqrtf(std::max(0.f,1.f-z*z));
+        const float phi = 2.f*float(M_PI)*random();
+        ray.dir  = vec3f(r*cosf(phi),r*sinf(phi),z);
+        ray.tmin = 0.f;
+        ray.tmax = INFINITY;
+      },[&](size_t, BVHRay &ray){
+        BVHHit hit;
+        intersect(modelBVH.bvh8,ray,hit);
+      });
+
+    std::cout << "traced host BVH on " << getNumThreads() << " threads: "
+              << numPixels << " primary rays at " << primaryRate << " Mrays/s ("
+              << 100.*shadowOrigin.size()/std::max(numPixels,(size_t)1) << "% hit), "
+              << shadowOrigin.size() << " shadow rays at " << shadowRate << " Mrays/s ("
+              << 100.*numOccluded.load()/std::max(shadowOrigin.size(),(size_t)1) << "% occluded), "
+              << numPixels << " random rays at " << randomRate << " Mrays/s"
+              << std::endl;
+  }
+
+  /*! where along the ray (in multiples of its direction) it hits
+      the triangle, or INFINITY - Moeller-Trumbore, in double
+      precision */
+  static double rayTriangle(const BVHRay &ray, const vec3f &a, const vec3f &b, const vec3f &c)
+  {
+    const vec3d org(ray.org), dir(ray.dir), v0(a);
+    const vec3d e1 = vec3d(b)-v0, e2 = vec3d(c)-v0;
+    const vec3d p  = cross(dir,e2);
+    const double det = dot(e1,p);
+    if (det == 0.) return INFINITY;
+    const vec3d  s = org-v0;
+    const double u = dot(s,p)/det;
+    if (u < 0. || u > 1.) return INFINITY;
+    const vec3d  q = cross(s,e1);
+    const double v = dot(dir,q)/det;
+    if (v < 0. || u+v > 1.) return INFINITY;
+    const double t = dot(e2,q)/det;
+    return t > ray.tmin && t < ray.tmax ? t : INFINITY;
+  }
+
+  /*! trace 'numRays' random rays (like benchmarkModelBVH()'s)
+      through the BVH, and as shadow rays ending before or after
+      their hit; throw unless each finds what testing the ray against
+      every one of the model's triangles finds */
+  static void validateModelBVH(const ModelBVH &modelBVH, const Model *model, int numRays)
+  {
+    // one part per instance, or per mesh - as in the BVH
+    std::vector<MeshInstance> parts = model->instances;
+    const bool instanced = !parts.empty();
+    if (!instanced)
+      for (int meshID=0;meshID<(int)model->meshes.size();meshID++)
+        parts.push_back({ meshID, affine3f(one) });
+
+    const box3f &bounds = model->bounds;
+    const float  tolerance = 1e-4f*length(bounds.span());
+    std::atomic<int> numWrong(0);
+    parallel_for(numRays,[&](size_t rayID){
+        // random rays, like those benchmarkModelBVH() traces
+        LCG<16> random((unsigned)rayID,1);
+        BVHRay ray;
+        ray.org = bounds.lower + vec3f(random(),random(),random())*bounds.span();
+        const float z   = 1.f-2.f*random();
+        const float r   = sqrtf(std::max(0.f,1.f-z*z));
+        const float phi = 2.f*float(M_PI)*random();
+        ray.dir  = vec3f(r*cosf(phi),r*sinf(phi),z);
+        ray.tmin = 0.f;
+        ray.tmax = INFINITY;
+
+        // every triangle of every part, in world space
+        double closest = INFINITY;
+        for (auto &part : parts) {
+          const TriangleMesh &mesh = *model->meshes[part.meshID];
+          for (auto &tri : mesh.index) {
+            vec3f a = meshVertex(mesh,tri.x);
+            vec3f b = meshVertex(mesh,tri.y);
+            vec3f c = meshVertex(mesh,tri.z);
+            if (instanced) {
+              a = xfmPoint(part.xfm,a);
+              b = xfmPoint(part.xfm,b);
+              c = xfmPoint(part.xfm,c);
+            }
+            closest = std::min(closest,rayTriangle(ray,a,b,c));
+          }
+        }
+
+        // shadow ray: as far as half the closest hit, or a bit beyond
+        BVHRay shadowRay = ray;
+        shadowRay.tmax = closest < INFINITY
+          ? float(closest)*((rayID & 1) ? .5f : 1.5f)
+          : .5f*length(bounds.span());
+        BVHHit hit;
+        const bool isHit = intersect(modelBVH.bvh8,ray,hit);
+        if (isHit != (closest < INFINITY)
+            || (isHit && fabs(hit.t-closest) > tolerance)
+            || occluded(modelBVH.bvh8,shadowRay) != (closest < shadowRay.tmax))
+          numWrong++;
+      });
+    if (numWrong > 0)
+      throw std::runtime_error("validateModelBVH: "+std::to_string(numWrong.load())
+                               +" of "+std::to_string(numRays)+" rays got a"
+                               " different hit than from testing all triangles");
+    std::cout << "checked " << numRays << " random rays against all triangles:"
+              << " the host BVH finds the same closest hits and occlusions" << std::endl;
+  }
+
+  void benchmarkBVHTrace(const Model *model)
+  {
+    ModelBVH modelBVH;
+    buildModelBVH(modelBVH,model);
+    validateModelBVH(modelBVH,model,256);
+
+    benchmarkModelBVH(modelBVH,model,overviewCamera(model->bounds),
+                      overheadLight(model->bounds),vec2i(1920,1080));
+  }
+
+  /*! trace 'samplesPerPixel' jittered primary rays per pixel for a
+      frame of the given size, one by one, and then in packets of one
+      sample for each pixel of an 8x8 tile; throw unless each ray
+      hits at the same distance either way, and report how many rays
+      per second either way got */
+  static void benchmarkPrimaryRays(const ModelBVH &modelBVH, const Camera &camera,
+                                   const vec2i &frameSize, int samplesPerPixel)
+  {
+    const PinholeCamera pinhole(camera,frameSize);
+    const int tileSize = 8;
+    const vec2i numTiles((frameSize.x+tileSize-1)/tileSize,
+                         (frameSize.y+tileSize-1)/tileSize);
+    const size_t numRays = size_t(frameSize.x)*frameSize.y*samplesPerPixel;
+    const size_t raysPerTile = size_t(tileSize*tileSize)*samplesPerPixel;
+
+    // where each ray traced one by one hit (or INFINITY), for the
+    // packets to get checked against. Not which triangle it hit:
+    // where a ray hits an edge (nearly) right on, either of the
+    // triangles sharing it may win - at a distance a few ulps apart
+    std::vector<float> singleT(size_t(numTiles.x)*numTiles.y*raysPerTile);
+    double rate[2];
+    std::atomic<size_t> numWrong(0);
+    for (int packets=0;packets<2;packets++) {
+      const double startTime = getCurrentTime();
+      parallel_for(size_t(numTiles.x)*numTiles.y,[&](size_t tileID){
+          const vec2i tile(int(tileID % numTiles.x)*tileSize,
+                           int(tileID / numTiles.x)*tileSize);
+          // the same jitter for both runs
+          LCG<16> random((unsigned)tileID,0);
+          BVHRay rays[tileSize*tileSize];
+          BVHHit rayHits[tileSize*tileSize];
+          float *tileT = &singleT[tileID*raysPerTile];
+          size_t tileWrong = 0;
+          for (int sampleID=0;sampleID<samplesPerPixel;sampleID++) {
+            // one packet: one sample for each pixel of the tile
+            int numTileRays = 0;
+            for (int iy=tile.y;iy<std::min(tile.y+tileSize,frameSize.y);iy++)
+              for (int ix=tile.x;ix<std::min(tile.x+tileSize,frameSize.x);ix++) {
+                const float jitterX = random();
+                const float jitterY = random();
+                pinhole.makeRay(vec2f((ix+jitterX)/frameSize.x,
+                                      (iy+jitterY)/frameSize.y),rays[numTileRays++]);
+              }
+            float *sampleT = tileT+sampleID*tileSize*tileSize;
+            if (packets) {
+              const uint64_t hitMask = intersect(modelBVH.bvh8,rays,rayHits,numTileRays);
+              for (int i=0;i<numTileRays;i++) {
+                const float t = (hitMask & (1ull<<i)) ? rayHits[i].t : INFINITY;
+                if (t != sampleT[i] && !(fabsf(t-sampleT[i]) <= 1e-5f*sampleT[i]))
+                  tileWrong++;
+              }
+            } else
+              for (int i=0;i<numTileRays;i++)
+                sampleT[i] = intersect(modelBVH.bvh8,rays[i],rayHits[i])
+                  ? rayHits[i].t : INFINITY;
+          }
+          numWrong += tileWrong;
+        });
+      rate[packets] = numRays/(getCurrentTime()-startTime)*1e-6;
+    }
+    if (numWrong > 0)
+      throw std::runtime_error("benchmarkPrimaryRays: "+std::to_string(numWrong.load())
+                               +" of "+std::to_string(numRays)+" rays hit differently"
+                               " in packets than one by one");
+
+    std::cout << "traced " << samplesPerPixel << " primary rays/pixel at "
+              << frameSize.x << "x" << frameSize.y << " on the host: "
+              << rate[0] << " Mrays/s one by one, "
+              << rate[1] << " Mrays/s in " << tileSize << "x" << tileSize << " packets"
+              << " (" << rate[1]/rate[0] << "x)" << std::endl;
+  }
+
+  void benchmarkRayPackets(const Model *model)
+  {
+    ModelBVH modelBVH;
+    buildModelBVH(modelBVH,model);
+    const Camera camera = overviewCamera(model->bounds);
+    for (const vec2i &frameSize : { vec2i(1920,1080), vec2i(3840,2160) })
+      for (int samplesPerPixel=1;samplesPerPixel<=16;samplesPerPixel*=2)
+        benchmarkPrimaryRays(modelBVH,camera,frameSize,samplesPerPixel);
+  }
+
+  /*! trace primary rays for a frame of the given size through the
+      two-level BVH; then move all of its instances and rebuild its
+      top-level BVH, a few times over; and report how long each
+      took. Leaves the instances where they were */
+  static void benchmarkModelTwoLevelBVH(ModelTwoLevelBVH &modelBVH, const Camera &camera,
+                                        const vec2i &frameSize)
+  {
+    gdt::TwoLevelBVH8 &bvh = modelBVH.bvh;
+    const size_t numPixels = size_t(frameSize.x)*frameSize.y;
+
+    // primary rays through the pixel centers
+    const PinholeCamera pinhole(camera,frameSize);
+    std::atomic<size_t> numHits(0);
+    const double primaryRate = traceRays(numPixels,[&](size_t pixelID, BVHRay &ray, LCG<16> &){
+        pinhole.makeRay(vec2f((pixelID % frameSize.x + .5f)/frameSize.x,
+                              (pixelID / frameSize.x + .5f)/frameSize.y),ray);
+      },[&](size_t, BVHRay &ray){
+        BVHHit hit;
+        if (intersect(bvh,ray,hit))
+          numHits++;
+      });
+
+    // spin every instance a bit around its origin, and rebuild the
+    // top-level BVH; over and over
+    const std::vector<gdt::BVHInstance> original = bvh.instances;
+    const int numFrames = 16;
+    double updateTime = 0., buildTime = 0.;
+    for (int frameID=0;frameID<numFrames;frameID++) {
+      const double startTime = getCurrentTime();
+      const float angle = .01f*(frameID+1);
+      parallel_for_blocked(bvh.instances.size(),16*1024,[&](size_t begin, size_t end){
+          for (size_t instanceID=begin;instanceID<end;instanceID++) {
+            const affine3f &xfm = original[instanceID].xfm;
+            bvh.instances[instanceID].xfm
+              = affine3f::rotate(xfm.p,vec3f(0.f,1.f,0.f),angle) * xfm;
+          }
+        });
+      const double movedTime = getCurrentTime();
+      gdt::buildTLAS(bvh);
+      updateTime += movedTime-startTime;
+      buildTime  += getCurrentTime()-movedTime;
+    }
+    bvh.instances = original;
+    gdt::buildTLAS(bvh);
+
+    const size_t numInstances = std::max(bvh.instances.size(),(size_t)1);
+    std::cout << "traced two-level host BVH on " << getNumThreads() << " threads: "
+              << numPixels << " primary rays at " << primaryRate << " Mrays/s ("
+              << 100.*numHits.load()/std::max(numPixels,(size_t)1) << "% hit); "
+              << "moving all " << bvh.instances.size() << " instances took "
+              << 1e3*updateTime/numFrames << "ms, rebuilding the top-level BVH "
+              << 1e3*buildTime/numFrames << "ms ("
+              << 1e6*buildTime/numFrames/numInstances << "us per instance)" << std::endl;
+  }
+
+  /*! whether the ray enters the box within (tmin,tmax) */
+  static bool rayBox(const BVHRay &ray, const box3f &box)
+  {
+    float t0 = ray.tmin, t1 = ray.tmax;
+    for (int dim=0;dim<3;dim++) {
+      const float inv = 1.f/ray.dir[dim];
+      float tNear = (box.lower[dim]-ray.org[dim])*inv;
+      float tFar  = (box.upper[dim]-ray.org[dim])*inv;
+      if (tNear > tFar) std::swap(tNear,tFar);
+      t0 = std::max(t0,tNear);
+      t1 = std::min(t1,tFar*(1.f+1e-5f));
+    }
+    return t0 <= t1;
+  }
+
+  /*! trace 'numRays' random rays through the two-level BVH - half of
+      them with a mask that sees only a quarter of the instances -
+      and as shadow rays ending before or after their hit; throw
+      unless each finds what testing the ray against every triangle
+      of every instance it sees finds. Leaves all instances with all
+      mask bits */
+  static void validateModelTwoLevelBVH(ModelTwoLevelBVH &modelBVH, const Model *model,
+                                       int numRays)
+  {
+    gdt::TwoLevelBVH8 &bvh = modelBVH.bvh;
+    const size_t numInstances = bvh.instances.size();
+    // each instance in one of four groups, which half the rays see
+    // just one of
+    for (size_t instanceID=0;instanceID<numInstances;instanceID++)
+      bvh.instances[instanceID].mask = 1u<<(instanceID % 4);
+    std::vector<box3f> worldBounds(numInstances);
+    for (size_t instanceID=0;instanceID<numInstances;instanceID++) {
+      const gdt::BVHInstance &instance = bvh.instances[instanceID];
+      const TriangleMesh &mesh = *model->meshes[instance.blasID];
+      for (auto &tri : mesh.index)
+        for (int k=0;k<3;k++)
+          worldBounds[instanceID].extend(xfmPoint(instance.xfm,meshVertex(mesh,tri[k])));
+    }
+
+    const box3f &bounds = model->bounds;
+    const float  tolerance = 1e-4f*length(bounds.span());
+    std::atomic<int> numWrong(0);
+    parallel_for(numRays,[&](size_t rayID){
+        LCG<16> random((unsigned)rayID,2);
+        BVHRay ray;
+        ray.org = bounds.lower + vec3f(random(),random(),random())*bounds.span();
+        const float z   = 1.f-2.f*random();
+        const float r   = sqrtf(std::max(0.f,1.f-z*z));
+        const float phi = 2.f*float(M_PI)*random();
+        ray.dir  = vec3f(r*cosf(phi),r*sinf(phi),z);
+        ray.tmin = 0.f;
+        ray.tmax = INFINITY;
+        const uint32_t rayMask = (rayID & 1) ? 1u<<(rayID/2 % 4) : ~0u;
+
+        // every triangle of every instance the ray sees (and whose
+        // bounds it enters), in world space
+        double closest = INFINITY;
+        for (size_t instanceID=0;instanceID<numInstances;instanceID++) {
+          const gdt::BVHInstance &instance = bvh.instances[instanceID];
+          if (!(instance.mask & rayMask) || !rayBox(ray,worldBounds[instanceID]))
+            continue;
+          const TriangleMesh &mesh = *model->meshes[instance.blasID];
+          for (auto &tri : mesh.index)
+            closest = std::min(closest,rayTriangle(ray,
+                                                   xfmPoint(instance.xfm,meshVertex(mesh,tri.x)),
+                                                   xfmPoint(instance.xfm,meshVertex(mesh,tri.y)),
+                                                   xfmPoint(instance.xfm,meshVertex(mesh,tri.z))));
+        }
+
+        BVHRay shadowRay = ray;
+        shadowRay.tmax = closest < INFINITY
+          ? float(closest)*((rayID & 2) ? .5f : 1.5f)
+          : .5f*length(bounds.span());
+        BVHHit hit;
+        const bool isHit = intersect(bvh,ray,hit,rayMask);
+        if (isHit != (closest < INFINITY)
+            || (isHit && fabs(hit.t-closest) > tolerance)
+            || occluded(bvh,shadowRay,rayMask) != (closest < shadowRay.tmax))
+          numWrong++;
+      });
+    for (auto &instance : bvh.instances)
+      instance.mask = ~0u;
+    if (numWrong > 0)
+      throw std::runtime_error("validateModelTwoLevelBVH: "+std::to_string(numWrong.load())
+                               +" of "+std::to_string(numRays)+" rays got a"
+                               " different hit than from testing all triangles");
+    std::cout << "checked " << numRays << " random rays (half of them seeing a quarter"
+              << " of the instances) against all triangles: the two-level host BVH"
+              << " finds the same closest hits and occlusions" << std::endl;
+  }
+
+  void benchmarkTwoLevelBVH(const Model *model)
+  {
+    ModelTwoLevelBVH modelBVH;
+    buildModelTwoLevelBVH(modelBVH,model);
+    validateModelTwoLevelBVH(modelBVH,model,256);
+    benchmarkModelTwoLevelBVH(modelBVH,overviewCamera(model->bounds),vec2i(1920,1080));
+  }
+
+  void benchmarkMeshRefit(const Model *model, int numFrames)
+  {
+    if (model->meshes.empty()) return;
+
+    // a copy of the largest mesh, with full-precision positions, to
+    // deform
+    const TriangleMesh &largest
+      = **std::max_element(model->meshes.begin(),model->meshes.end(),
+                           [](const TriangleMesh *a, const TriangleMesh *b){
+                             return a->index.size() < b->index.size();
+                           });
+    Model deforming;
+    TriangleMesh *mesh = new TriangleMesh;
+    deforming.meshes.push_back(mesh);
+    mesh->index.assign(largest.index.begin(),largest.index.end());
+    std::vector<vec3f> rest(largest.compactVertex.empty()
+                            ? largest.vertex.size()
+                            : largest.compactVertex.size());
+    box3f restBounds;
+    for (size_t vertexID=0;vertexID<rest.size();vertexID++)
+      restBounds.extend(rest[vertexID] = meshVertex(largest,(int)vertexID));
+    mesh->vertex.assign(rest.begin(),rest.end());
+
+    // twist it around the vertical axis through its center: by up
+    // to two turns from its bottom to its top, by the last frame
+    const vec3f center = restBounds.center();
+    const float height = std::max(restBounds.span().y,1e-20f);
+    auto deform = [&](int frameID) {
+      const float twist = 4.f*float(M_PI)*(frameID+1)/numFrames;
+      parallel_for_blocked(rest.size(),64*1024,[&](size_t begin, size_t end){
+          for (size_t vertexID=begin;vertexID<end;vertexID++) {
+            const vec3f &p    = rest[vertexID];
+            const float angle = twist*(p.y-restBounds.lower.y)/height;
+            const float dx = p.x-center.x, dz = p.z-center.z;
+            mesh->vertex[vertexID] = vec3f(center.x + cosf(angle)*dx - sinf(angle)*dz,
+                                           p.y,
+                                           center.z + sinf(angle)*dx + cosf(angle)*dz);
+          }
+        });
+    };
+
+    // primary rays at the (twisting) mesh, through one BVH or another
+    const vec2i  frameSize(640,360);
+    const Camera camera = { center + vec3f(.3f,.6f,1.f)*.6f*length(restBounds.span()),
+                            center, vec3f(0.f,1.f,0.f) };
+    const PinholeCamera pinhole(camera,frameSize);
+    // all BVHs over the mesh have to find the same hits: how far
+    // each ray got (INFINITY for none), through each of them
+    std::vector<float> hitT[3];
+    auto traceRate = [&](const gdt::BVH8 &bvh, std::vector<float> &t) {
+      t.assign(size_t(frameSize.x)*frameSize.y,INFINITY);
+      return traceRays(t.size(),[&](size_t pixelID, BVHRay &ray, LCG<16> &){
+          pinhole.makeRay(vec2f((pixelID % frameSize.x + .5f)/frameSize.x,
+                                (pixelID / frameSize.x + .5f)/frameSize.y),ray);
+        },[&](size_t pixelID, BVHRay &ray){
+          BVHHit hit;
+          if (intersect(bvh,ray,hit))
+            t[pixelID] = hit.t;
+        });
+    };
+    // (a ray right through an edge may hit either triangle, at
+    // slightly different distances)
+    auto sameHits = [&](const std::vector<float> &a, const std::vector<float> &b) {
+      for (size_t i=0;i<a.size();i++)
+        if (a[i] != b[i] && !(fabsf(a[i]-b[i]) <= 1e-5f*a[i]))
+          return false;
+      return true;
+    };
+
+    // one BVH that only ever gets refit, and one that gets rebuilt
+    // whenever refitting made it too bad
+    const float maxCostRatio = 1.5f;
+    ModelTwoLevelBVH refitted, adaptive;
+    buildModelTwoLevelBVH(refitted,&deforming);
+    buildModelTwoLevelBVH(adaptive,&deforming);
+    double refitTime = 0., rebuildTime = 0.;
+    int numRebuilds = 0, numSamples = 0;
+    for (int frameID=0;frameID<numFrames;frameID++) {
+      deform(frameID);
+
+      double startTime = getCurrentTime();
+      updateMeshBVHs(refitted,&deforming,std::vector<int>(1,0),INFINITY);
+      gdt::buildTLAS(refitted.bvh);
+      refitTime += getCurrentTime()-startTime;
+
+      numRebuilds += updateMeshBVHs(adaptive,&deforming,std::vector<int>(1,0),maxCostRatio);
+      gdt::buildTLAS(adaptive.bvh);
+
+      if ((frameID+1) % std::max(numFrames/10,1) != 0) continue;
+
+      // compare both to a BVH built from scratch
+      startTime = getCurrentTime();
+      gdt::BVH8 rebuilt;
+      const float rebuiltCost = buildMeshBVH(rebuilt,*mesh);
+      rebuildTime += getCurrentTime()-startTime;
+      numSamples++;
+      std::cout << "frame " << (frameID+1) << ": refit only: SAH cost "
+                << refitted.meshCost[0]/refitted.meshBuildCost[0] << "x as built, "
+                << traceRate(refitted.meshBVH[0],hitT[0]) << " Mrays/s; with "
+                << numRebuilds << " rebuilds so far: SAH cost "
+                << adaptive.meshCost[0]/adaptive.meshBuildCost[0] << "x as built, "
+                << traceRate(adaptive.meshBVH[0],hitT[1]) << " Mrays/s; built from scratch: SAH cost "
+                << rebuiltCost/refitted.meshBuildCost[0] << "x the first build's, "
+                << traceRate(rebuilt,hitT[2]) << " Mrays/s" << std::endl;
+      if (!sameHits(hitT[0],hitT[2]) || !sameHits(hitT[1],hitT[2]))
+        throw std::runtime_error("benchmarkMeshRefit: in frame "+std::to_string(frameID+1)
+                                 +", rays through the refit BVHs hit other than"
+                                 " through one built from scratch");
+    }
+
+    std::cout << "deformed " << mesh->index.size() << " triangles over "
+              << numFrames << " frames: refit in " << 1e3*refitTime/numFrames << "ms, "
+              << "rebuilt in " << 1e3*rebuildTime/std::max(numSamples,1) << "ms; "
+              << numRebuilds << " rebuilds at a maximum SAH cost ratio of "
+              << maxCostRatio << std::endl;
+  }
+  
+} // ::osc
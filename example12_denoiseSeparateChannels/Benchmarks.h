@@ -0,0 +1,195 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "Model.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! @{ host-side benchmarks and validations of ex12's model
+      preparation; these only get built into ex12_benchmarks, not
+      into the renderer */
+
+  /*! a copy of a model file, next to it (so that whatever it refers
+      to by relative path still resolves) but under a name of its
+      own, so benchmarks can load it with and without a model cache
+      without ever touching the model's own cache. The copy and its
+      cache get removed again when this goes out of scope */
+  struct TemporaryModelCopy {
+    TemporaryModelCopy(const std::string &original);
+    ~TemporaryModelCopy();
+
+    std::string fileName;
+  };
+  
+  /*! deduplicate the corners of the given OBJ file's faces into
+      vertices (as loadOBJ does) through a std::map, and through the
+      hash table loadOBJ uses; then run all of loadOBJ; and report
+      triangles per second for each */
+  void benchmarkOBJLoader(const std::string &objFile);
+
+  /*! parse given OBJ file both through tinyobj::LoadObj and through
+      parseOBJParallel, throw if they do not produce bit-identical
+      attributes, shapes and materials, and report how many bytes
+      per second each of them parsed */
+  void validateOBJParser(const std::string &objFile);
+
+  /*! load (a temporary copy of) the given OBJ file without its cache
+      (which writes one), and then again from that cache; throw
+      unless both models hold the very same meshes and textures, and
+      report how long each load - and the first pass over the mapped
+      cache's pages - took */
+  void benchmarkModelCache(const std::string &objFile);
+
+  /*! write a small OBJ with a material library and a texture, cache
+      it, and throw unless editing the OBJ, the material library, or
+      the texture's image each makes that cache stale */
+  void validateModelCacheStamps();
+
+  /*! write a scene of two small OBJ files (one with a texture),
+      load it, and throw unless reloadSceneFile() replaces just the
+      one mesh or texture that changed after editing a model file or
+      the texture's image; places the models anew, keeping all meshes
+      and textures, after the scene file moves and adds instances;
+      and, after the scene file adds or drops a model, loads just the
+      new one - and any other that changed since it got loaded */
+  void validateSceneReload();
+
+  /*! flip (and expand to RGBA) synthetic RGB and RGBA images of
+      1K^2 up to 'maxSize'^2 pixels, once the way stbi and the
+      per-pixel swap used to, and once through ingestTexture(); throw
+      if their pixels differ, and report the time each took */
+  void benchmarkTextureIngest(int maxSize);
+
+  /*! build box- and Kaiser-filtered mip chains for synthetic
+      textures of 512^2 up to 'maxSize'^2 pixels, checking that
+      single-color ones stay that color; then fit them into half the
+      memory their finest levels took. Reports memory and time of
+      each */
+  void benchmarkTextureMips(int maxSize);
+
+  /*! load (a temporary copy of) the given OBJ file without, and then
+      with, its cache, write its meshes to a glb, and load that back;
+      throw unless the glb's meshes are the OBJ's, and report each
+      load's time */
+  void benchmarkGLTFLoader(const std::string &objFile);
+
+  /*! load (a temporary copy of) the given OBJ file, without a model
+      cache, as is and with mergeMeshes(); throw unless both have the
+      same triangles and bounds, and report mesh and device buffer
+      counts and load time of either */
+  void benchmarkMergeMeshes(const std::string &objFile);
+
+  /*! detectInstances() on (a temporary copy of) the given OBJ file,
+      with translation and with affine instancing (each reports the
+      memory it saved); and check that every instance puts its mesh's
+      vertices where the mesh it replaced had them */
+  void benchmarkInstancing(const std::string &objFile);
+
+  /*! find the triangles visible in a 1080p overview of the given OBJ
+      file, and time fetching the positions, normals and texcoords of
+      their vertices in scanline order, on one thread; report that
+      along with the meshes' ACMR (see computeACMR()), before and
+      after optimizeMeshes(), for the model as loaded and with its
+      triangles and vertices shuffled */
+  void benchmarkMeshOptimize(const std::string &objFile);
+
+  /*! load (a temporary copy of) the given OBJ file and drop its
+      normals, then have generateNormals() (which reports its time
+      and memory) make new ones - without and with the given crease
+      angle, and with tangents; and report how much memory that adds,
+      and how far the new normals are from the file's own */
+  void benchmarkSmoothNormals(const std::string &objFile, float creaseAngle);
+
+  /*! generateLODs() on (a temporary copy of) the given OBJ file,
+      which reports triangles and time; then check that each LOD has
+      fewer triangles, none of them degenerate, and no less error
+      than the one before; and report how much each level changes the
+      surface area, and its largest error */
+  void benchmarkLODs(const std::string &objFile, int numLevels);
+
+  /*! load (a temporary copy of) the given OBJ file, and
+      compactVertexAttributes() with quantized positions; report how
+      far the decoded attributes are off from the originals, and how
+      fast all of them can be read back - in order and in random
+      order, on one thread - compared to the full-precision ones */
+  void benchmarkCompactVertices(const std::string &objFile);
+
+  /*! partition the meshes of (a temporary copy of) the given OBJ
+      file - optionally shuffled first - into meshlets by just
+      cutting their index arrays into runs that fit, and then by
+      buildMeshlets(); check that either way every triangle ends up
+      in exactly one meshlet, and report size, overlap and build time
+      of both */
+  void benchmarkMeshlets(const std::string &objFile, bool shuffle);
+
+  /*! render a small frame of (a temporary copy of) the given OBJ
+      file with the CPU renderer, under a light above it - optionally
+      with its meshes instanced and checker textured first - twice:
+      throw unless both come out the same, and every pixel is valid
+      (finite, non-negative colors and albedos, normals no longer
+      than unit length, alpha one). Then accumulate a few more frames
+      and save them as a PPM. Reports rays per second of each frame */
+  void benchmarkCPURenderer(const std::string &objFile, int samplesPerPixel,
+                            bool instanceAndTexture);
+
+  /*! render a floor quad, lit from the side by a tiny light, with a
+      narrow quad floating above it, with the CPU renderer; and throw
+      unless every pixel's color is the ambient term plus the light's
+      power*diffuse*(N.L)/distance^2 (or the ambient term alone, in
+      the shadow), and its normal and albedo are the quad's - or the
+      background's, where the rays miss */
+  void validateCPURenderer();
+
+  /*! build the host BVH over the given model, then check it: throw
+      unless every triangle sits in exactly one leaf whose bounds
+      contain it, and every node lies inside its parent */
+  void benchmarkBVHBuild(const Model *model);
+
+  /*! build the host BVH over the given model, and check it against
+      testing every one of its triangles with random rays; then report
+      how many primary, shadow and random rays per second it traces
+      for a 1080p frame of the model, seen from above */
+  void benchmarkBVHTrace(const Model *model);
+
+  /*! build the host BVH over the given model, and trace 1 to 16
+      jittered primary rays per pixel of 1080p and 4K frames of it,
+      one by one and in packets of 8x8 pixels; throw unless either
+      way the rays hit at the same distances, and report how many
+      rays per second either way got */
+  void benchmarkRayPackets(const Model *model);
+
+  /*! build the two-level host BVH over the given model, and check
+      it against testing every triangle of every instance with random
+      rays, some of them masked; then time tracing primary rays for a
+      1080p frame, and moving all instances and rebuilding the top
+      level a few times over */
+  void benchmarkTwoLevelBVH(const Model *model);
+
+  /*! twist (a copy of) the model's largest mesh over 'numFrames'
+      frames, and keep its BVH up to date each frame: once by refits
+      alone, and once by updateMeshBVHs(); and report how long refits
+      and rebuilds take, and how the SAH cost and the speed of
+      tracing primary rays at the mesh drift over time. Throws if
+      those rays find other hits than through a BVH built from
+      scratch */
+  void benchmarkMeshRefit(const Model *model, int numFrames);
+  /*! @} */
+  
+} // ::osc
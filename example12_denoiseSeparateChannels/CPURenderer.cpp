@@ -0,0 +1,418 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "CPURenderer.h"
+#include "gdt/parallel/parallel_for.h"
+#include "gdt/random/random.h"
+//std
+#include <atomic>
+
+#define NUM_LIGHT_SAMPLES 4
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  typedef gdt::LCG<16> Random;
+
+  /*! the device programs' per-ray data */
+  struct CPURenderer::PRD {
+    Random random;
+    vec3f  pixelColor;
+    vec3f  pixelNormal;
+    vec3f  pixelAlbedo;
+    /*! how many rays tracing this one took (itself included) */
+    size_t numRays;
+  };
+
+  //------------------------------------------------------------------------------
+  // vertex attribute fetches, from either the full-precision or the
+  // compact arrays, whichever the mesh has
+  //------------------------------------------------------------------------------
+
+  static inline vec3f getVertex(const TriangleMesh &mesh, int i)
+  {
+    return mesh.compactVertex.empty()
+      ? mesh.vertex[i]
+      : mesh.vertexQuantizer.decode(mesh.compactVertex[i]);
+  }
+
+  static inline vec3f getNormal(const TriangleMesh &mesh, int i)
+  {
+    return mesh.compactNormal.empty()
+      ? mesh.normal[i]
+      : (vec3f)mesh.compactNormal[i];
+  }
+
+  static inline vec2f getTexcoord(const TriangleMesh &mesh, int i)
+  {
+    return mesh.compactTexcoord.empty()
+      ? mesh.texcoord[i]
+      : mesh.compactTexcoord[i].decode(mesh.halfTexcoords);
+  }
+
+  //------------------------------------------------------------------------------
+  // texture lookups, as on the texture objects that
+  // SampleRenderer::createTexture() creates: normalized coordinates
+  // with wrap-around, bilinear filtering within, and linear filtering
+  // between mip levels, and the rgba8 texels read as floats in [0,1]
+  //------------------------------------------------------------------------------
+
+  static inline vec4f texel(const uint32_t *pixels, const vec2i &res, int x, int y)
+  {
+    const uint32_t rgba = pixels[size_t(y)*res.x+x];
+    return vec4f(float((rgba >>  0) & 0xff),
+                 float((rgba >>  8) & 0xff),
+                 float((rgba >> 16) & 0xff),
+                 float((rgba >> 24) & 0xff)) * (1.f/255.f);
+  }
+
+  static inline int wrap(int i, int n)
+  {
+    i %= n;
+    return i < 0 ? i+n : i;
+  }
+
+  static vec4f tex2DLevel(const Texture &texture, int level, const vec2f &tc)
+  {
+    const vec2i     res    = texture.levelResolution(level);
+    const uint32_t *pixels = texture.levelPixels(level);
+    // texel centers are at half-integer coordinates
+    const float x  = (tc.x-floorf(tc.x))*res.x - .5f;
+    const float y  = (tc.y-floorf(tc.y))*res.y - .5f;
+    const float fx = floorf(x);
+    const float fy = floorf(y);
+    const float wx = x-fx;
+    const float wy = y-fy;
+    const int x0 = wrap(int(fx),res.x), x1 = wrap(int(fx)+1,res.x);
+    const int y0 = wrap(int(fy),res.y), y1 = wrap(int(fy)+1,res.y);
+    return
+      (1.f-wy) * ((1.f-wx) * texel(pixels,res,x0,y0) + wx * texel(pixels,res,x1,y0))
+      +    wy  * ((1.f-wx) * texel(pixels,res,x0,y1) + wx * texel(pixels,res,x1,y1));
+  }
+
+  static vec4f tex2DLod(const Texture &texture, const vec2f &tc, float lod)
+  {
+    lod = fminf(fmaxf(lod,0.f),float(texture.numLevels-1));
+    const int   level  = int(lod);
+    const float weight = lod-level;
+    const vec4f finer  = tex2DLevel(texture,level,tc);
+    if (weight == 0.f)
+      return finer;
+    return (1.f-weight) * finer + weight * tex2DLevel(texture,level+1,tc);
+  }
+
+  //------------------------------------------------------------------------------
+  // the renderer itself
+  //------------------------------------------------------------------------------
+
+  CPURenderer::CPURenderer(const Model *model, const std::vector<QuadLight> &lights)
+  {
+    setModel(model,lights);
+  }
+
+  void CPURenderer::setModel(const Model *model, const std::vector<QuadLight> &lights)
+  {
+    this->model = model;
+    launchParams.lights = lights;
+    buildModelTwoLevelBVH(modelBVH,model);
+    launchParams.frame.frameID = 0;
+  }
+
+  /*! __closesthit__radiance */
+  void CPURenderer::closestHit(const vec3f &rayDir, const gdt::BVHHit &hit, PRD &prd) const
+  {
+    const gdt::BVHInstance &instance = modelBVH.bvh.instances[hit.instanceID];
+    const TriangleMesh     &mesh     = *model->meshes[instance.blasID];
+    const affine3f         &xfm      = instance.xfm;
+    // what transforms normals to world space: the inverse transpose
+    // of the instance's transform
+    const linear3f normalXfm
+      = modelBVH.bvh.worldToInstance[hit.instanceID].l.transposed();
+
+    // ------------------------------------------------------------------
+    // gather some basic hit information
+    // ------------------------------------------------------------------
+    const vec3i index = mesh.index[hit.primID];
+    const float u = hit.u;
+    const float v = hit.v;
+
+    // ------------------------------------------------------------------
+    // compute normal, using either shading normal (if avail), or
+    // geometry normal (fallback)
+    // ------------------------------------------------------------------
+    const vec3f A = getVertex(mesh,index.x);
+    const vec3f B = getVertex(mesh,index.y);
+    const vec3f C = getVertex(mesh,index.z);
+    vec3f Ng = cross(B-A,C-A);
+    vec3f Ns = (!mesh.normal.empty() || !mesh.compactNormal.empty())
+      ? ((1.f-u-v) * getNormal(mesh,index.x)
+         +       u * getNormal(mesh,index.y)
+         +       v * getNormal(mesh,index.z))
+      : Ng;
+    Ng = xfmVector(normalXfm,Ng);
+    Ns = xfmVector(normalXfm,Ns);
+
+    // ------------------------------------------------------------------
+    // face-forward and normalize normals
+    // ------------------------------------------------------------------
+    if (dot(rayDir,Ng) > 0.f) Ng = -Ng;
+    Ng = normalize(Ng);
+
+    if (dot(Ng,Ns) < 0.f)
+      Ns -= 2.f*dot(Ng,Ns)*Ng;
+    Ns = normalize(Ns);
+
+    // ------------------------------------------------------------------
+    // compute diffuse material color, including diffuse texture, if
+    // available
+    // ------------------------------------------------------------------
+    vec3f diffuseColor = mesh.diffuse;
+    if (mesh.diffuseTextureID >= 0
+        && mesh.diffuseTextureID < (int)model->textures.size()
+        && (!mesh.texcoord.empty() || !mesh.compactTexcoord.empty())) {
+      const Texture &texture = *model->textures[mesh.diffuseTextureID];
+      const vec2f TA = getTexcoord(mesh,index.x);
+      const vec2f TB = getTexcoord(mesh,index.y);
+      const vec2f TC = getTexcoord(mesh,index.z);
+      const vec2f tc
+        = (1.f-u-v) * TA
+        +         u * TB
+        +         v * TC;
+
+      // the same ray cone footprint as on the device
+      const vec2f dTB = TB-TA;
+      const vec2f dTC = TC-TA;
+      const float texelArea
+        = fabsf(dTB.x*dTC.y-dTC.x*dTB.y)
+        * texture.resolution.x * texture.resolution.y;
+      const float worldArea
+        = length(cross(xfmVector(xfm,B-A),xfmVector(xfm,C-A)));
+      const float pixelSpread
+        = length(launchParams.camera.horizontal)
+        / launchParams.frame.size.x;
+      const float coneWidth  = hit.t * pixelSpread;
+      const float cosine     = fmaxf(fabsf(dot(rayDir,Ng)),1e-3f);
+      const float lod
+        = (texelArea > 0.f && worldArea > 0.f)
+        ? 0.5f*log2f(texelArea/worldArea) + log2f(coneWidth/cosine)
+        : 0.f;
+
+      diffuseColor *= (vec3f)tex2DLod(texture,tc,lod);
+    }
+
+    // start with some ambient term
+    vec3f pixelColor = (0.1f + 0.2f*fabsf(dot(Ns,rayDir)))*diffuseColor;
+
+    // ------------------------------------------------------------------
+    // compute shadow
+    // ------------------------------------------------------------------
+    const vec3f surfPos
+      = xfmPoint(xfm,(1.f-u-v) * A
+                 +         u * B
+                 +         v * C);
+
+    const int numLightSamples = NUM_LIGHT_SAMPLES;
+    const int numLights       = (int)launchParams.lights.size();
+    for (int lightSampleID=0;numLights>0 && lightSampleID<numLightSamples;lightSampleID++) {
+      int lightID = numLights > 1 ? int(prd.random()*numLights) : 0;
+      if (lightID >= numLights) lightID = numLights-1;
+      const QuadLight &light = launchParams.lights[lightID];
+
+      // produce random light sample
+      const vec3f lightPos
+        = light.origin
+        + prd.random() * light.du
+        + prd.random() * light.dv;
+      vec3f lightDir = lightPos - surfPos;
+      float lightDist = gdt::length(lightDir);
+      lightDir = normalize(lightDir);
+
+      // trace shadow ray - where __miss__shadow would run, the light
+      // is visible
+      const float NdotL = dot(lightDir,Ns);
+      if (NdotL >= 0.f) {
+        gdt::BVHRay shadowRay;
+        shadowRay.org  = surfPos + 1e-3f * Ng;
+        shadowRay.dir  = lightDir;
+        shadowRay.tmin = 1e-3f;
+        shadowRay.tmax = lightDist * (1.f-1e-3f);
+        prd.numRays++;
+        const vec3f lightVisibility
+          = gdt::occluded(modelBVH.bvh,shadowRay) ? vec3f(0.f) : vec3f(1.f);
+        pixelColor
+          += lightVisibility
+          *  light.power
+          *  diffuseColor
+          *  (numLights * NdotL / (lightDist*lightDist*numLightSamples));
+      }
+    }
+
+    prd.pixelNormal = Ns;
+    prd.pixelAlbedo = diffuseColor;
+    prd.pixelColor = pixelColor;
+  }
+
+  void CPURenderer::traceRadiance(const vec3f &org, const vec3f &dir, PRD &prd) const
+  {
+    gdt::BVHRay ray;
+    ray.org  = org;
+    ray.dir  = dir;
+    ray.tmin = 0.f;
+    ray.tmax = 1e20f;
+    gdt::BVHHit hit;
+    prd.numRays++;
+    if (gdt::intersect(modelBVH.bvh,ray,hit))
+      closestHit(dir,hit,prd);
+    else
+      // __miss__radiance: constant white as background color (and,
+      // as there, normal and albedo stay what they were)
+      prd.pixelColor = vec3f(1.f);
+  }
+
+  /*! __raygen__renderFrame */
+  void CPURenderer::renderPixel(int ix, int iy, size_t &numRays)
+  {
+    const auto &camera = launchParams.camera;
+
+    PRD prd;
+    prd.random.init(ix+launchParams.frame.size.x*iy,
+                    launchParams.frame.frameID);
+    prd.pixelColor = vec3f(0.f);
+    // (which the device leaves undefined, until something gets hit)
+    prd.pixelNormal = vec3f(0.f);
+    prd.pixelAlbedo = vec3f(0.f);
+    prd.numRays = 0;
+
+    int numPixelSamples = launchParams.numPixelSamples;
+
+    vec3f pixelColor = 0.f;
+    vec3f pixelNormal = 0.f;
+    vec3f pixelAlbedo = 0.f;
+    for (int sampleID=0;sampleID<numPixelSamples;sampleID++) {
+      // normalized screen plane position, in [0,1]^2. (The device
+      // draws both jitters within one expression, leaving which comes
+      // first to the compiler; here, x comes first)
+      const float jitterX = prd.random();
+      const float jitterY = prd.random();
+      vec2f screen(vec2f(ix+jitterX,iy+jitterY)
+                   / vec2f(launchParams.frame.size));
+
+      // generate ray direction
+      vec3f rayDir = normalize(camera.direction
+                               + (screen.x - 0.5f) * camera.horizontal
+                               + (screen.y - 0.5f) * camera.vertical);
+
+      traceRadiance(camera.position,rayDir,prd);
+      pixelColor  += prd.pixelColor;
+      pixelNormal += prd.pixelNormal;
+      pixelAlbedo += prd.pixelAlbedo;
+    }
+
+    vec4f rgba(pixelColor/numPixelSamples,1.f);
+    vec4f albedo(pixelAlbedo/numPixelSamples,1.f);
+    vec4f normal(pixelNormal/numPixelSamples,1.f);
+
+    // and write/accumulate to frame buffer ...
+    const uint32_t fbIndex = ix+iy*launchParams.frame.size.x;
+    if (launchParams.frame.frameID > 0) {
+      rgba
+        += float(launchParams.frame.frameID)
+        *  colorBuffer[fbIndex];
+      rgba /= (launchParams.frame.frameID+1.f);
+    }
+    colorBuffer[fbIndex]  = rgba;
+    albedoBuffer[fbIndex] = albedo;
+    normalBuffer[fbIndex] = normal;
+    numRays += prd.numRays;
+  }
+
+  /*! render one frame */
+  void CPURenderer::render()
+  {
+    // sanity check: make sure we render only after first resize is
+    // already done:
+    if (launchParams.frame.size.x == 0) return;
+
+    if (!accumulate)
+      launchParams.frame.frameID = 0;
+
+    std::atomic<size_t> numRays(0);
+    parallel_for(launchParams.frame.size.y,[&](size_t iy){
+        size_t rowRays = 0;
+        for (int ix=0;ix<launchParams.frame.size.x;ix++)
+          renderPixel(ix,(int)iy,rowRays);
+        numRays += rowRays;
+      });
+    numRaysTraced = numRays;
+
+    launchParams.frame.frameID++;
+  }
+
+  /*! set camera to render with */
+  void CPURenderer::setCamera(const Camera &camera)
+  {
+    lastSetCamera = camera;
+    // reset accumulation
+    launchParams.frame.frameID = 0;
+    launchParams.camera.position  = camera.from;
+    launchParams.camera.direction = normalize(camera.at-camera.from);
+    const float cosFovy = 0.66f;
+    const float aspect
+      = float(launchParams.frame.size.x)
+      / float(launchParams.frame.size.y);
+    launchParams.camera.horizontal
+      = cosFovy * aspect * normalize(cross(launchParams.camera.direction,
+                                           camera.up));
+    launchParams.camera.vertical
+      = cosFovy * normalize(cross(launchParams.camera.horizontal,
+                                  launchParams.camera.direction));
+  }
+
+  /*! resize frame buffer to given resolution */
+  void CPURenderer::resize(const vec2i &newSize)
+  {
+    const size_t numPixels = size_t(newSize.x)*newSize.y;
+    colorBuffer.assign(numPixels,vec4f(0.f));
+    normalBuffer.assign(numPixels,vec4f(0.f));
+    albedoBuffer.assign(numPixels,vec4f(0.f));
+    launchParams.frame.size = newSize;
+
+    // and re-set the camera, since aspect may have changed
+    setCamera(lastSetCamera);
+  }
+
+  /*! what computeFinalPixelColors() does, on the color buffer */
+  void CPURenderer::downloadPixels(uint32_t h_pixels[])
+  {
+    const size_t numPixels = colorBuffer.size();
+    parallel_for_blocked(numPixels,16*1024,[&](size_t begin, size_t end){
+        for (size_t pixelID=begin;pixelID<end;pixelID++) {
+          const vec4f &f4 = colorBuffer[pixelID];
+          auto toByte = [](float f) {
+            return (uint32_t)(fminf(1.f,fmaxf(0.f,sqrtf(f))) * 255.9f);
+          };
+          uint32_t rgba = 0;
+          rgba |= toByte(f4.x) <<  0;
+          rgba |= toByte(f4.y) <<  8;
+          rgba |= toByte(f4.z) << 16;
+          rgba |= (uint32_t)255 << 24;
+          h_pixels[pixelID] = rgba;
+        }
+      });
+  }
+
+} // ::osc
@@ -0,0 +1,113 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "Model.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! a multithreaded host-side renderer that does what
+      SampleRenderer's device programs (see devicePrograms.cu) do -
+      same camera rays, same random numbers, same shading, soft
+      shadows and textures - but traces its rays through a
+      ModelTwoLevelBVH, so it needs neither cuda nor optix. Its color,
+      normal and albedo buffers are laid out like the launch params'
+      ones, so it can stand in for SampleRenderer where there is no
+      gpu, and serve as a reference for what that renders */
+  class CPURenderer
+  {
+    // ------------------------------------------------------------------
+    // publicly accessible interface
+    // ------------------------------------------------------------------
+  public:
+    /*! constructor - builds the BVH over the model */
+    CPURenderer(const Model *model, const std::vector<QuadLight> &lights);
+
+    /*! render one frame, on all threads of the host */
+    void render();
+
+    /*! resize frame buffer to given resolution */
+    void resize(const vec2i &newSize);
+
+    /*! the rendered color buffer, gamma corrected and converted to
+        rgba8 the way SampleRenderer's is (there is no denoiser, so
+        this is what SampleRenderer shows with the denoiser off) */
+    void downloadPixels(uint32_t h_pixels[]);
+
+    /*! set camera to render with */
+    void setCamera(const Camera &camera);
+
+    /*! switch to rendering given model, with given lights */
+    void setModel(const Model *model, const std::vector<QuadLight> &lights);
+
+    bool accumulate = true;
+
+    /*! the host-side counterpart of the LaunchParams that
+        SampleRenderer launches with (which host-only code cannot
+        include), minus what only the device needs */
+    struct {
+      int numPixelSamples = 1;
+      struct {
+        int   frameID = 0;
+        /*! the size of the frame buffer to render */
+        vec2i size { 0 };
+      } frame;
+
+      struct {
+        vec3f position;
+        vec3f direction;
+        vec3f horizontal;
+        vec3f vertical;
+      } camera;
+
+      /*! the scene's quad lights; each light sample picks one of
+          them at random */
+      std::vector<QuadLight> lights;
+    } launchParams;
+
+    /*! @{ the frame buffers, as the device programs write them: one
+        vec4f (laid out like a float4) per pixel, for pixel (ix,iy) at
+        ix+iy*size.x */
+    std::vector<vec4f> colorBuffer;
+    std::vector<vec4f> normalBuffer;
+    std::vector<vec4f> albedoBuffer;
+    /*! @} */
+
+    /*! how many rays (primary and shadow) the last render() traced */
+    size_t numRaysTraced { 0 };
+
+  protected:
+    struct PRD;
+
+    /*! what __raygen__renderFrame does for pixel (ix,iy) */
+    void renderPixel(int ix, int iy, size_t &numRays);
+
+    /*! trace a radiance ray, and run what __closesthit__radiance
+        or __miss__radiance does for it */
+    void traceRadiance(const vec3f &org, const vec3f &dir, PRD &prd) const;
+
+    /*! what __closesthit__radiance does for the hit */
+    void closestHit(const vec3f &rayDir, const gdt::BVHHit &hit, PRD &prd) const;
+
+    const Model      *model;
+    ModelTwoLevelBVH  modelBVH;
+
+    Camera lastSetCamera;
+  };
+
+} // ::osc
@@ -56,8 +56,14 @@ namespace osc {
     template<typename T>
     void alloc_and_upload(const std::vector<T> &vt)
     {
-      alloc(vt.size()*sizeof(T));
-      upload((const T*)vt.data(),vt.size());
+      alloc_and_upload(vt.data(),vt.size());
+    }
+    
+    template<typename T>
+    void alloc_and_upload(const T *t, size_t count)
+    {
+      alloc(count*sizeof(T));
+      upload(t,count);
     }
     
     template<typename T>
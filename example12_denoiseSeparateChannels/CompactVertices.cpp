@@ -0,0 +1,89 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Model.h"
+#include "gdt/parallel/parallel_for.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  size_t vertexBytes(const TriangleMesh *mesh)
+  {
+    return mesh->vertex.size()*sizeof(vec3f)
+      + mesh->normal.size()*sizeof(vec3f)
+      + mesh->texcoord.size()*sizeof(vec2f)
+      + mesh->compactVertex.size()*sizeof(vec3us)
+      + mesh->compactNormal.size()*sizeof(octNormal16)
+      + mesh->compactTexcoord.size()*sizeof(texcoord16);
+  }
+
+  /*! encode 'in' into 'out' (in parallel), then free 'in' */
+  template<typename InT, typename OutT, typename EncodeT>
+  static void encode(MeshArray<InT> &in, std::vector<OutT> &out,
+                     const EncodeT &encodeOne)
+  {
+    out.resize(in.size());
+    gdt::parallel_for_blocked(in.size(),64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++)
+          out[i] = encodeOne(in[i]);
+      });
+    in.free();
+  }
+
+  void compactVertexAttributes(Model *model, bool quantizePositions)
+  {
+    size_t bytesBefore = 0, bytesAfter = 0;
+    for (auto mesh : model->meshes) {
+      bytesBefore += vertexBytes(mesh);
+
+      encode(mesh->normal,mesh->compactNormal,[](const vec3f &n){
+          // degenerate normals would encode to NaNs
+          return octNormal16(dot(n,n) > 0.f ? n : vec3f(0.f,0.f,1.f));
+        });
+
+      bool inUnitSquare = true;
+      for (auto &tc : mesh->texcoord)
+        if (!(tc.x >= 0.f && tc.x <= 1.f && tc.y >= 0.f && tc.y <= 1.f)) {
+          inUnitSquare = false;
+          break;
+        }
+      const bool asHalf = !inUnitSquare;
+      mesh->halfTexcoords = asHalf;
+      encode(mesh->texcoord,mesh->compactTexcoord,[asHalf](const vec2f &tc){
+          return texcoord16(tc,asHalf);
+        });
+
+      if (quantizePositions) {
+        const PositionQuantizer quantizer(mesh->bounds);
+        mesh->vertexQuantizer = quantizer;
+        encode(mesh->vertex,mesh->compactVertex,[&quantizer](const vec3f &p){
+            return quantizer.encode(p);
+          });
+      }
+
+      bytesAfter += vertexBytes(mesh);
+    }
+    // no mesh uses these any more
+    model->normalArena.free();
+    model->texcoordArena.free();
+    if (quantizePositions)
+      model->vertexArena.free();
+    std::cout << "compacted vertex attributes from "
+              << prettyNumber(bytesBefore) << "B to "
+              << prettyNumber(bytesAfter) << "B" << std::endl;
+  }
+
+}
@@ -0,0 +1,65 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/gdt.h"
+#include <string>
+#include <sys/stat.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! a file's size and modification time - if either differs from
+      what it was before, the file changed */
+  struct FileStamp {
+    bool operator==(const FileStamp &other) const
+    {
+      return exists == other.exists && size == other.size
+        && seconds == other.seconds && nanoseconds == other.nanoseconds;
+    }
+    bool operator!=(const FileStamp &other) const
+    { return !(*this == other); }
+
+    bool     exists      { false };
+    uint64_t size        { 0 };
+    int64_t  seconds     { 0 };
+    int64_t  nanoseconds { 0 };
+  };
+
+  /*! given file's current stamp ('exists' is not set if there is no
+      such file) */
+  inline FileStamp fileStamp(const std::string &fileName)
+  {
+    FileStamp stamp;
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(fileName.c_str(),&st) != 0) return stamp;
+#else
+    struct stat st;
+    if (stat(fileName.c_str(),&st) != 0) return stamp;
+#endif
+    stamp.exists  = true;
+    stamp.size    = (uint64_t)st.st_size;
+    stamp.seconds = (int64_t)st.st_mtime;
+#ifdef __linux__
+    // two saves within the same second should still be two changes
+    stamp.nanoseconds = (int64_t)st.st_mtim.tv_nsec;
+#endif
+    return stamp;
+  }
+
+} // ::osc
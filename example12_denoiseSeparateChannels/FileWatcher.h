@@ -0,0 +1,126 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "FileStamp.h"
+#include <map>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#  include <fcntl.h>
+#  include <sys/inotify.h>
+#  include <unistd.h>
+#endif
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! tells which of a set of files got changed - written to, or
+      replaced by another file of the same name - since it was last
+      asked. On linux, inotify tells us which of the files' directories
+      saw any writes, so asking costs nothing until something actually
+      happened; elsewhere every file's modification time gets checked
+      each time. Either way, a file only counts as changed once its
+      size or modification time differ from what they were the last
+      time around, so the several events a single save tends to cause
+      make for one change at most */
+  struct FileWatcher {
+    FileWatcher()
+    {
+#ifdef __linux__
+      fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+#endif
+    }
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+    ~FileWatcher()
+    {
+#ifdef __linux__
+      if (fd >= 0) close(fd);
+#endif
+    }
+
+    /*! start watching given file (if we are not already) */
+    void watch(const std::string &fileName)
+    {
+      if (stamps.find(fileName) != stamps.end())
+        return;
+      stamps[fileName] = fileStamp(fileName);
+#ifdef __linux__
+      if (fd < 0) return;
+      const size_t slash = fileName.rfind('/');
+      const std::string dir
+        = slash == std::string::npos ? "." : fileName.substr(0,slash+1);
+      // editors tend to save by writing a new file and renaming it
+      // over the old one, so watch the directory rather than the file
+      const int wd = inotify_add_watch(fd,dir.c_str(),
+                                       IN_CLOSE_WRITE|IN_MOVED_TO|IN_ATTRIB);
+      if (wd < 0) return;
+      filesIn[wd][fileName.substr(slash+1)] = fileName;
+#endif
+    }
+
+    /*! the watched files that changed since the last call (under the
+        names they got watched by); never blocks */
+    std::vector<std::string> changedFiles()
+    {
+      std::vector<std::string> candidates;
+#ifdef __linux__
+      if (fd >= 0) {
+        alignas(inotify_event) char buffer[16*1024];
+        ssize_t numRead;
+        while ((numRead = read(fd,buffer,sizeof(buffer))) > 0)
+          for (char *ptr = buffer; ptr < buffer+numRead; ) {
+            const inotify_event &event = *(const inotify_event *)ptr;
+            ptr += sizeof(inotify_event)+event.len;
+            if (event.len == 0) continue;
+            auto dir = filesIn.find(event.wd);
+            if (dir == filesIn.end()) continue;
+            auto file = dir->second.find(event.name);
+            if (file != dir->second.end())
+              candidates.push_back(file->second);
+          }
+      } else
+#endif
+        for (auto &stamp : stamps)
+          candidates.push_back(stamp.first);
+
+      std::vector<std::string> changed;
+      for (auto &fileName : candidates) {
+        const FileStamp stamp = fileStamp(fileName);
+        FileStamp &known = stamps[fileName];
+        // (a file that is gone - say, in the middle of getting
+        // replaced - has not changed yet)
+        if (stamp.exists && stamp != known) {
+          changed.push_back(fileName);
+          known = stamp;
+        }
+      }
+      return changed;
+    }
+
+  private:
+    std::map<std::string,FileStamp> stamps;
+#ifdef __linux__
+    int fd { -1 };
+    /*! for each watched directory: the watched files in it, by
+        their name in that directory */
+    std::map<int,std::map<std::string,std::string>> filesIn;
+#endif
+  };
+
+} // ::osc
@@ -0,0 +1,42 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! @{ glb container: a 12-byte header, then chunks, each with its
+      length and type up front */
+  enum { GLB_MAGIC = 0x46546C67, GLB_VERSION = 2 };
+  enum { GLB_CHUNK_JSON = 0x4E4F534A, GLB_CHUNK_BIN = 0x004E4942 };
+  /*! @} */
+
+  /*! @{ accessor component types, and the one primitive mode we
+      render */
+  enum {
+    GLTF_BYTE           = 5120,
+    GLTF_UNSIGNED_BYTE  = 5121,
+    GLTF_SHORT          = 5122,
+    GLTF_UNSIGNED_SHORT = 5123,
+    GLTF_UNSIGNED_INT   = 5125,
+    GLTF_FLOAT          = 5126
+  };
+  enum { GLTF_TRIANGLES = 4 };
+  /*! @} */
+
+} // ::osc
@@ -0,0 +1,602 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Model.h"
+#include "GLTF.h"
+#include "JSON.h"
+#include "MappedFile.h"
+#include "TextureMips.h"
+#include "gdt/parallel/parallel_for.h"
+#include "3rdParty/stb_image.h"
+//std
+#include <atomic>
+#include <set>
+#include <string.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  static size_t componentSize(int componentType)
+  {
+    switch (componentType) {
+    case GLTF_BYTE:
+    case GLTF_UNSIGNED_BYTE:  return 1;
+    case GLTF_SHORT:
+    case GLTF_UNSIGNED_SHORT: return 2;
+    case GLTF_UNSIGNED_INT:
+    case GLTF_FLOAT:          return 4;
+    default:                  return 0;
+    }
+  }
+
+  static int numComponents(const std::string &type)
+  {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2")   return 2;
+    if (type == "VEC3")   return 3;
+    if (type == "VEC4")   return 4;
+    return 0;
+  }
+
+  template<typename T>
+  inline T readUnaligned(const char *ptr)
+  {
+    T t;
+    memcpy(&t,ptr,sizeof(t));
+    return t;
+  }
+  
+  /*! an accessor, resolved to where its elements are in the file */
+  struct GLTFAccessor {
+    /*! component 'c' of element 'i', as a float; normalized
+        integers map to [0,1] (unsigned) or [-1,1] (signed) */
+    float component(size_t i, int c) const
+    {
+      const char *ptr = data+i*stride+c*componentSize(componentType);
+      switch (componentType) {
+      case GLTF_FLOAT:
+        return readUnaligned<float>(ptr);
+      case GLTF_UNSIGNED_BYTE: {
+        const float f = (float)readUnaligned<uint8_t>(ptr);
+        return normalized ? f/255.f : f;
+      }
+      case GLTF_BYTE: {
+        const float f = (float)readUnaligned<int8_t>(ptr);
+        return normalized ? std::max(f/127.f,-1.f) : f;
+      }
+      case GLTF_UNSIGNED_SHORT: {
+        const float f = (float)readUnaligned<uint16_t>(ptr);
+        return normalized ? f/65535.f : f;
+      }
+      case GLTF_SHORT: {
+        const float f = (float)readUnaligned<int16_t>(ptr);
+        return normalized ? std::max(f/32767.f,-1.f) : f;
+      }
+      default:
+        return (float)readUnaligned<uint32_t>(ptr);
+      }
+    }
+
+    /*! element 'i' of an (unsigned integer) index accessor */
+    uint32_t index(size_t i) const
+    {
+      const char *ptr = data+i*stride;
+      switch (componentType) {
+      case GLTF_UNSIGNED_BYTE:  return readUnaligned<uint8_t>(ptr);
+      case GLTF_UNSIGNED_SHORT: return readUnaligned<uint16_t>(ptr);
+      default:                  return readUnaligned<uint32_t>(ptr);
+      }
+    }
+
+    /*! whether the elements are tightly packed T's (which have
+        'numComponents' floats or ints each) that we can use in
+        place */
+    template<typename T>
+    bool isArrayOf(int type, int components) const
+    {
+      return componentType == type && numComponents == components
+        && !normalized && stride == sizeof(T)
+        && (size_t(data) % alignof(T)) == 0;
+    }
+    
+    char  *data;
+    size_t count;
+    /*! bytes from one element to the next */
+    size_t stride;
+    int    componentType;
+    int    numComponents;
+    bool   normalized;
+  };
+
+  /*! a .glb file: its (parsed) JSON chunk, and its binary chunk,
+      mapped copy-on-write - so that meshes can use their arrays in
+      place, and even the passes that modify arrays in place (say,
+      index renumbering) work on them, without touching the file */
+  struct GLTFFile {
+    GLTFFile(const std::string &fileName)
+      : fileName(fileName),
+        file(std::make_shared<MappedFile>())
+    {
+      if (!file->map(fileName,/*copyOnWrite=*/true))
+        throw std::runtime_error("could not map glTF file "+fileName);
+      char *data = (char *)file->data;
+      if (file->size < 12
+          || readUnaligned<uint32_t>(data) != GLB_MAGIC
+          || readUnaligned<uint32_t>(data+4) != GLB_VERSION)
+        throw std::runtime_error(fileName+" is not a glTF 2.0 binary (.glb) file");
+      const size_t length = std::min(size_t(readUnaligned<uint32_t>(data+8)),file->size);
+
+      const char *jsonBegin = nullptr, *jsonEnd = nullptr;
+      for (size_t offset = 12; offset+8 <= length; ) {
+        const size_t   chunkLength = readUnaligned<uint32_t>(data+offset);
+        const uint32_t chunkType   = readUnaligned<uint32_t>(data+offset+4);
+        if (chunkLength > length-offset-8)
+          throw std::runtime_error("truncated chunk in glTF file "+fileName);
+        char *chunk = data+offset+8;
+        if (chunkType == GLB_CHUNK_JSON && !jsonBegin) {
+          jsonBegin = chunk;
+          jsonEnd   = chunk+chunkLength;
+        } else if (chunkType == GLB_CHUNK_BIN && !bin) {
+          bin     = chunk;
+          binSize = chunkLength;
+        }
+        // chunks are padded to 4 bytes
+        offset += 8+((chunkLength+3) & ~size_t(3));
+      }
+      if (!jsonBegin)
+        throw std::runtime_error("no JSON chunk in glTF file "+fileName);
+      json = parseJSON(jsonBegin,jsonEnd);
+
+      const size_t slash = fileName.find_last_of("/\\");
+      dir = slash == std::string::npos ? "." : fileName.substr(0,slash);
+    }
+
+    /*! the top-level array of given name (or an empty one) */
+    const JSONValue &array(const char *name) const
+    {
+      static const JSONValue none;
+      const JSONValue *found = json.find(name);
+      return (found && found->isArray()) ? *found : none;
+    }
+
+    /*! element 'i' of top-level array 'name'; throws if there is
+        no such element */
+    const JSONValue &element(const char *name, int i) const
+    {
+      const JSONValue &all = array(name);
+      if (i < 0 || size_t(i) >= all.size() || !all[i].isObject())
+        throw std::runtime_error("invalid "+std::string(name)+" reference in "+fileName);
+      return all[i];
+    }
+    
+    /*! the bytes of given buffer view */
+    char *bufferView(int viewID, size_t &size) const
+    {
+      const JSONValue &view = element("bufferViews",viewID);
+      // only the glb's own binary chunk; no external .bin files
+      if (view.getInt("buffer",-1) != 0 || !bin
+          || element("buffers",0).find("uri"))
+        throw std::runtime_error("glTF buffer view does not live in the binary"
+                                 " chunk of "+fileName);
+      const size_t offset = (size_t)view.getNumber("byteOffset",0.);
+      size = (size_t)view.getNumber("byteLength",0.);
+      if (offset > binSize || size > binSize-offset)
+        throw std::runtime_error("glTF buffer view out of bounds in "+fileName);
+      return bin+offset;
+    }
+
+    GLTFAccessor accessor(int accessorID) const
+    {
+      const JSONValue &json = element("accessors",accessorID);
+      if (json.find("sparse"))
+        throw std::runtime_error("sparse glTF accessors are not supported");
+      GLTFAccessor a;
+      a.componentType = json.getInt("componentType",0);
+      a.numComponents = numComponents(json.getString("type"));
+      a.normalized    = json.getBool("normalized",false);
+      a.count         = (size_t)json.getNumber("count",0.);
+      const size_t elementSize = componentSize(a.componentType)*a.numComponents;
+      if (elementSize == 0)
+        throw std::runtime_error("invalid glTF accessor type in "+fileName);
+
+      size_t viewSize = 0;
+      char *view = bufferView(json.getInt("bufferView",-1),viewSize);
+      const size_t offset = (size_t)json.getNumber("byteOffset",0.);
+      a.stride = (size_t)element("bufferViews",json.getInt("bufferView",-1))
+        .getNumber("byteStride",0.);
+      if (a.stride == 0) a.stride = elementSize;
+      if (a.count > 0 &&
+          (offset > viewSize || elementSize > viewSize-offset
+           || (a.count-1) > (viewSize-offset-elementSize)/a.stride))
+        throw std::runtime_error("glTF accessor out of bounds in "+fileName);
+      a.data = view+offset;
+      return a;
+    }
+
+    const std::string           fileName;
+    std::shared_ptr<MappedFile> file;
+    JSONValue                   json;
+    char                       *bin     { nullptr };
+    size_t                      binSize { 0 };
+    /*! where external image files are relative to */
+    std::string                 dir;
+  };
+
+  /*! counts how many of the meshes' arrays could get used in place */
+  struct GLTFArrayStats {
+    std::atomic<size_t> numViews { 0 }, numConverted { 0 };
+  };
+  
+  /*! make 'array' a view of the accessor's elements if they are laid
+      out exactly like T's, or else fill it with a converted copy */
+  template<typename T, int N>
+  static void fetchFloats(MeshArray<T> &array,
+                          const GLTFAccessor &a,
+                          GLTFArrayStats &stats)
+  {
+    if (a.isArrayOf<T>(GLTF_FLOAT,N)) {
+      array.setView((T *)a.data,a.count);
+      stats.numViews++;
+      return;
+    }
+    std::vector<T> converted(a.count);
+    for (size_t i=0;i<a.count;i++)
+      for (int c=0;c<N;c++)
+        converted[i][c] = c < a.numComponents ? a.component(i,c) : 0.f;
+    array.assign(std::move(converted));
+    stats.numConverted++;
+  }
+
+  /*! one glTF primitive as a mesh (nullptr for anything that is not
+      a triangle list). Index arrays are used in place only by the
+      first primitive using them: passes renumber indices in place,
+      and must not do that to another mesh's indices, too */
+  static TriangleMesh *loadPrimitive(const GLTFFile &gltf,
+                                     const JSONValue &primitive,
+                                     std::set<int> &viewedIndices,
+                                     GLTFArrayStats &stats)
+  {
+    if (primitive.getInt("mode",GLTF_TRIANGLES) != GLTF_TRIANGLES)
+      return nullptr;
+    const JSONValue *attributes = primitive.find("attributes");
+    if (!attributes || attributes->getInt("POSITION",-1) < 0)
+      return nullptr;
+    
+    TriangleMesh *mesh = new TriangleMesh;
+    try {
+      fetchFloats<vec3f,3>(mesh->vertex,gltf.accessor(attributes->getInt("POSITION",-1)),stats);
+      const size_t numVertices = mesh->vertex.size();
+
+      const int normalID = attributes->getInt("NORMAL",-1);
+      if (normalID >= 0 && gltf.accessor(normalID).count == numVertices)
+        fetchFloats<vec3f,3>(mesh->normal,gltf.accessor(normalID),stats);
+
+      // material: base color factor and texture, as diffuse
+      mesh->diffuse = vec3f(1.f);
+      int texcoordSet = 0;
+      const int materialID = primitive.getInt("material",-1);
+      if (materialID >= 0) {
+        const JSONValue *pbr
+          = gltf.element("materials",materialID).find("pbrMetallicRoughness");
+        const JSONValue *factor = pbr ? pbr->find("baseColorFactor") : nullptr;
+        if (factor && factor->size() >= 3)
+          mesh->diffuse = vec3f((float)(*factor)[0].number,
+                                (float)(*factor)[1].number,
+                                (float)(*factor)[2].number);
+        const JSONValue *texture = pbr ? pbr->find("baseColorTexture") : nullptr;
+        if (texture) {
+          // (preliminary) texture ID: the glTF texture's image
+          mesh->diffuseTextureID
+            = gltf.element("textures",texture->getInt("index",-1)).getInt("source",-1);
+          texcoordSet = texture->getInt("texCoord",0);
+        }
+      }
+
+      // glTF's texture origin is the top left, ours (with textures
+      // flipped on load) the bottom left: texture coordinates always
+      // get converted
+      const int texcoordID
+        = attributes->getInt(("TEXCOORD_"+std::to_string(texcoordSet)).c_str(),-1);
+      if (texcoordID >= 0) {
+        const GLTFAccessor a = gltf.accessor(texcoordID);
+        if (a.count == numVertices && a.numComponents == 2) {
+          mesh->texcoord.resize(numVertices);
+          for (size_t i=0;i<numVertices;i++)
+            mesh->texcoord[i] = vec2f(a.component(i,0),1.f-a.component(i,1));
+          stats.numConverted++;
+        }
+      }
+
+      const int indicesID = primitive.getInt("indices",-1);
+      if (indicesID < 0) {
+        // non-indexed: every three vertices make a triangle
+        mesh->index.resize(numVertices/3);
+        for (size_t i=0;i<numVertices/3;i++)
+          mesh->index[i] = vec3i(int(3*i+0),int(3*i+1),int(3*i+2));
+      } else {
+        const GLTFAccessor a = gltf.accessor(indicesID);
+        if (a.numComponents != 1)
+          throw std::runtime_error("invalid glTF index accessor in "+gltf.fileName);
+        if (a.isArrayOf<int>(GLTF_UNSIGNED_INT,1)
+            && a.count % 3 == 0
+            && viewedIndices.insert(indicesID).second) {
+          mesh->index.setView((vec3i *)a.data,a.count/3);
+          stats.numViews++;
+        } else {
+          mesh->index.resize(a.count/3);
+          for (size_t i=0;i<a.count/3;i++)
+            mesh->index[i] = vec3i(a.index(3*i+0),a.index(3*i+1),a.index(3*i+2));
+          stats.numConverted++;
+        }
+      }
+
+      // (indices of 2^31 and up come out negative)
+      std::atomic<bool> indicesValid(true);
+      gdt::parallel_for_blocked(mesh->index.size(),64*1024,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++) {
+            const vec3i index = mesh->index[i];
+            if (index.x < 0 || size_t(index.x) >= numVertices ||
+                index.y < 0 || size_t(index.y) >= numVertices ||
+                index.z < 0 || size_t(index.z) >= numVertices)
+              indicesValid = false;
+          }
+        });
+      if (!indicesValid)
+        throw std::runtime_error("invalid vertex index in glTF file "+gltf.fileName);
+    } catch (...) {
+      delete mesh;
+      throw;
+    }
+    return mesh;
+  }
+
+  /*! the node's local transform - either a column-major matrix, or
+      translation * rotation * scale */
+  static affine3f nodeTransform(const JSONValue &node)
+  {
+    const JSONValue *matrix = node.find("matrix");
+    if (matrix && matrix->size() == 16) {
+      float m[16];
+      for (int i=0;i<16;i++)
+        m[i] = (float)(*matrix)[i].number;
+      return affine3f(vec3f(m[0],m[1],m[2]),
+                      vec3f(m[4],m[5],m[6]),
+                      vec3f(m[8],m[9],m[10]),
+                      vec3f(m[12],m[13],m[14]));
+    }
+    
+    affine3f xfm = affine3f(one);
+    const JSONValue *t = node.find("translation");
+    if (t && t->size() == 3)
+      xfm = affine3f::translate(vec3f((float)(*t)[0].number,
+                                      (float)(*t)[1].number,
+                                      (float)(*t)[2].number));
+    const JSONValue *r = node.find("rotation");
+    if (r && r->size() == 4) {
+      // glTF stores x,y,z,w
+      QuaternionT<float> q((float)(*r)[3].number,(float)(*r)[0].number,
+                           (float)(*r)[1].number,(float)(*r)[2].number);
+      const float len = sqrtf(q.r*q.r+q.i*q.i+q.j*q.j+q.k*q.k);
+      if (len > 0.f) {
+        q.r /= len; q.i /= len; q.j /= len; q.k /= len;
+        xfm = xfm * affine3f(LinearSpace3f(q));
+      }
+    }
+    const JSONValue *s = node.find("scale");
+    if (s && s->size() == 3)
+      xfm = xfm * affine3f::scale(vec3f((float)(*s)[0].number,
+                                        (float)(*s)[1].number,
+                                        (float)(*s)[2].number));
+    return xfm;
+  }
+
+  /*! walks the node hierarchy, placing an instance of each of a
+      node's glTF mesh's primitives */
+  struct GLTFSceneWalker {
+    GLTFSceneWalker(const GLTFFile &gltf,
+                    const std::vector<std::vector<int>> &primitivesOf)
+      : gltf(gltf), primitivesOf(primitivesOf)
+    {}
+
+    void walk(int nodeID, const affine3f &parentXfm, size_t depth)
+    {
+      // a node hierarchy deeper than there are nodes has a cycle
+      if (depth > gltf.array("nodes").size())
+        throw std::runtime_error("cycle in node hierarchy of "+gltf.fileName);
+      const JSONValue &node = gltf.element("nodes",nodeID);
+      const affine3f xfm = parentXfm * nodeTransform(node);
+      const int meshID = node.getInt("mesh",-1);
+      if (meshID >= 0) {
+        if (size_t(meshID) >= primitivesOf.size())
+          throw std::runtime_error("invalid mesh reference in "+gltf.fileName);
+        for (int primitiveID : primitivesOf[meshID]) {
+          MeshInstance instance;
+          instance.meshID = primitiveID;
+          instance.xfm    = xfm;
+          instances.push_back(instance);
+        }
+      }
+      const JSONValue *children = node.find("children");
+      if (children)
+        for (size_t i=0;i<children->size();i++)
+          walk((int)(*children)[i].number,xfm,depth+1);
+    }
+
+    const GLTFFile &gltf;
+    /*! for each glTF mesh, the IDs of its primitives' meshes */
+    const std::vector<std::vector<int>> &primitivesOf;
+    std::vector<MeshInstance> instances;
+  };
+  
+  /*! decode the given images - embedded in the binary chunk, or
+      external files - all in parallel */
+  static std::vector<Texture *> decodeImages(const GLTFFile &gltf,
+                                             const std::vector<int> &imageIDs,
+                                             const TextureOptions &options)
+  {
+    std::vector<Texture *> decoded(imageIDs.size(),nullptr);
+    gdt::parallel_for(imageIDs.size(),[&](size_t i){
+        const JSONValue &image = gltf.element("images",imageIDs[i]);
+        vec2i res;
+        int   comp;
+        unsigned char *pixels = nullptr;
+        std::string fileName;
+        try {
+          if (image.find("bufferView")) {
+            size_t size = 0;
+            const char *bytes = gltf.bufferView(image.getInt("bufferView",-1),size);
+            pixels = stbi_load_from_memory((const stbi_uc *)bytes,(int)size,
+                                           &res.x,&res.y,&comp,0);
+          } else {
+            // (data: uris are not supported)
+            const std::string uri = image.getString("uri");
+            if (uri != "" && uri.compare(0,5,"data:") != 0) {
+              fileName = gltf.dir+"/"+uri;
+              pixels = stbi_load(fileName.c_str(),&res.x,&res.y,&comp,0);
+            }
+          }
+        } catch (const std::runtime_error &) {
+          pixels = nullptr;
+        }
+        if (!pixels)
+          return;
+        Texture *texture = ingestTexture(pixels,res,comp,false);
+        texture->fileName = fileName;
+        if (options.generateMips)
+          generateMipLevels(texture,options.mipFilter);
+        decoded[i] = texture;
+      });
+    return decoded;
+  }
+  
+  Model *loadGLTF(const std::string &glbFile,
+                  const TextureOptions &textureOptions)
+  {
+    const double startTime = getCurrentTime();
+    GLTFFile gltf(glbFile);
+
+    Model *model = new Model;
+    try {
+      // one mesh per (triangle) primitive
+      GLTFArrayStats stats;
+      std::set<int> viewedIndices;
+      const JSONValue &meshes = gltf.array("meshes");
+      std::vector<std::vector<int>> primitivesOf(meshes.size());
+      size_t numSkipped = 0;
+      for (size_t meshID=0;meshID<meshes.size();meshID++) {
+        const JSONValue *primitives = meshes[meshID].find("primitives");
+        if (!primitives) continue;
+        for (size_t i=0;i<primitives->size();i++) {
+          TriangleMesh *mesh
+            = loadPrimitive(gltf,(*primitives)[i],viewedIndices,stats);
+          if (!mesh) { numSkipped++; continue; }
+          primitivesOf[meshID].push_back((int)model->meshes.size());
+          model->meshes.push_back(mesh);
+        }
+      }
+      if (numSkipped > 0)
+        std::cout << GDT_TERMINAL_YELLOW
+                  << "#osc: skipped " << numSkipped
+                  << " glTF primitives that are not triangle lists"
+                  << GDT_TERMINAL_DEFAULT << std::endl;
+
+      // node transforms become instances - of the default scene, or
+      // (if there is none) of all nodes that are nobody's child
+      GLTFSceneWalker walker(gltf,primitivesOf);
+      const JSONValue &nodes = gltf.array("nodes");
+      std::vector<int> roots;
+      const JSONValue &scenes = gltf.array("scenes");
+      if (scenes.size() > 0) {
+        const JSONValue &scene = gltf.element("scenes",gltf.json.getInt("scene",0));
+        const JSONValue *sceneNodes = scene.find("nodes");
+        if (sceneNodes)
+          for (size_t i=0;i<sceneNodes->size();i++)
+            roots.push_back((int)(*sceneNodes)[i].number);
+      } else {
+        std::vector<bool> isChild(nodes.size(),false);
+        for (size_t nodeID=0;nodeID<nodes.size();nodeID++) {
+          const JSONValue *children = nodes[nodeID].find("children");
+          if (children)
+            for (size_t i=0;i<children->size();i++) {
+              const size_t child = (size_t)(*children)[i].number;
+              if (child < nodes.size()) isChild[child] = true;
+            }
+        }
+        for (size_t nodeID=0;nodeID<nodes.size();nodeID++)
+          if (!isChild[nodeID]) roots.push_back((int)nodeID);
+      }
+      for (int nodeID : roots)
+        walker.walk(nodeID,affine3f(one),0);
+      model->instances.swap(walker.instances);
+
+      dropTrivialInstances(model);
+
+      // textures: the images the meshes use, numbered in the order
+      // the meshes first use them
+      std::vector<int> textureOfImage(gltf.array("images").size(),-1);
+      std::vector<int> imageIDs;
+      for (auto mesh : model->meshes) {
+        const int imageID = mesh->diffuseTextureID;
+        if (imageID < 0) continue;
+        if (size_t(imageID) >= textureOfImage.size())
+          throw std::runtime_error("invalid image reference in "+glbFile);
+        if (textureOfImage[imageID] < 0) {
+          textureOfImage[imageID] = (int)imageIDs.size();
+          imageIDs.push_back(imageID);
+        }
+      }
+      const std::vector<Texture *> decoded
+        = decodeImages(gltf,imageIDs,textureOptions);
+      std::vector<int> finalID(decoded.size(),-1);
+      for (size_t i=0;i<decoded.size();i++)
+        if (decoded[i]) {
+          finalID[i] = (int)model->textures.size();
+          model->textures.push_back(decoded[i]);
+        } else
+          std::cout << GDT_TERMINAL_RED
+                    << "Could not load texture from glTF image #" << imageIDs[i] << "!"
+                    << GDT_TERMINAL_DEFAULT << std::endl;
+      for (auto mesh : model->meshes)
+        if (mesh->diffuseTextureID >= 0)
+          mesh->diffuseTextureID = finalID[textureOfImage[mesh->diffuseTextureID]];
+
+      // keep the file mapped as long as some mesh uses it in place
+      if (stats.numViews > 0)
+        model->mappedFiles.push_back(gltf.file);
+      
+      computeBounds(model);
+
+      size_t numTriangles = 0;
+      for (auto mesh : model->meshes)
+        numTriangles += mesh->index.size();
+      const double loadTime = getCurrentTime()-startTime;
+      std::cout << "Done loading glTF file - found "
+                << model->meshes.size() << " meshes";
+      if (!model->instances.empty())
+        std::cout << " (" << model->instances.size() << " instances)";
+      std::cout << " with " << numTriangles << " triangles, and "
+                << model->textures.size() << " textures; "
+                << stats.numViews << " of " << (stats.numViews+stats.numConverted)
+                << " mesh arrays used in place (in " << loadTime << "s)"
+                << std::endl;
+    } catch (...) {
+      delete model;
+      throw;
+    }
+    applyTextureOptions(model,textureOptions);
+    return model;
+  }
+}
@@ -0,0 +1,166 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Model.h"
+//std
+#include <atomic>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  void buildModelBVH(ModelBVH &modelBVH, const Model *model)
+  {
+    const double startTime = getCurrentTime();
+
+    // one part per instance, or per mesh
+    std::vector<MeshInstance> parts = model->instances;
+    const bool instanced = !parts.empty();
+    if (!instanced)
+      for (int meshID=0;meshID<(int)model->meshes.size();meshID++)
+        parts.push_back({ meshID, affine3f(one) });
+
+    std::vector<uint32_t> &primBegin = modelBVH.primBegin;
+    primBegin.clear();
+    size_t numTriangles = 0;
+    for (auto &part : parts) {
+      primBegin.push_back((uint32_t)numTriangles);
+      numTriangles += model->meshes[part.meshID]->index.size();
+    }
+    primBegin.push_back((uint32_t)numTriangles);
+    if (numTriangles > 0xffffffffull)
+      throw std::runtime_error("too many triangles for a host BVH");
+
+    auto getTriangle = [&](uint32_t primID, vec3f &a, vec3f &b, vec3f &c) {
+      int partID, triangleID;
+      modelBVH.locate(primID,partID,triangleID);
+      const MeshInstance &part = parts[partID];
+      const TriangleMesh &mesh = *model->meshes[part.meshID];
+      const vec3i &tri = mesh.index[triangleID];
+      a = meshVertex(mesh,tri.x);
+      b = meshVertex(mesh,tri.y);
+      c = meshVertex(mesh,tri.z);
+      if (instanced) {
+        a = xfmPoint(part.xfm,a);
+        b = xfmPoint(part.xfm,b);
+        c = xfmPoint(part.xfm,c);
+      }
+    };
+    gdt::buildBVH(modelBVH.bvh,numTriangles,[&](size_t primID){
+        vec3f a, b, c;
+        getTriangle((uint32_t)primID,a,b,c);
+        return box3f(a).including(b).including(c);
+      });
+    const double binaryTime = getCurrentTime()-startTime;
+    gdt::buildBVH8(modelBVH.bvh8,modelBVH.bvh,getTriangle);
+
+    std::cout << "built host BVH over " << numTriangles << " triangles"
+              << " (" << modelBVH.bvh.nodes.size() << " nodes,"
+              << " SAH cost " << gdt::computeSAHCost(modelBVH.bvh)
+              << ", in " << binaryTime << "s; collapsed to "
+              << modelBVH.bvh8.nodes.size() << " 8-wide nodes and "
+              << modelBVH.bvh8.blocks.size() << " leaves"
+              << " in " << (getCurrentTime()-startTime-binaryTime) << "s)" << std::endl;
+  }
+
+  /*! the vertices of one of the mesh's triangles, in the mesh's space */
+  static inline void meshTriangle(const TriangleMesh &mesh, uint32_t primID,
+                                  vec3f &a, vec3f &b, vec3f &c)
+  {
+    const vec3i &tri = mesh.index[primID];
+    a = meshVertex(mesh,tri.x);
+    b = meshVertex(mesh,tri.y);
+    c = meshVertex(mesh,tri.z);
+  }
+
+  float buildMeshBVH(gdt::BVH8 &wide, const TriangleMesh &mesh)
+  {
+    auto getTriangle = [&](uint32_t primID, vec3f &a, vec3f &b, vec3f &c) {
+      meshTriangle(mesh,primID,a,b,c);
+    };
+    gdt::BVH bvh;
+    gdt::buildBVH(bvh,mesh.index.size(),[&](size_t primID){
+        vec3f a, b, c;
+        getTriangle((uint32_t)primID,a,b,c);
+        return box3f(a).including(b).including(c);
+      });
+    gdt::buildBVH8(wide,bvh,getTriangle);
+    return gdt::computeSAHCost(wide);
+  }
+
+  void buildModelTwoLevelBVH(ModelTwoLevelBVH &modelBVH, const Model *model)
+  {
+    const double startTime = getCurrentTime();
+
+    // one bottom-level BVH per mesh, in the mesh's own space
+    const int numMeshes = (int)model->meshes.size();
+    modelBVH.meshBVH.resize(numMeshes);
+    modelBVH.meshBuildCost.resize(numMeshes);
+    modelBVH.meshCost.resize(numMeshes);
+    size_t numTriangles = 0;
+    for (int meshID=0;meshID<numMeshes;meshID++) {
+      const TriangleMesh &mesh = *model->meshes[meshID];
+      modelBVH.meshBuildCost[meshID] = modelBVH.meshCost[meshID]
+        = buildMeshBVH(modelBVH.meshBVH[meshID],mesh);
+      numTriangles += mesh.index.size();
+    }
+    const double blasTime = getCurrentTime()-startTime;
+
+    // and a top-level one over the instances (or each mesh, once)
+    gdt::TwoLevelBVH8 &bvh = modelBVH.bvh;
+    bvh.blas.clear();
+    for (auto &blas : modelBVH.meshBVH)
+      bvh.blas.push_back(&blas);
+    bvh.instances.clear();
+    for (auto &instance : model->instances)
+      bvh.instances.push_back({ instance.xfm, (uint32_t)instance.meshID, ~0u });
+    if (model->instances.empty())
+      for (int meshID=0;meshID<numMeshes;meshID++)
+        bvh.instances.push_back({ affine3f(one), (uint32_t)meshID, ~0u });
+    gdt::buildTLAS(bvh);
+
+    std::cout << "built two-level host BVH: " << numMeshes << " bottom-level BVHs over "
+              << numTriangles << " triangles in " << blasTime << "s, "
+              << "top-level BVH over " << bvh.instances.size() << " instances in "
+              << (getCurrentTime()-startTime-blasTime) << "s" << std::endl;
+  }
+
+  bool updateMeshBVH(ModelTwoLevelBVH &modelBVH, const Model *model, int meshID,
+                     float maxCostRatio)
+  {
+    const TriangleMesh &mesh = *model->meshes[meshID];
+    gdt::BVH8 &bvh = modelBVH.meshBVH[meshID];
+    gdt::refitBVH8(bvh,[&](uint32_t primID, vec3f &a, vec3f &b, vec3f &c){
+        meshTriangle(mesh,primID,a,b,c);
+      });
+    modelBVH.meshCost[meshID] = gdt::computeSAHCost(bvh);
+    if (!(modelBVH.meshCost[meshID] > maxCostRatio*modelBVH.meshBuildCost[meshID]))
+      return false;
+
+    modelBVH.meshBuildCost[meshID] = modelBVH.meshCost[meshID] = buildMeshBVH(bvh,mesh);
+    return true;
+  }
+
+  int updateMeshBVHs(ModelTwoLevelBVH &modelBVH, const Model *model,
+                     const std::vector<int> &meshIDs, float maxCostRatio)
+  {
+    std::atomic<int> numRebuilds(0);
+    parallel_for(meshIDs.size(),[&](size_t i){
+        numRebuilds += updateMeshBVH(modelBVH,model,meshIDs[i],maxCostRatio);
+      });
+    return numRebuilds;
+  }
+
+}
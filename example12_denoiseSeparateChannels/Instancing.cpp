@@ -0,0 +1,330 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Model.h"
+#include "gdt/parallel/parallel_for.h"
+//std
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <float.h>
+#include <string.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! 64-bit FNV-1a, continued from 'h' */
+  static uint64_t hashBytes(const void *data, size_t numBytes,
+                            uint64_t h = 0xcbf29ce484222325ULL)
+  {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i=0;i<numBytes;i++) {
+      h ^= bytes[i];
+      h *= 0x100000001b3ULL;
+    }
+    return h;
+  }
+
+  /*! hash of everything about a mesh that neither a translation nor
+      an affine transform changes: its material, its topology, which
+      attributes it has, and its texture coordinates. Positions (and
+      normals) only get compared - with a tolerance - once two meshes'
+      hashes match */
+  static uint64_t topologyHash(const TriangleMesh *mesh)
+  {
+    const uint64_t counts[4] = {
+      mesh->vertex.size(), mesh->index.size(),
+      mesh->normal.size(), mesh->texcoord.size()
+    };
+    uint64_t h = hashBytes(counts,sizeof(counts));
+    h = hashBytes(&mesh->diffuse,sizeof(mesh->diffuse),h);
+    h = hashBytes(&mesh->diffuseTextureID,sizeof(mesh->diffuseTextureID),h);
+    h = hashBytes(mesh->index.data(),mesh->index.size()*sizeof(vec3i),h);
+    h = hashBytes(mesh->texcoord.data(),mesh->texcoord.size()*sizeof(vec2f),h);
+    return h;
+  }
+
+  static bool sameTopology(const TriangleMesh *a, const TriangleMesh *b)
+  {
+    return a->vertex.size()      == b->vertex.size()
+      &&   a->index.size()       == b->index.size()
+      &&   a->normal.size()      == b->normal.size()
+      &&   a->texcoord.size()    == b->texcoord.size()
+      &&   a->diffuseTextureID   == b->diffuseTextureID
+      &&   !memcmp(&a->diffuse,&b->diffuse,sizeof(a->diffuse))
+      &&   !memcmp(a->index.data(),b->index.data(),
+                   a->index.size()*sizeof(vec3i))
+      &&   !memcmp(a->texcoord.data(),b->texcoord.data(),
+                   a->texcoord.size()*sizeof(vec2f));
+  }
+
+  /*! how far apart two positions in a mesh with given bounds may be
+      and still count as the same: relative to the mesh's size, plus
+      a few float ulps of its distance from the origin */
+  static float positionTolerance(const box3f &bounds)
+  {
+    const vec3f farthest = max(abs(bounds.lower),abs(bounds.upper));
+    return 1e-5f*length(bounds.span())
+      +    4.f*FLT_EPSILON*max(farthest.x,max(farthest.y,farthest.z));
+  }
+
+  /*! how far apart two meshes' bucket keys (see Bucket) may be for
+      them to still be worth comparing: for translation keys, that is
+      a position tolerance; affine keys are relative to the mesh's
+      size, so their tolerance is, too (with some slack, as they are
+      computed from four positions) */
+  static float keyTolerance(const TriangleMesh *mesh, bool allowAffine)
+  {
+    const float tolerance = positionTolerance(mesh->bounds);
+    if (!allowAffine)
+      return tolerance;
+    return 4.f*tolerance/std::max(length(mesh->bounds.span()),1e-30f);
+  }
+
+  static bool sameNormal(const vec3f &a, const vec3f &b)
+  {
+    return dot(a,b) >= 0.99999f*length(a)*length(b);
+  }
+
+  template<typename Distance>
+  static int farthest(const MeshArray<vec3f> &v, const Distance &distance)
+  {
+    int   best = 0;
+    float bestDistance = 0.f;
+    for (size_t i=1;i<v.size();i++) {
+      const float d = distance(v[i]);
+      if (d > bestDistance) { bestDistance = d; best = (int)i; }
+    }
+    return best;
+  }
+
+  /*! all meshes seen so far that share a topology hash and are not
+      instances of others, each under a key that an instance of it
+      has to have (roughly) the same value of: the x extent of its
+      bounds for translations, and for affine transforms one of its
+      vertices in coordinates relative to a frame (a vertex, and the
+      edges from it to three others) that affine transforms do not
+      change. The frame's vertices get picked from the first mesh of
+      the bucket, but work for all its affine transforms as well */
+  struct Bucket {
+    void pickFrame(const TriangleMesh *mesh)
+    {
+      const MeshArray<vec3f> &v = mesh->vertex;
+      if (v.size() < 4) return;
+      // the vertex farthest from the first one, then the one
+      // farthest from the line through those two, then the one
+      // farthest from the plane through those three
+      frame[1] = farthest(v,[&](const vec3f &p){
+          return length(p-v[0]);
+        });
+      const vec3f e1 = v[frame[1]]-v[0];
+      frame[2] = farthest(v,[&](const vec3f &p){
+          return length(cross(e1,p-v[0]));
+        });
+      const vec3f n = cross(e1,v[frame[2]]-v[0]);
+      if (!(dot(n,n) > 0.f)) return;
+      frame[3] = farthest(v,[&](const vec3f &p){
+          return fabsf(dot(n,p-v[0]));
+        });
+      if (!(fabsf(dot(normalize(n),v[frame[3]]-v[0])) > 1e-4f*length(e1)))
+        // flat: the third edge gets made up from the other two
+        frame[3] = -1;
+      // and a vertex to compute the key from: any that is not part of
+      // the frame
+      keyVertex = int(v.size()/2);
+      while (keyVertex == frame[1] || keyVertex == frame[2] || keyVertex == frame[3])
+        keyVertex = (keyVertex+1) % int(v.size());
+      hasFrame = true;
+    }
+
+    /*! the frame's three edges in given mesh, as the columns of a
+        matrix; for a flat mesh, the third one is the normal of the
+        first two (scaled such that it changes the same way they do
+        under uniform scaling) */
+    linear3f basis(const MeshArray<vec3f> &v) const
+    {
+      const vec3f e1 = v[frame[1]]-v[0];
+      const vec3f e2 = v[frame[2]]-v[0];
+      vec3f e3;
+      if (frame[3] >= 0)
+        e3 = v[frame[3]]-v[0];
+      else {
+        const vec3f n = cross(e1,e2);
+        e3 = n*(1.f/sqrtf(length(n)));
+      }
+      return linear3f(e1,e2,e3);
+    }
+
+    /*! whether the frame is degenerate in given mesh (which then
+        cannot be matched up to an affine transform) */
+    bool degenerate(const MeshArray<vec3f> &v) const
+    {
+      const linear3f b = basis(v);
+      return !(fabsf(b.det()) > 1e-6f*length(b.vx)*length(b.vy)*length(b.vz));
+    }
+
+    float key(const TriangleMesh *mesh, bool allowAffine) const
+    {
+      if (!allowAffine)
+        return mesh->bounds.span().x;
+      const MeshArray<vec3f> &v = mesh->vertex;
+      const vec3f c = xfmVector(basis(v).inverse(),v[keyVertex]-v[0]);
+      return c.x+c.y+c.z;
+    }
+
+    bool     hasFrame { false };
+    int      frame[4] { 0, 0, 0, -1 };
+    int      keyVertex { 0 };
+    std::multimap<float,int> prototypes;
+  };
+
+  /*! whether 'mesh' is the prototype's mesh, transformed by 'l' and
+      some translation. Both get compared relative to their first
+      vertex, so that far-away meshes do not lose the precision they
+      have relative to themselves */
+  static bool matches(const TriangleMesh *proto,
+                      const TriangleMesh *mesh,
+                      const linear3f &l)
+  {
+    const float tolerance
+      = positionTolerance(proto->bounds)+positionTolerance(mesh->bounds);
+    const vec3f protoOrigin = proto->vertex[0];
+    const vec3f meshOrigin  = mesh->vertex[0];
+    for (size_t i=1;i<mesh->vertex.size();i++)
+      if (length(xfmVector(l,proto->vertex[i]-protoOrigin)
+                 -(mesh->vertex[i]-meshOrigin)) > tolerance)
+        return false;
+    const linear3f normalXfm = l.inverse().transposed();
+    for (size_t i=0;i<mesh->normal.size();i++)
+      if (!sameNormal(xfmVector(normalXfm,proto->normal[i]),mesh->normal[i]))
+        return false;
+    return true;
+  }
+
+  /*! the transform that makes 'mesh' out of the prototype's mesh, if
+      there is one: for affine transforms, the one that maps the
+      frame in the prototype onto the frame in 'mesh' */
+  static bool match(const Bucket &bucket,
+                    const TriangleMesh *proto,
+                    const TriangleMesh *mesh,
+                    bool allowAffine,
+                    affine3f &xfm)
+  {
+    if (!sameTopology(proto,mesh) || mesh->vertex.empty())
+      return false;
+    linear3f l(one);
+    if (allowAffine)
+      l = bucket.basis(mesh->vertex)*bucket.basis(proto->vertex).inverse();
+    else if (length(proto->bounds.span()-mesh->bounds.span())
+             > positionTolerance(proto->bounds)+positionTolerance(mesh->bounds))
+      return false;
+    if (!matches(proto,mesh,l))
+      return false;
+    xfm = affine3f(l,mesh->vertex[0]-xfmVector(l,proto->vertex[0]));
+    return true;
+  }
+
+  /*! how many bytes the arrays of given mesh take */
+  static size_t meshBytes(const TriangleMesh *mesh)
+  {
+    return mesh->vertex.size()*sizeof(vec3f)
+      + mesh->normal.size()*sizeof(vec3f)
+      + mesh->texcoord.size()*sizeof(vec2f)
+      + mesh->index.size()*sizeof(vec3i);
+  }
+
+  void detectInstances(Model *model, bool allowAffine)
+  {
+    const double startTime = getCurrentTime();
+    const bool   wasPacked = isPacked(model);
+    const size_t numMeshes = model->meshes.size();
+    size_t bytesBefore = 0;
+    for (auto mesh : model->meshes)
+      bytesBefore += meshBytes(mesh);
+
+    std::vector<uint64_t> hash(numMeshes);
+    gdt::parallel_for(numMeshes,[&](size_t meshID){
+        hash[meshID] = topologyHash(model->meshes[meshID]);
+      });
+
+    std::unordered_map<uint64_t,Bucket> buckets;
+    std::vector<TriangleMesh *> uniqueMeshes;
+    std::vector<MeshInstance>   instances(numMeshes);
+    for (size_t meshID=0;meshID<numMeshes;meshID++) {
+      TriangleMesh *mesh = model->meshes[meshID];
+      Bucket &bucket = buckets[hash[meshID]];
+      if (allowAffine && bucket.prototypes.empty() && !bucket.hasFrame)
+        bucket.pickFrame(mesh);
+      // meshes the frame does not work for stay unique
+      const bool matchable
+        = !allowAffine
+        || (bucket.hasFrame && !bucket.degenerate(mesh->vertex));
+
+      int found = -1;
+      affine3f xfm;
+      float key = 0.f;
+      if (matchable) {
+        key = bucket.key(mesh,allowAffine);
+        const float tolerance = keyTolerance(mesh,allowAffine);
+        for (auto it = bucket.prototypes.lower_bound(key-tolerance);
+             found < 0 && it != bucket.prototypes.end() && it->first <= key+tolerance;
+             ++it)
+          if (match(bucket,uniqueMeshes[it->second],mesh,allowAffine,xfm))
+            found = it->second;
+      }
+
+      if (found >= 0) {
+        instances[meshID].meshID = found;
+        instances[meshID].xfm    = xfm;
+        delete mesh;
+        continue;
+      }
+      const int uniqueID = (int)uniqueMeshes.size();
+      uniqueMeshes.push_back(mesh);
+      instances[meshID].meshID = uniqueID;
+      instances[meshID].xfm    = affine3f(one);
+      if (matchable)
+        bucket.prototypes.insert(std::make_pair(key,uniqueID));
+    }
+
+    if (uniqueMeshes.size() < numMeshes) {
+      model->meshes.swap(uniqueMeshes);
+      // a model that already came with instances (say, from a glTF
+      // scene graph) keeps those, now placing the unique meshes
+      for (auto &instance : model->instances) {
+        const MeshInstance &found = instances[instance.meshID];
+        instance.meshID = found.meshID;
+        instance.xfm    = instance.xfm * found.xfm;
+      }
+      if (model->instances.empty())
+        model->instances.swap(instances);
+      // the removed duplicates' ranges in the arenas are dead now
+      if (wasPacked)
+        packMeshes(model);
+    }
+
+    size_t bytesAfter = model->instances.size()*sizeof(MeshInstance);
+    for (auto mesh : model->meshes)
+      bytesAfter += meshBytes(mesh);
+    std::cout << "found " << model->meshes.size() << " unique meshes"
+              << " in " << numMeshes
+              << " (" << (allowAffine ? "affine" : "translation") << " instancing;"
+              << " mesh data " << prettyNumber(bytesBefore) << "B"
+              << " -> " << prettyNumber(bytesAfter) << "B"
+              << ", in " << (getCurrentTime()-startTime) << "s)" << std::endl;
+  }
+
+}
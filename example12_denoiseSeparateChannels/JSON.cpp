@@ -0,0 +1,309 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "JSON.h"
+//std
+#include <stdexcept>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  const JSONValue *JSONValue::find(const char *key) const
+  {
+    if (type != OBJECT) return nullptr;
+    for (size_t i=0;i<keys.size();i++)
+      if (keys[i] == key)
+        return &elements[i];
+    return nullptr;
+  }
+
+  double JSONValue::getNumber(const char *key, double fallback) const
+  {
+    const JSONValue *value = find(key);
+    return (value && value->type == NUMBER) ? value->number : fallback;
+  }
+  
+  int JSONValue::getInt(const char *key, int fallback) const
+  {
+    const JSONValue *value = find(key);
+    return (value && value->type == NUMBER) ? (int)value->number : fallback;
+  }
+  
+  bool JSONValue::getBool(const char *key, bool fallback) const
+  {
+    const JSONValue *value = find(key);
+    return (value && value->type == BOOLEAN) ? value->boolean : fallback;
+  }
+  
+  std::string JSONValue::getString(const char *key,
+                                   const std::string &fallback) const
+  {
+    const JSONValue *value = find(key);
+    return (value && value->type == STRING) ? value->string : fallback;
+  }
+
+  /*! recursive descent over the JSON text */
+  struct JSONParser {
+    /*! deeper nesting than this is rejected, rather than running
+        out of stack */
+    enum { MAX_DEPTH = 256 };
+    
+    JSONParser(const char *begin, const char *end)
+      : begin(begin), ptr(begin), end(end), scratch(MAX_DEPTH+1)
+    {}
+
+    void fail(const std::string &what) const
+    {
+      throw std::runtime_error("JSON: "+what+" at offset "
+                               +std::to_string(ptr-begin));
+    }
+    
+    void skipSpace()
+    {
+      while (ptr < end && (*ptr == ' ' || *ptr == '\t' ||
+                           *ptr == '\n' || *ptr == '\r'))
+        ptr++;
+    }
+
+    void expect(char c)
+    {
+      skipSpace();
+      if (ptr == end || *ptr != c)
+        fail(std::string("expected '")+c+"'");
+      ptr++;
+    }
+
+    /*! whether the next (non-space) character is 'c'; consumes it
+        if it is */
+    bool accept(char c)
+    {
+      skipSpace();
+      if (ptr == end || *ptr != c) return false;
+      ptr++;
+      return true;
+    }
+    
+    bool acceptWord(const char *word)
+    {
+      const size_t length = strlen(word);
+      if (size_t(end-ptr) < length || strncmp(ptr,word,length) != 0)
+        return false;
+      ptr += length;
+      return true;
+    }
+    
+    static void appendUTF8(std::string &s, uint32_t c)
+    {
+      if (c < 0x80)
+        s += char(c);
+      else if (c < 0x800) {
+        s += char(0xc0 | (c >> 6));
+        s += char(0x80 | (c & 0x3f));
+      } else if (c < 0x10000) {
+        s += char(0xe0 | (c >> 12));
+        s += char(0x80 | ((c >> 6) & 0x3f));
+        s += char(0x80 | (c & 0x3f));
+      } else {
+        s += char(0xf0 | (c >> 18));
+        s += char(0x80 | ((c >> 12) & 0x3f));
+        s += char(0x80 | ((c >> 6) & 0x3f));
+        s += char(0x80 | (c & 0x3f));
+      }
+    }
+    
+    uint32_t parseHex4()
+    {
+      if (end-ptr < 4) fail("truncated \\u escape");
+      uint32_t c = 0;
+      for (int i=0;i<4;i++) {
+        const char h = *ptr++;
+        c <<= 4;
+        if      (h >= '0' && h <= '9') c |= h-'0';
+        else if (h >= 'a' && h <= 'f') c |= h-'a'+10;
+        else if (h >= 'A' && h <= 'F') c |= h-'A'+10;
+        else fail("invalid \\u escape");
+      }
+      return c;
+    }
+    
+    std::string parseString()
+    {
+      expect('"');
+      std::string s;
+      while (true) {
+        // copy everything up to the next quote or escape in one go
+        const char *run = ptr;
+        while (ptr < end && *ptr != '"' && *ptr != '\\') ptr++;
+        s.append(run,ptr);
+        if (ptr == end) fail("unterminated string");
+        if (*ptr++ == '"') return s;
+
+        if (ptr == end) fail("unterminated string");
+        const char c = *ptr++;
+        switch (c) {
+        case '"': case '\\': case '/': s += c; break;
+        case 'b': s += '\b'; break;
+        case 'f': s += '\f'; break;
+        case 'n': s += '\n'; break;
+        case 'r': s += '\r'; break;
+        case 't': s += '\t'; break;
+        case 'u': {
+          uint32_t code = parseHex4();
+          // utf-16 surrogate pair
+          if (code >= 0xd800 && code < 0xdc00
+              && end-ptr >= 6 && ptr[0] == '\\' && ptr[1] == 'u') {
+            ptr += 2;
+            const uint32_t low = parseHex4();
+            if (low < 0xdc00 || low >= 0xe000)
+              fail("invalid utf-16 surrogate pair");
+            code = 0x10000 + ((code-0xd800) << 10) + (low-0xdc00);
+          }
+          appendUTF8(s,code);
+        } break;
+        default:
+          fail("invalid escape in string");
+        }
+      }
+    }
+
+    void parseNumber(JSONValue &value)
+    {
+      const char *start = ptr;
+      if (ptr < end && *ptr == '-') ptr++;
+      // fast path for (the many) integers - offsets, counts, indices
+      const char *digits = ptr;
+      int64_t integer = 0;
+      while (ptr < end && isdigit((unsigned char)*ptr) && ptr-digits < 15)
+        integer = 10*integer+(*ptr++ - '0');
+      if (ptr > digits &&
+          (ptr == end || !(isdigit((unsigned char)*ptr) || *ptr == '.' ||
+                           *ptr == 'e' || *ptr == 'E'))) {
+        value.type   = JSONValue::NUMBER;
+        value.number = double(*start == '-' ? -integer : integer);
+        return;
+      }
+      
+      while (ptr < end && (isdigit((unsigned char)*ptr) || *ptr == '.' ||
+                           *ptr == 'e' || *ptr == 'E' ||
+                           *ptr == '+' || *ptr == '-'))
+        ptr++;
+      // strtod needs a terminated string; numbers are short
+      char text[64];
+      const size_t length = ptr-start;
+      char *parsedEnd = nullptr;
+      if (length > 0 && length < sizeof(text)) {
+        memcpy(text,start,length);
+        text[length] = 0;
+        value.number = strtod(text,&parsedEnd);
+      }
+      if (parsedEnd != text+length) {
+        ptr = start;
+        fail("invalid number");
+      }
+      value.type = JSONValue::NUMBER;
+    }
+    
+    void parseValue(JSONValue &value, int depth)
+    {
+      if (depth > MAX_DEPTH) fail("too deeply nested");
+      skipSpace();
+      if (ptr == end) fail("unexpected end of input");
+      switch (*ptr) {
+      case '{': {
+        ptr++;
+        value.type = JSONValue::OBJECT;
+        if (accept('}')) return;
+        Scratch &level = scratch[depth];
+        do {
+          skipSpace();
+          level.keys.push_back(parseString());
+          expect(':');
+          level.elements.push_back(JSONValue());
+          parseValue(level.elements.back(),depth+1);
+        } while (accept(','));
+        expect('}');
+        level.moveTo(value);
+      } return;
+      case '[': {
+        ptr++;
+        value.type = JSONValue::ARRAY;
+        if (accept(']')) return;
+        Scratch &level = scratch[depth];
+        do {
+          level.elements.push_back(JSONValue());
+          parseValue(level.elements.back(),depth+1);
+        } while (accept(','));
+        expect(']');
+        level.moveTo(value);
+      } return;
+      case '"':
+        value.type   = JSONValue::STRING;
+        value.string = parseString();
+        return;
+      default:
+        if (acceptWord("true")) {
+          value.type    = JSONValue::BOOLEAN;
+          value.boolean = true;
+        } else if (acceptWord("false")) {
+          value.type    = JSONValue::BOOLEAN;
+          value.boolean = false;
+        } else if (acceptWord("null"))
+          value.type = JSONValue::NULL_VALUE;
+        else
+          parseNumber(value);
+      }
+    }
+
+    /*! where the elements of the array/object currently getting
+        parsed at some depth collect; they then get moved into an
+        exactly-sized array, rather than each array growing (and
+        re-allocating) one element at a time */
+    struct Scratch {
+      void moveTo(JSONValue &value)
+      {
+        value.elements.reserve(elements.size());
+        for (auto &element : elements)
+          value.elements.push_back(std::move(element));
+        value.keys.reserve(keys.size());
+        for (auto &key : keys)
+          value.keys.push_back(std::move(key));
+        elements.clear();
+        keys.clear();
+      }
+      std::vector<JSONValue>   elements;
+      std::vector<std::string> keys;
+    };
+
+    
+    const char *begin, *ptr, *end;
+    std::vector<Scratch> scratch;
+  };
+  
+  JSONValue parseJSON(const char *begin, const char *end)
+  {
+    JSONParser parser(begin,end);
+    JSONValue value;
+    parser.parseValue(value,0);
+    parser.skipSpace();
+    if (parser.ptr != end)
+      parser.fail("trailing characters");
+    return value;
+  }
+}
@@ -0,0 +1,66 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! a parsed JSON value - just enough of a DOM to read glTF and
+      scene files; numbers all become doubles */
+  struct JSONValue {
+    enum Type { NULL_VALUE, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+    bool isArray()  const { return type == ARRAY; }
+    bool isObject() const { return type == OBJECT; }
+    bool isNumber() const { return type == NUMBER; }
+    bool isString() const { return type == STRING; }
+    
+    /*! number of elements (arrays) or members (objects) */
+    size_t size() const { return elements.size(); }
+    const JSONValue &operator[](size_t i) const { return elements[i]; }
+
+    /*! the object member of given name; nullptr if there is none
+        (or this is not an object) */
+    const JSONValue *find(const char *key) const;
+
+    /*! @{ the object member of given name, or 'fallback' if there
+        is no such member (or it has a different type) */
+    double      getNumber(const char *key, double fallback) const;
+    int         getInt(const char *key, int fallback) const;
+    bool        getBool(const char *key, bool fallback) const;
+    std::string getString(const char *key,
+                          const std::string &fallback = "") const;
+    /*! @} */
+
+    Type        type    { NULL_VALUE };
+    bool        boolean { false };
+    double      number  { 0. };
+    /*! string values (utf-8) */
+    std::string string;
+    /*! array elements, or object members' values, in file order */
+    std::vector<JSONValue>   elements;
+    /*! object members' names, same order as 'elements' */
+    std::vector<std::string> keys;
+  };
+
+  /*! parse the JSON text in [begin,end); throws a std::runtime_error
+      (saying where) if it is not valid JSON */
+  JSONValue parseJSON(const char *begin, const char *end);
+}
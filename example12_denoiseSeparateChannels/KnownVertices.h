@@ -0,0 +1,108 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "3rdParty/tiny_obj_loader.h"
+#include <vector>
+#include <stdint.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! open-addressing hash table that maps a tinyobj (vertex,normal,
+      texcoord) index triple to the ID that vertex got in the mesh
+      we're currently building. Slots are tagged with a 'generation'
+      counter, so clear() is O(1) and the same table (and its
+      allocated memory) gets re-used across all meshes of a model */
+  struct KnownVertices {
+    struct Slot {
+      tinyobj::index_t key;
+      int              value;
+      uint32_t         generation;
+    };
+
+    KnownVertices() { slots.resize(1024); }
+
+    /*! forget all known vertices, but keep the memory */
+    void clear()
+    {
+      numUsed = 0;
+      if (++generation == 0) {
+        for (auto &slot : slots) slot.generation = 0;
+        generation = 1;
+      }
+    }
+
+    /*! return reference to the value stored for given key; if the
+        key was not yet known it gets inserted with a value of -1 */
+    int &findOrInsert(const tinyobj::index_t &idx)
+    {
+      if (2*(numUsed+1) > slots.size())
+        grow();
+      Slot *slot = lookup(idx);
+      if (slot->generation != generation) {
+        slot->key        = idx;
+        slot->value      = -1;
+        slot->generation = generation;
+        numUsed++;
+      }
+      return slot->value;
+    }
+
+  private:
+    static inline size_t hash(const tinyobj::index_t &idx)
+    {
+      uint64_t h
+        = uint64_t(uint32_t(idx.vertex_index))
+        | (uint64_t(uint32_t(idx.normal_index)) << 32);
+      h ^= uint64_t(uint32_t(idx.texcoord_index)) * 0xc2b2ae3d27d4eb4fULL;
+      h *= 0x9e3779b97f4a7c15ULL;
+      return size_t(h ^ (h >> 32));
+    }
+
+    /*! linear probing; returns either the slot holding this key, or
+        the first free one (for the current generation) */
+    inline Slot *lookup(const tinyobj::index_t &idx)
+    {
+      const size_t mask = slots.size()-1;
+      for (size_t i = hash(idx) & mask;; i = (i+1) & mask) {
+        Slot &slot = slots[i];
+        if (slot.generation != generation)
+          return &slot;
+        if (slot.key.vertex_index   == idx.vertex_index &&
+            slot.key.normal_index   == idx.normal_index &&
+            slot.key.texcoord_index == idx.texcoord_index)
+          return &slot;
+      }
+    }
+
+    void grow()
+    {
+      std::vector<Slot> oldSlots(2*slots.size());
+      oldSlots.swap(slots);
+      for (auto &old : oldSlots)
+        if (old.generation == generation)
+          *lookup(old.key) = old;
+    }
+
+    std::vector<Slot> slots;
+    size_t            numUsed    { 0 };
+    uint32_t          generation { 1 };
+  };
+
+} // ::osc
@@ -17,6 +17,7 @@
 #pragma once
 
 #include "gdt/math/vec.h"
+#include "gdt/math/quantize.h"
 #include "optix7.h"
 
 namespace osc {
@@ -31,8 +32,23 @@ namespace osc {
     vec3f *normal;
     vec2f *texcoord;
     vec3i *index;
+    /*! @{ compact vertex attributes (see compactVertexAttributes()),
+        for whichever of the above is null */
+    vec3us            *compactVertex;
+    PositionQuantizer  vertexQuantizer;
+    octNormal16       *compactNormal;
+    texcoord16        *compactTexcoord;
+    bool               halfTexcoords;
+    /*! @} */
     bool                hasTexture;
     cudaTextureObject_t texture;
+    /*! resolution of the texture's finest mip level */
+    vec2i               textureSize;
+  };
+  
+  /*! device-side copy of a QuadLight */
+  struct QuadLightData {
+    vec3f origin, du, dv, power;
   };
   
   struct LaunchParams
@@ -55,9 +71,12 @@ namespace osc {
       vec3f vertical;
     } camera;
 
+    /*! the scene's quad lights; each light sample picks one of them
+        at random */
     struct {
-      vec3f origin, du, dv, power;
-    } light;
+      QuadLightData *quads;
+      int            count;
+    } lights;
     
     OptixTraversableHandle traversable;
   };
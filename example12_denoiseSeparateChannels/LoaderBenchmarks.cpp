@@ -0,0 +1,792 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "Benchmarks.h"
+#include "Scene.h"
+#include "GLTF.h"
+#include "OBJParser.h"
+#include "ModelCache.h"
+#include "TextureMips.h"
+#include "KnownVertices.h"
+#include "MappedFile.h"
+#include "gdt/parallel/parallel_for.h"
+//std
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#  include <process.h>
+#  define getpid _getpid
+#else
+#  include <unistd.h>
+#endif
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  TemporaryModelCopy::TemporaryModelCopy(const std::string &original)
+  {
+    const size_t slash = original.rfind('/');
+    size_t dot = original.rfind('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+      dot = original.size();
+    fileName
+      = original.substr(0,dot)
+      + ".benchmark-"+std::to_string((long long)getpid())
+      + original.substr(dot);
+#ifndef _WIN32
+    // a hard link is as good as a copy, and free
+    if (link(original.c_str(),fileName.c_str()) == 0)
+      return;
+#endif
+    std::ifstream in(original.c_str(),std::ios::binary);
+    std::ofstream out(fileName.c_str(),std::ios::binary);
+    if (in && out)
+      out << in.rdbuf();
+    out.close();
+    if (!in || !out) {
+      std::remove(fileName.c_str());
+      throw std::runtime_error("could not copy "+original+" to "+fileName);
+    }
+  }
+
+  TemporaryModelCopy::~TemporaryModelCopy()
+  {
+    std::remove(modelCacheFileName(fileName).c_str());
+    std::remove(fileName.c_str());
+  }
+  
+  /*! the order std::map used to dedup vertices by */
+  struct IndexLess {
+    bool operator()(const tinyobj::index_t &a, const tinyobj::index_t &b) const
+    {
+      if (a.vertex_index < b.vertex_index) return true;
+      if (a.vertex_index > b.vertex_index) return false;
+      if (a.normal_index < b.normal_index) return true;
+      if (a.normal_index > b.normal_index) return false;
+      return a.texcoord_index < b.texcoord_index;
+    }
+  };
+  
+  void benchmarkOBJLoader(const std::string &objFile)
+  {
+    tinyobj::attrib_t attributes;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    const std::string modelDir = objFile.substr(0,objFile.rfind('/')+1);
+    if (!parseOBJParallel(attributes,shapes,materials,err,objFile,modelDir))
+      throw std::runtime_error("Could not read OBJ model from "+objFile+" : "+err);
+    size_t numTriangles = 0;
+    for (auto &shape : shapes)
+      numTriangles += shape.mesh.num_face_vertices.size();
+
+    // dedup all corners of each shape, once through a std::map (with
+    // a find() and an operator[] per corner, as addVertex() used to),
+    // and once through KnownVertices
+    double startTime = getCurrentTime();
+    size_t numVerticesMap = 0;
+    for (auto &shape : shapes) {
+      std::map<tinyobj::index_t,int,IndexLess> knownVertices;
+      for (auto &idx : shape.mesh.indices)
+        if (knownVertices.find(idx) == knownVertices.end())
+          knownVertices[idx] = (int)numVerticesMap++;
+    }
+    const double mapTime = getCurrentTime()-startTime;
+    
+    startTime = getCurrentTime();
+    size_t numVerticesHash = 0;
+    KnownVertices knownVertices;
+    for (auto &shape : shapes) {
+      knownVertices.clear();
+      for (auto &idx : shape.mesh.indices) {
+        int &knownID = knownVertices.findOrInsert(idx);
+        if (knownID < 0)
+          knownID = (int)numVerticesHash++;
+      }
+    }
+    const double hashTime = getCurrentTime()-startTime;
+    if (numVerticesMap != numVerticesHash)
+      throw std::runtime_error("benchmarkOBJLoader: std::map and KnownVertices"
+                               " disagree on the number of vertices");
+
+    // and the whole loader, on a copy that has no cache yet
+    TemporaryModelCopy copy(objFile);
+    startTime = getCurrentTime();
+    Model *model = loadOBJ(copy.fileName);
+    const double loadTime = getCurrentTime()-startTime;
+    delete model;
+
+    std::cout << "deduplicated " << 3*numTriangles << " corners into "
+              << numVerticesHash << " vertices: std::map "
+              << prettyDouble(numTriangles/std::max(mapTime,1e-6)) << " triangles/s, "
+              << "hash table " << prettyDouble(numTriangles/std::max(hashTime,1e-6))
+              << " triangles/s; loadOBJ " << prettyDouble(numTriangles/std::max(loadTime,1e-6))
+              << " triangles/s (" << loadTime << "s)" << std::endl;
+  }
+  
+  /*! throw if 'a' and 'b' don't hold the same bits */
+  template<typename T>
+  static void checkSame(const std::vector<T> &a,
+                        const std::vector<T> &b,
+                        const std::string &what)
+  {
+    if (a.size() != b.size())
+      throw std::runtime_error("parseOBJParallel: "+what+" has "
+                               +std::to_string(b.size())+" elements, tinyobj has "
+                               +std::to_string(a.size()));
+    if (!a.empty() && memcmp(a.data(),b.data(),a.size()*sizeof(T)) != 0)
+      throw std::runtime_error("parseOBJParallel: "+what+" differs from tinyobj's");
+  }
+
+  static void checkSame(const std::string &a,
+                        const std::string &b,
+                        const std::string &what)
+  {
+    if (a != b)
+      throw std::runtime_error("parseOBJParallel: "+what+" is '"+b
+                               +"', tinyobj has '"+a+"'");
+  }
+  
+  void validateOBJParser(const std::string &objFile)
+  {
+    const std::string mtlDir = objFile.substr(0,objFile.rfind('/')+1);
+    MappedFile file;
+    if (!file.map(objFile))
+      throw std::runtime_error("could not open "+objFile);
+    
+    tinyobj::attrib_t attributes;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+    double startTime = gdt::getCurrentTime();
+    if (!tinyobj::LoadObj(&attributes,&shapes,&materials,&warn,&err,
+                          objFile.c_str(),mtlDir.c_str(),/* triangulate */true))
+      throw std::runtime_error("tinyobj could not read "+objFile+" : "+err);
+    const double tinyobjTime = gdt::getCurrentTime()-startTime;
+
+    tinyobj::attrib_t parallelAttributes;
+    std::vector<tinyobj::shape_t> parallelShapes;
+    std::vector<tinyobj::material_t> parallelMaterials;
+    startTime = gdt::getCurrentTime();
+    if (!parseOBJParallel(parallelAttributes,parallelShapes,parallelMaterials,
+                          err,objFile,mtlDir))
+      throw std::runtime_error("parseOBJParallel could not read "+objFile+" : "+err);
+    const double parallelTime = gdt::getCurrentTime()-startTime;
+
+    checkSame(attributes.vertices, parallelAttributes.vertices, "vertices");
+    checkSame(attributes.normals,  parallelAttributes.normals,  "normals");
+    checkSame(attributes.texcoords,parallelAttributes.texcoords,"texcoords");
+    if (shapes.size() != parallelShapes.size())
+      throw std::runtime_error("parseOBJParallel found "
+                               +std::to_string(parallelShapes.size())
+                               +" shapes, tinyobj "+std::to_string(shapes.size()));
+    for (size_t i=0;i<shapes.size();i++) {
+      const tinyobj::mesh_t &a = shapes[i].mesh, &b = parallelShapes[i].mesh;
+      const std::string what = "shape #"+std::to_string(i);
+      checkSame(shapes[i].name,parallelShapes[i].name,what+"'s name");
+      checkSame(a.indices,b.indices,what+"'s indices");
+      checkSame(a.num_face_vertices,b.num_face_vertices,what+"'s num_face_vertices");
+      checkSame(a.material_ids,b.material_ids,what+"'s material_ids");
+    }
+    if (materials.size() != parallelMaterials.size())
+      throw std::runtime_error("parseOBJParallel found "
+                               +std::to_string(parallelMaterials.size())
+                               +" materials, tinyobj "+std::to_string(materials.size()));
+    for (size_t i=0;i<materials.size();i++) {
+      const tinyobj::material_t &a = materials[i], &b = parallelMaterials[i];
+      const std::string what = "material #"+std::to_string(i);
+      checkSame(a.name,b.name,what+"'s name");
+      checkSame(a.diffuse_texname,b.diffuse_texname,what+"'s diffuse texture");
+      if (memcmp(a.diffuse,b.diffuse,sizeof(a.diffuse)) != 0)
+        throw std::runtime_error("parseOBJParallel: "+what+"'s diffuse color differs from tinyobj's");
+    }
+    
+    std::cout << "parseOBJParallel matches tinyobj on " << objFile
+              << " (" << attributes.vertices.size()/3 << " vertices, "
+              << shapes.size() << " shapes, " << materials.size() << " materials): "
+              << "tinyobj " << gdt::prettyNumber(size_t(file.size/std::max(tinyobjTime,1e-6))) << "B/s, "
+              << "parseOBJParallel " << gdt::prettyNumber(size_t(file.size/std::max(parallelTime,1e-6))) << "B/s"
+              << " on " << gdt::getNumThreads() << " threads" << std::endl;
+  }
+  
+  /*! throw unless both arrays hold the same bytes */
+  template<typename T>
+  static void checkCached(const MeshArray<T> &a, const MeshArray<T> &b,
+                          const std::string &what)
+  {
+    if (a.size() != b.size()
+        || (a.size() && memcmp(a.data(),b.data(),a.size()*sizeof(T)) != 0))
+      throw std::runtime_error("benchmarkModelCache: cached "+what
+                               +" differs from the loaded one");
+  }
+  
+  void benchmarkModelCache(const std::string &objFile)
+  {
+    TemporaryModelCopy copy(objFile);
+    double startTime = getCurrentTime();
+    std::unique_ptr<Model> loaded(loadOBJ(copy.fileName));
+    const double coldTime = getCurrentTime()-startTime;
+
+    startTime = getCurrentTime();
+    std::unique_ptr<Model> cached(loadModelCache(copy.fileName));
+    const double warmTime = getCurrentTime()-startTime;
+    if (!cached)
+      throw std::runtime_error("benchmarkModelCache: no usable cache for "+copy.fileName);
+
+    // comparing reads every byte of the cached model, so this is also
+    // what it costs to page all of it in
+    startTime = getCurrentTime();
+    size_t numBytes = 0;
+    if (cached->meshes.size() != loaded->meshes.size()
+        || cached->textures.size() != loaded->textures.size())
+      throw std::runtime_error("benchmarkModelCache: cached model has a different"
+                               " number of meshes or textures");
+    for (size_t meshID=0;meshID<loaded->meshes.size();meshID++) {
+      const TriangleMesh &a = *loaded->meshes[meshID], &b = *cached->meshes[meshID];
+      const std::string what = "mesh #"+std::to_string(meshID);
+      checkCached(a.vertex,  b.vertex,  what+"'s vertices");
+      checkCached(a.normal,  b.normal,  what+"'s normals");
+      checkCached(a.texcoord,b.texcoord,what+"'s texcoords");
+      checkCached(a.index,   b.index,   what+"'s indices");
+      if (a.diffuse != b.diffuse || a.diffuseTextureID != b.diffuseTextureID)
+        throw std::runtime_error("benchmarkModelCache: cached "+what
+                                 +"'s material differs from the loaded one");
+      numBytes += b.vertex.size()*sizeof(vec3f) + b.normal.size()*sizeof(vec3f)
+        + b.texcoord.size()*sizeof(vec2f) + b.index.size()*sizeof(vec3i);
+    }
+    for (size_t texID=0;texID<loaded->textures.size();texID++) {
+      const Texture &a = *loaded->textures[texID], &b = *cached->textures[texID];
+      const size_t texBytes = size_t(a.resolution.x)*a.resolution.y*sizeof(uint32_t);
+      if (a.resolution != b.resolution || memcmp(a.pixel,b.pixel,texBytes) != 0)
+        throw std::runtime_error("benchmarkModelCache: cached texture #"
+                                 +std::to_string(texID)+" differs from the loaded one");
+      numBytes += texBytes;
+    }
+    const double touchTime = getCurrentTime()-startTime;
+
+    std::cout << "loaded " << objFile << " in " << prettyDouble(coldTime)
+              << "s without its cache, and in " << prettyDouble(warmTime)
+              << "s from it (" << prettyDouble(coldTime/std::max(warmTime,1e-9))
+              << "x faster); then first reading all " << prettyNumber(numBytes)
+              << "B of it took " << prettyDouble(touchTime) << "s" << std::endl;
+  }
+
+  static void writeTextFile(const std::string &fileName, const std::string &text)
+  {
+    std::ofstream out(fileName.c_str(),std::ios::binary);
+    out << text;
+    out.close();
+    if (!out)
+      throw std::runtime_error("could not write "+fileName);
+  }
+
+  /*! a binary PPM image of given size, all in one color */
+  static void writePPM(const std::string &fileName, int size, unsigned char value)
+  {
+    writeTextFile(fileName,
+                  "P6\n"+std::to_string(size)+" "+std::to_string(size)+"\n255\n"
+                  +std::string(3*size*size,(char)value));
+  }
+  
+  void validateModelCacheStamps()
+  {
+    // (in ./, as loadOBJ looks for textures in the model's directory)
+    const std::string base = "./ex12_cache_stamps_"+std::to_string((long long)getpid());
+    const std::string objFile = base+".obj";
+    const std::string mtlFile = base+".mtl";
+    const std::string ppmFile = base+".ppm";
+    struct RemoveAll {
+      ~RemoveAll() { for (auto &f : files) std::remove(f.c_str()); }
+      std::vector<std::string> files;
+    } removeAll;
+    removeAll.files = { objFile, mtlFile, ppmFile, modelCacheFileName(objFile) };
+
+    const std::string obj
+      = "mtllib "+mtlFile.substr(2)+"\n"
+      "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nvt 1 0\nvt 0 1\n"
+      "usemtl material0\nf 1/1 2/2 3/3\n";
+    writeTextFile(objFile,obj);
+    writeTextFile(mtlFile,"newmtl material0\nKd 0.5 0.5 0.5\nmap_Kd "+ppmFile.substr(2)+"\n");
+    writePPM(ppmFile,2,64);
+
+    // every edit below changes the file's size, so the caches go
+    // stale even where modification times only have seconds
+    auto check = [&](const std::string &edit, bool expectStale,
+                     const vec3f &expectedDiffuse, int expectedRes) {
+      std::unique_ptr<Model> cached(loadModelCache(objFile));
+      if ((cached == nullptr) != expectStale)
+        throw std::runtime_error("validateModelCacheStamps: after "+edit+", the cache is "
+                                 +(cached ? "still used" : "stale"));
+      // (re-)load, which also refreshes the cache
+      std::unique_ptr<Model> model(cached ? cached.release() : loadOBJ(objFile));
+      if (model->meshes.size() != 1 || model->textures.size() != 1
+          || model->meshes[0]->diffuse != expectedDiffuse
+          || model->textures[0]->resolution != vec2i(expectedRes))
+        throw std::runtime_error("validateModelCacheStamps: after "+edit
+                                 +", the model has the wrong material");
+    };
+    check("writing the model",true,vec3f(.5f),2);
+    check("loading it once",false,vec3f(.5f),2);
+    writeTextFile(mtlFile,"newmtl material0\nKd 0.25 0.5 0.5\nmap_Kd "+ppmFile.substr(2)+"\n");
+    check("editing its material library",true,vec3f(.25f,.5f,.5f),2);
+    writePPM(ppmFile,4,128);
+    check("editing its texture",true,vec3f(.25f,.5f,.5f),4);
+    writeTextFile(objFile,obj+"\n");
+    check("editing the model file",true,vec3f(.25f,.5f,.5f),4);
+    check("loading it again",false,vec3f(.25f,.5f,.5f),4);
+    std::cout << "model cache goes stale with its model file, material"
+              << " library, and texture images" << std::endl;
+  }
+  
+  /*! a textured quad ('left') and an untextured one ('right') - the
+      latter's first corner at height 'rightY' */
+  static std::string twoQuadsOBJ(const std::string &mtlFile, float rightY)
+  {
+    return "mtllib "+mtlFile+"\n"
+      "v 0 0 0\nv 1 0 0\nv 1 0 1\nv 0 0 1\n"
+      "v 2 "+std::to_string(rightY)+" 0\nv 3 0 0\nv 3 0 1\nv 2 0 1\n"
+      "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+      "o left\nusemtl textured\nf 1/1 2/2 3/3\nf 1/1 3/3 4/4\n"
+      "o right\nusemtl plain\nf 5 6 7\nf 5 7 8\n";
+  }
+
+  void validateSceneReload()
+  {
+    // (in ./, as the scene's model files are relative to it)
+    const std::string base = "ex12_scene_reload_"+std::to_string((long long)getpid());
+    const std::string sceneFile = "./"+base+".json";
+    const std::string aFile = base+"_a.obj", aMtl = base+"_a.mtl";
+    const std::string bFile = base+"_b.obj", bMtl = base+"_b.mtl";
+    const std::string cFile = base+"_c.obj";
+    const std::string ppmFile = base+".ppm";
+    struct RemoveAll {
+      ~RemoveAll() { for (auto &f : files) std::remove(f.c_str()); }
+      std::vector<std::string> files;
+    } removeAll;
+    removeAll.files = { sceneFile, aFile, aMtl, bFile, bMtl, cFile, ppmFile,
+                        modelCacheFileName(aFile), modelCacheFileName(bFile),
+                        modelCacheFileName(cFile) };
+    auto fail = [](const std::string &what) {
+      throw std::runtime_error("validateSceneReload: "+what);
+    };
+
+    writeTextFile(aFile,twoQuadsOBJ(aMtl,0.f));
+    writeTextFile(aMtl,"newmtl textured\nKd 1 1 1\nmap_Kd "+ppmFile+"\n\n"
+                  "newmtl plain\nKd .5 .5 .5\n");
+    writeTextFile(bFile,"mtllib "+bMtl+"\nv 0 0 0\nv 1 0 0\nv 0 1 0\nusemtl red\nf 1 2 3\n");
+    writeTextFile(bMtl,"newmtl red\nKd 1 0 0\n");
+    writeTextFile(cFile,"mtllib "+bMtl+"\nv 0 0 0\nv 0 1 0\nv 0 0 1\nusemtl red\nf 1 2 3\n");
+    writePPM(ppmFile,2,64);
+    auto writeScene = [&](const std::string &models, const std::string &instances) {
+      writeTextFile(sceneFile,"{ \"models\": { "+models+" },\n"
+                    "  \"instances\": [ "+instances+" ] }\n");
+    };
+    const std::string aAndB
+      = "\"a\": \""+aFile+"\", \"b\": \""+bFile+"\"";
+    writeScene(aAndB,"{ \"model\": \"a\" }, { \"model\": \"b\", \"translate\": [ 0,0,5 ] }");
+
+    double startTime = getCurrentTime();
+    std::unique_ptr<Scene> scene(loadScene(sceneFile));
+    const double loadTime = getCurrentTime()-startTime;
+    const Model *model = scene->model;
+    if (model->meshes.size() != 3 || model->textures.size() != 1)
+      fail("expected 3 meshes and 1 texture");
+    // the scene's own names for the files
+    std::string objDependency, ppmDependency;
+    for (auto &dependency : sceneDependencies(scene.get())) {
+      if (dependency.find(aFile) != std::string::npos)   objDependency = dependency;
+      if (dependency.find(ppmFile) != std::string::npos) ppmDependency = dependency;
+    }
+    if (objDependency == "" || ppmDependency == "")
+      fail("the model or its texture are no dependency of the scene");
+
+    // the mesh of quad 'right', which starts at x=2, z=0, and has its
+    // first corner at height y
+    auto rightMesh = [&](float y) {
+      for (int meshID=0;meshID<(int)scene->model->meshes.size();meshID++)
+        for (auto &v : scene->model->meshes[meshID]->vertex)
+          if (v == vec3f(2.f,y,0.f)) return meshID;
+      return -1;
+    };
+    const int rightID = rightMesh(0.f);
+    if (rightID < 0)
+      fail("no quad 'right'");
+
+    // moving one vertex replaces just the mesh it is in
+    writeTextFile(aFile,twoQuadsOBJ(aMtl,.5f));
+    startTime = getCurrentTime();
+    SceneChanges changes = reloadSceneFile(scene.get(),objDependency);
+    const double meshTime = getCurrentTime()-startTime;
+    if (changes.everything || changes.instances || !changes.textures.empty()
+        || changes.meshes != std::vector<int>{ rightID } || rightMesh(.5f) != rightID)
+      fail("moving one vertex of a model did not replace just the mesh it is in");
+
+    // changing the image replaces just the texture made from it
+    const uint32_t oldTexel = scene->model->textures[0]->pixel[0];
+    writePPM(ppmFile,2,192);
+    startTime = getCurrentTime();
+    changes = reloadSceneFile(scene.get(),ppmDependency);
+    const double textureTime = getCurrentTime()-startTime;
+    if (changes.everything || changes.instances || !changes.meshes.empty()
+        || changes.textures != std::vector<int>{ 0 }
+        || scene->model->textures[0]->pixel[0] == oldTexel)
+      fail("changing the texture's image did not replace just its texture");
+
+    // moving and adding instances keeps all meshes and textures
+    const std::vector<TriangleMesh *> meshes = scene->model->meshes;
+    const Texture *texture = scene->model->textures[0];
+    writeScene(aAndB,"{ \"model\": \"a\" }, { \"model\": \"a\", \"translate\": [ 0,3,0 ] },"
+               " { \"model\": \"b\", \"translate\": [ 0,0,7 ] }");
+    startTime = getCurrentTime();
+    changes = reloadSceneFile(scene.get(),sceneFile);
+    const double instanceTime = getCurrentTime()-startTime;
+    if (!changes.instances || changes.everything
+        || scene->model->meshes != meshes || scene->model->textures[0] != texture
+        || scene->model->instances.size() != 5
+        || scene->model->instances.back().xfm.p != vec3f(0.f,0.f,7.f))
+      fail("moving and adding instances did not just place them anew");
+
+    // adding a model loads just that one
+    writeScene(aAndB+", \"c\": \""+cFile+"\"",
+               "{ \"model\": \"a\" }, { \"model\": \"b\" }, { \"model\": \"c\" }");
+    startTime = getCurrentTime();
+    changes = reloadSceneFile(scene.get(),sceneFile);
+    const double addTime = getCurrentTime()-startTime;
+    if (!changes.everything || scene->model->meshes.size() != 4)
+      fail("adding a model did not rebuild the model");
+    for (auto mesh : meshes)
+      if (std::find(scene->model->meshes.begin(),scene->model->meshes.end(),mesh)
+          == scene->model->meshes.end())
+        fail("adding a model reloaded the models that were there already");
+    if (scene->model->textures[0] != texture || rightMesh(.5f) < 0)
+      fail("adding a model lost what the models that were there already had");
+
+    // ... but a model file that changed in the meantime does get
+    // loaded again
+    writeTextFile(aFile,twoQuadsOBJ(aMtl,.25f)+"\n");
+    writeScene(aAndB,"{ \"model\": \"a\" }, { \"model\": \"b\" }");
+    changes = reloadSceneFile(scene.get(),sceneFile);
+    if (!changes.everything || scene->model->meshes.size() != 3
+        || rightMesh(.25f) < 0 || rightMesh(.5f) >= 0)
+      fail("dropping a model kept an outdated model of another file");
+
+    std::cout << "scene reload replaces just what changed: loading the scene took "
+              << prettyDouble(loadTime) << "s, reloading a changed mesh "
+              << prettyDouble(meshTime) << "s, a changed texture "
+              << prettyDouble(textureTime) << "s, moved instances "
+              << prettyDouble(instanceTime) << "s, and an added model "
+              << prettyDouble(addTime) << "s" << std::endl;
+  }
+  
+  /*! how textures got ingested before ingestTexture(): stbi
+      expanded anything but RGBA to RGBA in a pass of its own, and
+      then they got flipped by swapping pixel by pixel */
+  static uint32_t *ingestTextureTwoPass(unsigned char *image,
+                                        const vec2i &res,
+                                        int numChannels)
+  {
+    uint32_t *pixels = (uint32_t *)image;
+    if (numChannels != 4) {
+      const size_t numPixels = size_t(res.x)*size_t(res.y);
+      pixels = (uint32_t *)malloc(4*numPixels);
+      if (!pixels)
+        throw std::bad_alloc();
+      unsigned char *dst = (unsigned char *)pixels;
+      for (size_t i=0;i<numPixels;i++)
+        for (int c=0;c<4;c++)
+          dst[4*i+c] = c < numChannels ? image[numChannels*i+c] : 255;
+      free(image);
+    }
+    for (int y=0;y<res.y/2;y++) {
+      uint32_t *line_y     = pixels + size_t(y) * res.x;
+      uint32_t *mirrored_y = pixels + size_t(res.y-1-y) * res.x;
+      for (int x=0;x<res.x;x++)
+        std::swap(line_y[x],mirrored_y[x]);
+    }
+    return pixels;
+  }
+  
+  void benchmarkTextureIngest(int maxSize)
+  {
+    for (int size=1024;size<=maxSize;size*=2)
+      for (int numChannels : { 3, 4 }) {
+        const vec2i res(size);
+        const size_t numBytes = size_t(numChannels)*size*size;
+        unsigned char *image = (unsigned char *)malloc(numBytes);
+        if (!image)
+          throw std::bad_alloc();
+        for (size_t i=0;i<numBytes;i++)
+          image[i] = (unsigned char)(i*2654435761u >> 13);
+        unsigned char *copy = (unsigned char *)malloc(numBytes);
+        if (!copy) {
+          free(image);
+          throw std::bad_alloc();
+        }
+        memcpy(copy,image,numBytes);
+
+        double startTime = getCurrentTime();
+        uint32_t *twoPass = ingestTextureTwoPass(image,res,numChannels);
+        const double twoPassTime = getCurrentTime()-startTime;
+
+        startTime = getCurrentTime();
+        Texture *texture = ingestTexture(copy,res,numChannels,false);
+        const double onePassTime = getCurrentTime()-startTime;
+
+        const bool same = memcmp(twoPass,texture->pixel,4*size_t(size)*size) == 0;
+        free(twoPass);
+        delete texture;
+        if (!same)
+          throw std::runtime_error("benchmarkTextureIngest: ingestTexture's "
+                                   "pixels differ from the two-pass ones");
+        std::cout << size << "^2 " << (numChannels == 3 ? "RGB " : "RGBA")
+                  << ": convert+swap " << prettyDouble(twoPassTime)
+                  << "s, ingestTexture " << prettyDouble(onePassTime) << "s" << std::endl;
+      }
+  }
+  
+  void benchmarkTextureMips(int maxSize)
+  {
+    // two textures of each size, the first of each pair a single
+    // color (which every mip level has to keep), the second noise
+    Model model;
+    for (int size=512;size<=maxSize;size*=2)
+      for (int i=0;i<2;i++) {
+        Texture *texture = new Texture;
+        texture->resolution = vec2i(size);
+        texture->pixel = (uint32_t *)malloc(area(texture->resolution)*sizeof(uint32_t));
+        if (!texture->pixel) {
+          delete texture;
+          throw std::bad_alloc();
+        }
+        model.textures.push_back(texture);
+      }
+    if (model.textures.empty())
+      throw std::runtime_error("benchmarkTextureMips: no textures of 512^2 up to "
+                               +std::to_string(maxSize)+"^2");
+    const uint32_t color = 0xff4080c0u;
+    auto resetPixels = [&]() {
+      for (size_t textureID=0;textureID<model.textures.size();textureID++) {
+        Texture *texture = model.textures[textureID];
+        if (texture->numLevels != 1) {
+          // (shrinking, so this keeps the pixels where they are)
+          texture->pixel = (uint32_t *)realloc(texture->pixel,
+                                               area(texture->resolution)*sizeof(uint32_t));
+          texture->numLevels = 1;
+        }
+        const size_t numPixels = area(texture->resolution);
+        for (size_t i=0;i<numPixels;i++)
+          texture->pixel[i] = (textureID & 1) ? uint32_t(i*2654435761u) : color;
+      }
+    };
+    
+    const size_t baseBytes = applyTextureMemoryBudget(&model,0);
+    for (MipFilter filter : { MIP_FILTER_BOX, MIP_FILTER_KAISER }) {
+      resetPixels();
+      // one texture per job, the way the loader's decode jobs build them
+      const double startTime = getCurrentTime();
+      gdt::parallel_for(model.textures.size(),[&](size_t textureID){
+          generateMipLevels(model.textures[textureID],filter);
+        });
+      const double mipTime = getCurrentTime()-startTime;
+      
+      for (size_t textureID=0;textureID<model.textures.size();textureID+=2) {
+        const Texture *texture = model.textures[textureID];
+        for (int level=0;level<texture->numLevels;level++) {
+          const size_t numPixels = area(texture->levelResolution(level));
+          for (size_t i=0;i<numPixels;i++)
+            if (texture->levelPixels(level)[i] != color)
+              throw std::runtime_error("benchmarkTextureMips: mip level "
+                                       +std::to_string(level)
+                                       +" of a single-color texture is not"
+                                       " that color any more");
+        }
+      }
+      const size_t mipBytes = applyTextureMemoryBudget(&model,0);
+      std::cout << (filter == MIP_FILTER_KAISER ? "kaiser" : "box   ")
+                << " mips of " << model.textures.size() << " textures (512^2.."
+                << maxSize << "^2): " << prettyNumber(baseBytes) << "B -> "
+                << prettyNumber(mipBytes) << "B, in " << prettyDouble(mipTime)
+                << "s on " << getNumThreads() << " threads" << std::endl;
+    }
+    
+    int numLevels = 0;
+    for (auto texture : model.textures)
+      numLevels += texture->numLevels;
+    const size_t budget = baseBytes/2;
+    const double startTime = getCurrentTime();
+    const size_t numBytes = applyTextureMemoryBudget(&model,budget);
+    const double budgetTime = getCurrentTime()-startTime;
+    int numDropped = numLevels;
+    for (auto texture : model.textures)
+      numDropped -= texture->numLevels;
+    std::cout << "budget of " << prettyNumber(budget) << "B: dropped "
+              << numDropped << " mip levels, textures take "
+              << prettyNumber(numBytes) << "B, in " << prettyDouble(budgetTime)
+              << "s" << std::endl;
+  }
+
+  /*! a float, exactly as it is, in JSON */
+  static std::string jsonNumber(float f)
+  {
+    char buf[32];
+    snprintf(buf,sizeof(buf),"%.9g",f);
+    return buf;
+  }
+  
+  /*! write the model's meshes (with their diffuse colors, but
+      without textures) to a glTF binary that loadGLTF() reads back as
+      the same meshes, arrays in place where it can */
+  static void writeGLB(const Model *model, const std::string &glbFile)
+  {
+    std::string bin, json;
+    std::string bufferViews, accessors, meshes, materials, nodes;
+    int numArrays = 0;
+    // append 'count' elements of 'type' to the binary chunk, and a
+    // buffer view and accessor for them; returns the accessor's ID
+    auto addArray = [&](const void *data, size_t count, const char *type,
+                        int numComponents, int componentType,
+                        const std::string &extra) {
+      const size_t size = count*numComponents*4;
+      if (numArrays > 0) { bufferViews += ","; accessors += ","; }
+      bufferViews += "{\"buffer\":0,\"byteOffset\":"+std::to_string(bin.size())
+        +",\"byteLength\":"+std::to_string(size)+"}";
+      accessors += "{\"bufferView\":"+std::to_string(numArrays)
+        +",\"componentType\":"+std::to_string(componentType)
+        +",\"count\":"+std::to_string(count)
+        +",\"type\":\""+type+"\""+extra+"}";
+      bin.append((const char *)data,size);
+      return numArrays++;
+    };
+
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+      const TriangleMesh &mesh = *model->meshes[meshID];
+      if (!mesh.compactVertex.empty())
+        throw std::runtime_error("writeGLB: meshes with compact vertices can't be written");
+      box3f bounds;
+      for (auto &v : mesh.vertex) bounds.extend(v);
+      const std::string minMax
+        = ",\"min\":["+jsonNumber(bounds.lower.x)+","+jsonNumber(bounds.lower.y)
+        +","+jsonNumber(bounds.lower.z)+"],\"max\":["+jsonNumber(bounds.upper.x)
+        +","+jsonNumber(bounds.upper.y)+","+jsonNumber(bounds.upper.z)+"]";
+      std::string attributes = "\"POSITION\":"
+        +std::to_string(addArray(mesh.vertex.data(),mesh.vertex.size(),
+                                 "VEC3",3,GLTF_FLOAT,mesh.vertex.empty() ? "" : minMax));
+      if (!mesh.normal.empty())
+        attributes += ",\"NORMAL\":"
+          +std::to_string(addArray(mesh.normal.data(),mesh.normal.size(),
+                                   "VEC3",3,GLTF_FLOAT,""));
+      if (!mesh.texcoord.empty()) {
+        // glTF's texture origin is the top left
+        std::vector<vec2f> texcoord(mesh.texcoord.size());
+        for (size_t i=0;i<texcoord.size();i++)
+          texcoord[i] = vec2f(mesh.texcoord[i].x,1.f-mesh.texcoord[i].y);
+        attributes += ",\"TEXCOORD_0\":"
+          +std::to_string(addArray(texcoord.data(),texcoord.size(),
+                                   "VEC2",2,GLTF_FLOAT,""));
+      }
+      const int indices = addArray(mesh.index.data(),3*mesh.index.size(),
+                                   "SCALAR",1,GLTF_UNSIGNED_INT,"");
+      const std::string id = std::to_string(meshID);
+      if (meshID > 0) { meshes += ","; materials += ","; nodes += ","; }
+      meshes += "{\"primitives\":[{\"attributes\":{"+attributes+"},\"indices\":"
+        +std::to_string(indices)+",\"material\":"+id+"}]}";
+      materials += "{\"pbrMetallicRoughness\":{\"baseColorFactor\":["
+        +jsonNumber(mesh.diffuse.x)+","+jsonNumber(mesh.diffuse.y)+","
+        +jsonNumber(mesh.diffuse.z)+",1]}}";
+      nodes += "{\"mesh\":"+id+"}";
+    }
+    // (instances would need to be nodes of their own, with matrices)
+    if (!model->instances.empty())
+      throw std::runtime_error("writeGLB: instanced models can't be written");
+    std::string sceneNodes;
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++)
+      sceneNodes += (meshID ? "," : "")+std::to_string(meshID);
+    json = "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":["
+      +sceneNodes+"]}],\"nodes\":["+nodes+"],\"meshes\":["+meshes
+      +"],\"materials\":["+materials+"],\"accessors\":["+accessors
+      +"],\"bufferViews\":["+bufferViews+"],\"buffers\":[{\"byteLength\":"
+      +std::to_string(bin.size())+"}]}";
+    // chunks are padded to 4 bytes: JSON with blanks, binary with zeros
+    json.resize((json.size()+3) & ~size_t(3),' ');
+    bin.resize((bin.size()+3) & ~size_t(3),'\0');
+
+    std::ofstream out(glbFile,std::ios::binary);
+    auto write32 = [&](uint32_t u) { out.write((const char *)&u,4); };
+    write32(GLB_MAGIC);
+    write32(GLB_VERSION);
+    write32(uint32_t(12+8+json.size()+8+bin.size()));
+    write32(uint32_t(json.size()));
+    write32(GLB_CHUNK_JSON);
+    out.write(json.data(),json.size());
+    write32(uint32_t(bin.size()));
+    write32(GLB_CHUNK_BIN);
+    out.write(bin.data(),bin.size());
+    if (!out)
+      throw std::runtime_error("could not write "+glbFile);
+  }
+
+  void benchmarkGLTFLoader(const std::string &objFile)
+  {
+    TemporaryModelCopy copy(objFile);
+    double startTime = getCurrentTime();
+    std::unique_ptr<Model> obj(loadOBJ(copy.fileName));
+    const double objTime = getCurrentTime()-startTime;
+    startTime = getCurrentTime();
+    delete loadOBJ(copy.fileName);
+    const double cachedTime = getCurrentTime()-startTime;
+
+    const std::string glbFile = copy.fileName+".glb";
+    writeGLB(obj.get(),glbFile);
+    startTime = getCurrentTime();
+    std::unique_ptr<Model> glb(loadGLTF(glbFile));
+    const double glbTime = getCurrentTime()-startTime;
+    std::remove(glbFile.c_str());
+
+    if (glb->meshes.size() != obj->meshes.size())
+      throw std::runtime_error("benchmarkGLTFLoader: glb has a different number of meshes");
+    for (size_t meshID=0;meshID<obj->meshes.size();meshID++) {
+      const TriangleMesh &a = *obj->meshes[meshID], &b = *glb->meshes[meshID];
+      bool same
+        = a.vertex.size() == b.vertex.size() && a.normal.size() == b.normal.size()
+        && a.texcoord.size() == b.texcoord.size() && a.index.size() == b.index.size()
+        && a.diffuse == b.diffuse
+        && !memcmp(a.vertex.data(),b.vertex.data(),a.vertex.size()*sizeof(vec3f))
+        && !memcmp(a.normal.data(),b.normal.data(),a.normal.size()*sizeof(vec3f))
+        && !memcmp(a.index.data(),b.index.data(),a.index.size()*sizeof(vec3i));
+      // (1-(1-v) need not be v, to the last bit)
+      for (size_t i=0;same && i<a.texcoord.size();i++)
+        same = fabsf(a.texcoord[i].x-b.texcoord[i].x) <= 1e-6f
+          &&   fabsf(a.texcoord[i].y-b.texcoord[i].y) <= 1e-6f;
+      if (!same)
+        throw std::runtime_error("benchmarkGLTFLoader: glb's mesh #"+std::to_string(meshID)
+                                 +" differs from the OBJ's");
+    }
+    if (!obj->textures.empty())
+      std::cout << GDT_TERMINAL_YELLOW << "#osc: the glb has none of the OBJ's "
+                << obj->textures.size() << " textures" << GDT_TERMINAL_DEFAULT << std::endl;
+    std::cout << "loaded the same meshes from " << objFile << " in "
+              << prettyDouble(objTime) << "s (from its cache in "
+              << prettyDouble(cachedTime) << "s), and from glb in "
+              << prettyDouble(glbTime) << "s" << std::endl;
+  }
+
+} // ::osc
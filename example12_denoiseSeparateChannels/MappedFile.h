@@ -0,0 +1,107 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/gdt.h"
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! simple wrapper for mapping a file into memory - read-only, or
+      copy-on-write */
+  struct MappedFile {
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() { unmap(); }
+
+    /*! map given file; returns false if the file could not be
+        opened or mapped (empty files can not be mapped, either).
+        With 'copyOnWrite', the mapped memory may also be written
+        to: pages get copied when first written, and the file itself
+        never changes */
+    bool map(const std::string &fileName, bool copyOnWrite = false)
+    {
+      unmap();
+#ifdef _WIN32
+      file = CreateFileA(fileName.c_str(),GENERIC_READ,FILE_SHARE_READ,
+                         nullptr,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,nullptr);
+      if (file == INVALID_HANDLE_VALUE) return false;
+      LARGE_INTEGER fileSize;
+      if (!GetFileSizeEx(file,&fileSize) || fileSize.QuadPart == 0) {
+        unmap(); return false;
+      }
+      mapping = CreateFileMappingA(file,nullptr,
+                                   copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY,
+                                   0,0,nullptr);
+      if (!mapping) { unmap(); return false; }
+      void *ptr = MapViewOfFile(mapping,copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ,
+                                0,0,0);
+      if (!ptr) { unmap(); return false; }
+      data = (const char *)ptr;
+      size = (size_t)fileSize.QuadPart;
+#else
+      fd = open(fileName.c_str(),O_RDONLY);
+      if (fd < 0) return false;
+      struct stat st;
+      if (fstat(fd,&st) != 0 || st.st_size == 0) { unmap(); return false; }
+      const int prot = copyOnWrite ? (PROT_READ|PROT_WRITE) : PROT_READ;
+      void *ptr = mmap(nullptr,(size_t)st.st_size,prot,MAP_PRIVATE,fd,0);
+      if (ptr == MAP_FAILED) { unmap(); return false; }
+      data = (const char *)ptr;
+      size = (size_t)st.st_size;
+      // we'll stream through the whole thing anyway
+      madvise(ptr,size,MADV_WILLNEED);
+#endif
+      return true;
+    }
+
+    void unmap()
+    {
+#ifdef _WIN32
+      if (data)    UnmapViewOfFile(data);
+      if (mapping) CloseHandle(mapping);
+      if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+      mapping = nullptr;
+      file    = INVALID_HANDLE_VALUE;
+#else
+      if (data)    munmap((void *)data,size);
+      if (fd >= 0) close(fd);
+      fd = -1;
+#endif
+      data = nullptr;
+      size = 0;
+    }
+
+    const char *data { nullptr };
+    size_t      size { 0 };
+  private:
+#ifdef _WIN32
+    HANDLE file    { INVALID_HANDLE_VALUE };
+    HANDLE mapping { nullptr };
+#else
+    int    fd      { -1 };
+#endif
+  };
+
+} // ::osc
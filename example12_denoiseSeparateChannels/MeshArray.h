@@ -0,0 +1,94 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <vector>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! one of a mesh's arrays (vertices, normals, ...): either a
+      std::vector of its own (while the mesh gets built), or a view
+      into memory somebody else owns (usually, one of the model's
+      arenas, see packMeshes()). Reading works the same way for both;
+      anything that changes the array's size first turns a view into
+      an array of its own. Writing to elements of a view writes to
+      whatever it is a view of. */
+  template<typename T>
+  struct MeshArray {
+    typedef T        value_type;
+    typedef T       *iterator;
+    typedef const T *const_iterator;
+
+    size_t   size()  const { return view ? viewSize : owned.size(); }
+    bool     empty() const { return size() == 0; }
+    T       *data()        { return view ? view : owned.data(); }
+    const T *data()  const { return view ? view : owned.data(); }
+
+    T       &operator[](size_t i)       { return data()[i]; }
+    const T &operator[](size_t i) const { return data()[i]; }
+
+    iterator       begin()       { return data(); }
+    iterator       end()         { return data()+size(); }
+    const_iterator begin() const { return data(); }
+    const_iterator end()   const { return data()+size(); }
+
+    /*! whether this array is a view of somebody else's memory */
+    bool isView() const { return view != nullptr; }
+
+    /*! make this array a view of 'count' elements at 'ptr' */
+    void setView(T *ptr, size_t count)
+    {
+      std::vector<T>().swap(owned);
+      view     = count ? ptr : nullptr;
+      viewSize = count ? count : 0;
+    }
+
+    /*! @{ std::vector-style building */
+    void push_back(const T &t) { detach(); owned.push_back(t); }
+    void reserve(size_t n)     { detach(); owned.reserve(n); }
+    void resize(size_t n)      { detach(); owned.resize(n); }
+    void resize(size_t n, const T &t) { detach(); owned.resize(n,t); }
+    /*! empty the array, but keep its capacity (if it has one) */
+    void clear()               { view = nullptr; viewSize = 0; owned.clear(); }
+    template<typename It>
+    void assign(It begin, It end)
+    { view = nullptr; viewSize = 0; owned.assign(begin,end); }
+    /*! take over the given vector's elements */
+    void assign(std::vector<T> &&other)
+    { view = nullptr; viewSize = 0; owned = std::move(other); }
+    /*! @} */
+
+    /*! empty the array, and release whatever memory it owns */
+    void free()
+    { view = nullptr; viewSize = 0; std::vector<T>().swap(owned); }
+
+  private:
+    void detach()
+    {
+      if (!view) return;
+      owned.assign(view,view+viewSize);
+      view     = nullptr;
+      viewSize = 0;
+    }
+
+    std::vector<T> owned;
+    T             *view     { nullptr };
+    size_t         viewSize { 0 };
+  };
+
+} // ::osc
@@ -0,0 +1,614 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "Benchmarks.h"
+#include "gdt/parallel/parallel_for.h"
+//std
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! number of triangles the model renders */
+  static size_t numTriangles(const Model *model)
+  {
+    size_t numTriangles = 0;
+    for (auto mesh : model->meshes)
+      numTriangles += mesh->index.size();
+    return numTriangles;
+  }
+
+  void benchmarkMergeMeshes(const std::string &objFile)
+  {
+    size_t numTris[2], numMeshes[2], numBuffers[2];
+    box3f  bounds[2];
+    double loadTime[2];
+    for (int merged=0;merged<2;merged++) {
+      // a fresh copy each time, so neither load comes from a cache
+      TemporaryModelCopy copy(objFile);
+      const double startTime = getCurrentTime();
+      std::unique_ptr<Model> model(loadOBJ(copy.fileName));
+      if (merged)
+        mergeMeshes(model.get());
+      loadTime[merged] = getCurrentTime()-startTime;
+
+      numTris[merged]    = numTriangles(model.get());
+      numMeshes[merged]  = model->meshes.size();
+      numBuffers[merged] = numDeviceBuffers(model->meshes);
+      bounds[merged]     = model->bounds;
+    }
+    if (numTris[1] != numTris[0] || bounds[1] != bounds[0])
+      throw std::runtime_error("benchmarkMergeMeshes: the merged model has different"
+                               " triangles than the one loaded");
+    std::cout << "as loaded: " << numMeshes[0] << " meshes, "
+              << numBuffers[0] << " device buffers, load "
+              << prettyDouble(loadTime[0]) << "s; merged: "
+              << numMeshes[1] << " meshes, "
+              << numBuffers[1] << " device buffers, load+merge "
+              << prettyDouble(loadTime[1]) << "s" << std::endl;
+  }
+
+  void benchmarkInstancing(const std::string &objFile)
+  {
+    TemporaryModelCopy copy(objFile);
+    std::unique_ptr<Model> original(loadOBJ(copy.fileName));
+    if (!original->instances.empty())
+      throw std::runtime_error("benchmarkInstancing: "+objFile+" already has instances");
+    const size_t numMeshes = original->meshes.size();
+    for (int allowAffine=0;allowAffine<2;allowAffine++) {
+      std::unique_ptr<Model> model(loadOBJ(copy.fileName));
+      detectInstances(model.get(),allowAffine);
+      if (model->meshes.size() == numMeshes)
+        continue;
+      // instance i is what became of mesh i
+      if (model->instances.size() != numMeshes)
+        throw std::runtime_error("benchmarkInstancing: not one instance per mesh");
+      for (size_t meshID=0;meshID<numMeshes;meshID++) {
+        const MeshInstance &instance = model->instances[meshID];
+        const TriangleMesh *mesh  = original->meshes[meshID];
+        const TriangleMesh *proto = model->meshes[instance.meshID];
+        // (four times what detectInstances allows)
+        const vec3f farthest = max(abs(mesh->bounds.lower),abs(mesh->bounds.upper));
+        const float tolerance
+          = 4.f*(1e-5f*length(mesh->bounds.span())+4.f*FLT_EPSILON*reduce_max(farthest));
+        bool same
+          =  proto->vertex.size() == mesh->vertex.size()
+          && proto->index.size()  == mesh->index.size()
+          && std::equal(proto->index.begin(),proto->index.end(),mesh->index.begin());
+        for (size_t i=0;same && i<mesh->vertex.size();i++)
+          same = length(xfmPoint(instance.xfm,proto->vertex[i])-mesh->vertex[i])
+            <= tolerance;
+        if (!same)
+          throw std::runtime_error("benchmarkInstancing: instance #"+std::to_string(meshID)
+                                   +" is not where mesh #"+std::to_string(meshID)+" was");
+      }
+      std::cout << "all instances match the meshes they replaced" << std::endl;
+    }
+  }
+
+  /*! move attribute[v] to attribute[newID[v]] */
+  template<typename T>
+  static void permute(MeshArray<T> &attribute, const std::vector<int> &newID)
+  {
+    std::vector<T> permuted(attribute.size());
+    for (size_t v=0;v<attribute.size();v++)
+      permuted[newID[v]] = attribute[v];
+    attribute.assign(std::move(permuted));
+  }
+
+  /*! randomly reorder each mesh's triangles, and its vertices - the
+      worst case optimizeMeshes() has to deal with */
+  static void shuffleMeshes(Model *model)
+  {
+    const bool wasPacked = isPacked(model);
+    gdt::parallel_for(model->meshes.size(),[&](size_t meshID){
+        TriangleMesh *mesh = model->meshes[meshID];
+        std::mt19937 random((unsigned)meshID);
+        std::shuffle(mesh->index.begin(),mesh->index.end(),random);
+        std::vector<int> newID(mesh->vertex.size());
+        std::iota(newID.begin(),newID.end(),0);
+        std::shuffle(newID.begin(),newID.end(),random);
+        for (auto &tri : mesh->index)
+          tri = vec3i(newID[tri.x],newID[tri.y],newID[tri.z]);
+        permute(mesh->vertex,newID);
+        permute(mesh->normal,newID);
+        permute(mesh->texcoord,newID);
+      });
+    if (wasPacked)
+      packMeshes(model);
+  }
+
+  /*! the (meshID,triangleID) each pixel of a frame of the given size
+      sees, looking from 'from' at 'at', in scanline order; pixels
+      that see nothing get left out. Each triangle only gets splatted
+      at its centroid - with many more triangles than pixels, that is
+      close enough to what a rasterizer would find */
+  static std::vector<vec2i> visibleTriangles(const Model *model,
+                                             const vec3f &from,
+                                             const vec3f &at,
+                                             const vec3f &up,
+                                             const vec2i &frameSize)
+  {
+    const vec3f dir = normalize(at-from);
+    const vec3f du  = normalize(cross(dir,up));
+    const vec3f dv  = cross(du,dir);
+    const float tanY = .5f, tanX = tanY*frameSize.x/frameSize.y;
+
+    const size_t numPixels = size_t(frameSize.x)*frameSize.y;
+    std::vector<float> depth(numPixels,INFINITY);
+    std::vector<vec2i> visible(numPixels,vec2i(-1));
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+      const TriangleMesh *mesh = model->meshes[meshID];
+      for (size_t triangleID=0;triangleID<mesh->index.size();triangleID++) {
+        const vec3i &tri = mesh->index[triangleID];
+        const vec3f P
+          = (mesh->vertex[tri.x]+mesh->vertex[tri.y]+mesh->vertex[tri.z])*(1.f/3.f)
+          - from;
+        const float z = dot(P,dir);
+        if (z <= 0.f) continue;
+        const int x = int((.5f+.5f*dot(P,du)/(z*tanX))*frameSize.x);
+        const int y = int((.5f+.5f*dot(P,dv)/(z*tanY))*frameSize.y);
+        if (x < 0 || y < 0 || x >= frameSize.x || y >= frameSize.y) continue;
+        const size_t pixelID = size_t(y)*frameSize.x+x;
+        if (z >= depth[pixelID]) continue;
+        depth[pixelID]   = z;
+        visible[pixelID] = vec2i((int)meshID,(int)triangleID);
+      }
+    }
+    visible.erase(std::remove(visible.begin(),visible.end(),vec2i(-1)),visible.end());
+    return visible;
+  }
+
+  /*! time fetching all vertex attributes of the given (meshID,
+      triangleID)s, and report that with the model's ACMR */
+  static void benchmarkVertexFetch(const Model *model,
+                                   const std::vector<vec2i> &visible,
+                                   const vec2i &frameSize)
+  {
+    // best of a few passes, to not measure the first one's page faults
+    double fetchTime = INFINITY;
+    float sum = 0.f;
+    for (int pass=0;pass<5;pass++) {
+      const double startTime = getCurrentTime();
+      for (auto &v : visible) {
+        const TriangleMesh &mesh = *model->meshes[v.x];
+        const vec3i &tri = mesh.index[v.y];
+        for (int k=0;k<3;k++) {
+          const vec3f &P = mesh.vertex[tri[k]];
+          sum += P.x+P.y+P.z;
+          if (!mesh.normal.empty()) {
+            const vec3f &N = mesh.normal[tri[k]];
+            sum += N.x+N.y+N.z;
+          }
+          if (!mesh.texcoord.empty()) {
+            const vec2f &T = mesh.texcoord[tri[k]];
+            sum += T.x+T.y;
+          }
+        }
+      }
+      fetchTime = std::min(fetchTime,getCurrentTime()-startTime);
+    }
+    // so the compiler can't skip the fetches
+    volatile float checksum = sum; (void)checksum;
+
+    double acmr = 0.;
+    for (auto mesh : model->meshes)
+      acmr += computeACMR(mesh)*mesh->index.size();
+    std::cout << "fetched the vertices of the " << visible.size()
+              << " visible triangles of a " << frameSize.x << "x" << frameSize.y
+              << " frame in " << prettyDouble(fetchTime) << "s"
+              << " (ACMR " << acmr/std::max(numTriangles(model),(size_t)1) << ")"
+              << std::endl;
+  }
+
+  void benchmarkMeshOptimize(const std::string &objFile)
+  {
+    std::unique_ptr<Model> model;
+    {
+      TemporaryModelCopy copy(objFile);
+      model.reset(loadOBJ(copy.fileName));
+    }
+    // looking down at the model from above one of its corners, from
+    // far enough away to see all of it
+    const box3f bounds = model->bounds;
+    const vec3f at = bounds.center();
+    const vec3f from = at + .8f*length(bounds.span())*normalize(vec3f(-.5f,.7f,-.5f));
+    const vec3f up(0.f,1.f,0.f);
+    const vec2i frameSize(1920,1080);
+    for (int shuffled=0;shuffled<2;shuffled++) {
+      if (shuffled) {
+        std::cout << "shuffling all triangles and vertices" << std::endl;
+        shuffleMeshes(model.get());
+      }
+      for (int optimized=0;optimized<2;optimized++) {
+        if (optimized)
+          optimizeMeshes(model.get());
+        benchmarkVertexFetch(model.get(),
+                             visibleTriangles(model.get(),from,at,up,frameSize),
+                             frameSize);
+      }
+    }
+  }
+
+  /*! full-precision copy of a mesh's vertex attributes */
+  struct FullVertices {
+    std::vector<vec3f> vertex;
+    std::vector<vec3f> normal;
+    std::vector<vec2f> texcoord;
+  };
+
+  /*! read (and sum up) the attributes of all vertices, in order or in
+      the given one; returns the best time of a few passes */
+  template<typename ReadT>
+  static double timeVertexReads(const std::vector<std::vector<int>> &order,
+                                bool inOrder, const ReadT &read)
+  {
+    double bestTime = INFINITY;
+    float sum = 0.f;
+    for (int pass=0;pass<5;pass++) {
+      const double startTime = getCurrentTime();
+      for (size_t meshID=0;meshID<order.size();meshID++)
+        for (size_t i=0;i<order[meshID].size();i++)
+          sum += read(meshID,inOrder ? (int)i : order[meshID][i]);
+      bestTime = std::min(bestTime,getCurrentTime()-startTime);
+    }
+    // so the compiler can't skip the reads
+    volatile float checksum = sum; (void)checksum;
+    return bestTime;
+  }
+  
+  void benchmarkCompactVertices(const std::string &objFile)
+  {
+    std::unique_ptr<Model> model;
+    {
+      TemporaryModelCopy copy(objFile);
+      model.reset(loadOBJ(copy.fileName));
+    }
+    std::vector<FullVertices> full(model->meshes.size());
+    std::vector<std::vector<int>> order(model->meshes.size());
+    size_t numVertices = 0, fullBytes = 0;
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+      const TriangleMesh *mesh = model->meshes[meshID];
+      full[meshID].vertex.assign(mesh->vertex.begin(),mesh->vertex.end());
+      full[meshID].normal.assign(mesh->normal.begin(),mesh->normal.end());
+      full[meshID].texcoord.assign(mesh->texcoord.begin(),mesh->texcoord.end());
+      order[meshID].resize(mesh->vertex.size());
+      std::iota(order[meshID].begin(),order[meshID].end(),0);
+      std::shuffle(order[meshID].begin(),order[meshID].end(),std::mt19937((unsigned)meshID));
+      numVertices += mesh->vertex.size();
+      fullBytes   += vertexBytes(mesh);
+    }
+    compactVertexAttributes(model.get(),/*quantizePositions*/true);
+    size_t compactBytes = 0;
+    for (auto mesh : model->meshes)
+      compactBytes += vertexBytes(mesh);
+
+    // round-trip errors: normals in degrees, texcoords absolute,
+    // positions relative to the mesh's extent in that axis
+    double maxNormalError = 0., sumNormalError = 0.;
+    double maxTexcoordError = 0., maxPositionError = 0.;
+    size_t numNormals = 0;
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+      const TriangleMesh *mesh = model->meshes[meshID];
+      const FullVertices &f = full[meshID];
+      for (size_t i=0;i<f.normal.size();i++) {
+        if (!(dot(f.normal[i],f.normal[i]) > 0.f)) continue;
+        // (in doubles, and not through acos(dot()), which is way
+        // less precise than the encoding for small angles)
+        const vec3f n = f.normal[i], d = mesh->compactNormal[i];
+        const vec3d a(n.x,n.y,n.z), b(d.x,d.y,d.z);
+        const double degrees = atan2(length(cross(a,b)),dot(a,b))*180./M_PI;
+        maxNormalError  = std::max(maxNormalError,degrees);
+        sumNormalError += degrees;
+        numNormals++;
+      }
+      for (size_t i=0;i<f.texcoord.size();i++) {
+        const vec2f d = f.texcoord[i]-mesh->compactTexcoord[i].decode(mesh->halfTexcoords);
+        maxTexcoordError = std::max(maxTexcoordError,(double)std::max(fabsf(d.x),fabsf(d.y)));
+      }
+      const vec3f extent = max(mesh->bounds.span(),vec3f(1e-20f));
+      for (size_t i=0;i<f.vertex.size();i++) {
+        const vec3f d = abs(f.vertex[i]-mesh->vertexQuantizer.decode(mesh->compactVertex[i]))/extent;
+        maxPositionError = std::max(maxPositionError,(double)reduce_max(d));
+      }
+    }
+
+    // reading all attributes of all vertices, full vs compact
+    auto readFull = [&](size_t meshID, int i) {
+      const FullVertices &f = full[meshID];
+      const vec3f P = f.vertex[i];
+      float sum = P.x+P.y+P.z;
+      if (!f.normal.empty())   { const vec3f N = f.normal[i];   sum += N.x+N.y+N.z; }
+      if (!f.texcoord.empty()) { const vec2f T = f.texcoord[i]; sum += T.x+T.y; }
+      return sum;
+    };
+    auto readCompact = [&](size_t meshID, int i) {
+      const TriangleMesh *mesh = model->meshes[meshID];
+      const vec3f P = mesh->vertexQuantizer.decode(mesh->compactVertex[i]);
+      float sum = P.x+P.y+P.z;
+      if (!mesh->compactNormal.empty()) {
+        const vec3f N = mesh->compactNormal[i];
+        sum += N.x+N.y+N.z;
+      }
+      if (!mesh->compactTexcoord.empty()) {
+        const vec2f T = mesh->compactTexcoord[i].decode(mesh->halfTexcoords);
+        sum += T.x+T.y;
+      }
+      return sum;
+    };
+    const double fullTime[2]
+      = { timeVertexReads(order,true,readFull), timeVertexReads(order,false,readFull) };
+    const double compactTime[2]
+      = { timeVertexReads(order,true,readCompact), timeVertexReads(order,false,readCompact) };
+
+    std::cout << "compact vertices: normals off by " << maxNormalError << " degrees max ("
+              << sumNormalError/std::max(numNormals,(size_t)1) << " avg), texcoords by "
+              << maxTexcoordError << " max, positions by " << maxPositionError
+              << " of the extent max" << std::endl;
+    for (int random=0;random<2;random++)
+      std::cout << "reading all " << numVertices << " vertices "
+                << (random ? "in random order" : "in order") << " on one thread: full "
+                << prettyNumber(fullBytes) << "B in " << prettyDouble(fullTime[random])
+                << "s (" << prettyNumber(size_t(fullBytes/fullTime[random])) << "B/s), compact "
+                << prettyNumber(compactBytes) << "B in " << prettyDouble(compactTime[random])
+                << "s (" << prettyNumber(size_t(compactBytes/compactTime[random])) << "B/s)"
+                << std::endl;
+  }
+
+  void benchmarkSmoothNormals(const std::string &objFile, float creaseAngle)
+  {
+    TemporaryModelCopy copy(objFile);
+    struct Run { float creaseAngle; bool withTangents; };
+    for (const Run &run : { Run{ 180.f, false }, Run{ creaseAngle, false }, Run{ 180.f, true } }) {
+      std::unique_ptr<Model> model(loadOBJ(copy.fileName));
+      // the file's own normals, to compare against
+      std::vector<std::vector<vec3f>> fileNormal(model->meshes.size());
+      size_t meshBytes = 0, numTriangles = 0;
+      for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+        TriangleMesh *mesh = model->meshes[meshID];
+        fileNormal[meshID].assign(mesh->normal.begin(),mesh->normal.end());
+        mesh->normal.clear();
+        meshBytes += mesh->vertex.size()*sizeof(vec3f)
+          + mesh->texcoord.size()*sizeof(vec2f)
+          + mesh->index.size()*sizeof(vec3i);
+        numTriangles += mesh->index.size();
+      }
+      std::cout << numTriangles << " triangles, crease angle "
+                << run.creaseAngle << (run.withTangents ? ", with tangents" : "")
+                << ": " << std::flush;
+      generateNormals(model.get(),run.creaseAngle,run.withTangents);
+
+      size_t generatedBytes = 0, numCompared = 0;
+      double sumAngle = 0.;
+      for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+        const TriangleMesh *mesh = model->meshes[meshID];
+        generatedBytes += mesh->normal.size()*sizeof(vec3f)
+          + mesh->tangent.size()*sizeof(vec4f);
+        // (vertices split at creases are new ones, so then the
+        // file's normals no longer line up)
+        if (fileNormal[meshID].size() != mesh->normal.size())
+          continue;
+        for (size_t i=0;i<mesh->normal.size();i++) {
+          const vec3f &a = fileNormal[meshID][i], &b = mesh->normal[i];
+          sumAngle += atan2(double(length(cross(a,b))),double(dot(a,b)));
+        }
+        numCompared += mesh->normal.size();
+      }
+      std::cout << "  normals and tangents add " << (100.*generatedBytes/meshBytes)
+                << "% to the mesh data";
+      if (numCompared > 0)
+        std::cout << ", and are off from the file's normals by "
+                  << (sumAngle/numCompared*180./M_PI) << " degrees on average";
+      std::cout << std::endl;
+    }
+  }
+
+  /*! total area of the given triangles of the mesh */
+  static double surfaceArea(const TriangleMesh *mesh, const std::vector<vec3i> &tris)
+  {
+    double area = 0.;
+    for (auto &tri : tris) {
+      const vec3f &a = mesh->vertex[tri.x];
+      const vec3f &b = mesh->vertex[tri.y];
+      const vec3f &c = mesh->vertex[tri.z];
+      area += .5*length(cross(b-a,c-a));
+    }
+    return area;
+  }
+
+  void benchmarkLODs(const std::string &objFile, int numLevels)
+  {
+    std::unique_ptr<Model> model;
+    {
+      TemporaryModelCopy copy(objFile);
+      model.reset(loadOBJ(copy.fileName));
+    }
+    for (auto mesh : model->meshes)
+      if (!mesh->lodIndex.empty())
+        throw std::runtime_error("benchmarkLODs: the model already has LODs");
+    generateLODs(model.get(),numLevels);
+
+    // per level: surface area, and largest error relative to the
+    // size of its mesh
+    std::vector<double> area(numLevels+1,0.), relError(numLevels+1,0.);
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+      const TriangleMesh *mesh = model->meshes[meshID];
+      const std::vector<vec3i> full(mesh->index.begin(),mesh->index.end());
+      const float size = std::max(length(mesh->bounds.span()),1e-30f);
+      for (int level=0;level<=numLevels;level++) {
+        const int lod = std::min(level,(int)mesh->lodIndex.size());
+        const std::vector<vec3i> &tris = lod == 0 ? full : mesh->lodIndex[lod-1];
+        for (auto &tri : tris)
+          if (min(tri.x,min(tri.y,tri.z)) < 0
+              || max(tri.x,max(tri.y,tri.z)) >= (int)mesh->vertex.size()
+              || tri.x == tri.y || tri.y == tri.z || tri.z == tri.x)
+            throw std::runtime_error("benchmarkLODs: LOD "+std::to_string(lod)
+                                     +" of mesh #"+std::to_string(meshID)
+                                     +" has a broken triangle");
+        if (lod > 0
+            && (tris.size() >= (lod == 1 ? full.size() : mesh->lodIndex[lod-2].size())
+                || mesh->lodError[lod-1] < (lod == 1 ? 0.f : mesh->lodError[lod-2])))
+          throw std::runtime_error("benchmarkLODs: LOD "+std::to_string(lod)
+                                   +" of mesh #"+std::to_string(meshID)
+                                   +" is not coarser than the one before");
+        area[level] += surfaceArea(mesh,tris);
+        if (lod > 0)
+          relError[level] = std::max(relError[level],double(mesh->lodError[lod-1]/size));
+      }
+    }
+    for (int level=1;level<=numLevels;level++)
+      std::cout << "LOD " << level << ": surface area changed by "
+                << 100.*(area[level]/area[0]-1.) << "%, largest error "
+                << 100.*relError[level] << "% of its mesh's size" << std::endl;
+  }
+
+  /*! the baseline buildMeshlets() has to beat: cut the mesh's index
+      array, in the order it is in, into runs that fit into a meshlet.
+      Only the bounds get filled in; the cones are left wide open */
+  static void buildContiguousMeshlets(TriangleMesh *mesh)
+  {
+    mesh->meshlets.clear();
+    mesh->meshletVertex.clear();
+    mesh->meshletIndex.clear();
+    Meshlet meshlet;
+    meshlet.numTriangles = 0;
+    auto closeMeshlet = [&]() {
+      if (meshlet.numTriangles == 0) return;
+      meshlet.coneAxis  = vec3f(0.f,0.f,1.f);
+      meshlet.coneAngle = float(M_PI);
+      mesh->meshlets.push_back(meshlet);
+      meshlet.numTriangles = 0;
+    };
+    for (auto &tri : mesh->index) {
+      if (meshlet.numTriangles == 0) {
+        meshlet.vertexBegin   = (uint32_t)mesh->meshletVertex.size();
+        meshlet.triangleBegin = (uint32_t)(mesh->meshletIndex.size()/3);
+        meshlet.numVertices   = 0;
+        meshlet.bounds        = box3f();
+      }
+      const int *vertex = mesh->meshletVertex.data()+meshlet.vertexBegin;
+      int local[3], numNew = 0;
+      for (int k=0;k<3;k++) {
+        local[k] = int(std::find(vertex,vertex+meshlet.numVertices,tri[k])-vertex);
+        if (local[k] == meshlet.numVertices
+            && (k < 1 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1]))
+          numNew++;
+      }
+      if (meshlet.numVertices+numNew > Meshlet::maxVertices
+          || meshlet.numTriangles == Meshlet::maxTriangles) {
+        closeMeshlet();
+        meshlet.vertexBegin   = (uint32_t)mesh->meshletVertex.size();
+        meshlet.triangleBegin = (uint32_t)(mesh->meshletIndex.size()/3);
+        meshlet.numVertices   = 0;
+        meshlet.bounds        = box3f();
+      }
+      for (int k=0;k<3;k++) {
+        const int *begin = mesh->meshletVertex.data()+meshlet.vertexBegin;
+        int l = int(std::find(begin,begin+meshlet.numVertices,tri[k])-begin);
+        if (l == meshlet.numVertices) {
+          mesh->meshletVertex.push_back(tri[k]);
+          meshlet.bounds.extend(mesh->vertex[tri[k]]);
+          meshlet.numVertices++;
+        }
+        mesh->meshletIndex.push_back((uint8_t)l);
+      }
+      meshlet.numTriangles++;
+    }
+    closeMeshlet();
+  }
+
+  /*! throw unless the mesh's meshlets hold each of its triangles
+      exactly once (with the same winding) */
+  static void checkMeshlets(const TriangleMesh *mesh, const std::string &what)
+  {
+    // each triangle, rotated to start with its smallest vertex
+    auto canonical = [](vec3i t) {
+      while (t.x > t.y || t.x > t.z) t = vec3i(t.y,t.z,t.x);
+      return t;
+    };
+    auto less = [](const vec3i &a, const vec3i &b) {
+      return a.x < b.x || (a.x == b.x && (a.y < b.y || (a.y == b.y && a.z < b.z)));
+    };
+    std::vector<vec3i> expected, found;
+    for (auto &tri : mesh->index)
+      expected.push_back(canonical(tri));
+    for (auto &meshlet : mesh->meshlets) {
+      const int     *vertex = &mesh->meshletVertex[meshlet.vertexBegin];
+      const uint8_t *index  = &mesh->meshletIndex[3*meshlet.triangleBegin];
+      for (int t=0;t<meshlet.numTriangles;t++)
+        found.push_back(canonical(vec3i(vertex[index[3*t+0]],
+                                        vertex[index[3*t+1]],
+                                        vertex[index[3*t+2]])));
+    }
+    std::sort(expected.begin(),expected.end(),less);
+    std::sort(found.begin(),found.end(),less);
+    if (expected != found)
+      throw std::runtime_error("benchmarkMeshlets: "+what
+                               +" meshlets don't hold each triangle exactly once");
+  }
+
+  /*! check all meshes' meshlets, and print their stats the way
+      buildMeshlets() does */
+  static void reportMeshlets(const Model *model, const std::string &what,
+                             double buildTime)
+  {
+    size_t numMeshlets = 0, numTriangles = 0, numVertices = 0;
+    double overlap = 0.;
+    for (auto mesh : model->meshes) {
+      checkMeshlets(mesh,what);
+      numMeshlets  += mesh->meshlets.size();
+      numTriangles += mesh->index.size();
+      numVertices  += mesh->meshletVertex.size();
+      overlap      += computeMeshletOverlap(mesh)*mesh->index.size();
+    }
+    const size_t n = std::max(numMeshlets,(size_t)1);
+    std::cout << what << ": " << numMeshlets << " meshlets"
+              << " (" << numTriangles/float(n) << " triangles, "
+              << numVertices/float(n) << " vertices each;"
+              << " overlap " << 100.*overlap/std::max(numTriangles,(size_t)1)
+              << "%, in " << buildTime << "s)" << std::endl;
+  }
+  
+  void benchmarkMeshlets(const std::string &objFile, bool shuffle)
+  {
+    std::unique_ptr<Model> model;
+    {
+      TemporaryModelCopy copy(objFile);
+      model.reset(loadOBJ(copy.fileName));
+    }
+    if (shuffle)
+      shuffleMeshes(model.get());
+
+    double startTime = getCurrentTime();
+    gdt::parallel_for(model->meshes.size(),[&](size_t meshID){
+        buildContiguousMeshlets(model->meshes[meshID]);
+      });
+    reportMeshlets(model.get(),"contiguous runs of the index array",getCurrentTime()-startTime);
+
+    // (prints the same stats itself)
+    buildMeshlets(model.get());
+    for (auto mesh : model->meshes)
+      checkMeshlets(mesh,"buildMeshlets");
+  }
+
+} // ::osc
@@ -0,0 +1,186 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Model.h"
+#include "gdt/parallel/parallel_for.h"
+//std
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <string.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! everything that has to be the same for two meshes to be merged
+      into one: their material, and which vertex attributes they
+      have (so we never have to make up normals or texcoords) */
+  struct MergeKey {
+    MergeKey(const TriangleMesh *mesh)
+      : diffuse(mesh->diffuse),
+        diffuseTextureID(mesh->diffuseTextureID),
+        hasNormals(!mesh->normal.empty()),
+        hasTexcoords(!mesh->texcoord.empty())
+    {}
+
+    bool operator<(const MergeKey &other) const
+    {
+      if (diffuseTextureID != other.diffuseTextureID)
+        return diffuseTextureID < other.diffuseTextureID;
+      if (hasNormals != other.hasNormals)
+        return hasNormals < other.hasNormals;
+      if (hasTexcoords != other.hasTexcoords)
+        return hasTexcoords < other.hasTexcoords;
+      return memcmp(&diffuse,&other.diffuse,sizeof(diffuse)) < 0;
+    }
+
+    vec3f diffuse;
+    int   diffuseTextureID;
+    bool  hasNormals, hasTexcoords;
+  };
+
+  size_t numDeviceBuffers(const std::vector<TriangleMesh *> &meshes)
+  {
+    size_t numBuffers = 0;
+    for (auto mesh : meshes)
+      numBuffers += 2 + !mesh->normal.empty() + !mesh->texcoord.empty();
+    return numBuffers;
+  }
+
+  /*! concatenate the given meshes (which all share the same
+      MergeKey) into a single one, rebasing the indices */
+  static TriangleMesh *concatenate(const std::vector<TriangleMesh *> &meshes)
+  {
+    if (meshes.size() == 1)
+      return meshes[0];
+
+    std::vector<size_t> vertexBegin(meshes.size()+1,0);
+    std::vector<size_t> indexBegin(meshes.size()+1,0);
+    for (size_t i=0;i<meshes.size();i++) {
+      vertexBegin[i+1] = vertexBegin[i]+meshes[i]->vertex.size();
+      indexBegin[i+1]  = indexBegin[i]+meshes[i]->index.size();
+    }
+
+    TriangleMesh *merged = new TriangleMesh;
+    merged->diffuse          = meshes[0]->diffuse;
+    merged->diffuseTextureID = meshes[0]->diffuseTextureID;
+    merged->vertex.resize(vertexBegin.back());
+    merged->index.resize(indexBegin.back());
+    if (!meshes[0]->normal.empty())
+      merged->normal.resize(vertexBegin.back());
+    if (!meshes[0]->texcoord.empty())
+      merged->texcoord.resize(vertexBegin.back());
+    for (auto mesh : meshes)
+      merged->bounds.extend(mesh->bounds);
+
+    for (size_t i=0;i<meshes.size();i++) {
+      const TriangleMesh *mesh = meshes[i];
+      std::copy(mesh->vertex.begin(),mesh->vertex.end(),
+                merged->vertex.begin()+vertexBegin[i]);
+      std::copy(mesh->normal.begin(),mesh->normal.end(),
+                merged->normal.begin()+vertexBegin[i]);
+      std::copy(mesh->texcoord.begin(),mesh->texcoord.end(),
+                merged->texcoord.begin()+vertexBegin[i]);
+      const vec3i offset((int)vertexBegin[i]);
+      vec3i *index = merged->index.data()+indexBegin[i];
+      for (auto idx : mesh->index)
+        *index++ = idx+offset;
+    }
+
+    for (auto mesh : meshes)
+      delete mesh;
+    return merged;
+  }
+
+  void mergeMeshes(Model *model)
+  {
+    const double startTime = getCurrentTime();
+    const bool   wasPacked        = isPacked(model);
+    const size_t numMeshesBefore  = model->meshes.size();
+    const size_t numBuffersBefore = numDeviceBuffers(model->meshes);
+
+    // group meshes by material, in order of first appearance; a group
+    // gets closed (and a new one started) whenever adding another
+    // mesh would overflow the 32-bit vertex indices
+    const size_t maxVertices = (size_t)std::numeric_limits<int>::max();
+    std::vector<std::vector<TriangleMesh *>> groups;
+    std::vector<size_t> groupVertices;
+    std::map<MergeKey,size_t> openGroup;
+    // with instancing, only meshes that get rendered exactly once
+    // (and untransformed) can be merged; all others keep a group of
+    // their own
+    std::vector<int> numUses(model->meshes.size(),0);
+    std::vector<bool> mergeable(model->meshes.size(),true);
+    for (auto &instance : model->instances) {
+      numUses[instance.meshID]++;
+      if (instance.xfm != affine3f(one))
+        mergeable[instance.meshID] = false;
+    }
+    std::vector<size_t> groupOf(model->meshes.size());
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+      TriangleMesh *mesh = model->meshes[meshID];
+      if (!model->instances.empty() &&
+          (numUses[meshID] != 1 || !mergeable[meshID])) {
+        groupOf[meshID] = groups.size();
+        groups.push_back(std::vector<TriangleMesh *>(1,mesh));
+        groupVertices.push_back(mesh->vertex.size());
+        continue;
+      }
+      const MergeKey key(mesh);
+      auto it = openGroup.find(key);
+      if (it == openGroup.end() ||
+          groupVertices[it->second]+mesh->vertex.size() > maxVertices) {
+        openGroup[key] = groups.size();
+        groups.push_back(std::vector<TriangleMesh *>());
+        groupVertices.push_back(0);
+        it = openGroup.find(key);
+      }
+      groupOf[meshID] = it->second;
+      groups[it->second].push_back(mesh);
+      groupVertices[it->second] += mesh->vertex.size();
+    }
+
+    // each merged group gets rendered once, where its first mesh was
+    if (!model->instances.empty()) {
+      std::vector<MeshInstance> instances;
+      std::vector<bool> groupInstanced(groups.size(),false);
+      for (auto instance : model->instances) {
+        const size_t groupID = groupOf[instance.meshID];
+        if (groups[groupID].size() > 1 && groupInstanced[groupID])
+          continue;
+        groupInstanced[groupID] = true;
+        instance.meshID = (int)groupID;
+        instances.push_back(instance);
+      }
+      model->instances.swap(instances);
+    }
+
+    model->meshes.resize(groups.size());
+    gdt::parallel_for(groups.size(),[&](size_t groupID){
+        model->meshes[groupID] = concatenate(groups[groupID]);
+      });
+    // the merged meshes' arrays are their own, and the ones that
+    // were not merged still point into the old arenas
+    if (wasPacked)
+      packMeshes(model);
+
+    std::cout << "merged " << numMeshesBefore << " meshes into "
+              << model->meshes.size() << " (device buffers: "
+              << numBuffersBefore << " -> " << numDeviceBuffers(model->meshes)
+              << ", in " << (getCurrentTime()-startTime) << "s)" << std::endl;
+  }
+
+}
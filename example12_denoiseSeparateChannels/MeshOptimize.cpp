@@ -0,0 +1,253 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Model.h"
+#include "gdt/parallel/parallel_for.h"
+//std
+#include <algorithm>
+#include <math.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! size of the (LRU) vertex cache the triangle order gets
+      optimized for */
+  enum { FORSYTH_CACHE_SIZE = 32 };
+
+  /*! Forsyth's vertex score: vertices near the top of the cache score
+      high (except for the last triangle's three, which the next
+      triangle should not re-use all of), and vertices with few
+      remaining triangles get a boost, so that they get finished off
+      rather than left dangling */
+  struct ForsythScores {
+    ForsythScores()
+    {
+      for (int pos=0;pos<FORSYTH_CACHE_SIZE;pos++)
+        cacheScore[pos]
+          = pos < 3
+          ? .75f
+          : powf(1.f-(pos-3)/float(FORSYTH_CACHE_SIZE-3),1.5f);
+      for (int valence=1;valence<maxValence;valence++)
+        valenceScore[valence] = 2.f*powf((float)valence,-.5f);
+      valenceScore[0] = 0.f;
+    }
+
+    /*! score of a vertex at given cache position (-1 if not in the
+        cache) that still has 'valence' triangles left to emit */
+    float operator()(int cachePos, int valence) const
+    {
+      if (valence == 0) return -1.f;
+      const float posScore = cachePos < 0 ? 0.f : cacheScore[cachePos];
+      return posScore + (valence < maxValence
+                         ? valenceScore[valence]
+                         : 2.f*powf((float)valence,-.5f));
+    }
+
+    enum { maxValence = 64 };
+    float cacheScore[FORSYTH_CACHE_SIZE];
+    float valenceScore[maxValence];
+  };
+
+  /*! reorder the triangles of given index buffer for post-transform
+      vertex cache locality, after Tom Forsyth's "Linear-speed vertex
+      cache optimisation" */
+  static void reorderTriangles(MeshArray<vec3i> &index, int numVertices)
+  {
+    static const ForsythScores score;
+    const int numTriangles = (int)index.size();
+    if (numTriangles == 0) return;
+
+    // vertex->triangle adjacency, in CSR form
+    std::vector<int> valence(numVertices,0);
+    for (auto &tri : index)
+      for (int k=0;k<3;k++)
+        valence[tri[k]]++;
+    std::vector<int> adjBegin(numVertices+1,0);
+    for (int v=0;v<numVertices;v++)
+      adjBegin[v+1] = adjBegin[v]+valence[v];
+    std::vector<int> adjacent(adjBegin[numVertices]);
+    {
+      std::vector<int> fill(adjBegin.begin(),adjBegin.end()-1);
+      for (int t=0;t<numTriangles;t++)
+        for (int k=0;k<3;k++)
+          adjacent[fill[index[t][k]]++] = t;
+    }
+
+    std::vector<int>   cachePos(numVertices,-1);
+    std::vector<float> vertexScore(numVertices);
+    for (int v=0;v<numVertices;v++)
+      vertexScore[v] = score(-1,valence[v]);
+    std::vector<float> triangleScore(numTriangles);
+    std::vector<bool>  emitted(numTriangles,false);
+    for (int t=0;t<numTriangles;t++)
+      triangleScore[t]
+        = vertexScore[index[t].x]+vertexScore[index[t].y]+vertexScore[index[t].z];
+
+    // the cache, plus room for the (up to) three vertices that get
+    // pushed out by each new triangle
+    int cache[FORSYTH_CACHE_SIZE+3];
+    int cacheSize = 0;
+
+    std::vector<vec3i> reordered;
+    reordered.reserve(numTriangles);
+    int bestTriangle = -1;
+    int nextUnemitted = 0;
+    while ((int)reordered.size() < numTriangles) {
+      if (bestTriangle < 0) {
+        // nothing in the cache is useful any more: continue with the
+        // next triangle (in input order) that has not been emitted
+        while (emitted[nextUnemitted]) nextUnemitted++;
+        bestTriangle = nextUnemitted;
+      }
+
+      const vec3i tri = index[bestTriangle];
+      reordered.push_back(tri);
+      emitted[bestTriangle] = true;
+
+      // remove the triangle from its vertices' adjacency lists
+      for (int k=0;k<3;k++) {
+        const int v = tri[k];
+        int *adj = &adjacent[adjBegin[v]];
+        int *end = adj+valence[v];
+        std::swap(*std::find(adj,end,bestTriangle),end[-1]);
+        valence[v]--;
+      }
+
+      // move the triangle's vertices to the top of the cache (in
+      // order), pushing everything else down
+      int newCache[FORSYTH_CACHE_SIZE+3];
+      int newSize = 0;
+      for (int k=0;k<3;k++)
+        newCache[newSize++] = tri[k];
+      for (int i=0;i<cacheSize;i++) {
+        const int v = cache[i];
+        if (v != tri.x && v != tri.y && v != tri.z)
+          newCache[newSize++] = v;
+      }
+      for (int i=FORSYTH_CACHE_SIZE;i<newSize;i++)
+        cachePos[newCache[i]] = -1;
+      cacheSize = std::min(newSize,(int)FORSYTH_CACHE_SIZE);
+      std::copy(newCache,newCache+newSize,cache);
+
+      // rescore everything that is (or just was) in the cache, and
+      // find the best triangle touching any of it
+      for (int i=0;i<newSize;i++) {
+        const int v = newCache[i];
+        if (i < FORSYTH_CACHE_SIZE) cachePos[v] = i;
+        const float newScore = score(cachePos[v],valence[v]);
+        const float delta = newScore-vertexScore[v];
+        vertexScore[v] = newScore;
+        for (int j=adjBegin[v];j<adjBegin[v]+valence[v];j++)
+          triangleScore[adjacent[j]] += delta;
+      }
+      bestTriangle = -1;
+      float bestScore = -1.f;
+      for (int i=0;i<cacheSize;i++) {
+        const int v = cache[i];
+        for (int j=adjBegin[v];j<adjBegin[v]+valence[v];j++) {
+          const int t = adjacent[j];
+          if (triangleScore[t] > bestScore) {
+            bestScore    = triangleScore[t];
+            bestTriangle = t;
+          }
+        }
+      }
+    }
+    index.assign(std::move(reordered));
+  }
+
+  /*! move attribute[v] to attribute[newID[v]] */
+  template<typename T>
+  static void permute(MeshArray<T> &attribute, const std::vector<int> &newID)
+  {
+    if (attribute.empty()) return;
+    std::vector<T> permuted(attribute.size());
+    for (size_t v=0;v<attribute.size();v++)
+      permuted[newID[v]] = attribute[v];
+    attribute.assign(std::move(permuted));
+  }
+
+  /*! renumber the vertices in the order in which the (already
+      reordered) triangles first reference them, so that fetching the
+      vertex attributes walks through memory (mostly) linearly */
+  static void reorderVertices(TriangleMesh *mesh)
+  {
+    const int numVertices = (int)mesh->vertex.size();
+    std::vector<int> newID(numVertices,-1);
+    int numUsed = 0;
+    for (auto &tri : mesh->index)
+      for (int k=0;k<3;k++) {
+        int &id = newID[tri[k]];
+        if (id < 0) id = numUsed++;
+        tri[k] = id;
+      }
+    // vertices no triangle uses go to the end, in their old order
+    for (auto &id : newID)
+      if (id < 0) id = numUsed++;
+
+    permute(mesh->vertex,newID);
+    permute(mesh->normal,newID);
+    permute(mesh->texcoord,newID);
+  }
+
+  float computeACMR(const TriangleMesh *mesh, int cacheSize)
+  {
+    if (mesh->index.empty()) return 0.f;
+
+    // FIFO cache: a vertex is in the cache if it got loaded by one
+    // of the last 'cacheSize' misses
+    std::vector<size_t> loadedBy(mesh->vertex.size(),0);
+    size_t numMisses = 0;
+    for (auto &tri : mesh->index)
+      for (int k=0;k<3;k++) {
+        size_t &miss = loadedBy[tri[k]];
+        if (miss == 0 || numMisses-miss >= (size_t)cacheSize)
+          miss = ++numMisses;
+      }
+    return numMisses/float(mesh->index.size());
+  }
+
+  void optimizeMeshes(Model *model)
+  {
+    const double startTime = getCurrentTime();
+    const bool wasPacked = isPacked(model);
+    size_t numTriangles = 0;
+    double acmrBefore = 0., acmrAfter = 0.;
+    for (auto mesh : model->meshes) {
+      numTriangles += mesh->index.size();
+      acmrBefore   += computeACMR(mesh)*mesh->index.size();
+    }
+
+    gdt::parallel_for(model->meshes.size(),[&](size_t meshID){
+        TriangleMesh *mesh = model->meshes[meshID];
+        reorderTriangles(mesh->index,(int)mesh->vertex.size());
+        reorderVertices(mesh);
+      });
+    // the reordered arrays are all the meshes' own now
+    if (wasPacked)
+      packMeshes(model);
+
+    for (auto mesh : model->meshes)
+      acmrAfter += computeACMR(mesh)*mesh->index.size();
+    const size_t divisor = std::max(numTriangles,(size_t)1);
+    std::cout << "reordered " << numTriangles << " triangles"
+              << " for vertex cache and fetch locality"
+              << " (ACMR " << acmrBefore/divisor
+              << " -> " << acmrAfter/divisor
+              << ", in " << (getCurrentTime()-startTime) << "s)" << std::endl;
+  }
+
+}
@@ -0,0 +1,410 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Model.h"
+#include "gdt/parallel/parallel_for.h"
+//std
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! extra weight of the planes that keep borders (and attribute
+      seams) in place, relative to those of the triangles */
+  static const double BORDER_WEIGHT = 10.;
+
+  /*! Garland/Heckbert error quadric: sum of squared distances to a
+      set of (weighted) planes */
+  struct Quadric {
+    Quadric() { memset(this,0,sizeof(*this)); }
+
+    /*! the plane through 'p' with (unit) normal 'n' */
+    Quadric(const vec3f &n, const vec3f &p, double weight)
+    {
+      const double nx = n.x, ny = n.y, nz = n.z;
+      const double d  = -(nx*p.x+ny*p.y+nz*p.z);
+      a00 = weight*nx*nx; a01 = weight*nx*ny; a02 = weight*nx*nz;
+      a11 = weight*ny*ny; a12 = weight*ny*nz; a22 = weight*nz*nz;
+      b0  = weight*nx*d;  b1  = weight*ny*d;  b2  = weight*nz*d;
+      c   = weight*d*d;
+      w   = weight;
+    }
+
+    void operator+=(const Quadric &q)
+    {
+      a00 += q.a00; a01 += q.a01; a02 += q.a02;
+      a11 += q.a11; a12 += q.a12; a22 += q.a22;
+      b0  += q.b0;  b1  += q.b1;  b2  += q.b2;
+      c   += q.c;   w   += q.w;
+    }
+
+    /*! (weighted) rms distance of 'p' to the planes */
+    float error(const vec3f &p) const
+    {
+      const double x = p.x, y = p.y, z = p.z;
+      const double e
+        = a00*x*x + a11*y*y + a22*z*z
+        + 2.*(a01*x*y + a02*x*z + a12*y*z)
+        + 2.*(b0*x + b1*y + b2*z)
+        + c;
+      return w > 0. ? (float)sqrt(std::max(e,0.)/w) : 0.f;
+    }
+
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2, c;
+    /*! sum of the planes' weights, to turn the sum of squares into
+        a distance */
+    double w;
+  };
+
+  /*! simplifies (ever coarser versions of) one mesh's triangles by
+      collapsing edges - always onto one of the edge's two vertices,
+      so all levels keep using the mesh's vertex arrays as they are.
+      Vertices with the same position but different normals or
+      texcoords (i.e., the two sides of an attribute seam) get
+      collapsed together, each onto the copy of the target vertex on
+      its own side of the seam; collapses for which there is no such
+      copy (which would move the seam, or need attributes the mesh
+      does not have) are not done */
+  struct Simplifier {
+    Simplifier(const TriangleMesh *mesh)
+      : vertex(mesh->vertex),
+        numVertices((int)mesh->vertex.size())
+    {
+      weldPositions();
+
+      // quadrics of all triangles (weighted by area), plus those of
+      // all edges that only one triangle uses - in the mesh as it
+      // is, which includes both its borders and its attribute seams
+      quadric.resize(numVertices);
+      current.assign(mesh->index.begin(),mesh->index.end());
+      buildAdjacency();
+      for (auto &tri : mesh->index) {
+        const vec3f &A = vertex[tri.x], &B = vertex[tri.y], &C = vertex[tri.z];
+        const vec3f  N = cross(B-A,C-A);
+        const float  area2 = length(N);
+        if (!(area2 > 0.f)) continue;
+        const vec3f n = N*(1.f/area2);
+        const Quadric q(n,A,.5*area2);
+        for (int k=0;k<3;k++)
+          quadric[rep[tri[k]]] += q;
+        for (int k=0;k<3;k++) {
+          const int a = tri[k], b = tri[(k+1)%3];
+          if (numTrianglesUsing(a,b) != 1) continue;
+          const vec3f edge = vertex[b]-vertex[a];
+          const float length2 = dot(edge,edge);
+          if (!(length2 > 0.f)) continue;
+          const Quadric border(normalize(cross(edge,n)),vertex[a],
+                               BORDER_WEIGHT*length2);
+          quadric[rep[a]] += border;
+          quadric[rep[b]] += border;
+        }
+      }
+      collapsed.resize(numVertices,false);
+    }
+
+    /*! collapse edges of 'tris' until there are at most 'target'
+        triangles left, or nothing more can be collapsed; returns the
+        largest error of any collapse */
+    float simplify(std::vector<vec3i> &tris, size_t target)
+    {
+      float maxError = 0.f;
+      current.swap(tris);
+      while (current.size() > target) {
+        buildAdjacency();
+        findCandidates();
+        size_t numRemoved = 0;
+        const size_t toRemove = current.size()-target;
+        std::vector<bool> locked(numVertices,false);
+        std::vector<int>  vertexMap(numVertices);
+        for (int v=0;v<numVertices;v++) vertexMap[v] = v;
+        for (auto &candidate : candidates) {
+          if (numRemoved >= toRemove) break;
+          const int from = candidate.from, to = candidate.to;
+          if (locked[from] || locked[to]) continue;
+          if (!tryCollapse(from,to,vertexMap,numRemoved)) continue;
+          maxError = std::max(maxError,candidate.error);
+          // everything whose triangles this collapse changed has to
+          // wait for the next pass
+          locked[from] = locked[to] = true;
+          forEachTriangle(from,[&](int triID){
+              for (int k=0;k<3;k++)
+                locked[rep[current[triID][k]]] = true;
+            });
+        }
+        if (numRemoved == 0) break;
+
+        size_t numKept = 0;
+        for (auto tri : current) {
+          for (int k=0;k<3;k++)
+            tri[k] = vertexMap[tri[k]];
+          if (rep[tri.x] == rep[tri.y] ||
+              rep[tri.y] == rep[tri.z] ||
+              rep[tri.z] == rep[tri.x])
+            continue;
+          current[numKept++] = tri;
+        }
+        current.resize(numKept);
+      }
+      tris.swap(current);
+      return maxError;
+    }
+
+  private:
+    struct Candidate {
+      int   from, to;
+      float error;
+      bool operator<(const Candidate &other) const
+      { return error < other.error; }
+    };
+
+    /*! number of (current) triangles that use both vertices a and b */
+    int numTrianglesUsing(int a, int b) const
+    {
+      int count = 0;
+      for (int i=adjBegin[a];i<adjBegin[a+1];i++) {
+        const vec3i &tri = current[adjacent[i]];
+        count += (tri.x == b || tri.y == b || tri.z == b);
+      }
+      return count;
+    }
+
+    /*! rep[v]: the first vertex with v's position; nextWedge[v]: the
+        next vertex with that position (in a ring) */
+    void weldPositions()
+    {
+      rep = osc::weldPositions(vertex);
+      nextWedge.resize(numVertices);
+      for (int v=0;v<numVertices;v++) {
+        const int r = rep[v];
+        if (r == v)
+          nextWedge[v] = v;
+        else {
+          nextWedge[v] = nextWedge[r];
+          nextWedge[r] = v;
+        }
+      }
+    }
+
+    /*! vertex -> triangles, in CSR form */
+    void buildAdjacency()
+    {
+      adjBegin.assign(numVertices+1,0);
+      for (auto &tri : current)
+        for (int k=0;k<3;k++)
+          adjBegin[tri[k]+1]++;
+      for (int v=0;v<numVertices;v++)
+        adjBegin[v+1] += adjBegin[v];
+      adjacent.resize(adjBegin[numVertices]);
+      std::vector<int> fill(adjBegin.begin(),adjBegin.end()-1);
+      for (int t=0;t<(int)current.size();t++)
+        for (int k=0;k<3;k++)
+          adjacent[fill[current[t][k]]++] = t;
+    }
+
+    /*! call 'f(triID)' for every triangle that uses any of the
+        vertices with the position of (representative) vertex 'r' */
+    template<typename F>
+    void forEachTriangle(int r, const F &f) const
+    {
+      int w = r;
+      do {
+        for (int i=adjBegin[w];i<adjBegin[w+1];i++)
+          f(adjacent[i]);
+        w = nextWedge[w];
+      } while (w != r);
+    }
+
+    /*! the cheapest collapse for every (representative) vertex,
+        cheapest first */
+    void findCandidates()
+    {
+      std::vector<Candidate> best(numVertices);
+      gdt::parallel_for_blocked(numVertices,16*1024,[&](size_t begin, size_t end){
+          std::vector<std::pair<int,int>> edges;
+          for (size_t v=begin;v<end;v++) {
+            best[v].from = -1;
+            if (rep[v] != (int)v || collapsed[v]) continue;
+            // the edges to all neighbors, with the number of
+            // triangles using each
+            edges.clear();
+            forEachTriangle((int)v,[&](int triID){
+                for (int k=0;k<3;k++) {
+                  const int n = rep[current[triID][k]];
+                  if (n == (int)v) continue;
+                  bool known = false;
+                  for (auto &edge : edges)
+                    if (edge.first == n) { edge.second++; known = true; }
+                  if (!known) edges.push_back(std::make_pair(n,1));
+                }
+              });
+            bool border = false;
+            bool complex = false;
+            for (auto &edge : edges) {
+              border  |= edge.second == 1;
+              complex |= edge.second > 2;
+            }
+            if (complex) continue;
+            for (auto &edge : edges) {
+              // border vertices may only move along the border
+              if (border && edge.second != 1) continue;
+              const float error = quadric[v].error(vertex[edge.first]);
+              if (best[v].from < 0 || error < best[v].error)
+                best[v] = { (int)v, edge.first, error };
+            }
+          }
+        });
+      candidates.clear();
+      for (auto &candidate : best)
+        if (candidate.from >= 0)
+          candidates.push_back(candidate);
+      std::sort(candidates.begin(),candidates.end());
+    }
+
+    /*! collapse 'from' onto 'to' (both representatives), if that
+        keeps all seams intact and does not flip any triangles */
+    bool tryCollapse(int from, int to, std::vector<int> &vertexMap,
+                     size_t &numRemoved)
+    {
+      // each copy of 'from' has to share a triangle with exactly one
+      // copy of 'to', which it will become
+      int w = from;
+      do {
+        int target = -1;
+        bool ambiguous = false;
+        for (int i=adjBegin[w];i<adjBegin[w+1];i++) {
+          const vec3i &tri = current[adjacent[i]];
+          for (int k=0;k<3;k++)
+            if (rep[tri[k]] == to) {
+              if (target >= 0 && target != tri[k]) ambiguous = true;
+              target = tri[k];
+            }
+        }
+        if (adjBegin[w] != adjBegin[w+1]) {
+          if (target < 0 || ambiguous)
+            return undoMap(from,vertexMap);
+          vertexMap[w] = target;
+        }
+        w = nextWedge[w];
+      } while (w != from);
+
+      // no triangle that stays may flip (or turn by much) ...
+      bool flips = false;
+      size_t numDegenerate = 0;
+      forEachTriangle(from,[&](int triID){
+          const vec3i &tri = current[triID];
+          if (rep[tri.x] == to || rep[tri.y] == to || rep[tri.z] == to) {
+            numDegenerate++;
+            return;
+          }
+          vec3f p[3], q[3];
+          for (int k=0;k<3;k++) {
+            p[k] = vertex[tri[k]];
+            q[k] = rep[tri[k]] == from ? vertex[to] : p[k];
+          }
+          const vec3f before = cross(p[1]-p[0],p[2]-p[0]);
+          const vec3f after  = cross(q[1]-q[0],q[2]-q[0]);
+          if (dot(before,after) < .25f*length(before)*length(after))
+            flips = true;
+        });
+      // (and never collapse the mesh into nothing)
+      if (flips || numRemoved+numDegenerate >= current.size())
+        return undoMap(from,vertexMap);
+
+      collapsed[from] = true;
+      quadric[to] += quadric[from];
+      numRemoved += numDegenerate;
+      return true;
+    }
+
+    /*! reset the mapping of all copies of 'from'; returns false,
+        for the failed collapse that needs this */
+    bool undoMap(int from, std::vector<int> &vertexMap) const
+    {
+      int w = from;
+      do { vertexMap[w] = w; w = nextWedge[w]; } while (w != from);
+      return false;
+    }
+
+    const MeshArray<vec3f> &vertex;
+    const int               numVertices;
+    std::vector<int>        rep, nextWedge;
+    std::vector<Quadric>    quadric;
+    std::vector<bool>       collapsed;
+    /*! the triangles being simplified */
+    std::vector<vec3i>      current;
+    std::vector<int>        adjBegin, adjacent;
+    std::vector<Candidate>  candidates;
+  };
+
+  /*! fill in given mesh's LODs */
+  static void generateLODs(TriangleMesh *mesh, int numLevels, float ratio)
+  {
+    mesh->lodIndex.clear();
+    mesh->lodError.clear();
+    if (mesh->index.empty()) return;
+
+    Simplifier simplifier(mesh);
+    std::vector<vec3i> tris(mesh->index.begin(),mesh->index.end());
+    float error = 0.f;
+    for (int level=0;level<numLevels;level++) {
+      const size_t numBefore = tris.size();
+      error = std::max(error,simplifier.simplify(tris,size_t(numBefore*ratio)));
+      if (tris.size() == numBefore)
+        // nothing left that can be collapsed
+        break;
+      mesh->lodIndex.push_back(tris);
+      mesh->lodError.push_back(error);
+    }
+  }
+
+  void generateLODs(Model *model, int numLevels, float ratio)
+  {
+    const double startTime = getCurrentTime();
+
+    // large meshes get their candidates found on all threads; small
+    // ones are not worth the threads, so we rather run several of
+    // those side by side
+    const size_t largeMesh = 1<<16;
+    std::vector<TriangleMesh *> small;
+    for (auto mesh : model->meshes)
+      if (mesh->vertex.size() >= largeMesh)
+        generateLODs(mesh,numLevels,ratio);
+      else
+        small.push_back(mesh);
+    gdt::parallel_for(small.size(),[&](size_t meshID){
+        generateLODs(small[meshID],numLevels,ratio);
+      });
+
+    // (meshes that ran out of things to collapse count with their
+    // coarsest LOD for all levels beyond that)
+    std::vector<size_t> numTriangles(numLevels+1,0);
+    for (auto mesh : model->meshes)
+      for (int level=0;level<=numLevels;level++) {
+        const int lod = std::min(level,(int)mesh->lodIndex.size());
+        numTriangles[level] += lod == 0
+          ? mesh->index.size()
+          : mesh->lodIndex[lod-1].size();
+      }
+    std::cout << "generated " << numLevels << " LODs, triangles:";
+    for (auto n : numTriangles)
+      std::cout << " " << n;
+    std::cout << " (in " << (getCurrentTime()-startTime) << "s)" << std::endl;
+  }
+
+}
@@ -0,0 +1,459 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Model.h"
+#include "gdt/parallel/parallel_for.h"
+//std
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! number of triangles (in Morton order) that large meshes get
+      cut into, to be partitioned independently of each other */
+  enum { MESHLET_CHUNK_SIZE = 64*1024 };
+
+  /*! how much each new vertex a triangle would add counts against
+      it, relative to its (squared) distance from the meshlet's
+      center over the meshlet's (squared) radius. Much higher costs
+      make for fuller, but stringier meshlets */
+  static const float NEW_VERTEX_COST = 1.f;
+
+  /*! spread the lower 10 bits of 'x' out to every third bit */
+  static uint32_t spreadBits(uint32_t x)
+  {
+    x = (x | (x << 16)) & 0x030000FF;
+    x = (x | (x <<  8)) & 0x0300F00F;
+    x = (x | (x <<  4)) & 0x030C30C3;
+    x = (x | (x <<  2)) & 0x09249249;
+    return x;
+  }
+
+  /*! 30-bit Morton code of 'p', on a grid of cubic cells over
+      'bounds' (which keeps thin dimensions from dominating the order) */
+  static uint32_t mortonCode(const vec3f &p, const box3f &bounds)
+  {
+    const float extent = std::max(reduce_max(bounds.span()),1e-20f);
+    const vec3f rel    = (p-bounds.lower)*(1.f/extent);
+    const uint32_t x = (uint32_t)clamp(rel.x*1024.f,0.f,1023.f);
+    const uint32_t y = (uint32_t)clamp(rel.y*1024.f,0.f,1023.f);
+    const uint32_t z = (uint32_t)clamp(rel.z*1024.f,0.f,1023.f);
+    return (spreadBits(x) << 2) | (spreadBits(y) << 1) | spreadBits(z);
+  }
+
+  /*! the meshlets of one contiguous range of triangles */
+  struct MeshletChunk {
+    std::vector<Meshlet>  meshlets;
+    std::vector<int>      vertex;
+    std::vector<uint8_t>  index;
+  };
+
+  /*! greedy meshlet partitioner for a single mesh: triangles get
+      sorted along a Morton curve, and each meshlet starts at the
+      first unused triangle in that order and then keeps growing by
+      whichever neighboring triangle adds the fewest new vertices
+      (and, among those, is closest to the meshlet's center), until
+      it runs out of triangles or vertices */
+  struct MeshletBuilder {
+    MeshletBuilder(const TriangleMesh *mesh);
+
+    /*! partition the triangles order[begin..end) */
+    void build(size_t begin, size_t end, MeshletChunk &chunk);
+
+    size_t numTriangles() const { return order.size(); }
+
+  private:
+    enum { UNUSED = 0, CANDIDATE = 1, USED = 2 };
+
+    vec3f centroid(int t) const
+    {
+      const vec3i &tri = mesh->index[t];
+      return (mesh->vertex[tri.x]+mesh->vertex[tri.y]+mesh->vertex[tri.z])
+        *(1.f/3.f);
+    }
+
+    /*! unit normal of triangle t, zero if it is degenerate */
+    vec3f unitNormal(int t) const
+    {
+      const vec3i &tri = mesh->index[t];
+      const vec3f n = cross(mesh->vertex[tri.y]-mesh->vertex[tri.x],
+                            mesh->vertex[tri.z]-mesh->vertex[tri.x]);
+      const float len = length(n);
+      return len > 0.f ? n/len : vec3f(0.f);
+    }
+
+    /*! fill in bounds and normal cone of a finished meshlet */
+    void finish(Meshlet &meshlet, const MeshletChunk &chunk,
+                const std::vector<int> &triangles) const;
+
+    const TriangleMesh *mesh;
+    /*! the triangles in Morton order, and each triangle's position
+        in that order */
+    std::vector<int>     order, rank;
+    /*! vertex->triangle adjacency, in CSR form */
+    std::vector<int>     adjBegin, adjacent;
+    /*! UNUSED, CANDIDATE (for the meshlet being grown), or USED */
+    std::vector<uint8_t> state;
+    /*! for candidates: how many vertices they would add */
+    std::vector<uint8_t> newVertices;
+  };
+
+  MeshletBuilder::MeshletBuilder(const TriangleMesh *mesh)
+    : mesh(mesh)
+  {
+    const int numTriangles = (int)mesh->index.size();
+    const int numVertices  = (int)mesh->vertex.size();
+
+    std::vector<uint64_t> keyed(numTriangles);
+    gdt::parallel_for_blocked(numTriangles,16*1024,[&](size_t begin, size_t end){
+        for (size_t t=begin;t<end;t++)
+          keyed[t] = (uint64_t(mortonCode(centroid((int)t),mesh->bounds)) << 32) | t;
+      });
+    std::sort(keyed.begin(),keyed.end());
+    order.resize(numTriangles);
+    rank.resize(numTriangles);
+    for (int i=0;i<numTriangles;i++) {
+      order[i] = (int)(uint32_t)keyed[i];
+      rank[order[i]] = i;
+    }
+
+    adjBegin.assign(numVertices+1,0);
+    for (auto &tri : mesh->index)
+      for (int k=0;k<3;k++)
+        adjBegin[tri[k]+1]++;
+    for (int v=0;v<numVertices;v++)
+      adjBegin[v+1] += adjBegin[v];
+    adjacent.resize(adjBegin[numVertices]);
+    std::vector<int> fill(adjBegin.begin(),adjBegin.end()-1);
+    for (int t=0;t<numTriangles;t++)
+      for (int k=0;k<3;k++)
+        adjacent[fill[mesh->index[t][k]]++] = t;
+
+    state.assign(numTriangles,UNUSED);
+    newVertices.resize(numTriangles);
+  }
+
+  void MeshletBuilder::finish(Meshlet &meshlet, const MeshletChunk &chunk,
+                              const std::vector<int> &triangles) const
+  {
+    meshlet.bounds = box3f();
+    for (int i=0;i<meshlet.numVertices;i++)
+      meshlet.bounds.extend(mesh->vertex[chunk.vertex[meshlet.vertexBegin+i]]);
+
+    vec3f sum(0.f);
+    for (int t : triangles)
+      sum += unitNormal(t);
+    const float len = length(sum);
+    if (len < 1e-6f) {
+      // normals (about) cancel out: no cone narrower than everything
+      meshlet.coneAxis  = vec3f(0.f,0.f,1.f);
+      meshlet.coneAngle = float(M_PI);
+      return;
+    }
+    meshlet.coneAxis = sum/len;
+    float minCos = 1.f;
+    for (int t : triangles) {
+      const vec3f n = unitNormal(t);
+      if (n != vec3f(0.f))
+        minCos = std::min(minCos,dot(n,meshlet.coneAxis));
+    }
+    meshlet.coneAngle = acosf(clamp(minCos,-1.f,1.f));
+  }
+
+  void MeshletBuilder::build(size_t begin, size_t end, MeshletChunk &chunk)
+  {
+    auto inChunk = [&](int t) {
+      return (size_t)rank[t] >= begin && (size_t)rank[t] < end;
+    };
+
+    // a triangle that could be added next, and its centroid
+    struct Candidate { int t; vec3f centroid; };
+    std::vector<Candidate> candidates;
+    std::vector<int>       triangles;
+    int   localVertex[Meshlet::maxVertices];
+    size_t nextSeed = begin;
+    int    seed     = -1;
+    while (true) {
+      while (nextSeed < end && state[order[nextSeed]] == USED) nextSeed++;
+      if (seed < 0 && nextSeed == end) break;
+
+      Meshlet meshlet;
+      meshlet.vertexBegin   = (uint32_t)chunk.vertex.size();
+      meshlet.triangleBegin = (uint32_t)(chunk.index.size()/3);
+      int   numVertices = 0;
+      vec3f centroidSum(0.f);
+      box3f grown;
+      triangles.clear();
+
+      auto localID = [&](int v) {
+        for (int i=0;i<numVertices;i++)
+          if (localVertex[i] == v) return i;
+        return -1;
+      };
+
+      int next = seed >= 0 ? seed : order[nextSeed];
+      while (next >= 0) {
+        // add triangle 'next' ...
+        const vec3i &tri = mesh->index[next];
+        for (int k=0;k<3;k++) {
+          int id = localID(tri[k]);
+          if (id < 0) {
+            id = numVertices++;
+            localVertex[id] = tri[k];
+            chunk.vertex.push_back(tri[k]);
+            // candidates using that vertex now need one less new one
+            for (int i=adjBegin[tri[k]];i<adjBegin[tri[k]+1];i++)
+              if (inChunk(adjacent[i]) && state[adjacent[i]] == CANDIDATE)
+                newVertices[adjacent[i]]--;
+          }
+          chunk.index.push_back((uint8_t)id);
+        }
+        state[next] = USED;
+        triangles.push_back(next);
+        const vec3f c = centroid(next);
+        centroidSum += c;
+        for (int k=0;k<3;k++)
+          grown.extend(mesh->vertex[tri[k]]);
+        if ((int)triangles.size() == Meshlet::maxTriangles) break;
+
+        // ... make its neighbors candidates ...
+        for (int k=0;k<3;k++)
+          for (int i=adjBegin[tri[k]];i<adjBegin[tri[k]+1];i++) {
+            const int t = adjacent[i];
+            if (inChunk(t) && state[t] == UNUSED) {
+              state[t] = CANDIDATE;
+              candidates.push_back({t,centroid(t)});
+              const vec3i &cand = mesh->index[t];
+              newVertices[t] = (localID(cand.x) < 0) + (localID(cand.y) < 0)
+                + (localID(cand.z) < 0);
+            }
+          }
+
+        // ... and pick the best one of those to add next
+        const vec3f center = centroidSum*(1.f/triangles.size());
+        const float radius2
+          = std::max(.25f*dot(grown.span(),grown.span()),1e-30f);
+        float bestScore = 1e30f;
+        next = -1;
+        size_t numLive = 0;
+        for (size_t i=0;i<candidates.size();i++) {
+          const int t = candidates[i].t;
+          if (state[t] != CANDIDATE) continue;
+          candidates[numLive++] = candidates[i];
+          if (numVertices+newVertices[t] > Meshlet::maxVertices) continue;
+          const vec3f d = candidates[i].centroid-center;
+          const float dist = dot(d,d);
+          const float score = dist/radius2 + NEW_VERTEX_COST*newVertices[t];
+          if (score < bestScore) {
+            bestScore = score;
+            next      = t;
+          }
+        }
+        candidates.resize(numLive);
+
+        if (next < 0 && candidates.empty()
+            && numVertices+3 <= Meshlet::maxVertices) {
+          // the connected piece(s) we grew over are used up: continue
+          // with the next triangle along the curve, if that is close
+          while (nextSeed < end && state[order[nextSeed]] == USED) nextSeed++;
+          if (nextSeed < end) {
+            const int t = order[nextSeed];
+            const float reach = length(grown.span())+1e-20f;
+            if (length(centroid(t)-center) <= reach) next = t;
+          }
+        }
+      }
+      // start the next meshlet at whichever of this one's left-over
+      // neighbors is most boxed in, so that pockets of unused
+      // triangles get filled rather than left to become meshlets of
+      // their own
+      seed = -1;
+      int seedNeighbors = 0;
+      for (auto &candidate : candidates) {
+        const int t = candidate.t;
+        if (state[t] != CANDIDATE) continue;
+        state[t] = UNUSED;
+        int neighbors = 0;
+        const vec3i &tri = mesh->index[t];
+        for (int k=0;k<3;k++)
+          for (int i=adjBegin[tri[k]];i<adjBegin[tri[k]+1];i++)
+            neighbors += (state[adjacent[i]] != USED);
+        if (seed < 0 || neighbors < seedNeighbors) {
+          seed          = t;
+          seedNeighbors = neighbors;
+        }
+      }
+      candidates.clear();
+
+      meshlet.numVertices  = (uint8_t)numVertices;
+      meshlet.numTriangles = (uint8_t)triangles.size();
+      finish(meshlet,chunk,triangles);
+      chunk.meshlets.push_back(meshlet);
+    }
+  }
+
+  /*! partition one mesh; large meshes get cut into chunks (along
+      the Morton curve) that are partitioned in parallel */
+  static void buildMeshlets(TriangleMesh *mesh)
+  {
+    mesh->meshlets.clear();
+    mesh->meshletVertex.clear();
+    mesh->meshletIndex.clear();
+    if (mesh->index.empty()) return;
+
+    MeshletBuilder builder(mesh);
+    const size_t numChunks
+      = (builder.numTriangles()+MESHLET_CHUNK_SIZE-1)/MESHLET_CHUNK_SIZE;
+    std::vector<MeshletChunk> chunks(numChunks);
+    gdt::parallel_for(numChunks,[&](size_t chunkID){
+        builder.build(chunkID*MESHLET_CHUNK_SIZE,
+                      std::min(builder.numTriangles(),
+                               (chunkID+1)*MESHLET_CHUNK_SIZE),
+                      chunks[chunkID]);
+      });
+
+    size_t numMeshlets = 0, numVertices = 0, numIndices = 0;
+    for (auto &chunk : chunks) {
+      numMeshlets += chunk.meshlets.size();
+      numVertices += chunk.vertex.size();
+      numIndices  += chunk.index.size();
+    }
+    mesh->meshlets.reserve(numMeshlets);
+    mesh->meshletVertex.reserve(numVertices);
+    mesh->meshletIndex.reserve(numIndices);
+    for (auto &chunk : chunks) {
+      const uint32_t vertexBegin   = (uint32_t)mesh->meshletVertex.size();
+      const uint32_t triangleBegin = (uint32_t)(mesh->meshletIndex.size()/3);
+      for (auto meshlet : chunk.meshlets) {
+        meshlet.vertexBegin   += vertexBegin;
+        meshlet.triangleBegin += triangleBegin;
+        mesh->meshlets.push_back(meshlet);
+      }
+      mesh->meshletVertex.insert(mesh->meshletVertex.end(),
+                                 chunk.vertex.begin(),chunk.vertex.end());
+      mesh->meshletIndex.insert(mesh->meshletIndex.end(),
+                                chunk.index.begin(),chunk.index.end());
+    }
+  }
+
+  /*! call f(cellID) for all cells lo..hi of a res^3 grid */
+  template<typename Lambda>
+  static void forEachCell(const vec3i &lo, const vec3i &hi, int res,
+                          const Lambda &f)
+  {
+    for (int z=lo.z;z<=hi.z;z++)
+      for (int y=lo.y;y<=hi.y;y++)
+        for (int x=lo.x;x<=hi.x;x++)
+          f(x+res*(y+res*z));
+  }
+
+  float computeMeshletOverlap(const TriangleMesh *mesh)
+  {
+    const size_t numMeshlets = mesh->meshlets.size();
+    if (numMeshlets < 2) return 0.f;
+
+    // bin the meshlets' bounds into a uniform grid over the mesh
+    const int   res   = std::max(1,(int)cbrtf((float)numMeshlets));
+    const box3f &bounds = mesh->bounds;
+    const vec3f scale = vec3f((float)res)/max(bounds.span(),vec3f(1e-20f));
+    auto cellOf = [&](const vec3f &p) {
+      const vec3f rel = (p-bounds.lower)*scale;
+      return vec3i(clamp((int)rel.x,0,res-1),
+                   clamp((int)rel.y,0,res-1),
+                   clamp((int)rel.z,0,res-1));
+    };
+    const int numCells = res*res*res;
+    std::vector<int> cellBegin(numCells+1,0);
+    for (auto &meshlet : mesh->meshlets)
+      forEachCell(cellOf(meshlet.bounds.lower),cellOf(meshlet.bounds.upper),res,
+                  [&](int cell){ cellBegin[cell+1]++; });
+    for (int c=0;c<numCells;c++)
+      cellBegin[c+1] += cellBegin[c];
+    std::vector<int> cellMeshlet(cellBegin[numCells]);
+    {
+      std::vector<int> fill(cellBegin.begin(),cellBegin.end()-1);
+      for (size_t m=0;m<numMeshlets;m++) {
+        const box3f &box = mesh->meshlets[m].bounds;
+        forEachCell(cellOf(box.lower),cellOf(box.upper),res,[&](int cell){
+            cellMeshlet[fill[cell]++] = (int)m;
+          });
+      }
+    }
+
+    std::atomic<size_t> numInside(0);
+    gdt::parallel_for_blocked(numMeshlets,1024,[&](size_t begin, size_t end){
+        size_t inside = 0;
+        for (size_t m=begin;m<end;m++) {
+          const Meshlet &meshlet = mesh->meshlets[m];
+          const int    *vertex   = &mesh->meshletVertex[meshlet.vertexBegin];
+          const uint8_t *index   = &mesh->meshletIndex[3*meshlet.triangleBegin];
+          for (int t=0;t<meshlet.numTriangles;t++) {
+            const vec3f c
+              = (mesh->vertex[vertex[index[3*t+0]]]
+                 + mesh->vertex[vertex[index[3*t+1]]]
+                 + mesh->vertex[vertex[index[3*t+2]]])*(1.f/3.f);
+            const vec3i cell = cellOf(c);
+            const int   cellID = cell.x+res*(cell.y+res*cell.z);
+            for (int i=cellBegin[cellID];i<cellBegin[cellID+1];i++)
+              if (cellMeshlet[i] != (int)m
+                  && mesh->meshlets[cellMeshlet[i]].bounds.contains(c)) {
+                inside++;
+                break;
+              }
+          }
+        }
+        numInside += inside;
+      });
+    return numInside/float(mesh->index.size());
+  }
+
+  void buildMeshlets(Model *model)
+  {
+    const double startTime = getCurrentTime();
+
+    // large meshes get their chunks partitioned on all threads;
+    // small ones are just one chunk, so we rather run several of
+    // those side by side
+    std::vector<TriangleMesh *> small;
+    for (auto mesh : model->meshes)
+      if (mesh->index.size() > MESHLET_CHUNK_SIZE)
+        buildMeshlets(mesh);
+      else
+        small.push_back(mesh);
+    gdt::parallel_for(small.size(),[&](size_t meshID){
+        buildMeshlets(small[meshID]);
+      });
+    const double buildTime = getCurrentTime()-startTime;
+
+    size_t numMeshlets = 0, numTriangles = 0, numVertices = 0;
+    double overlap = 0.;
+    for (auto mesh : model->meshes) {
+      numMeshlets  += mesh->meshlets.size();
+      numTriangles += mesh->index.size();
+      numVertices  += mesh->meshletVertex.size();
+      overlap      += computeMeshletOverlap(mesh)*mesh->index.size();
+    }
+    const size_t n = std::max(numMeshlets,(size_t)1);
+    std::cout << "built " << numMeshlets << " meshlets"
+              << " (" << numTriangles/float(n) << " triangles, "
+              << numVertices/float(n) << " vertices each;"
+              << " overlap " << 100.*overlap/std::max(numTriangles,(size_t)1)
+              << "%, in " << buildTime << "s)" << std::endl;
+  }
+
+}
@@ -15,54 +15,43 @@
 // ======================================================================== //
 
 #include "Model.h"
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "3rdParty/tiny_obj_loader.h"
+#include "OBJParser.h"
+#include "KnownVertices.h"
+#include "ModelCache.h"
+#include "TextureMips.h"
+#include "gdt/parallel/parallel_for.h"
+#include "gdt/parallel/parallel_bounds.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "3rdParty/stb_image.h"
 
 //std
-#include <set>
-
-namespace tinyobj {
-  inline bool operator<(const tinyobj::index_t &a,
-                        const tinyobj::index_t &b)
-  {
-    if (a.vertex_index < b.vertex_index) return true;
-    if (a.vertex_index > b.vertex_index) return false;
-    
-    if (a.normal_index < b.normal_index) return true;
-    if (a.normal_index > b.normal_index) return false;
-    
-    if (a.texcoord_index < b.texcoord_index) return true;
-    if (a.texcoord_index > b.texcoord_index) return false;
-    
-    return false;
-  }
-}
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <string.h>
 
 /*! \namespace osc - Optix Siggraph Course */
 namespace osc {
   
-
-
   /*! find vertex with given position, normal, texcoord, and return
       its vertex ID, or, if it doesn't exit, add it to the mesh, and
       its just-created index */
   int addVertex(TriangleMesh *mesh,
                 tinyobj::attrib_t &attributes,
                 const tinyobj::index_t &idx,
-                std::map<tinyobj::index_t,int> &knownVertices)
+                KnownVertices &knownVertices)
   {
-    if (knownVertices.find(idx) != knownVertices.end())
-      return knownVertices[idx];
+    int &knownID = knownVertices.findOrInsert(idx);
+    if (knownID >= 0)
+      return knownID;
 
     const vec3f *vertex_array   = (const vec3f*)attributes.vertices.data();
     const vec3f *normal_array   = (const vec3f*)attributes.normals.data();
     const vec2f *texcoord_array = (const vec2f*)attributes.texcoords.data();
     
     int newID = (int)mesh->vertex.size();
-    knownVertices[idx] = newID;
+    knownID = newID;
 
     mesh->vertex.push_back(vertex_array[idx.vertex_index]);
     if (idx.normal_index >= 0) {
@@ -74,71 +63,478 @@ namespace osc {
         mesh->texcoord.push_back(texcoord_array[idx.texcoord_index]);
     }
 
-    // just for sanity's sake:
+    // just for sanity's sake (and so that vertices without a
+    // texcoord or normal, in a mesh whose other vertices have them,
+    // get zeroes rather than whatever was in memory):
     if (mesh->texcoord.size() > 0)
-      mesh->texcoord.resize(mesh->vertex.size());
-    // just for sanity's sake:
+      mesh->texcoord.resize(mesh->vertex.size(),vec2f(0.f));
     if (mesh->normal.size() > 0)
-      mesh->normal.resize(mesh->vertex.size());
+      mesh->normal.resize(mesh->vertex.size(),vec3f(0.f));
     
     return newID;
   }
 
-  /*! load a texture (if not already loaded), and return its ID in the
-      model's textures[] vector. Textures that could not get loaded
-      return -1 */
-  int loadTexture(Model *model,
-                  std::map<std::string,int> &knownTextures,
-                  const std::string &inFileName,
-                  const std::string &modelPath)
+  /*! c*a/255, correctly rounded, without a division */
+  inline unsigned char mul8(unsigned c, unsigned a)
   {
-    if (inFileName == "")
-      return -1;
-    
-    if (knownTextures.find(inFileName) != knownTextures.end())
-      return knownTextures[inFileName];
+    const unsigned t = c*a+128;
+    return (unsigned char)((t+(t>>8))>>8);
+  }
+  
+  /*! pre-multiply one RGBA8 pixel's color by its alpha */
+  inline void premultiplyPixel(unsigned char *dst, const unsigned char *src)
+  {
+    const unsigned a = src[3];
+    dst[0] = mul8(src[0],a);
+    dst[1] = mul8(src[1],a);
+    dst[2] = mul8(src[2],a);
+    dst[3] = (unsigned char)a;
+  }
+  
+  Texture *ingestTexture(unsigned char *image,
+                         const vec2i &res,
+                         int numChannels,
+                         bool premultiplyAlpha)
+  {
+    Texture *texture = new Texture;
+    texture->resolution = res;
 
-    std::string fileName = inFileName;
-    // first, fix backspaces:
-    for (auto &c : fileName)
-      if (c == '\\') c = '/';
-    fileName = modelPath+"/"+fileName;
+    /* iw - actually, it seems that stbi loads the pictures
+       mirrored along the y axis - mirror them here */
+    if (numChannels == 4) {
+      const size_t pitch = 4*size_t(res.x);
+      std::vector<unsigned char> tmpLine(premultiplyAlpha ? 0 : pitch);
+      for (int y=0;y<(res.y+1)/2;y++) {
+        unsigned char *line_y     = image + size_t(y) * pitch;
+        unsigned char *mirrored_y = image + size_t(res.y-1-y) * pitch;
+        if (!premultiplyAlpha) {
+          memcpy(tmpLine.data(),line_y,pitch);
+          memmove(line_y,mirrored_y,pitch);
+          memcpy(mirrored_y,tmpLine.data(),pitch);
+        } else if (line_y == mirrored_y)
+          for (int x=0;x<res.x;x++)
+            premultiplyPixel(line_y+4*x,line_y+4*x);
+        else
+          for (int x=0;x<res.x;x++) {
+            unsigned char tmp[4];
+            premultiplyPixel(tmp,line_y+4*x);
+            premultiplyPixel(line_y+4*x,mirrored_y+4*x);
+            memcpy(mirrored_y+4*x,tmp,4);
+          }
+      }
+      texture->pixel = (uint32_t *)image;
+      return texture;
+    }
 
+    unsigned char *pixels
+      = (unsigned char *)malloc(4*size_t(res.x)*size_t(res.y));
+    if (!pixels) {
+      stbi_image_free(image);
+      delete texture;
+      throw std::bad_alloc();
+    }
+    const size_t srcPitch = size_t(res.x)*numChannels;
+    for (int y=0;y<res.y;y++) {
+      const unsigned char *src = image + size_t(res.y-1-y) * srcPitch;
+      unsigned char *dst = pixels + 4 * size_t(y) * res.x;
+      switch (numChannels) {
+      case 3:
+        for (int x=0;x<res.x;x++) {
+          dst[4*x+0] = src[3*x+0];
+          dst[4*x+1] = src[3*x+1];
+          dst[4*x+2] = src[3*x+2];
+          dst[4*x+3] = 255;
+        }
+        break;
+      case 2:
+        for (int x=0;x<res.x;x++) {
+          dst[4*x+0] = src[2*x+0];
+          dst[4*x+1] = src[2*x+0];
+          dst[4*x+2] = src[2*x+0];
+          dst[4*x+3] = src[2*x+1];
+        }
+        if (premultiplyAlpha)
+          for (int x=0;x<res.x;x++)
+            premultiplyPixel(dst+4*x,dst+4*x);
+        break;
+      default:
+        for (int x=0;x<res.x;x++) {
+          dst[4*x+0] = src[x];
+          dst[4*x+1] = src[x];
+          dst[4*x+2] = src[x];
+          dst[4*x+3] = 255;
+        }
+      }
+    }
+    stbi_image_free(image);
+    texture->pixel = (uint32_t *)pixels;
+    return texture;
+  }
+  
+  Texture *loadTexture(const std::string &fileName,
+                       bool premultiplyAlpha)
+  {
     vec2i res;
     int   comp;
+    // decode with the file's own channel count; ingestTexture()
+    // expands to RGBA while flipping, rather than having stbi do
+    // that in a pass of its own
     unsigned char* image = stbi_load(fileName.c_str(),
-                                     &res.x, &res.y, &comp, STBI_rgb_alpha);
-    int textureID = -1;
-    if (image) {
-      textureID = (int)model->textures.size();
-      Texture *texture = new Texture;
-      texture->resolution = res;
-      texture->pixel      = (uint32_t*)image;
-
-      /* iw - actually, it seems that stbi loads the pictures
-         mirrored along the y axis - mirror them here */
-      for (int y=0;y<res.y/2;y++) {
-        uint32_t *line_y = texture->pixel + y * res.x;
-        uint32_t *mirrored_y = texture->pixel + (res.y-1-y) * res.x;
-        int mirror_y = res.y-1-y;
-        for (int x=0;x<res.x;x++) {
-          std::swap(line_y[x],mirrored_y[x]);
+                                     &res.x, &res.y, &comp, 0);
+    if (!image)
+      return nullptr;
+    
+    Texture *texture = ingestTexture(image,res,comp,premultiplyAlpha);
+    texture->fileName = fileName;
+    return texture;
+  }
+
+  /*! decodes all textures of a model on a pool of worker threads, in
+      the background, while the loading thread goes on building the
+      meshes. Texture IDs get handed out when a texture is requested
+      (ie, in the order the meshes first reference them), so they do
+      not depend on which decode job happens to finish first */
+  struct TextureDecoder {
+    ~TextureDecoder()
+    {
+      if (done.valid()) done.wait();
+      for (auto texture : decoded)
+        if (texture) delete texture;
+    }
+    
+    /*! return the (preliminary) ID of given texture, scheduling it
+        for decoding if it is not already known. Empty file names
+        return -1 */
+    int request(const std::string &inFileName)
+    {
+      if (inFileName == "")
+        return -1;
+      auto known = knownTextures.find(inFileName);
+      if (known != knownTextures.end())
+        return known->second;
+
+      std::string fileName = inFileName;
+      // first, fix backspaces:
+      for (auto &c : fileName)
+        if (c == '\\') c = '/';
+      const int textureID = (int)fileNames.size();
+      // (modelDir is empty for a model in the working directory, and
+      // ends in a slash otherwise)
+      fileNames.push_back(modelDir+fileName);
+      knownTextures[inFileName] = textureID;
+      return textureID;
+    }
+
+    /*! kick off decoding all textures requested so far */
+    void start()
+    {
+      decoded.resize(fileNames.size(),nullptr);
+      mipTime.resize(fileNames.size(),0.);
+      done = std::async(std::launch::async,[this](){
+          gdt::parallel_for(fileNames.size(),[this](size_t textureID){
+              Texture *texture = loadTexture(fileNames[textureID]);
+              if (texture && options.generateMips) {
+                const double mipStartTime = getCurrentTime();
+                generateMipLevels(texture,options.mipFilter);
+                mipTime[textureID] = getCurrentTime()-mipStartTime;
+              }
+              decoded[textureID] = texture;
+            });
+        });
+    }
+
+    /*! completion barrier: waits for all decode jobs, moves all
+        textures that could get loaded into the model, and returns
+        the final ID for each preliminary one (-1 for those textures
+        that failed to load) */
+    std::vector<int> finish(Model *model)
+    {
+      done.get();
+      std::vector<int> finalID(decoded.size(),-1);
+      size_t numBytes = 0;
+      double totalMipTime = 0.;
+      for (size_t textureID=0;textureID<decoded.size();textureID++) {
+        totalMipTime += mipTime[textureID];
+        if (decoded[textureID]) {
+          numBytes += decoded[textureID]->sizeInBytes();
+          finalID[textureID] = (int)model->textures.size();
+          model->textures.push_back(decoded[textureID]);
+          decoded[textureID] = nullptr;
+        } else {
+          std::cout << GDT_TERMINAL_RED
+                    << "Could not load texture from " << fileNames[textureID] << "!"
+                    << GDT_TERMINAL_DEFAULT << std::endl;
         }
       }
-      
-      model->textures.push_back(texture);
-    } else {
-      std::cout << GDT_TERMINAL_RED
-                << "Could not load texture from " << fileName << "!"
-                << GDT_TERMINAL_DEFAULT << std::endl;
+      if (!model->textures.empty()) {
+        std::cout << "loaded " << model->textures.size() << " textures ("
+                  << prettyNumber(numBytes) << "B";
+        if (options.generateMips)
+          std::cout << " incl. mip levels, built in " << totalMipTime
+                    << "s of thread time";
+        std::cout << ")" << std::endl;
+      }
+      return finalID;
+    }
+
+    std::string                modelDir;
+    TextureOptions             options;
+    std::map<std::string,int>  knownTextures;
+    std::vector<std::string>   fileNames;
+    std::vector<Texture *>     decoded;
+    std::vector<double>        mipTime;
+    std::future<void>          done;
+  };
+  
+  void ArenaBuilder::reserve(size_t numVertices, size_t numNormals,
+                             size_t numTexcoords, size_t numIndices)
+  {
+    vertex.reserve(vertex.size()+numVertices);
+    normal.reserve(normal.size()+numNormals);
+    texcoord.reserve(texcoord.size()+numTexcoords);
+    index.reserve(index.size()+numIndices);
+  }
+
+  void ArenaBuilder::add(TriangleMesh *mesh, const TriangleMesh &from)
+  {
+    Added a;
+    a.mesh          = mesh;
+    a.vertexBegin   = vertex.size();
+    a.normalBegin   = normal.size();
+    a.texcoordBegin = texcoord.size();
+    a.indexBegin    = index.size();
+    added.push_back(a);
+    vertex.insert(vertex.end(),from.vertex.begin(),from.vertex.end());
+    normal.insert(normal.end(),from.normal.begin(),from.normal.end());
+    texcoord.insert(texcoord.end(),from.texcoord.begin(),from.texcoord.end());
+    index.insert(index.end(),from.index.begin(),from.index.end());
+  }
+
+  void ArenaBuilder::finish()
+  {
+    for (size_t i=0;i<added.size();i++) {
+      const Added &a = added[i];
+      const size_t nextVertex
+        = i+1 < added.size() ? added[i+1].vertexBegin   : vertex.size();
+      const size_t nextNormal
+        = i+1 < added.size() ? added[i+1].normalBegin   : normal.size();
+      const size_t nextTexcoord
+        = i+1 < added.size() ? added[i+1].texcoordBegin : texcoord.size();
+      const size_t nextIndex
+        = i+1 < added.size() ? added[i+1].indexBegin    : index.size();
+      a.mesh->vertex.setView(vertex.data()+a.vertexBegin,
+                             nextVertex-a.vertexBegin);
+      a.mesh->normal.setView(normal.data()+a.normalBegin,
+                             nextNormal-a.normalBegin);
+      a.mesh->texcoord.setView(texcoord.data()+a.texcoordBegin,
+                               nextTexcoord-a.texcoordBegin);
+      a.mesh->index.setView(index.data()+a.indexBegin,
+                            nextIndex-a.indexBegin);
     }
+    // moving the vectors keeps their data where it is
+    model->vertexArena.assign(std::move(vertex));
+    model->normalArena.assign(std::move(normal));
+    model->texcoordArena.assign(std::move(texcoord));
+    model->indexArena.assign(std::move(index));
+    added.clear();
+    std::vector<vec3f>().swap(vertex);
+    std::vector<vec3f>().swap(normal);
+    std::vector<vec2f>().swap(texcoord);
+    std::vector<vec3i>().swap(index);
+  }
+
+  void packMeshes(Model *model)
+  {
+    size_t numVertices = 0, numNormals = 0, numTexcoords = 0, numIndices = 0;
+    for (auto mesh : model->meshes) {
+      numVertices  += mesh->vertex.size();
+      numNormals   += mesh->normal.size();
+      numTexcoords += mesh->texcoord.size();
+      numIndices   += mesh->index.size();
+    }
+    ArenaBuilder arenas(model);
+    arenas.reserve(numVertices,numNormals,numTexcoords,numIndices);
+    for (auto mesh : model->meshes)
+      arenas.add(mesh,*mesh);
+    arenas.finish();
+  }
+
+  /*! whether given array is empty, or a view into given arena */
+  template<typename T>
+  static bool isInArena(const MeshArray<T> &array, const MeshArray<T> &arena)
+  {
+    return array.empty()
+      || (array.isView()
+          && array.data() >= arena.data()
+          && array.data()+array.size() <= arena.data()+arena.size());
+  }
+
+  bool isPacked(const Model *model)
+  {
+    for (auto mesh : model->meshes)
+      if (!isInArena(mesh->vertex,model->vertexArena) ||
+          !isInArena(mesh->normal,model->normalArena) ||
+          !isInArena(mesh->texcoord,model->texcoordArena) ||
+          !isInArena(mesh->index,model->indexArena))
+        return false;
+    return true;
+  }
+  
+  void computeBounds(Model *model)
+  {
+    // large meshes get reduced on all threads by gdt::computeBounds;
+    // small ones are not worth the threads, so we rather run several
+    // of those side by side. Meshes with compact positions keep the
+    // bounds they got quantized to
+    const size_t largeMesh = 1<<20;
+    std::vector<TriangleMesh *> small;
+    for (auto mesh : model->meshes)
+      if (!mesh->compactVertex.empty())
+        continue;
+      else if (mesh->vertex.size() >= largeMesh)
+        mesh->bounds = gdt::computeBounds(mesh->vertex.data(),mesh->vertex.size());
+      else
+        small.push_back(mesh);
+    gdt::parallel_for(small.size(),[&](size_t meshID){
+        TriangleMesh *mesh = small[meshID];
+        mesh->bounds = gdt::computeBounds_serial(mesh->vertex.data(),mesh->vertex.size());
+      });
+
+    model->bounds = box3f();
+    if (model->instances.empty())
+      for (auto mesh : model->meshes)
+        model->bounds.extend(mesh->bounds);
+    else
+      for (auto &instance : model->instances) {
+        const box3f &box = model->meshes[instance.meshID]->bounds;
+        if (box.empty()) continue;
+        for (int corner=0;corner<8;corner++)
+          model->bounds.extend(xfmPoint(instance.xfm,
+                                        vec3f((corner&1) ? box.upper.x : box.lower.x,
+                                              (corner&2) ? box.upper.y : box.lower.y,
+                                              (corner&4) ? box.upper.z : box.lower.z)));
+      }
+  }
+  
+  void dropTrivialInstances(Model *model)
+  {
+    std::vector<int> numUses(model->meshes.size(),0);
+    for (auto &instance : model->instances) {
+      if (instance.xfm != affine3f(one))
+        return;
+      numUses[instance.meshID]++;
+    }
+    for (auto uses : numUses)
+      if (uses != 1)
+        return;
+    model->instances.clear();
+  }
+  
+  /*! hash of a position's bits (so -0 and +0 hash differently,
+      just as weldPositions() tells them apart) */
+  struct PositionHash {
+    size_t operator()(const vec3f &p) const
+    {
+      uint32_t bits[3];
+      memcpy(bits,&p,sizeof(bits));
+      uint64_t h = bits[0];
+      h = h*0x9e3779b97f4a7c15ULL ^ bits[1];
+      h = h*0x9e3779b97f4a7c15ULL ^ bits[2];
+      h = (h ^ (h >> 29))*0x9e3779b97f4a7c15ULL;
+      return size_t(h ^ (h >> 32));
+    }
+  };
+  struct PositionEqual {
+    bool operator()(const vec3f &a, const vec3f &b) const
+    { return !memcmp(&a,&b,sizeof(a)); }
+  };
+
+  std::vector<int> weldPositions(const MeshArray<vec3f> &vertex)
+  {
+    const int numVertices = (int)vertex.size();
+    std::vector<int> rep(numVertices);
+
+    // vertices with the same position have the same hash, so we can
+    // bucket them by hash, and then weld each bucket on its own (and
+    // all of them in parallel)
+    const int numBuckets = numVertices < (1<<16) ? 1 : 256;
+    std::vector<uint32_t> bucketOf(numVertices);
+    gdt::parallel_for_blocked(numVertices,64*1024,[&](size_t begin, size_t end){
+        for (size_t v=begin;v<end;v++)
+          // (top bits for the bucket, the low ones for the slot)
+          bucketOf[v] = uint32_t(uint64_t(PositionHash()(vertex[v])) >> 56) % numBuckets;
+      });
+    std::vector<int> bucketBegin(numBuckets+1,0);
+    for (int v=0;v<numVertices;v++)
+      bucketBegin[bucketOf[v]+1]++;
+    for (int b=0;b<numBuckets;b++)
+      bucketBegin[b+1] += bucketBegin[b];
+    std::vector<int> inBucket(numVertices);
+    {
+      std::vector<int> fill(bucketBegin.begin(),bucketBegin.end()-1);
+      for (int v=0;v<numVertices;v++)
+        inBucket[fill[bucketOf[v]]++] = v;
+    }
+
+    gdt::parallel_for(numBuckets,[&](size_t b){
+        // open-addressing table of the first vertex of each position
+        // seen so far (-1 for empty slots)
+        size_t numSlots = 16;
+        while (numSlots < 2*size_t(bucketBegin[b+1]-bucketBegin[b]))
+          numSlots *= 2;
+        std::vector<int> first(numSlots,-1);
+        for (int i=bucketBegin[b];i<bucketBegin[b+1];i++) {
+          const int v = inBucket[i];
+          size_t slot = PositionHash()(vertex[v]) & (numSlots-1);
+          while (first[slot] >= 0 && !PositionEqual()(vertex[first[slot]],vertex[v]))
+            slot = (slot+1) & (numSlots-1);
+          if (first[slot] < 0) first[slot] = v;
+          rep[v] = first[slot];
+        }
+      });
+    return rep;
+  }
+
+  void applyTextureOptions(Model *model, const TextureOptions &textureOptions)
+  {
+    if (textureOptions.memoryBudget == 0 || model->textures.empty())
+      return;
     
-    knownTextures[inFileName] = textureID;
-    return textureID;
+    const size_t numBytes
+      = applyTextureMemoryBudget(model,textureOptions.memoryBudget);
+    std::cout << "textures take " << prettyNumber(numBytes) << "B"
+              << " (budget " << prettyNumber(textureOptions.memoryBudget) << "B)"
+              << std::endl;
+    if (numBytes > textureOptions.memoryBudget)
+      std::cout << GDT_TERMINAL_YELLOW
+                << "#osc: textures do not fit into the texture memory budget"
+                << " - no more mip levels left to drop!"
+                << GDT_TERMINAL_DEFAULT << std::endl;
   }
   
-  Model *loadOBJ(const std::string &objFile)
+  Model *loadOBJ(const std::string &objFile,
+                 const TextureOptions &textureOptions)
   {
+    const double cacheStartTime = getCurrentTime();
+    Model *cached = loadModelCache(objFile);
+    if (cached && textureOptions.generateMips)
+      // cache was written without mip levels - can't add them to
+      // textures that live in the (read-only) cache file, so ignore it
+      for (auto texture : cached->textures)
+        if (texture->numLevels == 1 && texture->resolution != vec2i(1)) {
+          delete cached;
+          cached = nullptr;
+          break;
+        }
+    if (cached) {
+      std::cout << "loaded " << cached->meshes.size() << " meshes and "
+                << cached->textures.size() << " textures from model cache "
+                << modelCacheFileName(objFile)
+                << " (in " << (getCurrentTime()-cacheStartTime) << "s)" << std::endl;
+      applyTextureOptions(cached,textureOptions);
+      return cached;
+    }
+    
     Model *model = new Model;
 
     const std::string modelDir
@@ -149,8 +545,20 @@ namespace osc {
     std::vector<tinyobj::material_t> materials;
     std::string err = "";
 
+    std::ifstream objStream(objFile.c_str(),std::ios::binary|std::ios::ate);
+    const size_t objFileSize = objStream ? (size_t)objStream.tellg() : 0;
+    objStream.close();
+
+    const double parseStartTime = getCurrentTime();
     bool readOK
-      = tinyobj::LoadObj(&attributes,
+      = (objFileSize >= PARALLEL_OBJ_PARSE_THRESHOLD)
+      ? parseOBJParallel(attributes,
+                         shapes,
+                         materials,
+                         err,
+                         objFile,
+                         modelDir)
+      : tinyobj::LoadObj(&attributes,
                          &shapes,
                          &materials,
                          &err,
@@ -165,50 +573,152 @@ namespace osc {
     if (materials.empty())
       throw std::runtime_error("could not parse materials ...");
 
-    std::cout << "Done loading obj file - found " << shapes.size() << " shapes with " << materials.size() << " materials" << std::endl;
-    std::map<std::string, int>      knownTextures;
+    const double parseTime = getCurrentTime()-parseStartTime;
+    std::cout << "Done loading obj file - found " << shapes.size() << " shapes with " << materials.size() << " materials"
+              << " (" << prettyNumber(objFileSize) << "B in " << parseTime << "s, "
+              << prettyNumber(size_t(objFileSize/std::max(parseTime,1e-6))) << "B/s)" << std::endl;
+    const double startTime = getCurrentTime();
+
+    // find out which textures we're going to need - in the same order
+    // the mesh building loop below will reference them - and get them
+    // decoding in the background right away
+    TextureDecoder textureDecoder;
+    textureDecoder.modelDir = modelDir;
+    textureDecoder.options  = textureOptions;
+    std::vector<int> textureOfBucket(materials.size()+1,-1);
+    {
+      std::vector<int> bucketUsedInShape(materials.size()+1,-1);
+      std::vector<int> usedBuckets;
+      for (int shapeID=0;shapeID<(int)shapes.size();shapeID++) {
+        usedBuckets.clear();
+        for (int materialID : shapes[shapeID].mesh.material_ids)
+          if (bucketUsedInShape[materialID+1] != shapeID) {
+            bucketUsedInShape[materialID+1] = shapeID;
+            usedBuckets.push_back(materialID+1);
+          }
+        std::sort(usedBuckets.begin(),usedBuckets.end());
+        for (int bucket : usedBuckets)
+          if (bucket > 0)
+            textureOfBucket[bucket]
+              = textureDecoder.request(materials[bucket-1].diffuse_texname);
+      }
+    }
+    textureDecoder.start();
+    
+    size_t numTriangles = 0;
+    KnownVertices knownVertices;
+    // per-material face buckets; allocated once, re-used for all shapes
+    std::vector<int> facesInBucket(materials.size()+1,0);
+    std::vector<int> bucketEnd(materials.size()+1);
+    std::vector<int> usedBuckets;
+    std::vector<int> sortedFaces;
+    // meshes get built one at a time in 'scratch' (whose arrays keep
+    // their capacity from one mesh to the next), and then get appended
+    // to the model's arenas
+    TriangleMesh scratch;
+    ArenaBuilder arenas(model);
     for (int shapeID=0;shapeID<(int)shapes.size();shapeID++) {
       tinyobj::shape_t &shape = shapes[shapeID];
+      const int numFaces = (int)shape.mesh.material_ids.size();
 
-      std::set<int> materialIDs;
-      for (auto faceMatID : shape.mesh.material_ids)
-        materialIDs.insert(faceMatID);
+      // bucket all faces of this shape by material in a single linear
+      // sweep (counting sort), rather than re-scanning all faces once
+      // per material. bucket 0 is for faces without a material (ID -1)
+      usedBuckets.clear();
+      for (int faceID=0;faceID<numFaces;faceID++) {
+        const int bucket = shape.mesh.material_ids[faceID]+1;
+        if (facesInBucket[bucket]++ == 0)
+          usedBuckets.push_back(bucket);
+      }
+      std::sort(usedBuckets.begin(),usedBuckets.end());
+      int numSorted = 0;
+      for (int bucket : usedBuckets) {
+        bucketEnd[bucket] = numSorted;
+        numSorted += facesInBucket[bucket];
+      }
+      sortedFaces.resize(numFaces);
+      for (int faceID=0;faceID<numFaces;faceID++)
+        sortedFaces[bucketEnd[shape.mesh.material_ids[faceID]+1]++] = faceID;
       
-      for (int materialID : materialIDs) {
-        std::map<tinyobj::index_t,int> knownVertices;
-        TriangleMesh *mesh = new TriangleMesh;
+      for (int bucket : usedBuckets) {
+        const int materialID = bucket-1;
+        const int end        = bucketEnd[bucket];
+        const int begin      = end - facesInBucket[bucket];
+        facesInBucket[bucket] = 0;
         
-        for (int faceID=0;faceID<shape.mesh.material_ids.size();faceID++) {
-          if (shape.mesh.material_ids[faceID] != materialID) continue;
+        knownVertices.clear();
+        scratch.vertex.clear();
+        scratch.normal.clear();
+        scratch.texcoord.clear();
+        scratch.index.clear();
+        scratch.index.reserve(end-begin);
+        
+        for (int i=begin;i<end;i++) {
+          const int faceID = sortedFaces[i];
           tinyobj::index_t idx0 = shape.mesh.indices[3*faceID+0];
           tinyobj::index_t idx1 = shape.mesh.indices[3*faceID+1];
           tinyobj::index_t idx2 = shape.mesh.indices[3*faceID+2];
           
-          vec3i idx(addVertex(mesh, attributes, idx0, knownVertices),
-                    addVertex(mesh, attributes, idx1, knownVertices),
-                    addVertex(mesh, attributes, idx2, knownVertices));
-          mesh->index.push_back(idx);
-          mesh->diffuse = (const vec3f&)materials[materialID].diffuse;
-          mesh->diffuseTextureID = loadTexture(model,
-                                               knownTextures,
-                                               materials[materialID].diffuse_texname,
-                                               modelDir);
+          vec3i idx(addVertex(&scratch, attributes, idx0, knownVertices),
+                    addVertex(&scratch, attributes, idx1, knownVertices),
+                    addVertex(&scratch, attributes, idx2, knownVertices));
+          scratch.index.push_back(idx);
         }
 
-        if (mesh->vertex.empty())
-          delete mesh;
-        else
-          model->meshes.push_back(mesh);
+        numTriangles += scratch.index.size();
+        if (scratch.vertex.empty())
+          continue;
+        
+        TriangleMesh *mesh = new TriangleMesh;
+        // faces without a material (bucket 0) get a light grey, and
+        // no texture
+        mesh->diffuse
+          = materialID < 0
+          ? vec3f(.8f)
+          : (const vec3f&)materials[materialID].diffuse;
+        mesh->diffuseTextureID = textureOfBucket[bucket];
+        arenas.add(mesh,scratch);
+        model->meshes.push_back(mesh);
       }
     }
+    arenas.finish();
 
-    // of course, you should be using tbb::parallel_for for stuff
-    // like this:
+    // wait for all textures, and fix up the meshes' texture IDs for
+    // any textures that failed to load
+    const std::vector<int> finalTextureID = textureDecoder.finish(model);
     for (auto mesh : model->meshes)
-      for (auto vtx : mesh->vertex)
-        model->bounds.extend(vtx);
+      if (mesh->diffuseTextureID >= 0)
+        mesh->diffuseTextureID = finalTextureID[mesh->diffuseTextureID];
+    
+    computeBounds(model);
     
-    std::cout << "created a total of " << model->meshes.size() << " meshes" << std::endl;
+    const double buildTime = getCurrentTime()-startTime;
+    std::cout << "created a total of " << model->meshes.size() << " meshes"
+              << " with " << numTriangles << " triangles"
+              << " (" << prettyDouble(numTriangles/std::max(buildTime,1e-6))
+              << " triangles/s)" << std::endl;
+
+    // the cache goes stale when any of these change, too; it always
+    // keeps all mip levels, the budget gets applied on every load
+    std::vector<std::string> dependencies
+      = objMaterialLibraries(objFile,modelDir);
+    dependencies.insert(dependencies.end(),
+                        textureDecoder.fileNames.begin(),
+                        textureDecoder.fileNames.end());
+    saveModelCache(model,objFile,dependencies);
+    applyTextureOptions(model,textureOptions);
     return model;
   }
+
+  Model *loadModel(const std::string &fileName,
+                   const TextureOptions &textureOptions)
+  {
+    auto hasExtension = [&](const std::string &ext) {
+      return fileName.size() > ext.size()
+        && fileName.compare(fileName.size()-ext.size(),ext.size(),ext) == 0;
+    };
+    return hasExtension(".ply") ? loadPLY(fileName)
+      :    hasExtension(".glb") ? loadGLTF(fileName,textureOptions)
+      :    loadOBJ(fileName,textureOptions);
+  }
 }
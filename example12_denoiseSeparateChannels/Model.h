@@ -17,19 +17,100 @@
 #pragma once
 
 #include "gdt/math/AffineSpace.h"
+#include "gdt/math/quantize.h"
+#include "gdt/bvh/BVH8.h"
+#include "MeshArray.h"
 #include <vector>
 
 /*! \namespace osc - Optix Siggraph Course */
 namespace osc {
   using namespace gdt;
   
+  /*! a cluster of spatially close triangles of a mesh (see
+      buildMeshlets()), small enough to be culled, streamed, or
+      shaded as a unit */
+  struct Meshlet {
+    enum { maxVertices = 64, maxTriangles = 128 };
+
+    /*! whether, seen from 'eye', all of the meshlet's triangles face
+        away (ie, have the eye on the side their cross(v1-v0,v2-v0)
+        normal points away from); conservative, so 'false' does not
+        mean any triangle is actually front-facing */
+    bool backfacing(const vec3f &eye) const
+    {
+      const vec3f toCenter = bounds.center()-eye;
+      const float dist     = length(toCenter);
+      const float radius   = .5f*length(bounds.span());
+      if (dist <= radius) return false;
+      const float alpha = acosf(clamp(dot(toCenter,coneAxis)/dist,-1.f,1.f));
+      return alpha + asinf(radius/dist) + coneAngle < float(M_PI/2);
+    }
+
+    /*! the meshlet's vertices are the mesh vertices listed in
+        meshletVertex[vertexBegin..vertexBegin+numVertices); its
+        triangles are the 3*numTriangles indices (into that list)
+        starting at meshletIndex[3*triangleBegin] */
+    uint32_t vertexBegin, triangleBegin;
+    uint8_t  numVertices, numTriangles;
+    box3f    bounds;
+    /*! the normals of all (non-degenerate) triangles are within
+        coneAngle (radians) of coneAxis */
+    vec3f    coneAxis;
+    float    coneAngle;
+  };
+
   /*! a simple indexed triangle mesh that our sample renderer will
       render */
   struct TriangleMesh {
-    std::vector<vec3f> vertex;
-    std::vector<vec3f> normal;
-    std::vector<vec2f> texcoord;
-    std::vector<vec3i> index;
+    MeshArray<vec3f> vertex;
+    MeshArray<vec3f> normal;
+    MeshArray<vec2f> texcoord;
+    MeshArray<vec3i> index;
+
+    /*! per-vertex tangents (see generateNormals()): xyz is the
+        direction of increasing u, w the handedness (+-1) of the
+        (tangent, cross(normal,tangent)) frame relative to v */
+    std::vector<vec4f> tangent;
+
+    /*! @{ compact (quantized) vertex attributes, created by
+        compactVertexAttributes(); each one that is present replaces
+        (and leaves empty) its full-precision counterpart above */
+    std::vector<vec3us>      compactVertex;
+    PositionQuantizer        vertexQuantizer;
+    std::vector<octNormal16> compactNormal;
+    std::vector<texcoord16>  compactTexcoord;
+    /*! whether compactTexcoord holds halfs (or else, unorm16's) */
+    bool                     halfTexcoords { false };
+    /*! @} */
+
+    /*! @{ coarser versions of 'index' (see generateLODs()), coarsest
+        last; they all use the same vertices as 'index' does */
+    std::vector<std::vector<vec3i>> lodIndex;
+    /*! for each of those: how far (in the mesh's space) its surface
+        is estimated to be from that of the full-resolution mesh */
+    std::vector<float>              lodError;
+    /*! @} */
+
+    /*! the coarsest level of detail whose error is no more than
+        'maxError' (say, the size of a pixel at the mesh's distance):
+        0 for 'index' itself, i for lodIndex[i-1] */
+    int pickLOD(float maxError) const
+    {
+      int level = 0;
+      while (level < (int)lodError.size() && lodError[level] <= maxError)
+        level++;
+      return level;
+    }
+
+    /*! @{ this mesh's triangles, partitioned into meshlets (see
+        buildMeshlets()); 'index' itself stays as it is */
+    std::vector<Meshlet>  meshlets;
+    std::vector<int>      meshletVertex;
+    std::vector<uint8_t>  meshletIndex;
+    /*! @} */
+
+    //! bounding box of this mesh's vertices
+    box3f              bounds;
 
     // material data:
     vec3f              diffuse;
@@ -39,14 +120,77 @@ namespace osc {
   struct QuadLight {
     vec3f origin, du, dv, power;
   };
+
+  struct Camera {
+    /*! camera position - *from* where we are looking */
+    vec3f from;
+    /*! which point we are looking *at* */
+    vec3f at;
+    /*! general up-vector */
+    vec3f up;
+  };
   
   struct Texture {
+    /*! pixels are malloc'ed (that's what stbi hands out) */
     ~Texture()
-    { if (pixel) delete[] pixel; }
+    { if (pixel && ownsPixels) free(pixel); }
+
+    /*! resolution of given mip level */
+    vec2i levelResolution(int level) const
+    { return vec2i(std::max(resolution.x>>level,1),std::max(resolution.y>>level,1)); }
+
+    /*! offset (in pixels) of given mip level */
+    size_t levelOffset(int level) const
+    {
+      size_t offset = 0;
+      for (int l=0;l<level;l++)
+        offset += size_t(levelResolution(l).x)*size_t(levelResolution(l).y);
+      return offset;
+    }
+
+    /*! pixels of given mip level */
+    uint32_t *levelPixels(int level) const
+    { return pixel+levelOffset(level); }
+
+    /*! number of bytes used by all mip levels */
+    size_t sizeInBytes() const
+    { return levelOffset(numLevels)*sizeof(uint32_t); }
     
+    /*! all mip levels, finest first, back to back; 'resolution' is
+        that of the finest level, each following level is half the
+        size (rounded down, but at least 1) of the one before */
     uint32_t *pixel      { nullptr };
     vec2i     resolution { -1 };
+    int       numLevels  { 1 };
+    /*! false if 'pixel' points into memory that somebody else owns
+        (eg, a memory-mapped model cache file) */
+    bool      ownsPixels { true };
+    /*! the image file the pixels came from; empty for images that
+        are part of the model file itself (as in a .glb) */
+    std::string fileName;
+  };
+
+  /*! filter used to compute each mip level from the one before */
+  enum MipFilter { MIP_FILTER_BOX, MIP_FILTER_KAISER };
+  
+  /*! how loadOBJ and loadGLTF prepare the model's textures */
+  struct TextureOptions {
+    /*! whether to build a full mip chain for each texture */
+    bool      generateMips { true };
+    MipFilter mipFilter    { MIP_FILTER_BOX };
+    /*! if non-zero, the finest mip levels of the largest textures
+        get dropped until all textures fit into that many bytes */
+    size_t    memoryBudget { 0 };
   };
+
+  /*! one placement of one of the model's meshes */
+  struct MeshInstance {
+    int      meshID;
+    /*! from the mesh's space to world space */
+    affine3f xfm;
+  };
+
+  struct MappedFile;
   
   struct Model {
     ~Model()
@@ -57,9 +201,236 @@ namespace osc {
     
     std::vector<TriangleMesh *> meshes;
     std::vector<Texture *>      textures;
+    /*! if non-empty, what gets rendered are these instances of the
+        meshes (each of which may then be used any number of times);
+        if empty, every mesh gets rendered once, as is */
+    std::vector<MeshInstance>   instances;
     //! bounding box of all vertices in the model
     box3f bounds;
+
+    /*! @{ the arenas that packed meshes' arrays are views into (see
+        packMeshes()) - themselves views into the mapped file for a
+        model loaded from its cache; each mesh's indices stay relative
+        to its own vertices */
+    MeshArray<vec3f> vertexArena;
+    MeshArray<vec3f> normalArena;
+    MeshArray<vec2f> texcoordArena;
+    MeshArray<vec3i> indexArena;
+    /*! @} */
+
+    /*! the mapped files (if any) that some of the model's arrays are
+        views into: model caches, which textures' pixels point into,
+        or glTF binaries, which meshes' arrays point into */
+    std::vector<std::shared_ptr<MappedFile>> mappedFiles;
+  };
+
+  /*! collects the arrays of many meshes, one mesh after another,
+      into a fresh set of arenas; finish() then hands those to the
+      model, and makes all added meshes' arrays views into them. All
+      meshes that were views into the model's old arenas have to be
+      added, as the old arenas are gone after finish() */
+  struct ArenaBuilder {
+    ArenaBuilder(Model *model) : model(model) {}
+
+    /*! reserve room for (at least) that many more elements */
+    void reserve(size_t numVertices, size_t numNormals,
+                 size_t numTexcoords, size_t numIndices);
+
+    /*! append the arrays of 'from' (which may be 'mesh' itself), to
+        become the arrays of 'mesh' once finish() is called */
+    void add(TriangleMesh *mesh, const TriangleMesh &from);
+
+    void finish();
+
+  private:
+    struct Added {
+      TriangleMesh *mesh;
+      size_t vertexBegin, normalBegin, texcoordBegin, indexBegin;
+    };
+    Model             *model;
+    std::vector<Added> added;
+    std::vector<vec3f> vertex, normal;
+    std::vector<vec2f> texcoord;
+    std::vector<vec3i> index;
+  };
+
+  /*! move the arrays of all meshes into a single set of arenas -
+      one allocation for all vertices, one for all normals, etc */
+  void packMeshes(Model *model);
+
+  /*! whether all of the model's meshes' arrays live in its arenas */
+  bool isPacked(const Model *model);
+  
+  /*! compute the bounds of every mesh of the given model, and the
+      model's bounds from those (and its instances, if it has any) */
+  void computeBounds(Model *model);
+
+  /*! clear the model's instances if all they do is render every
+      mesh once, untransformed - just as having no instances does */
+  void dropTrivialInstances(Model *model);
+
+  /*! for each vertex, the first (lowest-numbered) vertex with the
+      very same position - the vertices a loader had to duplicate for
+      differing normals or texture coordinates all map to one */
+  std::vector<int> weldPositions(const MeshArray<vec3f> &vertex);
+  
+  Model *loadOBJ(const std::string &objFile,
+                 const TextureOptions &textureOptions = TextureOptions());
+
+  /*! find meshes that are copies of an earlier mesh - moved, or
+      (if allowAffine is set) transformed by any affine transform -
+      and replace them with instances of that mesh. Material,
+      topology, and texture coordinates have to match exactly;
+      positions and normals up to a small tolerance */
+  void detectInstances(Model *model, bool allowAffine);
+
+  /*! concatenate all meshes that share the same material (and the
+      same set of vertex attributes) into one mesh each, to save on
+      per-mesh build inputs, buffers, and SBT records */
+  void mergeMeshes(Model *model);
+
+  /*! number of device buffers SampleRenderer::buildAccel creates for
+      the given meshes */
+  size_t numDeviceBuffers(const std::vector<TriangleMesh *> &meshes);
+
+  /*! reorder each mesh's triangles for post-transform vertex cache
+      locality (Forsyth), then renumber its vertices in the order the
+      triangles first use them */
+  void optimizeMeshes(Model *model);
+
+  /*! give all meshes that have no normals smooth ones - each
+      vertex gets the angle-weighted average of its triangles'
+      normals, over all vertices with the same position. Where the
+      triangles on either side of an edge differ by more than
+      'creaseAngle' (in degrees; 180 and up for none) the edge stays
+      sharp, splitting its vertices. With 'withTangents', all meshes
+      with texture coordinates also get (MikkTSpace-style)
+      tangents. Has to come after merging and optimizing, which do
+      not know about tangents */
+  void generateNormals(Model *model, float creaseAngle, bool withTangents);
+
+  /*! give each mesh 'numLevels' levels of detail (see
+      TriangleMesh::lodIndex), each with about 'ratio' times as many
+      triangles as the one before, by quadric-error-driven edge
+      collapses. Has to come after merging and optimizing, which do
+      not know about LODs */
+  void generateLODs(Model *model, int numLevels, float ratio = .5f);
+
+  /*! partition each mesh's triangles into meshlets of at most
+      Meshlet::maxTriangles triangles and Meshlet::maxVertices
+      vertices, with bounds and normal cone each. Has to come after
+      merging and optimizing, which do not know about meshlets */
+  void buildMeshlets(Model *model);
+
+  /*! quality metric for a mesh's meshlets: fraction of its triangles
+      whose centroid lies inside the bounds of a meshlet other than
+      their own (0 if the meshlets' bounds do not overlap at all) */
+  float computeMeshletOverlap(const TriangleMesh *mesh);
+
+  /*! average number of vertex cache misses per triangle, for a FIFO
+      cache of given size */
+  float computeACMR(const TriangleMesh *mesh, int cacheSize = 32);
+
+  /*! replace each mesh's normals with octahedral 2x16-bit ones, its
+      texture coordinates with 2x16-bit ones (unorms if they all are
+      in [0,1], halfs otherwise), and - if requested - its positions
+      with 16-bit ones relative to the mesh's bounds. This has to be
+      the last thing done to a model: none of the other passes know
+      about compact attributes */
+  void compactVertexAttributes(Model *model, bool quantizePositions);
+
+  /*! number of bytes all vertex attributes of given mesh take */
+  size_t vertexBytes(const TriangleMesh *mesh);
+
+  /*! position of one of the mesh's vertices, in the mesh's space -
+      whether its positions are compact or not */
+  inline vec3f meshVertex(const TriangleMesh &mesh, int vertexID)
+  {
+    return mesh.compactVertex.empty()
+      ? mesh.vertex[vertexID]
+      : mesh.vertexQuantizer.decode(mesh.compactVertex[vertexID]);
+  }
+
+  /*! a host-side BVH over all of the model's triangles in world
+      space: those of each of its instances (or, for models without
+      instances, of each of its meshes) in turn */
+  struct ModelBVH {
+    /*! the instance (or mesh) that primitive 'primID' belongs to,
+        and which of its mesh's triangles it is */
+    inline void locate(uint32_t primID, int &instanceID, int &triangleID) const
+    {
+      instanceID = int(std::upper_bound(primBegin.begin(),primBegin.end(),primID)
+                       - primBegin.begin()) - 1;
+      triangleID = int(primID - primBegin[instanceID]);
+    }
+
+    gdt::BVH              bvh;
+    /*! the same, collapsed to eight children per node, and with the
+        triangles in its leaves - for tracing rays */
+    gdt::BVH8             bvh8;
+    /*! for each instance (or mesh), the primID of its first
+        triangle; plus, at the end, the total number of triangles */
+    std::vector<uint32_t> primBegin;
   };
 
-  Model *loadOBJ(const std::string &objFile);
+  /*! build a binned SAH BVH over the model's triangles, from the
+      meshes' (possibly compact) positions and index arrays as they
+      are, and collapse it to an 8-wide one */
+  void buildModelBVH(ModelBVH &bvh, const Model *model);
+
+  /*! a host-side two-level BVH over the model: one bottom-level BVH
+      per mesh, in the mesh's own space, and a top-level one over the
+      model's instances (or, for models without instances, over every
+      mesh once, as is). Instance IDs are those of the model's
+      instances (or meshes), and all instances have all mask bits */
+  struct ModelTwoLevelBVH {
+    std::vector<gdt::BVH8> meshBVH;
+    /*! SAH cost (see gdt::computeSAHCost()) of each mesh's BVH right
+        after it was last built, and now - after any refits since */
+    std::vector<float>     meshBuildCost;
+    std::vector<float>     meshCost;
+    gdt::TwoLevelBVH8      bvh;
+  };
+
+  /*! build an 8-wide BVH over the mesh's triangles, from its
+      (possibly compact) positions, in the mesh's own space; returns
+      its SAH cost */
+  float buildMeshBVH(gdt::BVH8 &bvh, const TriangleMesh &mesh);
+
+  void buildModelTwoLevelBVH(ModelTwoLevelBVH &bvh, const Model *model);
+
+  /*! bring the BVH of mesh 'meshID' up to date with the mesh's
+      vertices having moved (but its triangles being the same): refit
+      it - or, if that leaves it with more than 'maxCostRatio' times
+      the SAH cost it had when it was last built, rebuild it. Returns
+      whether it got rebuilt. Either way, the bounds of the mesh's
+      instances change, so the top-level BVH needs to be rebuilt
+      after (see gdt::buildTLAS()) */
+  bool updateMeshBVH(ModelTwoLevelBVH &bvh, const Model *model, int meshID,
+                     float maxCostRatio = 1.5f);
+
+  /*! updateMeshBVH() for all the given (different) meshes, side by
+      side on all threads; returns how many of them got rebuilt */
+  int updateMeshBVHs(ModelTwoLevelBVH &bvh, const Model *model,
+                     const std::vector<int> &meshIDs,
+                     float maxCostRatio = 1.5f);
+
+  /*! load a (binary or ascii) PLY file as a single, untextured mesh;
+      polygons get triangulated as fans */
+  Model *loadPLY(const std::string &plyFile);
+
+  /*! load a glTF 2.0 binary (.glb) file: one mesh per triangle
+      primitive, with base color factor and texture as diffuse
+      material, and the default scene's node transforms as instances
+      (unless every mesh gets used once, untransformed). Arrays whose
+      layout matches ours - float positions and normals, 32-bit
+      indices - stay where they are in the (copy-on-write mapped)
+      file; all others get converted */
+  Model *loadGLTF(const std::string &glbFile,
+                  const TextureOptions &textureOptions = TextureOptions());
+
+  /*! load a model file of any of the formats above, going by its
+      extension (.ply, .glb, and anything else as OBJ) */
+  Model *loadModel(const std::string &fileName,
+                   const TextureOptions &textureOptions = TextureOptions());
 }
@@ -0,0 +1,422 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "ModelCache.h"
+#include "MappedFile.h"
+//std
+#include <fstream>
+#include <string.h>
+#include <sys/stat.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! bump this whenever anything in the layout below (or in what the
+      loader puts into a Model) changes */
+  enum { MODEL_CACHE_VERSION = 5 };
+
+  /*! all arrays in the cache file start at multiples of this */
+  enum { MODEL_CACHE_ALIGNMENT = 64 };
+
+  /*! cache file layout: one CacheHeader, followed by numMeshes
+      CacheMesh'es, numTextures CacheTexture's and numDependencies
+      CacheDependency's, followed by all the actual array data; all
+      offsets are in bytes from the start of the file. The meshes'
+      vertex arrays directly follow each other, and so do their
+      normal, texcoord and index arrays - so that each of those is one
+      of the model's arenas once mapped back in. Everything is stored
+      in host byte order. */
+  struct CacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    /*! @{ size and modification time of the source file this cache
+        was created from */
+    uint64_t sourceSize;
+    int64_t  sourceMTime;
+    /*! @} */
+    uint64_t numMeshes;
+    uint64_t numTextures;
+    uint64_t numDependencies;
+    box3f    bounds;
+  };
+
+  struct CacheMesh {
+    uint64_t numVertices, numNormals, numTexcoords, numIndices;
+    uint64_t vertexOffset, normalOffset, texcoordOffset, indexOffset;
+    box3f    bounds;
+    vec3f    diffuse;
+    int32_t  diffuseTextureID;
+  };
+
+  struct CacheTexture {
+    vec2i    resolution;
+    int32_t  numLevels;
+    uint64_t pixelOffset;
+    /*! the image file the texture came from (if any); whether that
+        changed gets checked through the dependencies */
+    uint64_t fileNameOffset, fileNameLength;
+  };
+
+  /*! another file the model got loaded from (eg, an OBJ's material
+      library, or a texture's image file), with its size and
+      modification time back then */
+  struct CacheDependency {
+    uint64_t fileNameOffset, fileNameLength;
+    uint64_t size;
+    int64_t  mtime;
+  };
+
+  static const char modelCacheMagic[8] = { 'O','S','C','M','O','D','E','L' };
+
+  std::string modelCacheFileName(const std::string &sourceFile)
+  {
+    return sourceFile+".osccache";
+  }
+
+  static bool getFileStamp(const std::string &fileName,
+                           uint64_t &size, int64_t &mtime)
+  {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(fileName.c_str(),&st) != 0) return false;
+#else
+    struct stat st;
+    if (stat(fileName.c_str(),&st) != 0) return false;
+#endif
+    size  = (uint64_t)st.st_size;
+    mtime = (int64_t)st.st_mtime;
+#ifdef __linux__
+    // in nanoseconds, so a file saved twice within the same second
+    // (say, while editing it with the viewer watching) still counts
+    // as changed
+    mtime = mtime*1000000000 + (int64_t)st.st_mtim.tv_nsec;
+#endif
+    return true;
+  }
+
+  /*! same as getFileStamp(), but a file that does not exist gets a
+      stamp, too - so a dependency that appears later also makes the
+      cache stale */
+  static void getDependencyStamp(const std::string &fileName,
+                                 uint64_t &size, int64_t &mtime)
+  {
+    if (!getFileStamp(fileName,size,mtime)) {
+      size  = ~0ull;
+      mtime = -1;
+    }
+  }
+
+  static inline uint64_t alignUp(uint64_t offset)
+  {
+    return divRoundUp(offset,(uint64_t)MODEL_CACHE_ALIGNMENT)*MODEL_CACHE_ALIGNMENT;
+  }
+
+  Model *loadModelCache(const std::string &sourceFile)
+  {
+    uint64_t sourceSize;
+    int64_t  sourceMTime;
+    if (!getFileStamp(sourceFile,sourceSize,sourceMTime))
+      return nullptr;
+
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    // (copy-on-write, as the meshes' arrays will be views into it)
+    if (!file->map(modelCacheFileName(sourceFile),/*copyOnWrite=*/true))
+      return nullptr;
+
+    // ------------------------------------------------------------------
+    // check that this cache is for this very source file, and that we
+    // can read it
+    // ------------------------------------------------------------------
+    if (file->size < sizeof(CacheHeader))
+      return nullptr;
+    const CacheHeader &header = *(const CacheHeader *)file->data;
+    if (memcmp(header.magic,modelCacheMagic,sizeof(modelCacheMagic)) != 0 ||
+        header.version     != MODEL_CACHE_VERSION ||
+        header.headerSize  != sizeof(CacheHeader) ||
+        header.sourceSize  != sourceSize ||
+        header.sourceMTime != sourceMTime)
+      return nullptr;
+
+    const uint64_t tablesEnd
+      = sizeof(CacheHeader)
+      + header.numMeshes*sizeof(CacheMesh)
+      + header.numTextures*sizeof(CacheTexture)
+      + header.numDependencies*sizeof(CacheDependency);
+    if (tablesEnd > file->size)
+      return nullptr;
+    const CacheMesh *cacheMeshes
+      = (const CacheMesh *)(file->data+sizeof(CacheHeader));
+    const CacheTexture *cacheTextures
+      = (const CacheTexture *)(cacheMeshes+header.numMeshes);
+    const CacheDependency *cacheDependencies
+      = (const CacheDependency *)(cacheTextures+header.numTextures);
+
+    // make sure nothing points outside the file
+    auto inFile = [&](uint64_t offset, uint64_t count, size_t elementSize) {
+      return offset <= file->size && count <= (file->size-offset)/elementSize;
+    };
+    for (uint64_t meshID=0;meshID<header.numMeshes;meshID++) {
+      const CacheMesh &cm = cacheMeshes[meshID];
+      if (!inFile(cm.vertexOffset,  cm.numVertices,  sizeof(vec3f)) ||
+          !inFile(cm.normalOffset,  cm.numNormals,   sizeof(vec3f)) ||
+          !inFile(cm.texcoordOffset,cm.numTexcoords, sizeof(vec2f)) ||
+          !inFile(cm.indexOffset,   cm.numIndices,   sizeof(vec3i)))
+        return nullptr;
+    }
+    // ... and that each kind of array of all meshes is one arena
+    auto isArena = [&](uint64_t CacheMesh::*arrayOffset,
+                       uint64_t CacheMesh::*arrayCount,
+                       size_t elementSize) {
+      for (uint64_t meshID=1;meshID<header.numMeshes;meshID++) {
+        const CacheMesh &prev = cacheMeshes[meshID-1];
+        if (cacheMeshes[meshID].*arrayOffset
+            != prev.*arrayOffset+prev.*arrayCount*elementSize)
+          return false;
+      }
+      return true;
+    };
+    if (!isArena(&CacheMesh::vertexOffset,  &CacheMesh::numVertices,  sizeof(vec3f)) ||
+        !isArena(&CacheMesh::normalOffset,  &CacheMesh::numNormals,   sizeof(vec3f)) ||
+        !isArena(&CacheMesh::texcoordOffset,&CacheMesh::numTexcoords, sizeof(vec2f)) ||
+        !isArena(&CacheMesh::indexOffset,   &CacheMesh::numIndices,   sizeof(vec3i)))
+      return nullptr;
+    for (uint64_t texID=0;texID<header.numTextures;texID++) {
+      const CacheTexture &ct = cacheTextures[texID];
+      if (ct.resolution.x < 0 || ct.resolution.y < 0 ||
+          ct.numLevels < 1 || ct.numLevels > 32)
+        return nullptr;
+      Texture levels;
+      levels.resolution = ct.resolution;
+      levels.numLevels  = ct.numLevels;
+      levels.ownsPixels = false;
+      if (!inFile(ct.pixelOffset,levels.sizeInBytes(),1) ||
+          !inFile(ct.fileNameOffset,ct.fileNameLength,1))
+        return nullptr;
+    }
+    // a material library or image file that changed since makes the
+    // cache just as stale as a changed model file does
+    for (uint64_t depID=0;depID<header.numDependencies;depID++) {
+      const CacheDependency &cd = cacheDependencies[depID];
+      if (!inFile(cd.fileNameOffset,cd.fileNameLength,1))
+        return nullptr;
+      uint64_t size;
+      int64_t  mtime;
+      getDependencyStamp(std::string(file->data+cd.fileNameOffset,cd.fileNameLength),
+                         size,mtime);
+      if (size != cd.size || mtime != cd.mtime)
+        return nullptr;
+    }
+
+    // ------------------------------------------------------------------
+    // valid cache - create the model
+    // ------------------------------------------------------------------
+    Model *model = new Model;
+    model->bounds = header.bounds;
+    // the model's arenas, and its meshes' arrays, are all views into
+    // the mapping - nothing gets copied (until written to)
+    if (header.numMeshes > 0) {
+      const CacheMesh &first = cacheMeshes[0];
+      const CacheMesh &last  = cacheMeshes[header.numMeshes-1];
+      auto arenaSize = [&](uint64_t CacheMesh::*arrayOffset,
+                           uint64_t CacheMesh::*arrayCount,
+                           size_t elementSize) {
+        return (last.*arrayOffset+last.*arrayCount*elementSize
+                - first.*arrayOffset)/elementSize;
+      };
+      model->vertexArena.setView((vec3f *)(file->data+first.vertexOffset),
+                                 arenaSize(&CacheMesh::vertexOffset,
+                                           &CacheMesh::numVertices,sizeof(vec3f)));
+      model->normalArena.setView((vec3f *)(file->data+first.normalOffset),
+                                 arenaSize(&CacheMesh::normalOffset,
+                                           &CacheMesh::numNormals,sizeof(vec3f)));
+      model->texcoordArena.setView((vec2f *)(file->data+first.texcoordOffset),
+                                   arenaSize(&CacheMesh::texcoordOffset,
+                                             &CacheMesh::numTexcoords,sizeof(vec2f)));
+      model->indexArena.setView((vec3i *)(file->data+first.indexOffset),
+                                arenaSize(&CacheMesh::indexOffset,
+                                          &CacheMesh::numIndices,sizeof(vec3i)));
+    }
+    for (uint64_t meshID=0;meshID<header.numMeshes;meshID++) {
+      const CacheMesh &cm = cacheMeshes[meshID];
+      TriangleMesh *mesh = new TriangleMesh;
+      mesh->vertex.setView((vec3f *)(file->data+cm.vertexOffset),cm.numVertices);
+      mesh->normal.setView((vec3f *)(file->data+cm.normalOffset),cm.numNormals);
+      mesh->texcoord.setView((vec2f *)(file->data+cm.texcoordOffset),cm.numTexcoords);
+      mesh->index.setView((vec3i *)(file->data+cm.indexOffset),cm.numIndices);
+      mesh->bounds           = cm.bounds;
+      mesh->diffuse          = cm.diffuse;
+      mesh->diffuseTextureID = cm.diffuseTextureID;
+      model->meshes.push_back(mesh);
+    }
+    for (uint64_t texID=0;texID<header.numTextures;texID++) {
+      const CacheTexture &ct = cacheTextures[texID];
+      Texture *texture = new Texture;
+      texture->resolution = ct.resolution;
+      texture->numLevels  = ct.numLevels;
+      texture->pixel      = (uint32_t *)(file->data+ct.pixelOffset);
+      texture->ownsPixels = false;
+      texture->fileName.assign(file->data+ct.fileNameOffset,ct.fileNameLength);
+      model->textures.push_back(texture);
+    }
+    model->mappedFiles.push_back(file);
+    return model;
+  }
+
+  void saveModelCache(const Model *model, const std::string &sourceFile,
+                      const std::vector<std::string> &dependencies)
+  {
+    CacheHeader header;
+    memset((void*)&header,0,sizeof(header));
+    memcpy(header.magic,modelCacheMagic,sizeof(modelCacheMagic));
+    header.version     = MODEL_CACHE_VERSION;
+    header.headerSize  = sizeof(CacheHeader);
+    header.numMeshes   = model->meshes.size();
+    header.numTextures = model->textures.size();
+    header.numDependencies = dependencies.size();
+    header.bounds      = model->bounds;
+    if (!getFileStamp(sourceFile,header.sourceSize,header.sourceMTime))
+      return;
+
+    // ------------------------------------------------------------------
+    // lay out all arrays
+    // ------------------------------------------------------------------
+    uint64_t offset
+      = sizeof(CacheHeader)
+      + header.numMeshes*sizeof(CacheMesh)
+      + header.numTextures*sizeof(CacheTexture)
+      + header.numDependencies*sizeof(CacheDependency);
+    auto allocate = [&](uint64_t numBytes) {
+      offset = alignUp(offset);
+      const uint64_t begin = offset;
+      offset += numBytes;
+      return begin;
+    };
+    std::vector<CacheMesh> cacheMeshes(header.numMeshes);
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+      const TriangleMesh *mesh = model->meshes[meshID];
+      CacheMesh &cm = cacheMeshes[meshID];
+      memset((void*)&cm,0,sizeof(cm));
+      cm.numVertices      = mesh->vertex.size();
+      cm.numNormals       = mesh->normal.size();
+      cm.numTexcoords     = mesh->texcoord.size();
+      cm.numIndices       = mesh->index.size();
+      cm.bounds           = mesh->bounds;
+      cm.diffuse          = mesh->diffuse;
+      cm.diffuseTextureID = mesh->diffuseTextureID;
+    }
+    // all meshes' arrays of one kind go into one arena
+    auto allocateArena = [&](uint64_t CacheMesh::*arrayOffset,
+                             uint64_t CacheMesh::*arrayCount,
+                             size_t elementSize) {
+      uint64_t at = allocate(0);
+      for (auto &cm : cacheMeshes) {
+        cm.*arrayOffset = at;
+        at += cm.*arrayCount*elementSize;
+      }
+      offset = at;
+    };
+    allocateArena(&CacheMesh::vertexOffset,  &CacheMesh::numVertices,  sizeof(vec3f));
+    allocateArena(&CacheMesh::normalOffset,  &CacheMesh::numNormals,   sizeof(vec3f));
+    allocateArena(&CacheMesh::texcoordOffset,&CacheMesh::numTexcoords, sizeof(vec2f));
+    allocateArena(&CacheMesh::indexOffset,   &CacheMesh::numIndices,   sizeof(vec3i));
+    std::vector<CacheTexture> cacheTextures(header.numTextures);
+    for (size_t texID=0;texID<model->textures.size();texID++) {
+      const Texture *texture = model->textures[texID];
+      CacheTexture &ct = cacheTextures[texID];
+      memset((void*)&ct,0,sizeof(ct));
+      ct.resolution  = texture->resolution;
+      ct.numLevels   = texture->numLevels;
+      ct.pixelOffset = allocate(texture->sizeInBytes());
+      ct.fileNameLength = texture->fileName.size();
+      ct.fileNameOffset = allocate(ct.fileNameLength);
+    }
+    std::vector<CacheDependency> cacheDependencies(header.numDependencies);
+    for (size_t depID=0;depID<dependencies.size();depID++) {
+      CacheDependency &cd = cacheDependencies[depID];
+      memset((void*)&cd,0,sizeof(cd));
+      getDependencyStamp(dependencies[depID],cd.size,cd.mtime);
+      cd.fileNameLength = dependencies[depID].size();
+      cd.fileNameOffset = allocate(cd.fileNameLength);
+    }
+
+    // ------------------------------------------------------------------
+    // and write it all out - to a temp file first, so a concurrent
+    // (or crashed) writer can't ever leave a half-written cache
+    // ------------------------------------------------------------------
+    const std::string cacheFile = modelCacheFileName(sourceFile);
+    const std::string tmpFile   = cacheFile+".tmp";
+    std::ofstream out(tmpFile.c_str(),std::ios::binary);
+    if (!out) {
+      std::cout << GDT_TERMINAL_YELLOW
+                << "#osc: could not write model cache " << cacheFile
+                << GDT_TERMINAL_DEFAULT << std::endl;
+      return;
+    }
+
+    uint64_t written = 0;
+    auto write = [&](uint64_t at, const void *data, uint64_t numBytes) {
+      static const char zeroes[MODEL_CACHE_ALIGNMENT] = { 0 };
+      while (written < at) {
+        const uint64_t pad = std::min(at-written,(uint64_t)MODEL_CACHE_ALIGNMENT);
+        out.write(zeroes,pad);
+        written += pad;
+      }
+      out.write((const char *)data,numBytes);
+      written += numBytes;
+    };
+    write(0,&header,sizeof(header));
+    write(written,cacheMeshes.data(),cacheMeshes.size()*sizeof(CacheMesh));
+    write(written,cacheTextures.data(),cacheTextures.size()*sizeof(CacheTexture));
+    write(written,cacheDependencies.data(),
+          cacheDependencies.size()*sizeof(CacheDependency));
+    // (in file order: one arena after another)
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++)
+      write(cacheMeshes[meshID].vertexOffset,model->meshes[meshID]->vertex.data(),
+            cacheMeshes[meshID].numVertices*sizeof(vec3f));
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++)
+      write(cacheMeshes[meshID].normalOffset,model->meshes[meshID]->normal.data(),
+            cacheMeshes[meshID].numNormals*sizeof(vec3f));
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++)
+      write(cacheMeshes[meshID].texcoordOffset,model->meshes[meshID]->texcoord.data(),
+            cacheMeshes[meshID].numTexcoords*sizeof(vec2f));
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++)
+      write(cacheMeshes[meshID].indexOffset,model->meshes[meshID]->index.data(),
+            cacheMeshes[meshID].numIndices*sizeof(vec3i));
+    for (size_t texID=0;texID<model->textures.size();texID++) {
+      const Texture *texture = model->textures[texID];
+      const CacheTexture &ct = cacheTextures[texID];
+      write(ct.pixelOffset,texture->pixel,texture->sizeInBytes());
+      write(ct.fileNameOffset,texture->fileName.data(),ct.fileNameLength);
+    }
+    for (size_t depID=0;depID<dependencies.size();depID++)
+      write(cacheDependencies[depID].fileNameOffset,
+            dependencies[depID].data(),dependencies[depID].size());
+    out.close();
+
+    if (!out) {
+      std::remove(tmpFile.c_str());
+      return;
+    }
+    std::remove(cacheFile.c_str());
+    if (std::rename(tmpFile.c_str(),cacheFile.c_str()) != 0)
+      std::remove(tmpFile.c_str());
+    else
+      std::cout << "#osc: wrote model cache " << cacheFile
+                << " (" << prettyNumber(written) << "B)" << std::endl;
+  }
+
+}
@@ -0,0 +1,44 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "Model.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! name of the binary cache file we keep next to the given source
+      model file */
+  std::string modelCacheFileName(const std::string &sourceFile);
+
+  /*! try to load the model from the binary cache of the given source
+      file. Returns nullptr if there is no cache, or if it is stale
+      (different size or modification time of the source file, or of
+      any of the files it depends on), or was written by a different
+      version of this code. Texture pixels
+      are used in place, straight from the mapped cache file. */
+  Model *loadModelCache(const std::string &sourceFile);
+
+  /*! write the given model (just loaded from 'sourceFile') to its
+      binary cache, along with the size and modification time of
+      each of the other files (material libraries, images) it got
+      loaded from; failing to do so is not an error, we just won't
+      have a cache the next time around */
+  void saveModelCache(const Model *model, const std::string &sourceFile,
+                      const std::vector<std::string> &dependencies
+                      = std::vector<std::string>());
+}
@@ -0,0 +1,438 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+// this is the one place that compiles tinyobj; we re-use its
+// (static) number and index parsing helpers below, so the parallel
+// parser produces exactly the same bits as tinyobj::LoadObj
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "OBJParser.h"
+#include "MappedFile.h"
+#include "gdt/parallel/parallel_for.h"
+//std
+#include <string.h>
+#include <sstream>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! a non-geometry record (usemtl, mtllib, g, o, s, l, p) that has
+      to be replayed in file order, after all chunks got parsed */
+  struct OBJCommand {
+    /*! number of faces in this chunk that came before this record */
+    size_t numFacesBefore;
+    const char *begin, *end;
+  };
+
+  /*! one line-aligned piece of the OBJ file, and what we parsed
+      from it */
+  struct OBJChunk {
+    const char *begin, *end;
+
+    /*! @{ number of lines and v/vn/vt records in this chunk, and
+        the number of those in all preceding chunks */
+    size_t numLines     { 0 }, lineBase     { 0 };
+    size_t numVertices  { 0 }, vertexBase   { 0 };
+    size_t numNormals   { 0 }, normalBase   { 0 };
+    size_t numTexcoords { 0 }, texcoordBase { 0 };
+    /*! @} */
+
+    /*! all face corners in this chunk, with already globally
+        resolved indices, and the number of corners per face */
+    std::vector<tinyobj::index_t> corners;
+    std::vector<uint32_t>         faceSizes;
+    std::vector<OBJCommand>       commands;
+    std::string                   error;
+  };
+
+  /*! copy given line into 'lineBuf', so tinyobj's helpers see the
+      same null-terminated, '\r'-trimmed line they'd see in LoadObj,
+      and return pointer to its first non-blank character */
+  static inline const char *getToken(std::string &lineBuf,
+                                     const char *begin, const char *end)
+  {
+    lineBuf.assign(begin,end);
+    if (!lineBuf.empty() && lineBuf[lineBuf.size()-1] == '\r')
+      lineBuf.erase(lineBuf.size()-1);
+    const char *token = lineBuf.c_str();
+    return token + strspn(token, " \t");
+  }
+
+  /*! calls 'lambda(lineBegin,lineEnd)' for each line of the chunk */
+  template<typename Lambda>
+  static inline void forEachLine(const OBJChunk &chunk, const Lambda &lambda)
+  {
+    const char *line = chunk.begin;
+    while (line < chunk.end) {
+      const char *eol = (const char *)memchr(line,'\n',chunk.end-line);
+      if (!eol) eol = chunk.end;
+      lambda(line,eol);
+      line = eol+1;
+    }
+  }
+
+  /*! first pass: only count lines and vertex/normal/texcoord
+      records, so we know where each chunk's data goes */
+  static void countRecords(OBJChunk &chunk)
+  {
+    forEachLine(chunk,[&](const char *line, const char *eol) {
+        chunk.numLines++;
+        while (line < eol && IS_SPACE(*line)) line++;
+        if (eol-line < 2 || line[0] != 'v') return;
+        if (IS_SPACE(line[1]))
+          chunk.numVertices++;
+        else if (eol-line >= 3 && line[1] == 'n' && IS_SPACE(line[2]))
+          chunk.numNormals++;
+        else if (eol-line >= 3 && line[1] == 't' && IS_SPACE(line[2]))
+          chunk.numTexcoords++;
+      });
+  }
+
+  /*! second pass: actually parse the chunk, writing v/vn/vt
+      straight into their final place in the attribute arrays */
+  static void parseRecords(OBJChunk &chunk,
+                           tinyobj::attrib_t &attributes)
+  {
+    tinyobj::real_t *v  = attributes.vertices.data()  + 3*chunk.vertexBase;
+    tinyobj::real_t *vn = attributes.normals.data()   + 3*chunk.normalBase;
+    tinyobj::real_t *vt = attributes.texcoords.data() + 2*chunk.texcoordBase;
+    int numVertices  = (int)chunk.vertexBase;
+    int numNormals   = (int)chunk.normalBase;
+    int numTexcoords = (int)chunk.texcoordBase;
+    size_t lineNum   = chunk.lineBase;
+
+    std::string lineBuf;
+    forEachLine(chunk,[&](const char *line, const char *eol) {
+        lineNum++;
+        if (!chunk.error.empty()) return;
+
+        // cheap pre-check so we don't copy lines we're going to skip
+        const char *first = line;
+        while (first < eol && IS_SPACE(*first)) first++;
+        if (first == eol || *first == '#') return;
+
+        const char *token = getToken(lineBuf,line,eol);
+        if (token[0] == 'v' && IS_SPACE(token[1])) {
+          token += 2;
+          tinyobj::parseReal3(v+0,v+1,v+2,&token);
+          v += 3;
+          numVertices++;
+        } else if (token[0] == 'v' && token[1] == 'n' && IS_SPACE(token[2])) {
+          token += 3;
+          tinyobj::parseReal3(vn+0,vn+1,vn+2,&token);
+          vn += 3;
+          numNormals++;
+        } else if (token[0] == 'v' && token[1] == 't' && IS_SPACE(token[2])) {
+          token += 3;
+          tinyobj::parseReal2(vt+0,vt+1,&token);
+          vt += 2;
+          numTexcoords++;
+        } else if (token[0] == 'f' && IS_SPACE(token[1])) {
+          token += 2;
+          token += strspn(token, " \t");
+          uint32_t numCorners = 0;
+          while (!IS_NEW_LINE(token[0])) {
+            tinyobj::vertex_index_t vi;
+            if (!tinyobj::parseTriple(&token,numVertices,numNormals,numTexcoords,&vi)) {
+              std::stringstream ss;
+              ss << "Failed parse `f' line(e.g. zero value for face index. line "
+                 << lineNum << ".)\n";
+              chunk.error = ss.str();
+              return;
+            }
+            tinyobj::index_t idx;
+            idx.vertex_index   = vi.v_idx;
+            idx.normal_index   = vi.vn_idx;
+            idx.texcoord_index = vi.vt_idx;
+            chunk.corners.push_back(idx);
+            numCorners++;
+            token += strspn(token, " \t\r");
+          }
+          chunk.faceSizes.push_back(numCorners);
+        } else if (((token[0] == 'g' || token[0] == 'o' || token[0] == 's' ||
+                     token[0] == 'l' || token[0] == 'p') && IS_SPACE(token[1])) ||
+                   ((0 == strncmp(token, "usemtl", 6) ||
+                     0 == strncmp(token, "mtllib", 6)) && IS_SPACE(token[6]))) {
+          OBJCommand command;
+          command.numFacesBefore = chunk.faceSizes.size();
+          command.begin          = line;
+          command.end            = eol;
+          chunk.commands.push_back(command);
+        }
+        // everything else gets ignored, same as in tinyobj
+      });
+  }
+
+  /*! sequentially walks all chunks' faces and commands in file
+      order, and assembles shapes and materials the same way
+      tinyobj::LoadObj does */
+  struct OBJReplay {
+    OBJReplay(tinyobj::attrib_t &attributes,
+              std::vector<tinyobj::shape_t> &shapes,
+              std::vector<tinyobj::material_t> &materials,
+              const std::string &mtlDir)
+      : attributes(attributes),
+        shapes(shapes),
+        materials(materials),
+        matFileReader(mtlDir)
+    {}
+
+    /*! emit faces [begin,end) of given chunk into current shape */
+    void emitFaces(const OBJChunk &chunk, size_t &faceID, size_t &cornerID,
+                   size_t end)
+    {
+      for (;faceID<end;faceID++) {
+        const uint32_t numCorners = chunk.faceSizes[faceID];
+        const tinyobj::index_t *corner = chunk.corners.data()+cornerID;
+        cornerID += numCorners;
+        numPendingPrims++;
+
+        if (numCorners < 3)
+          // face must have 3+ vertices
+          continue;
+
+        if (numCorners == 3) {
+          shape.mesh.indices.push_back(corner[0]);
+          shape.mesh.indices.push_back(corner[1]);
+          shape.mesh.indices.push_back(corner[2]);
+          shape.mesh.num_face_vertices.push_back(3);
+          shape.mesh.material_ids.push_back(material);
+          shape.mesh.smoothing_group_ids.push_back(smoothingID);
+          continue;
+        }
+
+        // polygon: let tinyobj do the ear clipping, so we get the
+        // very same triangles
+        tinyobj::PrimGroup polygon;
+        polygon.faceGroup.resize(1);
+        tinyobj::face_t &face = polygon.faceGroup[0];
+        face.smoothing_group_id = smoothingID;
+        for (uint32_t i=0;i<numCorners;i++)
+          face.vertex_indices.push_back
+            (tinyobj::vertex_index_t(corner[i].vertex_index,
+                                     corner[i].texcoord_index,
+                                     corner[i].normal_index));
+        tinyobj::exportGroupsToShape(&shape,polygon,noTags,material,name,
+                                     /*triangulate*/true,attributes.vertices);
+      }
+    }
+
+    /*! equivalent of tinyobj's exportGroupsToShape() of the pending
+        prim group: returns whether there were any */
+    bool flush()
+    {
+      if (numPendingPrims == 0)
+        return false;
+      shape.name = name;
+      numPendingPrims = 0;
+      return true;
+    }
+
+    void command(const OBJCommand &cmd)
+    {
+      const char *token = getToken(lineBuf,cmd.begin,cmd.end);
+      if (token[0] == 'l' || token[0] == 'p') {
+        // lines and points: not extracted, but they do count as
+        // primitives when deciding which shapes to emit
+        numPendingPrims++;
+      } else if (token[0] == 's') {
+        token += 2;
+        token += strspn(token, " \t");
+        if (token[0] == '\0' || token[0] == '\r' || token[1] == '\n')
+          return;
+        if (strlen(token) >= 3) {
+          if (token[0] == 'o' && token[1] == 'f' && token[2] == 'f')
+            smoothingID = 0;
+        } else {
+          const int id = tinyobj::parseInt(&token);
+          smoothingID = id < 0 ? 0 : (unsigned int)id;
+        }
+      } else if (token[0] == 'u') {
+        token += 7;
+        const std::string materialName = token;
+        int newMaterial = -1;
+        if (materialMap.find(materialName) != materialMap.end())
+          newMaterial = materialMap[materialName];
+        if (newMaterial != material) {
+          flush();
+          material = newMaterial;
+        }
+      } else if (token[0] == 'm') {
+        token += 7;
+        std::vector<std::string> fileNames;
+        tinyobj::SplitString(std::string(token), ' ', fileNames);
+        for (auto &fileName : fileNames) {
+          std::string warn, err;
+          if (matFileReader(fileName,&materials,&materialMap,&warn,&err))
+            break;
+        }
+      } else if (token[0] == 'g') {
+        flush();
+        if (!shape.mesh.indices.empty())
+          shapes.push_back(shape);
+        shape = tinyobj::shape_t();
+
+        std::vector<std::string> names;
+        while (!IS_NEW_LINE(token[0])) {
+          names.push_back(tinyobj::parseString(&token));
+          token += strspn(token, " \t\r");
+        }
+        name = "";
+        for (size_t i=1;i<names.size();i++)
+          name += (i>1?" ":"") + names[i];
+      } else if (token[0] == 'o') {
+        if (flush())
+          shapes.push_back(shape);
+        shape = tinyobj::shape_t();
+        name = token+2;
+      }
+    }
+
+    void finish()
+    {
+      if (flush() || !shape.mesh.indices.empty())
+        shapes.push_back(shape);
+    }
+
+    tinyobj::attrib_t                &attributes;
+    std::vector<tinyobj::shape_t>    &shapes;
+    std::vector<tinyobj::material_t> &materials;
+    tinyobj::MaterialFileReader       matFileReader;
+    std::map<std::string,int>         materialMap;
+    const std::vector<tinyobj::tag_t> noTags;
+
+    tinyobj::shape_t shape;
+    std::string      name;
+    int              material        { -1 };
+    unsigned int     smoothingID     { 0 };
+    size_t           numPendingPrims { 0 };
+    std::string      lineBuf;
+  };
+
+  bool parseOBJParallel(tinyobj::attrib_t &attributes,
+                        std::vector<tinyobj::shape_t> &shapes,
+                        std::vector<tinyobj::material_t> &materials,
+                        std::string &err,
+                        const std::string &objFile,
+                        const std::string &mtlDir)
+  {
+    MappedFile file;
+    if (!file.map(objFile)) {
+      err = "Cannot open file [" + objFile + "]\n";
+      return false;
+    }
+    const char *const fileEnd = file.data + file.size;
+
+    // ------------------------------------------------------------------
+    // split into line-aligned chunks; a few per thread so the ones
+    // that happen to have many faces don't hold everybody else up
+    // ------------------------------------------------------------------
+    const size_t minChunkSize = 1<<20;
+    const size_t numChunks
+      = std::max((size_t)1,std::min(file.size/minChunkSize,
+                                    (size_t)(8*gdt::getNumThreads())));
+    std::vector<OBJChunk> chunks(numChunks);
+    for (size_t i=0;i<numChunks;i++) {
+      const char *begin = file.data + i*(file.size/numChunks);
+      if (i > 0) {
+        const char *eol = (const char *)memchr(begin-1,'\n',fileEnd-(begin-1));
+        begin = std::max(eol ? eol+1 : fileEnd, chunks[i-1].begin);
+      }
+      chunks[i].begin = begin;
+      if (i > 0) chunks[i-1].end = begin;
+    }
+    chunks[numChunks-1].end = fileEnd;
+
+    // ------------------------------------------------------------------
+    // count, prefix-sum, and then parse
+    // ------------------------------------------------------------------
+    gdt::parallel_for(numChunks,[&](size_t chunkID){
+        countRecords(chunks[chunkID]);
+      });
+    size_t numLines = 0, numVertices = 0, numNormals = 0, numTexcoords = 0;
+    for (auto &chunk : chunks) {
+      chunk.lineBase     = numLines;     numLines     += chunk.numLines;
+      chunk.vertexBase   = numVertices;  numVertices  += chunk.numVertices;
+      chunk.normalBase   = numNormals;   numNormals   += chunk.numNormals;
+      chunk.texcoordBase = numTexcoords; numTexcoords += chunk.numTexcoords;
+    }
+    attributes = tinyobj::attrib_t();
+    attributes.vertices.resize(3*numVertices);
+    attributes.normals.resize(3*numNormals);
+    attributes.texcoords.resize(2*numTexcoords);
+
+    gdt::parallel_for(numChunks,[&](size_t chunkID){
+        parseRecords(chunks[chunkID],attributes);
+      });
+    for (auto &chunk : chunks)
+      if (!chunk.error.empty()) {
+        err = chunk.error;
+        return false;
+      }
+
+    // ------------------------------------------------------------------
+    // replay faces and commands in file order
+    // ------------------------------------------------------------------
+    std::string baseDir = mtlDir;
+#ifndef _WIN32
+    const char dirsep = '/';
+#else
+    const char dirsep = '\\';
+#endif
+    if (!baseDir.empty() && baseDir[baseDir.size()-1] != dirsep)
+      baseDir += dirsep;
+
+    shapes.clear();
+    OBJReplay replay(attributes,shapes,materials,baseDir);
+    for (auto &chunk : chunks) {
+      size_t faceID = 0, cornerID = 0;
+      for (auto &command : chunk.commands) {
+        replay.emitFaces(chunk,faceID,cornerID,command.numFacesBefore);
+        replay.command(command);
+      }
+      replay.emitFaces(chunk,faceID,cornerID,chunk.faceSizes.size());
+      // release this chunk's faces early, we've got a copy now
+      std::vector<tinyobj::index_t>().swap(chunk.corners);
+    }
+    replay.finish();
+    return true;
+  }
+
+  std::vector<std::string> objMaterialLibraries(const std::string &objFile,
+                                                const std::string &mtlDir)
+  {
+    std::vector<std::string> libraries;
+    MappedFile file;
+    if (!file.map(objFile))
+      return libraries;
+    const char *end = file.data+file.size;
+    for (const char *line = file.data; line < end; ) {
+      const char *eol = (const char *)memchr(line,'\n',end-line);
+      if (!eol) eol = end;
+      const char *token = line;
+      while (token < eol && (*token == ' ' || *token == '\t')) token++;
+      if (eol-token > 7 && strncmp(token,"mtllib",6) == 0 && IS_SPACE(token[6])) {
+        // same as tinyobj: any number of file names, separated by spaces
+        std::istringstream names(std::string(token+7,eol));
+        std::string name;
+        while (names >> name)
+          libraries.push_back(mtlDir+name);
+      }
+      line = eol+1;
+    }
+    return libraries;
+  }
+
+}
@@ -0,0 +1,51 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "3rdParty/tiny_obj_loader.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! files smaller than this go through plain tinyobj::LoadObj; for
+      anything larger spinning up the parallel parser pays off */
+  enum { PARALLEL_OBJ_PARSE_THRESHOLD = 4<<20 };
+
+  /*! parallel OBJ front end: maps the file into memory, splits it
+      into chunks at line boundaries, and parses the v/vn/vt/f
+      records of all chunks in parallel; the (few) remaining records
+      (usemtl/mtllib/g/o/l/p) are replayed in file order afterwards.
+
+      Produces the same attributes, shape faces (indices,
+      num_face_vertices, material_ids), shape names, and materials
+      that tinyobj::LoadObj (with triangulation) would; smoothing
+      groups, tags, vertex colors, lines and points are not
+      extracted. Returns false (with a message in 'err') if the file
+      could not be mapped or parsed */
+  bool parseOBJParallel(tinyobj::attrib_t &attributes,
+                        std::vector<tinyobj::shape_t> &shapes,
+                        std::vector<tinyobj::material_t> &materials,
+                        std::string &err,
+                        const std::string &objFile,
+                        const std::string &mtlDir);
+
+  /*! the material library files (in 'mtlDir') that the given OBJ
+      file's mtllib records name; an empty list if there are none, or
+      if the file can not be read */
+  std::vector<std::string> objMaterialLibraries(const std::string &objFile,
+                                                const std::string &mtlDir);
+}
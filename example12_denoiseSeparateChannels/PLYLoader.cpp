@@ -0,0 +1,516 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Model.h"
+#include "MappedFile.h"
+#include "gdt/parallel/parallel_for.h"
+#include "3rdParty/ply.h"
+//std
+#include <atomic>
+#include <string.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! size (in bytes) of each of ply's scalar types */
+  static const int plyTypeSize[PLY_END_TYPE] = { 0, 1, 2, 4, 1, 2, 4, 4, 8 };
+
+  /*! @{ names under which PLY files commonly store what we need */
+  static const char *plyNormalNames[][3]
+  = { { "nx","ny","nz" } };
+  static const char *plyTexcoordNames[][2]
+  = { { "u","v" }, { "s","t" }, { "texture_u","texture_v" } };
+  static const char *plyIndexListNames[]
+  = { "vertex_indices", "vertex_index" };
+  /*! @} */
+
+  template<typename T>
+  inline T loadScalar(const char *ptr, bool swap)
+  {
+    T value;
+    if (!swap)
+      memcpy(&value,ptr,sizeof(T));
+    else {
+      char bytes[sizeof(T)];
+      for (size_t i=0;i<sizeof(T);i++)
+        bytes[i] = ptr[sizeof(T)-1-i];
+      memcpy(&value,bytes,sizeof(T));
+    }
+    return value;
+  }
+
+  /*! read one binary scalar of given ply type, as a double */
+  inline double readScalar(const char *ptr, int type, bool swap)
+  {
+    switch (type) {
+    case PLY_CHAR:   return (double)loadScalar<int8_t>(ptr,swap);
+    case PLY_UCHAR:  return (double)loadScalar<uint8_t>(ptr,swap);
+    case PLY_SHORT:  return (double)loadScalar<int16_t>(ptr,swap);
+    case PLY_USHORT: return (double)loadScalar<uint16_t>(ptr,swap);
+    case PLY_INT:    return (double)loadScalar<int32_t>(ptr,swap);
+    case PLY_UINT:   return (double)loadScalar<uint32_t>(ptr,swap);
+    case PLY_FLOAT:  return (double)loadScalar<float>(ptr,swap);
+    default:         return loadScalar<double>(ptr,swap);
+    }
+  }
+
+  /*! read one binary scalar as a float; with a short-cut for the
+      (by far) most common case */
+  inline float readFloat(const char *ptr, int type, bool swap)
+  {
+    if (type == PLY_FLOAT && !swap) {
+      float f;
+      memcpy(&f,ptr,sizeof(f));
+      return f;
+    }
+    return (float)readScalar(ptr,type,swap);
+  }
+
+  /*! read one binary scalar as an integer (list counts, indices) */
+  inline int64_t readInt(const char *ptr, int type, bool swap)
+  {
+    switch (type) {
+    case PLY_CHAR:   return loadScalar<int8_t>(ptr,swap);
+    case PLY_UCHAR:  return loadScalar<uint8_t>(ptr,swap);
+    case PLY_SHORT:  return loadScalar<int16_t>(ptr,swap);
+    case PLY_USHORT: return loadScalar<uint16_t>(ptr,swap);
+    case PLY_INT:    return loadScalar<int32_t>(ptr,swap);
+    case PLY_UINT:   return loadScalar<uint32_t>(ptr,swap);
+    default:         return (int64_t)readScalar(ptr,type,swap);
+    }
+  }
+
+  /*! index of the property of that name in given element, or -1 */
+  static int findProperty(const PlyElement *elem, const char *name)
+  {
+    for (int i=0;i<elem->nprops;i++)
+      if (!strcmp(elem->props[i]->name,name))
+        return i;
+    return -1;
+  }
+
+  /*! find the first set of property names (eg, "u","v") that the
+      element has all of, and return their indices */
+  template<int N>
+  static bool findProperties(const PlyElement *elem,
+                             const char *names[][N], int numAlternatives,
+                             int (&found)[N])
+  {
+    for (int alt=0;alt<numAlternatives;alt++) {
+      bool all = true;
+      for (int i=0;i<N;i++)
+        all &= ((found[i] = findProperty(elem,names[alt][i])) >= 0);
+      if (all) return true;
+    }
+    return false;
+  }
+
+  static int findIndexList(const PlyElement *elem)
+  {
+    for (auto name : plyIndexListNames) {
+      const int prop = findProperty(elem,name);
+      if (prop >= 0 && elem->props[prop]->is_list)
+        return prop;
+    }
+    return -1;
+  }
+
+  /*! add polygon (given by its 'numIndices' vertex indices) as a fan
+      of triangles */
+  inline void addPolygon(TriangleMesh *mesh, const int64_t *index, int64_t numIndices)
+  {
+    for (int64_t i=2;i<numIndices;i++)
+      mesh->index.push_back(vec3i((int)index[0],(int)index[i-1],(int)index[i]));
+  }
+
+  // ==================================================================
+  // binary PLY files: read straight out of the mapped file
+  // ==================================================================
+
+  /*! walks through the (binary) body of a PLY file */
+  struct BinaryPLYReader {
+    const char *ptr;
+    const char *end;
+    bool        swap;
+
+    void need(size_t numBytes)
+    {
+      if (numBytes > size_t(end-ptr))
+        throw std::runtime_error("unexpected end of PLY file");
+    }
+
+    /*! size of one record of given element, if all its properties
+        are scalars; 0 if it has any lists */
+    static size_t fixedRecordSize(const PlyElement *elem)
+    {
+      size_t size = 0;
+      for (int j=0;j<elem->nprops;j++) {
+        if (elem->props[j]->is_list) return 0;
+        size += plyTypeSize[elem->props[j]->external_type];
+      }
+      return size;
+    }
+
+    /*! skip over a property that we do not care about */
+    void skipProperty(const PlyProperty *prop)
+    {
+      if (prop->is_list) {
+        need(plyTypeSize[prop->count_external]);
+        const int64_t count = readInt(ptr,prop->count_external,swap);
+        ptr += plyTypeSize[prop->count_external];
+        if (count < 0)
+          throw std::runtime_error("invalid list in PLY file");
+        need(size_t(count)*plyTypeSize[prop->external_type]);
+        ptr += size_t(count)*plyTypeSize[prop->external_type];
+      } else {
+        need(plyTypeSize[prop->external_type]);
+        ptr += plyTypeSize[prop->external_type];
+      }
+    }
+
+    void skipElement(const PlyElement *elem)
+    {
+      const size_t recordSize = fixedRecordSize(elem);
+      if (recordSize) {
+        need(size_t(elem->num)*recordSize);
+        ptr += size_t(elem->num)*recordSize;
+      } else
+        for (int i=0;i<elem->num;i++)
+          for (int j=0;j<elem->nprops;j++)
+            skipProperty(elem->props[j]);
+    }
+
+    void readVertices(const PlyElement *elem, TriangleMesh *mesh)
+    {
+      const size_t recordSize = fixedRecordSize(elem);
+      if (!recordSize)
+        throw std::runtime_error("PLY vertices with list properties are not supported");
+      const size_t numVertices = elem->num;
+      need(numVertices*recordSize);
+
+      std::vector<size_t> offset(elem->nprops);
+      for (int j=1;j<elem->nprops;j++)
+        offset[j] = offset[j-1] + plyTypeSize[elem->props[j-1]->external_type];
+
+      int position[3], normal[3], texcoord[2];
+      const char *positionNames[][3] = { { "x","y","z" } };
+      if (!findProperties(elem,positionNames,1,position))
+        throw std::runtime_error("PLY vertices do not have x/y/z coordinates");
+      const bool hasNormals   = findProperties(elem,plyNormalNames,1,normal);
+      const bool hasTexcoords = findProperties(elem,plyTexcoordNames,3,texcoord);
+
+      mesh->vertex.resize(numVertices);
+      if (hasNormals)   mesh->normal.resize(numVertices);
+      if (hasTexcoords) mesh->texcoord.resize(numVertices);
+
+      auto field = [&](int prop, const char *record) {
+        return readFloat(record+offset[prop],elem->props[prop]->external_type,swap);
+      };
+      const char *records = ptr;
+      gdt::parallel_for_blocked(numVertices,16*1024,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++) {
+            const char *record = records + i*recordSize;
+            mesh->vertex[i] = vec3f(field(position[0],record),
+                                    field(position[1],record),
+                                    field(position[2],record));
+            if (hasNormals)
+              mesh->normal[i] = vec3f(field(normal[0],record),
+                                      field(normal[1],record),
+                                      field(normal[2],record));
+            if (hasTexcoords)
+              mesh->texcoord[i] = vec2f(field(texcoord[0],record),
+                                        field(texcoord[1],record));
+          }
+        });
+      ptr += numVertices*recordSize;
+    }
+
+    /*! fast path for the (common) case of faces that are all
+        triangles, with nothing but scalars next to their index list:
+        those all have the same size, so we can convert them in
+        parallel. Returns false (having read nothing) if the faces
+        turn out not to be like that */
+    bool readTriangles(const PlyElement *elem, int indexList, TriangleMesh *mesh)
+    {
+      size_t prefixSize = 0, recordSize = 0;
+      for (int j=0;j<elem->nprops;j++) {
+        const PlyProperty *prop = elem->props[j];
+        if (j == indexList) {
+          prefixSize  = recordSize;
+          recordSize += plyTypeSize[prop->count_external]
+            + 3*plyTypeSize[prop->external_type];
+        } else if (prop->is_list)
+          return false;
+        else
+          recordSize += plyTypeSize[prop->external_type];
+      }
+      const size_t numFaces = elem->num;
+      if (numFaces*recordSize > size_t(end-ptr))
+        return false;
+
+      const PlyProperty *list = elem->props[indexList];
+      const int countType = list->count_external;
+      const int indexType = list->external_type;
+      const int countSize = plyTypeSize[countType];
+      const int indexSize = plyTypeSize[indexType];
+      std::atomic<bool> allTriangles(true);
+      const size_t numBefore = mesh->index.size();
+      mesh->index.resize(numBefore+numFaces);
+      vec3i *index = mesh->index.data()+numBefore;
+      const char *records = ptr;
+      gdt::parallel_for_blocked(numFaces,16*1024,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++) {
+            const char *record = records + i*recordSize + prefixSize;
+            if (readInt(record,countType,swap) != 3) {
+              allTriangles = false;
+              return;
+            }
+            record += countSize;
+            index[i] = vec3i((int)readInt(record+0*indexSize,indexType,swap),
+                             (int)readInt(record+1*indexSize,indexType,swap),
+                             (int)readInt(record+2*indexSize,indexType,swap));
+          }
+        });
+      if (!allTriangles) {
+        mesh->index.resize(numBefore);
+        return false;
+      }
+      ptr += numFaces*recordSize;
+      return true;
+    }
+
+    void readFaces(const PlyElement *elem, TriangleMesh *mesh)
+    {
+      const int indexList = findIndexList(elem);
+      if (indexList < 0)
+        throw std::runtime_error("PLY faces do not have a vertex index list");
+      if (readTriangles(elem,indexList,mesh))
+        return;
+
+      // general case - polygons of any size, any other lists
+      const PlyProperty *list = elem->props[indexList];
+      std::vector<int64_t> polygon;
+      for (int i=0;i<elem->num;i++)
+        for (int j=0;j<elem->nprops;j++) {
+          if (j != indexList) {
+            skipProperty(elem->props[j]);
+            continue;
+          }
+          need(plyTypeSize[list->count_external]);
+          const int64_t count = readInt(ptr,list->count_external,swap);
+          ptr += plyTypeSize[list->count_external];
+          if (count < 0)
+            throw std::runtime_error("invalid face in PLY file");
+          need(size_t(count)*plyTypeSize[list->external_type]);
+          polygon.resize(count);
+          for (int64_t k=0;k<count;k++) {
+            polygon[k] = readInt(ptr,list->external_type,swap);
+            ptr += plyTypeSize[list->external_type];
+          }
+          addPolygon(mesh,polygon.data(),count);
+        }
+    }
+  };
+
+  static void readBinaryPLY(PlyFile *ply,
+                            const std::string &fileName,
+                            size_t headerSize,
+                            TriangleMesh *mesh)
+  {
+    MappedFile file;
+    if (!file.map(fileName) || file.size < headerSize)
+      throw std::runtime_error("could not map PLY file "+fileName);
+
+    const int one = 1;
+    const bool hostIsBigEndian = (*(const char *)&one == 0);
+
+    BinaryPLYReader reader;
+    reader.ptr  = file.data+headerSize;
+    reader.end  = file.data+file.size;
+    reader.swap = ((ply->file_type == PLY_BINARY_BE) != hostIsBigEndian);
+    for (int i=0;i<ply->nelems;i++) {
+      const PlyElement *elem = ply->elems[i];
+      if (!strcmp(elem->name,"vertex"))
+        reader.readVertices(elem,mesh);
+      else if (!strcmp(elem->name,"face"))
+        reader.readFaces(elem,mesh);
+      else
+        reader.skipElement(elem);
+    }
+  }
+
+  // ==================================================================
+  // ascii PLY files: element by element, through ply_get_element
+  // ==================================================================
+
+  struct PLYVertexRecord {
+    float position[3];
+    float normal[3];
+    float texcoord[2];
+    void *other;
+  };
+
+  struct PLYFaceRecord {
+    int   numIndices;
+    int  *index;
+    void *other;
+  };
+
+  struct PLYOtherRecord {
+    void *other;
+  };
+
+  static void requestProperty(PlyFile *ply, PlyElement *elem,
+                              const char *name, int offset)
+  {
+    PlyProperty prop = { (char *)name, PLY_FLOAT, PLY_FLOAT, offset, 0, 0, 0, 0 };
+    ply_get_property(ply,elem->name,&prop);
+  }
+
+  static void readASCIIPLY(PlyFile *ply, TriangleMesh *mesh)
+  {
+    for (int i=0;i<ply->nelems;i++) {
+      PlyElement *elem = ply->elems[i];
+      if (!strcmp(elem->name,"vertex")) {
+        int position[3], normal[3], texcoord[2];
+        const char *positionNames[][3] = { { "x","y","z" } };
+        if (!findProperties(elem,positionNames,1,position))
+          throw std::runtime_error("PLY vertices do not have x/y/z coordinates");
+        const bool hasNormals   = findProperties(elem,plyNormalNames,1,normal);
+        const bool hasTexcoords = findProperties(elem,plyTexcoordNames,3,texcoord);
+        for (int k=0;k<3;k++)
+          requestProperty(ply,elem,elem->props[position[k]]->name,
+                          offsetof(PLYVertexRecord,position)+k*sizeof(float));
+        if (hasNormals)
+          for (int k=0;k<3;k++)
+            requestProperty(ply,elem,elem->props[normal[k]]->name,
+                            offsetof(PLYVertexRecord,normal)+k*sizeof(float));
+        if (hasTexcoords)
+          for (int k=0;k<2;k++)
+            requestProperty(ply,elem,elem->props[texcoord[k]]->name,
+                            offsetof(PLYVertexRecord,texcoord)+k*sizeof(float));
+        ply_get_other_properties(ply,elem->name,offsetof(PLYVertexRecord,other));
+
+        for (int j=0;j<elem->num;j++) {
+          PLYVertexRecord record;
+          record.other = nullptr;
+          ply_get_element(ply,&record);
+          free(record.other);
+          mesh->vertex.push_back((const vec3f &)record.position);
+          if (hasNormals)
+            mesh->normal.push_back((const vec3f &)record.normal);
+          if (hasTexcoords)
+            mesh->texcoord.push_back((const vec2f &)record.texcoord);
+        }
+      } else if (!strcmp(elem->name,"face") && findIndexList(elem) >= 0) {
+        PlyProperty prop = {
+          elem->props[findIndexList(elem)]->name,
+          PLY_INT, PLY_INT, offsetof(PLYFaceRecord,index),
+          1, PLY_INT, PLY_INT, offsetof(PLYFaceRecord,numIndices)
+        };
+        ply_get_property(ply,elem->name,&prop);
+        ply_get_other_properties(ply,elem->name,offsetof(PLYFaceRecord,other));
+
+        std::vector<int64_t> polygon;
+        for (int j=0;j<elem->num;j++) {
+          PLYFaceRecord record;
+          record.index = nullptr;
+          record.other = nullptr;
+          ply_get_element(ply,&record);
+          polygon.assign(record.index,record.index+record.numIndices);
+          addPolygon(mesh,polygon.data(),record.numIndices);
+          free(record.index);
+          free(record.other);
+        }
+      } else if (!strcmp(elem->name,"face")) {
+        throw std::runtime_error("PLY faces do not have a vertex index list");
+      } else {
+        ply_get_other_properties(ply,elem->name,offsetof(PLYOtherRecord,other));
+        for (int j=0;j<elem->num;j++) {
+          PLYOtherRecord record;
+          record.other = nullptr;
+          ply_get_element(ply,&record);
+          free(record.other);
+        }
+      }
+    }
+  }
+
+  // ==================================================================
+  // loadPLY
+  // ==================================================================
+
+  Model *loadPLY(const std::string &plyFile)
+  {
+    const double startTime = getCurrentTime();
+    FILE *file = fopen(plyFile.c_str(),"rb");
+    if (!file)
+      throw std::runtime_error("could not open PLY file "+plyFile);
+
+    int    numElements  = 0;
+    char **elementNames = nullptr;
+    PlyFile *ply = ply_read(file,&numElements,&elementNames);
+    if (!ply) {
+      fclose(file);
+      throw std::runtime_error("could not parse PLY header of "+plyFile);
+    }
+    for (int i=0;i<numElements;i++)
+      free(elementNames[i]);
+    free(elementNames);
+
+    Model *model = new Model;
+    TriangleMesh *mesh = new TriangleMesh;
+    mesh->diffuse = vec3f(.8f);
+    model->meshes.push_back(mesh);
+    try {
+      if (ply->file_type == PLY_ASCII)
+        readASCIIPLY(ply,mesh);
+      else
+        readBinaryPLY(ply,plyFile,(size_t)ftell(file),mesh);
+
+      std::atomic<bool> indicesValid(true);
+      const int numVertices = (int)mesh->vertex.size();
+      gdt::parallel_for_blocked(mesh->index.size(),64*1024,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++) {
+            const vec3i index = mesh->index[i];
+            if (index.x < 0 || index.x >= numVertices ||
+                index.y < 0 || index.y >= numVertices ||
+                index.z < 0 || index.z >= numVertices)
+              indicesValid = false;
+          }
+        });
+      if (!indicesValid)
+        throw std::runtime_error("invalid vertex index in PLY file");
+    } catch (...) {
+      ply_close(ply);
+      delete model;
+      throw;
+    }
+    ply_close(ply);
+
+    computeBounds(model);
+
+    const double loadTime = getCurrentTime()-startTime;
+    std::cout << "Done loading ply file - found "
+              << mesh->vertex.size() << " vertices and "
+              << mesh->index.size() << " triangles"
+              << " (in " << loadTime << "s, "
+              << prettyDouble(mesh->index.size()/std::max(loadTime,1e-6))
+              << " triangles/s)" << std::endl;
+    return model;
+  }
+
+}
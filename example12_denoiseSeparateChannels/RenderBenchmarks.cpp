@@ -0,0 +1,307 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Benchmarks.h"
+#include "CPURenderer.h"
+#include "TextureMips.h"
+#include "gdt/random/random.h"
+//std
+#include <algorithm>
+#include <fstream>
+#include <math.h>
+#include <memory>
+#include <stdexcept>
+#include <string.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! a checkerboard texture of 'size'^2 pixels (with mip levels),
+      each square 'squareSize' pixels wide */
+  static Texture *checkerTexture(int size, int squareSize)
+  {
+    Texture *texture = new Texture;
+    texture->resolution = vec2i(size);
+    texture->pixel = (uint32_t *)malloc(area(texture->resolution)*sizeof(uint32_t));
+    if (!texture->pixel) {
+      delete texture;
+      throw std::bad_alloc();
+    }
+    for (int y=0;y<size;y++)
+      for (int x=0;x<size;x++)
+        texture->pixel[y*size+x]
+          = ((x/squareSize + y/squareSize) % 2) ? 0xffffffffu : 0xff404040u;
+    generateMipLevels(texture,MIP_FILTER_BOX);
+    return texture;
+  }
+
+  /*! save rgba8 pixels (bottom row first, as in the frame buffer) as
+      a binary PPM */
+  static void writeFramePPM(const std::string &fileName, const vec2i &size,
+                            const std::vector<uint32_t> &pixels)
+  {
+    std::string ppm = "P6\n"+std::to_string(size.x)+" "+std::to_string(size.y)+"\n255\n";
+    for (int y=size.y-1;y>=0;y--)
+      for (int x=0;x<size.x;x++) {
+        const uint32_t rgba = pixels[y*size.x+x];
+        ppm += char(rgba & 0xff);
+        ppm += char((rgba >> 8) & 0xff);
+        ppm += char((rgba >> 16) & 0xff);
+      }
+    std::ofstream out(fileName.c_str(),std::ios::binary);
+    out << ppm;
+    out.close();
+    if (!out)
+      throw std::runtime_error("could not write "+fileName);
+  }
+
+  void benchmarkCPURenderer(const std::string &objFile, int samplesPerPixel,
+                            bool instanceAndTexture)
+  {
+    std::unique_ptr<Model> model;
+    {
+      TemporaryModelCopy copy(objFile);
+      model.reset(loadOBJ(copy.fileName));
+    }
+    if (instanceAndTexture) {
+      detectInstances(model.get(),/*allowAffine*/true);
+      model->textures.push_back(checkerTexture(256,16));
+      for (auto mesh : model->meshes)
+        mesh->diffuseTextureID = 0;
+    }
+
+    // looking down at the model from above one of its corners, with
+    // a light a tenth its size above it
+    const box3f bounds = model->bounds;
+    const vec3f span   = bounds.span();
+    const vec3f at     = bounds.center();
+    const Camera camera
+      = { /*from*/at + .8f*length(span)*normalize(vec3f(-.5f,.7f,-.5f)),
+          /* at */at,
+          /* up */vec3f(0.f,1.f,0.f) };
+    const vec3f lightCenter(at.x,bounds.upper.y+.5f*length(span),at.z);
+    const QuadLight light
+      = { /* origin */ lightCenter-vec3f(.05f*span.x,0.f,.05f*span.z),
+          /* edge 1 */ vec3f(.1f*span.x,0.f,0.f),
+          /* edge 2 */ vec3f(0.f,0.f,.1f*span.z),
+          /* power */  vec3f(3000000.f) };
+
+    // (small, as every ray gets tested against every instance)
+    const vec2i frameSize(480,270);
+    CPURenderer renderer(model.get(),std::vector<QuadLight>(1,light));
+    renderer.resize(frameSize);
+    renderer.setCamera(camera);
+    renderer.launchParams.numPixelSamples = samplesPerPixel;
+    renderer.accumulate = false;
+
+    auto renderFrame = [&]() {
+      const double startTime = getCurrentTime();
+      renderer.render();
+      const double renderTime = getCurrentTime()-startTime;
+      std::cout << "frame " << renderer.launchParams.frame.frameID-1 << ": "
+                << renderer.numRaysTraced << " rays in " << prettyDouble(renderTime)
+                << "s (" << prettyDouble(renderer.numRaysTraced/renderTime)
+                << " rays/s)" << std::endl;
+    };
+
+    renderFrame();
+    const std::vector<vec4f> color  = renderer.colorBuffer;
+    const std::vector<vec4f> normal = renderer.normalBuffer;
+    const std::vector<vec4f> albedo = renderer.albedoBuffer;
+    renderFrame();
+    const size_t bufferBytes = color.size()*sizeof(vec4f);
+    if (memcmp(color.data(),renderer.colorBuffer.data(),bufferBytes)
+        || memcmp(normal.data(),renderer.normalBuffer.data(),bufferBytes)
+        || memcmp(albedo.data(),renderer.albedoBuffer.data(),bufferBytes))
+      throw std::runtime_error("benchmarkCPURenderer: rendering the same frame"
+                               " twice gave different pixels");
+    auto valid = [](const vec4f &v) {
+      return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z)
+        && v.x >= 0.f && v.y >= 0.f && v.z >= 0.f && v.w == 1.f;
+    };
+    for (size_t pixelID=0;pixelID<color.size();pixelID++)
+      if (!valid(color[pixelID]) || !valid(albedo[pixelID])
+          || normal[pixelID].w != 1.f
+          || !(length(vec3f(normal[pixelID])) <= 1.0001f))
+        throw std::runtime_error("benchmarkCPURenderer: invalid pixel "
+                                 +std::to_string(pixelID));
+    std::cout << "two renders of the same frame match, and all pixels are valid"
+              << std::endl;
+
+    const int numFrames = 4;
+    renderer.accumulate = true;
+    renderer.setCamera(camera);
+    for (int frameID=0;frameID<numFrames;frameID++)
+      renderFrame();
+    std::vector<uint32_t> pixels(area(frameSize));
+    renderer.downloadPixels(pixels.data());
+    writeFramePPM("ex12_cpu_render.ppm",frameSize,pixels);
+    std::cout << "saved " << numFrames << " accumulated frames as ex12_cpu_render.ppm"
+              << std::endl;
+  }
+
+  /*! an untextured quad at height 'z', over [lower,upper] in x and
+      y, facing +z */
+  struct TestQuad {
+    float z;
+    vec2f lower, upper;
+    vec3f diffuse;
+
+    /*! where the ray hits the quad's plane, if it does within the
+        quad (and closer than 't'), with a margin of 'eps' around its
+        edges: 1 for a hit, -1 for a miss, 0 if too close to tell */
+    int hit(const vec3f &org, const vec3f &dir, float eps, float &t) const
+    {
+      const float tz = (z-org.z)/dir.z;
+      if (!(tz > 0.f) || tz >= t)
+        return -1;
+      const vec3f P = org+tz*dir;
+      const float inside
+        = std::min(std::min(P.x-lower.x,upper.x-P.x),std::min(P.y-lower.y,upper.y-P.y));
+      if (fabsf(inside) < eps)
+        return 0;
+      if (inside < 0.f)
+        return -1;
+      t = tz;
+      return 1;
+    }
+  };
+
+  static TriangleMesh *testQuadMesh(const TestQuad &quad)
+  {
+    TriangleMesh *mesh = new TriangleMesh;
+    // (counter-clockwise, seen from above)
+    mesh->vertex.push_back(vec3f(quad.lower.x,quad.lower.y,quad.z));
+    mesh->vertex.push_back(vec3f(quad.upper.x,quad.lower.y,quad.z));
+    mesh->vertex.push_back(vec3f(quad.upper.x,quad.upper.y,quad.z));
+    mesh->vertex.push_back(vec3f(quad.lower.x,quad.upper.y,quad.z));
+    mesh->index.push_back(vec3i(0,1,2));
+    mesh->index.push_back(vec3i(0,2,3));
+    mesh->diffuse = quad.diffuse;
+    return mesh;
+  }
+
+  void validateCPURenderer()
+  {
+    // a floor quad at z=0 over [-1,1]^2, seen from straight above,
+    // lit by a tiny light far off to the side (so its light hits at
+    // 45 degrees), with a narrow quad floating half a unit above the
+    // floor - and casting a shadow of the same width half a unit
+    // over
+    const TestQuad floor    = { 0.f,  vec2f(-1.f),       vec2f(1.f),      vec3f(.5f,.4f,.3f) };
+    const TestQuad occluder = { .5f,  vec2f(.1f,-1.f),   vec2f(.4f,1.f),  vec3f(.2f,.6f,.8f) };
+    const TestQuad quads[2] = { floor, occluder };
+    Model model;
+    model.meshes.push_back(testQuadMesh(floor));
+    model.meshes.push_back(testQuadMesh(occluder));
+    computeBounds(&model);
+
+    const vec3f lightCenter(1000.f,0.f,1000.f);
+    const float lightSize = 1e-3f;
+    const QuadLight light = { lightCenter-vec3f(.5f*lightSize,.5f*lightSize,0.f),
+                              vec3f(lightSize,0.f,0.f), vec3f(0.f,lightSize,0.f),
+                              vec3f(2e6f) };
+    const Camera camera = { vec3f(0.f,0.f,5.f), vec3f(0.f), vec3f(0.f,1.f,0.f) };
+
+    const vec2i frameSize(64,64);
+    CPURenderer renderer(&model,std::vector<QuadLight>(1,light));
+    renderer.resize(frameSize);
+    renderer.setCamera(camera);
+    renderer.render();
+
+    const float eps = 1e-3f;
+    int numChecked[4] = { 0, 0, 0, 0 }; // missed, lit, shadowed, occluder
+    for (int iy=0;iy<frameSize.y;iy++)
+      for (int ix=0;ix<frameSize.x;ix++) {
+        // the primary ray, jittered just as the renderer does it
+        // for the first frame
+        gdt::LCG<16> random;
+        random.init(ix+frameSize.x*iy,0);
+        const float sx = (ix+random())/frameSize.x;
+        const float sy = (iy+random())/frameSize.y;
+        const auto &cam = renderer.launchParams.camera;
+        const vec3f dir = normalize(cam.direction
+                                    + (sx-.5f)*cam.horizontal
+                                    + (sy-.5f)*cam.vertical);
+        const vec3f org = cam.position;
+
+        float t = INFINITY;
+        int hitQuad = -1;
+        bool ambiguous = false;
+        for (int quadID=0;quadID<2;quadID++) {
+          const int hit = quads[quadID].hit(org,dir,eps,t);
+          if (hit == 0)  ambiguous = true;
+          if (hit == 1)  hitQuad = quadID;
+        }
+        if (ambiguous)
+          continue;
+
+        // what the device programs compute: an ambient term, plus
+        // power*diffuse*(N.L)/dist^2 from the light - unless the way
+        // to it is blocked
+        vec3f expectedColor(1.f), expectedNormal(0.f), expectedAlbedo(0.f);
+        int kind = 0;
+        if (hitQuad >= 0) {
+          const vec3f diffuse = quads[hitQuad].diffuse;
+          const vec3f P       = org+t*dir;
+          const vec3f toLight = lightCenter-P;
+          const float dist    = length(toLight);
+          const float NdotL   = toLight.z/dist;
+          kind = hitQuad == 1 ? 3 : 1;
+          if (hitQuad == 0) {
+            float shadowT = INFINITY;
+            const int blocked = occluder.hit(P,toLight,eps,shadowT);
+            if (blocked == 0)
+              continue;
+            if (blocked == 1)
+              kind = 2;
+          }
+          expectedColor = (.1f+.2f*fabsf(dir.z))*diffuse;
+          if (kind != 2)
+            expectedColor += light.power*diffuse*(NdotL/(dist*dist));
+          expectedNormal = vec3f(0.f,0.f,1.f);
+          expectedAlbedo = diffuse;
+        }
+
+        const size_t pixelID = ix+iy*frameSize.x;
+        const vec3f color  = vec3f(renderer.colorBuffer[pixelID]);
+        const vec3f normal = vec3f(renderer.normalBuffer[pixelID]);
+        const vec3f albedo = vec3f(renderer.albedoBuffer[pixelID]);
+        if (length(color-expectedColor) > 1e-3f*length(expectedColor)
+            || length(normal-expectedNormal) > 1e-5f
+            || length(albedo-expectedAlbedo) > 1e-5f) {
+          static const char *kindName[4] = { "missed", "lit", "shadowed", "occluder" };
+          throw std::runtime_error("validateCPURenderer: "+std::string(kindName[kind])
+                                   +" pixel ("+std::to_string(ix)+","+std::to_string(iy)
+                                   +") is "+std::to_string(color.x)+","
+                                   +std::to_string(color.y)+","+std::to_string(color.z)
+                                   +", expected "+std::to_string(expectedColor.x)+","
+                                   +std::to_string(expectedColor.y)+","
+                                   +std::to_string(expectedColor.z));
+        }
+        numChecked[kind]++;
+      }
+    for (int kind=0;kind<4;kind++)
+      if (numChecked[kind] == 0)
+        throw std::runtime_error("validateCPURenderer: the test frame has no pixels"
+                                 " of some kind - check the test's camera");
+    std::cout << "cpu renderer matches the expected shading in "
+              << numChecked[0] << " missed, " << numChecked[1] << " lit, "
+              << numChecked[2] << " shadowed, and " << numChecked[3]
+              << " occluder pixels" << std::endl;
+  }
+
+} // ::osc
@@ -52,15 +52,13 @@ namespace osc {
 
   /*! constructor - performs all setup, including initializing
     optix, creates module, pipeline, programs, SBT, etc. */
-  SampleRenderer::SampleRenderer(const Model *model, const QuadLight &light)
+  SampleRenderer::SampleRenderer(const Model *model,
+                                 const std::vector<QuadLight> &lights)
     : model(model)
   {
     initOptix();
 
-    launchParams.light.origin = light.origin;
-    launchParams.light.du     = light.du;
-    launchParams.light.dv     = light.dv;
-    launchParams.light.power  = light.power;
+    uploadLights(lights);
 
     std::cout << "#osc: creating optix context ..." << std::endl;
     createContext();
@@ -94,6 +92,24 @@ namespace osc {
     std::cout << GDT_TERMINAL_DEFAULT;
   }
 
+  void SampleRenderer::uploadLights(const std::vector<QuadLight> &lights)
+  {
+    std::vector<QuadLightData> lightData(lights.size());
+    for (size_t lightID=0;lightID<lights.size();lightID++) {
+      lightData[lightID].origin = lights[lightID].origin;
+      lightData[lightID].du     = lights[lightID].du;
+      lightData[lightID].dv     = lights[lightID].dv;
+      lightData[lightID].power  = lights[lightID].power;
+    }
+    lightsBuffer.free();
+    launchParams.lights.quads = nullptr;
+    launchParams.lights.count = (int)lights.size();
+    if (!lightData.empty()) {
+      lightsBuffer.alloc_and_upload(lightData);
+      launchParams.lights.quads = (QuadLightData*)lightsBuffer.d_pointer();
+    }
+  }
+
   void SampleRenderer::createTextures()
   {
     int numTextures = (int)model->textures.size();
@@ -101,111 +117,98 @@ namespace osc {
     textureArrays.resize(numTextures);
     textureObjects.resize(numTextures);
     
-    for (int textureID=0;textureID<numTextures;textureID++) {
-      auto texture = model->textures[textureID];
-      
-      cudaResourceDesc res_desc = {};
-      
-      cudaChannelFormatDesc channel_desc;
-      int32_t width  = texture->resolution.x;
-      int32_t height = texture->resolution.y;
-      int32_t numComponents = 4;
-      int32_t pitch  = width*numComponents*sizeof(uint8_t);
-      channel_desc = cudaCreateChannelDesc<uchar4>();
-      
-      cudaArray_t   &pixelArray = textureArrays[textureID];
-      CUDA_CHECK(MallocArray(&pixelArray,
-                             &channel_desc,
-                             width,height));
-      
-      CUDA_CHECK(Memcpy2DToArray(pixelArray,
+    for (int textureID=0;textureID<numTextures;textureID++)
+      createTexture(textureID);
+  }
+
+  void SampleRenderer::createTexture(int textureID)
+  {
+    auto texture = model->textures[textureID];
+    
+    cudaResourceDesc res_desc = {};
+    
+    cudaChannelFormatDesc channel_desc;
+    int32_t width  = texture->resolution.x;
+    int32_t height = texture->resolution.y;
+    int32_t numComponents = 4;
+    channel_desc = cudaCreateChannelDesc<uchar4>();
+    
+    cudaMipmappedArray_t &pixelArray = textureArrays[textureID];
+    CUDA_CHECK(MallocMipmappedArray(&pixelArray,
+                                    &channel_desc,
+                                    make_cudaExtent(width,height,0),
+                                    texture->numLevels));
+
+    for (int level=0;level<texture->numLevels;level++) {
+      const vec2i levelRes = texture->levelResolution(level);
+      int32_t pitch = levelRes.x*numComponents*sizeof(uint8_t);
+      cudaArray_t levelArray;
+      CUDA_CHECK(GetMipmappedArrayLevel(&levelArray,pixelArray,level));
+      CUDA_CHECK(Memcpy2DToArray(levelArray,
                                  /* offset */0,0,
-                                 texture->pixel,
-                                 pitch,pitch,height,
+                                 texture->levelPixels(level),
+                                 pitch,pitch,levelRes.y,
                                  cudaMemcpyHostToDevice));
-      
-      res_desc.resType          = cudaResourceTypeArray;
-      res_desc.res.array.array  = pixelArray;
-      
-      cudaTextureDesc tex_desc     = {};
-      tex_desc.addressMode[0]      = cudaAddressModeWrap;
-      tex_desc.addressMode[1]      = cudaAddressModeWrap;
-      tex_desc.filterMode          = cudaFilterModeLinear;
-      tex_desc.readMode            = cudaReadModeNormalizedFloat;
-      tex_desc.normalizedCoords    = 1;
-      tex_desc.maxAnisotropy       = 1;
-      tex_desc.maxMipmapLevelClamp = 99;
-      tex_desc.minMipmapLevelClamp = 0;
-      tex_desc.mipmapFilterMode    = cudaFilterModePoint;
-      tex_desc.borderColor[0]      = 1.0f;
-      tex_desc.sRGB                = 0;
-      
-      // Create texture object
-      cudaTextureObject_t cuda_tex = 0;
-      CUDA_CHECK(CreateTextureObject(&cuda_tex, &res_desc, &tex_desc, nullptr));
-      textureObjects[textureID] = cuda_tex;
     }
+    
+    res_desc.resType           = cudaResourceTypeMipmappedArray;
+    res_desc.res.mipmap.mipmap = pixelArray;
+    
+    cudaTextureDesc tex_desc     = {};
+    tex_desc.addressMode[0]      = cudaAddressModeWrap;
+    tex_desc.addressMode[1]      = cudaAddressModeWrap;
+    tex_desc.filterMode          = cudaFilterModeLinear;
+    tex_desc.readMode            = cudaReadModeNormalizedFloat;
+    tex_desc.normalizedCoords    = 1;
+    tex_desc.maxAnisotropy       = 1;
+    tex_desc.maxMipmapLevelClamp = float(texture->numLevels-1);
+    tex_desc.minMipmapLevelClamp = 0;
+    tex_desc.mipmapFilterMode    = cudaFilterModeLinear;
+    tex_desc.borderColor[0]      = 1.0f;
+    tex_desc.sRGB                = 0;
+    
+    // Create texture object
+    cudaTextureObject_t cuda_tex = 0;
+    CUDA_CHECK(CreateTextureObject(&cuda_tex, &res_desc, &tex_desc, nullptr));
+    textureObjects[textureID] = cuda_tex;
+  }
+
+  void SampleRenderer::freeTexture(int textureID)
+  {
+    CUDA_CHECK(DestroyTextureObject(textureObjects[textureID]));
+    CUDA_CHECK(FreeMipmappedArray(textureArrays[textureID]));
+    textureObjects[textureID] = 0;
+    textureArrays[textureID]  = nullptr;
   }
   
-  OptixTraversableHandle SampleRenderer::buildAccel()
+  /*! device address of given mesh array: inside the (already
+      uploaded) arena if the model is packed, or else in a buffer of
+      its own */
+  template<typename T>
+  static CUdeviceptr uploadMeshArray(const MeshArray<T> &array,
+                                     CUDABuffer &ownBuffer,
+                                     bool packed,
+                                     const MeshArray<T> &arena,
+                                     const CUDABuffer &arenaBuffer)
+  {
+    if (array.empty())
+      return 0;
+    if (packed)
+      return arenaBuffer.d_pointer() + (array.data()-arena.data())*sizeof(T);
+    ownBuffer.alloc_and_upload(array.data(),array.size());
+    return ownBuffer.d_pointer();
+  }
+  
+  /*! build an acceleration structure over the given build inputs,
+      and compact it into 'asBuffer' */
+  OptixTraversableHandle SampleRenderer::buildAndCompact(const OptixBuildInput *inputs,
+                                                         int numInputs,
+                                                         CUDABuffer &asBuffer)
   {
-    const int numMeshes = (int)model->meshes.size();
-    vertexBuffer.resize(numMeshes);
-    normalBuffer.resize(numMeshes);
-    texcoordBuffer.resize(numMeshes);
-    indexBuffer.resize(numMeshes);
-    
     OptixTraversableHandle asHandle { 0 };
     
     // ==================================================================
-    // triangle inputs
-    // ==================================================================
-    std::vector<OptixBuildInput> triangleInput(numMeshes);
-    std::vector<CUdeviceptr> d_vertices(numMeshes);
-    std::vector<CUdeviceptr> d_indices(numMeshes);
-    std::vector<uint32_t> triangleInputFlags(numMeshes);
-
-    for (int meshID=0;meshID<numMeshes;meshID++) {
-      // upload the model to the device: the builder
-      TriangleMesh &mesh = *model->meshes[meshID];
-      vertexBuffer[meshID].alloc_and_upload(mesh.vertex);
-      indexBuffer[meshID].alloc_and_upload(mesh.index);
-      if (!mesh.normal.empty())
-        normalBuffer[meshID].alloc_and_upload(mesh.normal);
-      if (!mesh.texcoord.empty())
-        texcoordBuffer[meshID].alloc_and_upload(mesh.texcoord);
-
-      triangleInput[meshID] = {};
-      triangleInput[meshID].type
-        = OPTIX_BUILD_INPUT_TYPE_TRIANGLES;
-
-      // create local variables, because we need a *pointer* to the
-      // device pointers
-      d_vertices[meshID] = vertexBuffer[meshID].d_pointer();
-      d_indices[meshID]  = indexBuffer[meshID].d_pointer();
-      
-      triangleInput[meshID].triangleArray.vertexFormat        = OPTIX_VERTEX_FORMAT_FLOAT3;
-      triangleInput[meshID].triangleArray.vertexStrideInBytes = sizeof(vec3f);
-      triangleInput[meshID].triangleArray.numVertices         = (int)mesh.vertex.size();
-      triangleInput[meshID].triangleArray.vertexBuffers       = &d_vertices[meshID];
-    
-      triangleInput[meshID].triangleArray.indexFormat         = OPTIX_INDICES_FORMAT_UNSIGNED_INT3;
-      triangleInput[meshID].triangleArray.indexStrideInBytes  = sizeof(vec3i);
-      triangleInput[meshID].triangleArray.numIndexTriplets    = (int)mesh.index.size();
-      triangleInput[meshID].triangleArray.indexBuffer         = d_indices[meshID];
-    
-      triangleInputFlags[meshID] = 0 ;
-    
-      // in this example we have one SBT entry, and no per-primitive
-      // materials:
-      triangleInput[meshID].triangleArray.flags               = &triangleInputFlags[meshID];
-      triangleInput[meshID].triangleArray.numSbtRecords               = 1;
-      triangleInput[meshID].triangleArray.sbtIndexOffsetBuffer        = 0; 
-      triangleInput[meshID].triangleArray.sbtIndexOffsetSizeInBytes   = 0; 
-      triangleInput[meshID].triangleArray.sbtIndexOffsetStrideInBytes = 0; 
-    }
-    // ==================================================================
-    // BLAS setup
+    // accel setup
     // ==================================================================
     
     OptixAccelBuildOptions accelOptions = {};
@@ -219,8 +222,8 @@ namespace osc {
     OPTIX_CHECK(optixAccelComputeMemoryUsage
                 (optixContext,
                  &accelOptions,
-                 triangleInput.data(),
-                 (int)numMeshes,  // num_build_inputs
+                 inputs,
+                 numInputs,  // num_build_inputs
                  &blasBufferSizes
                  ));
     
@@ -248,8 +251,8 @@ namespace osc {
     OPTIX_CHECK(optixAccelBuild(optixContext,
                                 /* stream */0,
                                 &accelOptions,
-                                triangleInput.data(),
-                                (int)numMeshes,
+                                inputs,
+                                numInputs,
                                 tempBuffer.d_pointer(),
                                 tempBuffer.sizeInBytes,
                                 
@@ -283,9 +286,304 @@ namespace osc {
     outputBuffer.free(); // << the UNcompacted, temporary output buffer
     tempBuffer.free();
     compactedSizeBuffer.free();
+    return asHandle;
+  }
+  
+  void SampleRenderer::uploadMesh(int meshID, bool packed)
+  {
+    const TriangleMesh &mesh = *model->meshes[meshID];
+    if (!mesh.compactVertex.empty()) {
+      vertexBuffer[meshID].alloc_and_upload(mesh.compactVertex);
+      meshVertex[meshID] = vertexBuffer[meshID].d_pointer();
+    } else
+      meshVertex[meshID]
+        = uploadMeshArray(mesh.vertex,vertexBuffer[meshID],
+                          packed,model->vertexArena,vertexArenaBuffer);
+    meshIndex[meshID]
+      = uploadMeshArray(mesh.index,indexBuffer[meshID],
+                        packed,model->indexArena,indexArenaBuffer);
+    if (!mesh.compactNormal.empty()) {
+      normalBuffer[meshID].alloc_and_upload(mesh.compactNormal);
+      meshNormal[meshID] = normalBuffer[meshID].d_pointer();
+    } else
+      meshNormal[meshID]
+        = uploadMeshArray(mesh.normal,normalBuffer[meshID],
+                          packed,model->normalArena,normalArenaBuffer);
+    if (!mesh.compactTexcoord.empty()) {
+      texcoordBuffer[meshID].alloc_and_upload(mesh.compactTexcoord);
+      meshTexcoord[meshID] = texcoordBuffer[meshID].d_pointer();
+    } else
+      meshTexcoord[meshID]
+        = uploadMeshArray(mesh.texcoord,texcoordBuffer[meshID],
+                          packed,model->texcoordArena,texcoordArenaBuffer);
+  }
+
+  void SampleRenderer::freeMesh(int meshID)
+  {
+    vertexBuffer[meshID].free();
+    normalBuffer[meshID].free();
+    texcoordBuffer[meshID].free();
+    indexBuffer[meshID].free();
+  }
+
+  void SampleRenderer::meshBuildInput(int meshID,
+                                      OptixBuildInput &triangleInput,
+                                      CUdeviceptr &d_vertices,
+                                      uint32_t &triangleInputFlags,
+                                      CUDABuffer &decodedVertices)
+  {
+    const TriangleMesh &mesh = *model->meshes[meshID];
+    d_vertices = meshVertex[meshID];
+    if (!mesh.compactVertex.empty()) {
+      // the builder wants floats: decode the quantized positions,
+      // just for the build
+      std::vector<vec3f> decoded(mesh.compactVertex.size());
+      for (size_t i=0;i<decoded.size();i++)
+        decoded[i] = mesh.vertexQuantizer.decode(mesh.compactVertex[i]);
+      decodedVertices.alloc_and_upload(decoded);
+      d_vertices = decodedVertices.d_pointer();
+    }
+
+    triangleInput = {};
+    triangleInput.type
+      = OPTIX_BUILD_INPUT_TYPE_TRIANGLES;
+
+    triangleInput.triangleArray.vertexFormat        = OPTIX_VERTEX_FORMAT_FLOAT3;
+    triangleInput.triangleArray.vertexStrideInBytes = sizeof(vec3f);
+    triangleInput.triangleArray.numVertices
+      = (int)std::max(mesh.vertex.size(),mesh.compactVertex.size());
+    triangleInput.triangleArray.vertexBuffers       = &d_vertices;
+    
+    triangleInput.triangleArray.indexFormat         = OPTIX_INDICES_FORMAT_UNSIGNED_INT3;
+    triangleInput.triangleArray.indexStrideInBytes  = sizeof(vec3i);
+    triangleInput.triangleArray.numIndexTriplets    = (int)mesh.index.size();
+    triangleInput.triangleArray.indexBuffer         = meshIndex[meshID];
+    
+    triangleInputFlags = 0 ;
+    
+    // in this example we have one SBT entry, and no per-primitive
+    // materials:
+    triangleInput.triangleArray.flags               = &triangleInputFlags;
+    triangleInput.triangleArray.numSbtRecords               = 1;
+    triangleInput.triangleArray.sbtIndexOffsetBuffer        = 0; 
+    triangleInput.triangleArray.sbtIndexOffsetSizeInBytes   = 0; 
+    triangleInput.triangleArray.sbtIndexOffsetStrideInBytes = 0; 
+  }
+
+  OptixTraversableHandle SampleRenderer::buildMeshesAccel(const std::vector<int> &meshIDs,
+                                                          CUDABuffer &asBuffer)
+  {
+    const size_t numInputs = meshIDs.size();
+    std::vector<OptixBuildInput> triangleInput(numInputs);
+    // the build inputs take *pointers* to the device pointers
+    std::vector<CUdeviceptr> d_vertices(numInputs);
+    std::vector<uint32_t> triangleInputFlags(numInputs);
+    std::vector<CUDABuffer> decodedVertices(numInputs);
+    for (size_t i=0;i<numInputs;i++)
+      meshBuildInput(meshIDs[i],triangleInput[i],d_vertices[i],
+                     triangleInputFlags[i],decodedVertices[i]);
     
+    OptixTraversableHandle asHandle
+      = buildAndCompact(triangleInput.data(),(int)numInputs,asBuffer);
+    for (auto &buffer : decodedVertices)
+      buffer.free();
     return asHandle;
   }
+
+  OptixTraversableHandle SampleRenderer::buildInstanceAccel()
+  {
+    // a model without instances is one identity instance of the
+    // accel over all its meshes (in meshAS[0], with SBT offset 0)
+    const std::vector<MeshInstance> identity(1,MeshInstance{0,affine3f(one)});
+    const std::vector<MeshInstance> &modelInstances
+      = model->instances.empty() ? identity : model->instances;
+    const int numInstances = (int)modelInstances.size();
+    std::vector<OptixInstance> instances(numInstances);
+    for (int instanceID=0;instanceID<numInstances;instanceID++) {
+      const MeshInstance &instance = modelInstances[instanceID];
+      const affine3f &xfm = instance.xfm;
+      OptixInstance &oi = instances[instanceID];
+      oi = {};
+      // (row-major 3x4)
+      const float transform[12] = {
+        xfm.l.vx.x, xfm.l.vy.x, xfm.l.vz.x, xfm.p.x,
+        xfm.l.vx.y, xfm.l.vy.y, xfm.l.vz.y, xfm.p.y,
+        xfm.l.vx.z, xfm.l.vy.z, xfm.l.vz.z, xfm.p.z
+      };
+      memcpy(oi.transform,transform,sizeof(transform));
+      oi.instanceId        = instanceID;
+      // each mesh has one SBT record per ray type
+      oi.sbtOffset         = instance.meshID*RAY_TYPE_COUNT;
+      oi.visibilityMask    = 255;
+      oi.flags             = OPTIX_INSTANCE_FLAG_NONE;
+      oi.traversableHandle = meshAS[instance.meshID];
+    }
+    instanceBuffer.free();
+    instanceBuffer.alloc_and_upload(instances);
+
+    OptixBuildInput instanceInput = {};
+    instanceInput.type                       = OPTIX_BUILD_INPUT_TYPE_INSTANCES;
+    instanceInput.instanceArray.instances    = instanceBuffer.d_pointer();
+    instanceInput.instanceArray.numInstances = numInstances;
+    return buildAndCompact(&instanceInput,1,asBuffer);
+  }
+  
+  OptixTraversableHandle SampleRenderer::buildAccel()
+  {
+    const double startTime = getCurrentTime();
+    const int numMeshes = (int)model->meshes.size();
+    vertexBuffer.resize(numMeshes);
+    normalBuffer.resize(numMeshes);
+    texcoordBuffer.resize(numMeshes);
+    indexBuffer.resize(numMeshes);
+    meshVertex.resize(numMeshes);
+    meshNormal.resize(numMeshes);
+    meshTexcoord.resize(numMeshes);
+    meshIndex.resize(numMeshes);
+
+    const bool packed = isPacked(model);
+    if (packed) {
+      if (!model->vertexArena.empty())
+        vertexArenaBuffer.alloc_and_upload(model->vertexArena.data(),
+                                           model->vertexArena.size());
+      if (!model->normalArena.empty())
+        normalArenaBuffer.alloc_and_upload(model->normalArena.data(),
+                                           model->normalArena.size());
+      if (!model->texcoordArena.empty())
+        texcoordArenaBuffer.alloc_and_upload(model->texcoordArena.data(),
+                                             model->texcoordArena.size());
+      if (!model->indexArena.empty())
+        indexArenaBuffer.alloc_and_upload(model->indexArena.data(),
+                                          model->indexArena.size());
+    }
+    
+    // upload the model to the device
+    for (int meshID=0;meshID<numMeshes;meshID++)
+      uploadMesh(meshID,packed);
+
+    // the pipeline always traces through one level of instances, so
+    // that a reloaded model may or may not be instanced
+    if (model->instances.empty()) {
+      // all meshes in a single accel
+      std::vector<int> allMeshes(numMeshes);
+      for (int meshID=0;meshID<numMeshes;meshID++)
+        allMeshes[meshID] = meshID;
+      meshASBuffer.resize(1);
+      meshAS.resize(1);
+      meshAS[0] = buildMeshesAccel(allMeshes,meshASBuffer[0]);
+    } else {
+      // one accel per mesh
+      meshASBuffer.resize(numMeshes);
+      meshAS.resize(numMeshes);
+      for (int meshID=0;meshID<numMeshes;meshID++)
+        meshAS[meshID] = buildMeshesAccel(std::vector<int>(1,meshID),
+                                          meshASBuffer[meshID]);
+    }
+    // ... and one over all instances of those
+    OptixTraversableHandle asHandle = buildInstanceAccel();
+
+    std::cout << "#osc: built accel over " << numMeshes << " meshes";
+    if (!model->instances.empty())
+      std::cout << " (" << model->instances.size() << " instances)";
+    std::cout << " in " << (getCurrentTime()-startTime) << "s" << std::endl;
+    return asHandle;
+  }
+
+  void SampleRenderer::setModel(const Model *model,
+                                const std::vector<QuadLight> &lights)
+  {
+    // (whatever still renders may be using what is about to go)
+    CUDA_SYNC_CHECK();
+    for (int textureID=0;textureID<(int)textureObjects.size();textureID++)
+      freeTexture(textureID);
+    textureObjects.clear();
+    textureArrays.clear();
+    for (int meshID=0;meshID<(int)vertexBuffer.size();meshID++)
+      freeMesh(meshID);
+    vertexArenaBuffer.free();
+    normalArenaBuffer.free();
+    texcoordArenaBuffer.free();
+    indexArenaBuffer.free();
+    for (auto &buffer : meshASBuffer)
+      buffer.free();
+    meshASBuffer.clear();
+    meshAS.clear();
+    instanceBuffer.free();
+    asBuffer.free();
+    hitgroupRecordsBuffer.free();
+
+    this->model = model;
+    uploadLights(lights);
+    launchParams.traversable = buildAccel();
+    createTextures();
+    buildHitgroupRecords();
+    // restart accumulation
+    launchParams.frame.frameID = 0;
+  }
+
+  void SampleRenderer::updateModel(const std::vector<int> &meshIDs,
+                                   const std::vector<int> &textureIDs)
+  {
+    if (meshIDs.empty() && textureIDs.empty())
+      return;
+    const double startTime = getCurrentTime();
+    // (whatever still renders may be using what is about to go)
+    CUDA_SYNC_CHECK();
+    for (int textureID : textureIDs) {
+      freeTexture(textureID);
+      createTexture(textureID);
+    }
+    for (int meshID : meshIDs) {
+      // replaced meshes are not in the (uploaded) arenas any more
+      freeMesh(meshID);
+      uploadMesh(meshID,/*packed:*/false);
+    }
+
+    if (!meshIDs.empty()) {
+      asBuffer.free();
+      if (model->instances.empty()) {
+        // all meshes are in that one accel
+        std::vector<int> allMeshes(model->meshes.size());
+        for (int meshID=0;meshID<(int)allMeshes.size();meshID++)
+          allMeshes[meshID] = meshID;
+        meshASBuffer[0].free();
+        meshAS[0] = buildMeshesAccel(allMeshes,meshASBuffer[0]);
+      } else {
+        // just the replaced meshes' accels
+        for (int meshID : meshIDs) {
+          meshASBuffer[meshID].free();
+          meshAS[meshID] = buildMeshesAccel(std::vector<int>(1,meshID),
+                                            meshASBuffer[meshID]);
+        }
+      }
+      // either way the instances now have different handles
+      launchParams.traversable = buildInstanceAccel();
+    }
+
+    // the SBT records point to the replaced meshes' buffers, and
+    // the replaced textures
+    hitgroupRecordsBuffer.free();
+    buildHitgroupRecords();
+    // restart accumulation
+    launchParams.frame.frameID = 0;
+    std::cout << "#osc: updated " << meshIDs.size() << " meshes and "
+              << textureIDs.size() << " textures on the device (in "
+              << (getCurrentTime()-startTime) << "s)" << std::endl;
+  }
+  
+  void SampleRenderer::updateInstances(const std::vector<QuadLight> &lights)
+  {
+    const double startTime = getCurrentTime();
+    // (whatever still renders may be using what is about to go)
+    CUDA_SYNC_CHECK();
+    uploadLights(lights);
+    asBuffer.free();
+    launchParams.traversable = buildInstanceAccel();
+    // restart accumulation
+    launchParams.frame.frameID = 0;
+    std::cout << "#osc: rebuilt the accel over " << model->instances.size()
+              << " instances (in " << (getCurrentTime()-startTime) << "s)" << std::endl;
+  }
   
   /*! helper function that initializes optix and checks for errors */
   void SampleRenderer::initOptix()
@@ -352,7 +650,10 @@ namespace osc {
     moduleCompileOptions.debugLevel        = OPTIX_COMPILE_DEBUG_LEVEL_NONE;
 
     pipelineCompileOptions = {};
-    pipelineCompileOptions.traversableGraphFlags = OPTIX_TRAVERSABLE_GRAPH_FLAG_ALLOW_SINGLE_GAS;
+    // (even models without instances get one, see buildAccel(): the
+    // model - and whether it is instanced - can change on reload)
+    pipelineCompileOptions.traversableGraphFlags
+      = OPTIX_TRAVERSABLE_GRAPH_FLAG_ALLOW_SINGLE_LEVEL_INSTANCING;
     pipelineCompileOptions.usesMotionBlur     = false;
     pipelineCompileOptions.numPayloadValues   = 2;
     pipelineCompileOptions.numAttributeValues = 2;
@@ -545,7 +846,7 @@ namespace osc {
                  2*1024,
                  /* [in] The maximum depth of a traversable graph
                     passed to trace. */
-                 1));
+                 2));
     if (sizeof_log > 1) PRINT(log);
   }
 
@@ -581,9 +882,11 @@ namespace osc {
     sbt.missRecordStrideInBytes = sizeof(MissRecord);
     sbt.missRecordCount         = (int)missRecords.size();
 
-    // ------------------------------------------------------------------
-    // build hitgroup records
-    // ------------------------------------------------------------------
+    buildHitgroupRecords();
+  }
+
+  void SampleRenderer::buildHitgroupRecords()
+  {
     int numObjects = (int)model->meshes.size();
     std::vector<HitgroupRecord> hitgroupRecords;
     for (int meshID=0;meshID<numObjects;meshID++) {
@@ -594,15 +897,34 @@ namespace osc {
         OPTIX_CHECK(optixSbtRecordPackHeader(hitgroupPGs[rayID],&rec));
         rec.data.color   = mesh->diffuse;
         if (mesh->diffuseTextureID >= 0 && mesh->diffuseTextureID < textureObjects.size()) {
-          rec.data.hasTexture = true;
-          rec.data.texture    = textureObjects[mesh->diffuseTextureID];
+          rec.data.hasTexture  = true;
+          rec.data.texture     = textureObjects[mesh->diffuseTextureID];
+          rec.data.textureSize
+            = model->textures[mesh->diffuseTextureID]->resolution;
         } else {
           rec.data.hasTexture = false;
         }
-        rec.data.index    = (vec3i*)indexBuffer[meshID].d_pointer();
-        rec.data.vertex   = (vec3f*)vertexBuffer[meshID].d_pointer();
-        rec.data.normal   = (vec3f*)normalBuffer[meshID].d_pointer();
-        rec.data.texcoord = (vec2f*)texcoordBuffer[meshID].d_pointer();
+        rec.data.index    = (vec3i*)meshIndex[meshID];
+        rec.data.vertex   = (vec3f*)meshVertex[meshID];
+        rec.data.normal   = (vec3f*)meshNormal[meshID];
+        rec.data.texcoord = (vec2f*)meshTexcoord[meshID];
+        rec.data.compactVertex   = nullptr;
+        rec.data.compactNormal   = nullptr;
+        rec.data.compactTexcoord = nullptr;
+        rec.data.vertexQuantizer = mesh->vertexQuantizer;
+        rec.data.halfTexcoords   = mesh->halfTexcoords;
+        if (!mesh->compactVertex.empty()) {
+          rec.data.compactVertex = (vec3us*)meshVertex[meshID];
+          rec.data.vertex        = nullptr;
+        }
+        if (!mesh->compactNormal.empty()) {
+          rec.data.compactNormal = (octNormal16*)meshNormal[meshID];
+          rec.data.normal        = nullptr;
+        }
+        if (!mesh->compactTexcoord.empty()) {
+          rec.data.compactTexcoord = (texcoord16*)meshTexcoord[meshID];
+          rec.data.texcoord        = nullptr;
+        }
         hitgroupRecords.push_back(rec);
       }
     }
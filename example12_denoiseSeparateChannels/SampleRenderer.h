@@ -24,15 +24,6 @@
 /*! \namespace osc - Optix Siggraph Course */
 namespace osc {
 
-  struct Camera {
-    /*! camera position - *from* where we are looking */
-    vec3f from;
-    /*! which point we are looking *at* */
-    vec3f at;
-    /*! general up-vector */
-    vec3f up;
-  };
-  
   /*! a sample OptiX-7 renderer that demonstrates how to set up
       context, module, programs, pipeline, SBT, etc, and perform a
       valid launch that renders some pixel (using a simple test
@@ -45,7 +36,7 @@ namespace osc {
   public:
     /*! constructor - performs all setup, including initializing
       optix, creates module, pipeline, programs, SBT, etc. */
-    SampleRenderer(const Model *model, const QuadLight &light);
+    SampleRenderer(const Model *model, const std::vector<QuadLight> &lights);
 
     /*! render one frame */
     void render();
@@ -59,6 +50,24 @@ namespace osc {
     /*! set camera to render with */
     void setCamera(const Camera &camera);
 
+    /*! switch to rendering given model, with given lights -
+        everything that depends on the model gets built anew */
+    void setModel(const Model *model, const std::vector<QuadLight> &lights);
+
+    /*! bring the device's copy of the model up to date after the
+        given meshes and textures got replaced (under the same IDs,
+        with all else staying as it was - see reloadSceneFile()):
+        only those get uploaded anew, and only the accels containing
+        any of the meshes get rebuilt */
+    void updateModel(const std::vector<int> &meshIDs,
+                     const std::vector<int> &textureIDs);
+
+    /*! bring the device's copy of the model up to date after just
+        its instances changed (see SceneChanges::instances), and
+        switch to given lights: only the accel over the instances gets
+        rebuilt */
+    void updateInstances(const std::vector<QuadLight> &lights);
+
     
     bool denoiserOn = true;
     bool accumulate = true;
@@ -99,12 +108,58 @@ namespace osc {
     /*! constructs the shader binding table */
     void buildSBT();
 
-    /*! build an acceleration structure for the given triangle mesh */
+    /*! (re-)build the SBT's hitgroup records: one per mesh and ray
+        type */
+    void buildHitgroupRecords();
+
+    /*! upload the lights, and point the launch params to them */
+    void uploadLights(const std::vector<QuadLight> &lights);
+
+    /*! upload all of the model's meshes, and build the acceleration
+        structure(s) over them */
     OptixTraversableHandle buildAccel();
 
+    /*! upload given mesh's arrays - unless the model is 'packed',
+        and they already are, in the arenas - and remember where they
+        are */
+    void uploadMesh(int meshID, bool packed);
+
+    /*! free whatever buffers of its own the given mesh has */
+    void freeMesh(int meshID);
+
+    /*! the build input for given (uploaded) mesh. The builder wants
+        float positions, so compact ones get decoded into
+        'decodedVertices' for the build */
+    void meshBuildInput(int meshID,
+                        OptixBuildInput &triangleInput,
+                        CUdeviceptr &d_vertices,
+                        uint32_t &triangleInputFlags,
+                        CUDABuffer &decodedVertices);
+
+    /*! build an acceleration structure over the given meshes into
+        'asBuffer' */
+    OptixTraversableHandle buildMeshesAccel(const std::vector<int> &meshIDs,
+                                            CUDABuffer &asBuffer);
+
+    /*! build the acceleration structure over all of the model's
+        instances (of the meshes' own accels) into asBuffer - or over
+        one identity instance of meshAS[0] if the model has none */
+    OptixTraversableHandle buildInstanceAccel();
+
+    /*! build an acceleration structure over the given build inputs,
+        and compact it into 'asBuffer' */
+    OptixTraversableHandle buildAndCompact(const OptixBuildInput *inputs,
+                                           int numInputs,
+                                           CUDABuffer &asBuffer);
+
     /*! upload textures, and create cuda texture objects for them */
     void createTextures();
 
+    /*! @{ upload (or free) a single texture, and its texture object */
+    void createTexture(int textureID);
+    void freeTexture(int textureID);
+    /*! @} */
+
   protected:
     /*! @{ CUDA device context and stream that optix pipeline will run
         on, as well as device properties for this device */
@@ -145,6 +200,9 @@ namespace osc {
     CUDABuffer   launchParamsBuffer;
     /*! @} */
 
+    /*! the lights launchParams.lights points to */
+    CUDABuffer lightsBuffer;
+
     /*! the color buffer we use during _rendering_, which is a bit
         larger than the actual displayed frame buffer (to account for
         the border), and in float4 format (the denoiser requires
@@ -170,19 +228,45 @@ namespace osc {
     /*! the model we are going to trace rays against */
     const Model *model;
     
-    /*! @{ one buffer per input mesh */
+    /*! @{ one buffer per input mesh (for whatever is not in the
+        arenas below) */
     std::vector<CUDABuffer> vertexBuffer;
     std::vector<CUDABuffer> normalBuffer;
     std::vector<CUDABuffer> texcoordBuffer;
     std::vector<CUDABuffer> indexBuffer;
     /*! @} */
+
+    /*! @{ if the model is packed (see packMeshes()): its arenas, each
+        uploaded in one go */
+    CUDABuffer vertexArenaBuffer;
+    CUDABuffer normalArenaBuffer;
+    CUDABuffer texcoordArenaBuffer;
+    CUDABuffer indexArenaBuffer;
+    /*! @} */
+
+    /*! @{ device addresses of each mesh's arrays, in whichever of the
+        buffers above they ended up */
+    std::vector<CUdeviceptr> meshVertex;
+    std::vector<CUdeviceptr> meshNormal;
+    std::vector<CUdeviceptr> meshTexcoord;
+    std::vector<CUdeviceptr> meshIndex;
+    /*! @} */
     
     //! buffer that keeps the (final, compacted) accel structure
     CUDABuffer asBuffer;
 
-    /*! @{ one texture object and pixel array per used texture */
-    std::vector<cudaArray_t>         textureArrays;
-    std::vector<cudaTextureObject_t> textureObjects;
+    /*! @{ one accel per mesh (or, if the model is not instanced,
+        just one over all meshes), and the instances that asBuffer's
+        accel is built over */
+    std::vector<CUDABuffer>             meshASBuffer;
+    std::vector<OptixTraversableHandle> meshAS;
+    CUDABuffer                          instanceBuffer;
+    /*! @} */
+
+    /*! @{ one texture object and (mip-mapped) pixel array per used
+        texture */
+    std::vector<cudaMipmappedArray_t> textureArrays;
+    std::vector<cudaTextureObject_t>  textureObjects;
     /*! @} */
   };
 
@@ -0,0 +1,696 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Scene.h"
+#include "JSON.h"
+#include "TextureMips.h"
+#include "gdt/parallel/parallel_for.h"
+//std
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! the scene file's value of given name as a vec3f; a single
+      number gets replicated to all three components */
+  static vec3f getVec3f(const JSONValue &object, const char *key,
+                        const vec3f &fallback)
+  {
+    const JSONValue *value = object.find(key);
+    if (!value)
+      return fallback;
+    if (value->isNumber())
+      return vec3f((float)value->number);
+    if (!value->isArray() || value->size() != 3)
+      throw std::runtime_error(std::string("scene file: '")+key
+                               +"' has to be a number or three numbers");
+    return vec3f((float)(*value)[0].number,
+                 (float)(*value)[1].number,
+                 (float)(*value)[2].number);
+  }
+
+  /*! given path, with '.' and 'dir/..' components removed, and
+      backslashes turned into slashes - so that different spellings
+      of the same file still name the same model */
+  static std::string normalizePath(const std::string &path)
+  {
+    std::vector<std::string> components;
+    size_t begin = 0;
+    while (begin <= path.size()) {
+      size_t end = path.find_first_of("/\\",begin);
+      if (end == std::string::npos) end = path.size();
+      const std::string component = path.substr(begin,end-begin);
+      if (component == "." || (component == "" && !components.empty()))
+        ;
+      else if (component == ".." && !components.empty()
+               && components.back() != ".." && components.back() != "")
+        components.pop_back();
+      else
+        components.push_back(component);
+      begin = end+1;
+    }
+    std::string normalized;
+    for (size_t i=0;i<components.size();i++)
+      normalized += (i ? "/" : "")+components[i];
+    return normalized;
+  }
+
+  static affine3f instanceTransform(const JSONValue &instance)
+  {
+    const JSONValue *matrix = instance.find("matrix");
+    if (matrix) {
+      if (!matrix->isArray() || matrix->size() != 16)
+        throw std::runtime_error("scene file: 'matrix' has to be 16 numbers");
+      float m[16];
+      for (int i=0;i<16;i++)
+        m[i] = (float)(*matrix)[i].number;
+      return affine3f(vec3f(m[0],m[1],m[2]),
+                      vec3f(m[4],m[5],m[6]),
+                      vec3f(m[8],m[9],m[10]),
+                      vec3f(m[12],m[13],m[14]));
+    }
+
+    affine3f xfm = affine3f::scale(getVec3f(instance,"scale",vec3f(1.f)));
+    const JSONValue *rotate = instance.find("rotate");
+    if (rotate) {
+      if (!rotate->isArray() || rotate->size() != 4)
+        throw std::runtime_error("scene file: 'rotate' has to be an axis and an angle");
+      const vec3f axis((float)(*rotate)[0].number,
+                       (float)(*rotate)[1].number,
+                       (float)(*rotate)[2].number);
+      const float degrees = (float)(*rotate)[3].number;
+      if (axis != vec3f(0.f))
+        xfm = affine3f::rotate(axis,degrees*float(M_PI/180.)) * xfm;
+    }
+    return affine3f::translate(getVec3f(instance,"translate",vec3f(0.f))) * xfm;
+  }
+  
+  /*! whether given file is a scene file (or else, a model file) */
+  static bool isSceneFile(const std::string &fileName)
+  {
+    return fileName.size() > 5
+      && fileName.compare(fileName.size()-5,5,".json") == 0;
+  }
+  
+  /*! read the scene file's models and instances (into scene->files),
+      lights, and cameras */
+  static void parseSceneFile(Scene *scene, const std::string &sceneFile)
+  {
+    std::ifstream in(sceneFile.c_str(),std::ios::binary);
+    if (!in)
+      throw std::runtime_error("could not open scene file "+sceneFile);
+    std::stringstream text;
+    text << in.rdbuf();
+    const std::string json = text.str();
+    const JSONValue root = parseJSON(json.data(),json.data()+json.size());
+    if (!root.isObject())
+      throw std::runtime_error("scene file "+sceneFile+" is not a JSON object");
+    
+    const size_t slash = sceneFile.find_last_of("/\\");
+    const std::string dir
+      = slash == std::string::npos ? "" : sceneFile.substr(0,slash+1);
+
+    // ------------------------------------------------------------------
+    // which files get placed where; files are identified by their
+    // (scene-relative) path, so two names for the same file still
+    // load it just once
+    // ------------------------------------------------------------------
+    std::map<std::string,std::string> fileOfName;
+    const JSONValue *models = root.find("models");
+    if (models) {
+      if (!models->isObject())
+        throw std::runtime_error("scene file: 'models' has to map names to files");
+      for (size_t i=0;i<models->size();i++) {
+        const JSONValue &file = (*models)[i];
+        if (!file.isString())
+          throw std::runtime_error("scene file: model '"+models->keys[i]
+                                   +"' has to be a file name");
+        fileOfName[models->keys[i]] = normalizePath(dir+file.string);
+      }
+    }
+
+    std::vector<SceneFile> &files = scene->files;
+    std::map<std::string,int> fileID;
+    auto place = [&](const std::string &file, const affine3f &xfm) {
+      auto known = fileID.find(file);
+      if (known == fileID.end()) {
+        known = fileID.insert(std::make_pair(file,(int)files.size())).first;
+        files.push_back(SceneFile());
+        files.back().fileName = file;
+      }
+      files[known->second].placements.push_back(xfm);
+    };
+    
+    const JSONValue *instances = root.find("instances");
+    if (instances) {
+      if (!instances->isArray())
+        throw std::runtime_error("scene file: 'instances' has to be an array");
+      for (size_t i=0;i<instances->size();i++) {
+        const JSONValue &instance = (*instances)[i];
+        const std::string name = instance.getString("model");
+        auto file = fileOfName.find(name);
+        if (file == fileOfName.end())
+          throw std::runtime_error("scene file: instance of unknown model '"+name+"'");
+        place(file->second,instanceTransform(instance));
+      }
+    } else
+      for (auto &file : fileOfName)
+        place(file.second,affine3f(one));
+    if (files.empty())
+      throw std::runtime_error("scene file "+sceneFile+" does not place any models");
+
+    // ------------------------------------------------------------------
+    // lights and cameras
+    // ------------------------------------------------------------------
+    const JSONValue *lights = root.find("lights");
+    if (lights)
+      for (size_t i=0;i<lights->size();i++) {
+        const JSONValue &light = (*lights)[i];
+        QuadLight quad;
+        quad.origin = getVec3f(light,"origin",vec3f(0.f));
+        quad.du     = getVec3f(light,"du",vec3f(0.f));
+        quad.dv     = getVec3f(light,"dv",vec3f(0.f));
+        quad.power  = getVec3f(light,"power",vec3f(0.f));
+        scene->lights.push_back(quad);
+      }
+    const JSONValue *cameras = root.find("cameras");
+    if (cameras)
+      for (size_t i=0;i<cameras->size();i++) {
+        const JSONValue &camera = (*cameras)[i];
+        NamedCamera named;
+        named.name          = camera.getString("name","camera"+std::to_string(i));
+        named.camera.from   = getVec3f(camera,"from",vec3f(0.f));
+        named.camera.at     = getVec3f(camera,"at",vec3f(0.f,0.f,-1.f));
+        named.camera.up     = getVec3f(camera,"up",vec3f(0.f,1.f,0.f));
+        scene->cameras.push_back(named);
+      }
+  }
+
+  /*! load (and prepare) one of the scene's model files, along with
+      the stamp of the file loaded. The texture budget is for all
+      files together, so it only gets applied once they are
+      combined */
+  static Model *loadSceneModel(const Scene *scene, const std::string &fileName,
+                               FileStamp &stamp)
+  {
+    TextureOptions perFileOptions = scene->textureOptions;
+    perFileOptions.memoryBudget = 0;
+    // (stamped before loading, so a change while loading still
+    // counts as one)
+    stamp = fileStamp(fileName);
+    std::unique_ptr<Model> model(loadModel(fileName,perFileOptions));
+    if (scene->prepare)
+      scene->prepare(model.get());
+    return model.release();
+  }
+
+  /*! whether the scene is just a single model file, placed once, as
+      is - the scene's model then is that file's model */
+  static bool singleModelAsIs(const std::vector<SceneFile> &files)
+  {
+    return files.size() == 1 && files[0].placements.size() == 1
+      && files[0].placements[0] == affine3f(one);
+  }
+
+  /*! (re-)build the scene model's instances: each file's instances
+      (or else, meshes) placed by each of the file's placements */
+  static void placeInstances(Scene *scene)
+  {
+    Model *model = scene->model;
+    if (singleModelAsIs(scene->files)) {
+      // (just as the file's model had them)
+      model->instances = scene->files[0].instances;
+      return;
+    }
+    model->instances.clear();
+    for (auto &file : scene->files)
+      for (auto &xfm : file.placements)
+        if (file.instances.empty())
+          for (int i=0;i<file.numMeshes;i++) {
+            MeshInstance instance;
+            instance.meshID = file.meshBegin+i;
+            instance.xfm    = xfm;
+            model->instances.push_back(instance);
+          }
+        else
+          for (auto instance : file.instances) {
+            instance.meshID += file.meshBegin;
+            instance.xfm     = xfm * instance.xfm;
+            model->instances.push_back(instance);
+          }
+    dropTrivialInstances(model);
+  }
+
+  /*! (re-)build the scene's model from its files' models (one per
+      scene->files, as loadSceneModel() makes them): all meshes and
+      textures, with each file's instances (or meshes) placed by each
+      of the file's placements */
+  static void assembleModel(Scene *scene,
+                            std::vector<std::unique_ptr<Model>> &loaded)
+  {
+    std::vector<SceneFile> &files = scene->files;
+    for (size_t fileID=0;fileID<files.size();fileID++) {
+      const Model *source = loaded[fileID].get();
+      files[fileID].numMeshes   = (int)source->meshes.size();
+      files[fileID].numTextures = (int)source->textures.size();
+      files[fileID].instances   = source->instances;
+      files[fileID].mappedFiles = source->mappedFiles;
+    }
+
+    if (singleModelAsIs(files)) {
+      // a single model, placed as is: that's the scene's model
+      files[0].meshBegin = files[0].textureBegin = 0;
+      scene->model = loaded[0].release();
+      applyTextureOptions(scene->model,scene->textureOptions);
+      return;
+    }
+    
+    scene->model = new Model;
+    Model *model = scene->model;
+    for (size_t fileID=0;fileID<files.size();fileID++) {
+      Model *source = loaded[fileID].get();
+      const int meshBase    = (int)model->meshes.size();
+      const int textureBase = (int)model->textures.size();
+      files[fileID].meshBegin    = meshBase;
+      files[fileID].textureBegin = textureBase;
+      for (auto mesh : source->meshes) {
+        if (mesh->diffuseTextureID >= 0)
+          mesh->diffuseTextureID += textureBase;
+        model->meshes.push_back(mesh);
+      }
+      model->textures.insert(model->textures.end(),
+                             source->textures.begin(),source->textures.end());
+      model->mappedFiles.insert(model->mappedFiles.end(),
+                                source->mappedFiles.begin(),source->mappedFiles.end());
+      // (the source model's arenas stay around until packMeshes())
+      source->meshes.clear();
+      source->textures.clear();
+    }
+    placeInstances(scene);
+
+    // the meshes' arrays may be views into the loaded models' arenas;
+    // copy them into arenas of the scene's model before those go
+    packMeshes(model);
+    loaded.clear();
+    computeBounds(model);
+    applyTextureOptions(model,scene->textureOptions);
+  }
+  
+  Scene *loadScene(const std::string &sceneFile,
+                   const TextureOptions &textureOptions,
+                   const ModelPass &prepare)
+  {
+    const double startTime = getCurrentTime();
+    std::unique_ptr<Scene> scene(new Scene);
+    scene->textureOptions = textureOptions;
+    scene->prepare        = prepare;
+    if (isSceneFile(sceneFile)) {
+      scene->sceneFile = sceneFile;
+      parseSceneFile(scene.get(),sceneFile);
+    } else {
+      scene->files.push_back(SceneFile());
+      scene->files[0].fileName = sceneFile;
+      scene->files[0].placements.push_back(affine3f(one));
+    }
+
+    // load all files in parallel
+    std::vector<std::unique_ptr<Model>> loaded(scene->files.size());
+    gdt::parallel_for(scene->files.size(),[&](size_t fileID){
+        SceneFile &file = scene->files[fileID];
+        loaded[fileID].reset(loadSceneModel(scene.get(),file.fileName,file.stamp));
+      });
+    assembleModel(scene.get(),loaded);
+    
+    if (scene->sceneFile != "") {
+      const Model *model = scene->model;
+      size_t numTriangles = 0;
+      for (auto mesh : model->meshes)
+        numTriangles += mesh->index.size();
+      std::cout << "loaded scene " << sceneFile << ": "
+                << scene->files.size() << " model files (" << model->meshes.size() << " meshes";
+      if (!model->instances.empty())
+        std::cout << " in " << model->instances.size() << " instances";
+      std::cout << ", " << numTriangles << " triangles), "
+                << scene->lights.size() << " lights, "
+                << scene->cameras.size() << " cameras"
+                << " (in " << (getCurrentTime()-startTime) << "s)" << std::endl;
+    }
+    return scene.release();
+  }
+
+  std::vector<std::string> sceneDependencies(const Scene *scene)
+  {
+    std::vector<std::string> dependencies;
+    if (scene->sceneFile != "")
+      dependencies.push_back(scene->sceneFile);
+    for (auto &file : scene->files)
+      dependencies.push_back(file.fileName);
+    std::set<std::string> images;
+    for (auto texture : scene->model->textures)
+      if (texture->fileName != "" && images.insert(texture->fileName).second)
+        dependencies.push_back(texture->fileName);
+    return dependencies;
+  }
+
+  // ==================================================================
+  // reloading
+  // ==================================================================
+
+  template<typename A, typename B>
+  static bool sameElements(const A &a, const B &b)
+  {
+    return a.size() == b.size()
+      && (a.empty() || memcmp(a.data(),b.data(),a.size()*sizeof(a[0])) == 0);
+  }
+
+  /*! whether the two meshes would render the same. Anything the
+      passes derive from the arrays compared here (bounds, meshlets)
+      does not need comparing */
+  static bool sameMesh(const TriangleMesh &a, const TriangleMesh &b)
+  {
+    if (a.diffuse          != b.diffuse ||
+        a.diffuseTextureID != b.diffuseTextureID ||
+        a.lodIndex.size()  != b.lodIndex.size() ||
+        a.halfTexcoords    != b.halfTexcoords)
+      return false;
+    // (the quantizer only means anything with compact positions)
+    if (!a.compactVertex.empty() &&
+        (a.vertexQuantizer.origin != b.vertexQuantizer.origin ||
+         a.vertexQuantizer.scale  != b.vertexQuantizer.scale))
+      return false;
+    for (size_t level=0;level<a.lodIndex.size();level++)
+      if (!sameElements(a.lodIndex[level],b.lodIndex[level]))
+        return false;
+    return sameElements(a.index,b.index)
+      && sameElements(a.vertex,b.vertex)
+      && sameElements(a.normal,b.normal)
+      && sameElements(a.texcoord,b.texcoord)
+      && sameElements(a.tangent,b.tangent)
+      && sameElements(a.compactVertex,b.compactVertex)
+      && sameElements(a.compactNormal,b.compactNormal)
+      && sameElements(a.compactTexcoord,b.compactTexcoord)
+      && sameElements(a.lodError,b.lodError);
+  }
+
+  /*! whether the resident texture is (what the texture budget left
+      of) the freshly loaded one */
+  static bool sameTexture(const Texture &resident, const Texture &fresh)
+  {
+    if (resident.fileName != fresh.fileName)
+      return false;
+    const int dropped = fresh.numLevels-resident.numLevels;
+    return dropped >= 0
+      && fresh.levelResolution(dropped) == resident.resolution
+      && memcmp(resident.pixel,fresh.levelPixels(dropped),resident.sizeInBytes()) == 0;
+  }
+
+  static bool sameInstances(const std::vector<MeshInstance> &a,
+                            const std::vector<MeshInstance> &b)
+  {
+    if (a.size() != b.size())
+      return false;
+    for (size_t i=0;i<a.size();i++)
+      if (a[i].meshID != b[i].meshID || a[i].xfm != b[i].xfm)
+        return false;
+    return true;
+  }
+
+  /*! make the mesh's arrays its own, rather than views into the
+      arenas (or mapped file) of the model it came from */
+  static void detachArrays(TriangleMesh *mesh)
+  {
+    // (anything that may change an array's size first turns a view
+    // into an array of its own)
+    mesh->vertex.reserve(mesh->vertex.size());
+    mesh->normal.reserve(mesh->normal.size());
+    mesh->texcoord.reserve(mesh->texcoord.size());
+    mesh->index.reserve(mesh->index.size());
+  }
+
+  /*! make the texture's pixels its own, rather than part of the
+      mapped model cache it came from */
+  static void detachPixels(Texture *texture)
+  {
+    if (texture->ownsPixels)
+      return;
+    uint32_t *pixel = (uint32_t *)malloc(texture->sizeInBytes());
+    memcpy(pixel,texture->pixel,texture->sizeInBytes());
+    texture->pixel      = pixel;
+    texture->ownsPixels = true;
+  }
+
+  /*! fit the scene's textures back into the texture memory budget
+      after some of them got replaced; the ones losing mip levels
+      because of that count as replaced, too */
+  static void refitTextures(Scene *scene, SceneChanges &changes)
+  {
+    Model *model = scene->model;
+    std::vector<vec2i> resolution(model->textures.size());
+    for (size_t textureID=0;textureID<model->textures.size();textureID++)
+      resolution[textureID] = model->textures[textureID]->resolution;
+    applyTextureOptions(model,scene->textureOptions);
+    std::set<int> replaced(changes.textures.begin(),changes.textures.end());
+    for (size_t textureID=0;textureID<model->textures.size();textureID++)
+      if (model->textures[textureID]->resolution != resolution[textureID]
+          && !replaced.count((int)textureID))
+        changes.textures.push_back((int)textureID);
+  }
+
+  /*! replace all textures made from given image file with ones
+      decoded anew */
+  static void reloadImage(Scene *scene, const std::string &fileName,
+                          SceneChanges &changes)
+  {
+    Model *model = scene->model;
+    std::vector<int> textureIDs;
+    for (size_t textureID=0;textureID<model->textures.size();textureID++)
+      if (model->textures[textureID]->fileName == fileName)
+        textureIDs.push_back((int)textureID);
+    
+    // decode them all before replacing any, so failing leaves the
+    // scene as it was
+    std::vector<std::unique_ptr<Texture>> decoded(textureIDs.size());
+    for (auto &texture : decoded) {
+      texture.reset(loadTexture(fileName));
+      if (!texture)
+        throw std::runtime_error("could not load texture from "+fileName);
+      if (scene->textureOptions.generateMips)
+        generateMipLevels(texture.get(),scene->textureOptions.mipFilter);
+    }
+    for (size_t i=0;i<textureIDs.size();i++) {
+      delete model->textures[textureIDs[i]];
+      model->textures[textureIDs[i]] = decoded[i].release();
+      changes.textures.push_back(textureIDs[i]);
+    }
+    refitTextures(scene,changes);
+  }
+
+  /*! hand given file's meshes and textures back from the scene's
+      model to a model of their own, just as if the file had just been
+      loaded. The scene's model (with the arenas their arrays may be
+      views into) has to stay around until those are assembled anew */
+  static Model *takeFileModel(Model *sceneModel, const SceneFile &file)
+  {
+    Model *model = new Model;
+    for (int i=0;i<file.numMeshes;i++) {
+      TriangleMesh *&mesh = sceneModel->meshes[file.meshBegin+i];
+      if (mesh->diffuseTextureID >= 0)
+        mesh->diffuseTextureID -= file.textureBegin;
+      model->meshes.push_back(mesh);
+      mesh = nullptr;
+    }
+    for (int i=0;i<file.numTextures;i++) {
+      model->textures.push_back(sceneModel->textures[file.textureBegin+i]);
+      sceneModel->textures[file.textureBegin+i] = nullptr;
+    }
+    model->instances   = file.instances;
+    model->mappedFiles = file.mappedFiles;
+    return model;
+  }
+
+  /*! rebuild the scene's model after the given file's model
+      changed in ways that replacing meshes and textures can not
+      cover */
+  static void reassembleModel(Scene *scene, size_t changedFileID,
+                              std::unique_ptr<Model> &changed)
+  {
+    // all other files' models are as they were
+    std::unique_ptr<Model> old(scene->model);
+    scene->model = nullptr;
+    std::vector<std::unique_ptr<Model>> loaded(scene->files.size());
+    for (size_t fileID=0;fileID<scene->files.size();fileID++)
+      if (fileID == changedFileID)
+        loaded[fileID] = std::move(changed);
+      else
+        loaded[fileID].reset(takeFileModel(old.get(),scene->files[fileID]));
+    assembleModel(scene,loaded);
+  }
+
+  /*! reload one of the scene's model files */
+  static void reloadModelFile(Scene *scene, size_t fileID,
+                              SceneChanges &changes)
+  {
+    SceneFile &file = scene->files[fileID];
+    FileStamp stamp;
+    std::unique_ptr<Model> loaded(loadSceneModel(scene,file.fileName,stamp));
+    file.stamp = stamp;
+    if ((int)loaded->meshes.size()   != file.numMeshes ||
+        (int)loaded->textures.size() != file.numTextures ||
+        !sameInstances(loaded->instances,file.instances)) {
+      reassembleModel(scene,fileID,loaded);
+      changes.everything = true;
+      return;
+    }
+
+    // same meshes, textures, and instances as before - replace just
+    // those that differ. Whatever gets replaced goes with 'loaded'
+    Model *model = scene->model;
+    for (int i=0;i<file.numTextures;i++) {
+      Texture *&texture = loaded->textures[i];
+      const int textureID = file.textureBegin+i;
+      if (sameTexture(*model->textures[textureID],*texture))
+        continue;
+      detachPixels(texture);
+      std::swap(model->textures[textureID],texture);
+      changes.textures.push_back(textureID);
+    }
+    for (int i=0;i<file.numMeshes;i++) {
+      TriangleMesh *&mesh = loaded->meshes[i];
+      const int meshID = file.meshBegin+i;
+      if (mesh->diffuseTextureID >= 0)
+        mesh->diffuseTextureID += file.textureBegin;
+      if (sameMesh(*model->meshes[meshID],*mesh))
+        continue;
+      detachArrays(mesh);
+      std::swap(model->meshes[meshID],mesh);
+      changes.meshes.push_back(meshID);
+    }
+    // (the model's bounds stay as they were: they only ever get used
+    // to place the initial camera)
+    if (!changes.textures.empty())
+      refitTextures(scene,changes);
+  }
+
+  /*! reload the scene file itself: model files that it placed
+      before, and that did not change since, keep their models; just
+      new or changed ones get loaded. If that leaves the model files
+      as they were, only the instances get placed anew */
+  static void reloadDescription(Scene *scene, SceneChanges &changes)
+  {
+    // parse and load everything before changing anything, so failing
+    // leaves the scene as it was
+    Scene reparsed;
+    parseSceneFile(&reparsed,scene->sceneFile);
+    std::vector<SceneFile> &files = reparsed.files;
+    std::map<std::string,int> oldFileID;
+    for (size_t fileID=0;fileID<scene->files.size();fileID++)
+      oldFileID[scene->files[fileID].fileName] = (int)fileID;
+    std::vector<int> keep(files.size(),-1);
+    std::vector<size_t> toLoad;
+    for (size_t fileID=0;fileID<files.size();fileID++) {
+      auto old = oldFileID.find(files[fileID].fileName);
+      if (old != oldFileID.end()
+          && scene->files[old->second].stamp == fileStamp(files[fileID].fileName))
+        keep[fileID] = old->second;
+      else
+        toLoad.push_back(fileID);
+    }
+    std::vector<std::unique_ptr<Model>> loaded(files.size());
+    gdt::parallel_for(toLoad.size(),[&](size_t i){
+        SceneFile &file = files[toLoad[i]];
+        loaded[toLoad[i]].reset(loadSceneModel(scene,file.fileName,file.stamp));
+      });
+
+    bool sameFiles = files.size() == scene->files.size();
+    for (size_t fileID=0;fileID<files.size();fileID++)
+      sameFiles &= keep[fileID] == (int)fileID;
+    if (sameFiles) {
+      // same meshes and textures under the same IDs - just place them
+      // anew. Whether there are any instances at all decides how the
+      // renderer builds its accels, though
+      const bool wasInstanced = !scene->model->instances.empty();
+      for (size_t fileID=0;fileID<files.size();fileID++)
+        scene->files[fileID].placements = files[fileID].placements;
+      placeInstances(scene);
+      // (the model's bounds stay as they were, as with reloaded
+      // model files)
+      if (scene->model->instances.empty() == wasInstanced)
+        changes.everything = true;
+      else
+        changes.instances = true;
+    } else {
+      // the kept files' models are as they were
+      std::unique_ptr<Model> old(scene->model);
+      scene->model = nullptr;
+      for (size_t fileID=0;fileID<files.size();fileID++) {
+        if (keep[fileID] < 0)
+          continue;
+        const SceneFile &kept = scene->files[keep[fileID]];
+        loaded[fileID].reset(takeFileModel(old.get(),kept));
+        files[fileID].stamp = kept.stamp;
+        if (singleModelAsIs(files))
+          // that model becomes the scene's model as it is, so its
+          // arrays may not stay views into the old model's arenas
+          for (auto mesh : loaded[fileID]->meshes)
+            detachArrays(mesh);
+      }
+      scene->files = files;
+      assembleModel(scene,loaded);
+      changes.everything = true;
+    }
+    scene->lights  = reparsed.lights;
+    scene->cameras = reparsed.cameras;
+    std::cout << "#osc: kept " << (files.size()-toLoad.size()) << " of "
+              << files.size() << " model files, and loaded "
+              << toLoad.size() << " anew" << std::endl;
+  }
+
+  SceneChanges reloadSceneFile(Scene *scene, const std::string &fileName)
+  {
+    const double startTime = getCurrentTime();
+    SceneChanges changes;
+    if (fileName == scene->sceneFile)
+      reloadDescription(scene,changes);
+    else {
+      bool known = false;
+      for (size_t fileID=0;fileID<scene->files.size();fileID++)
+        if (scene->files[fileID].fileName == fileName) {
+          reloadModelFile(scene,fileID,changes);
+          known = true;
+        }
+      if (!known)
+        reloadImage(scene,fileName,changes);
+    }
+
+    if (changes.everything)
+      std::cout << "#osc: reloaded " << fileName << ", and rebuilt the whole model";
+    else if (changes.instances)
+      std::cout << "#osc: reloaded " << fileName << ", and placed the "
+                << scene->model->instances.size() << " instances anew";
+    else
+      std::cout << "#osc: reloaded " << fileName << ": replaced "
+                << changes.meshes.size() << " of " << scene->model->meshes.size()
+                << " meshes, and " << changes.textures.size() << " of "
+                << scene->model->textures.size() << " textures";
+    std::cout << " (in " << (getCurrentTime()-startTime) << "s)" << std::endl;
+    return changes;
+  }
+}
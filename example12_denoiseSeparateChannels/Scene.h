@@ -0,0 +1,149 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "Model.h"
+#include "FileStamp.h"
+#include <functional>
+#include <memory>
+#include <string>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  struct NamedCamera {
+    std::string name;
+    Camera      camera;
+  };
+
+  /*! something done to each model file's model right after loading
+      it - say, optimizing its meshes */
+  typedef std::function<void(Model *)> ModelPass;
+
+  /*! one of the model files a scene got loaded from */
+  struct SceneFile {
+    std::string           fileName;
+    /*! the file as it was when its model got loaded - a reloaded
+        scene file keeps the models of files that still are that way */
+    FileStamp             stamp;
+    /*! where the scene places the file's meshes (or instances) */
+    std::vector<affine3f> placements;
+
+    /*! @{ where the file's meshes and textures ended up in the
+        scene's model: model->meshes[meshBegin..meshBegin+numMeshes),
+        and likewise for the textures */
+    int meshBegin    { 0 }, numMeshes   { 0 };
+    int textureBegin { 0 }, numTextures { 0 };
+    /*! @} */
+    /*! the file's own instances, with mesh IDs relative to
+        meshBegin (empty if it has none) */
+    std::vector<MeshInstance> instances;
+    /*! the mapped files (if any) that its meshes and textures came
+        with (see Model::mappedFiles) */
+    std::vector<std::shared_ptr<MappedFile>> mappedFiles;
+  };
+
+  /*! what a scene file describes: any number of model files, each
+      placed by any number of instances, plus lights and cameras.
+
+      Scene files are JSON:
+
+        {
+          "models":    { "sponza": "sponza.obj", "bunny": "bunny.glb" },
+          "instances": [ { "model": "sponza" },
+                         { "model": "bunny", "scale": 100,
+                           "rotate": [ 0,1,0, 90 ],
+                           "translate": [ 0,200,0 ] } ],
+          "lights":    [ { "origin": [..], "du": [..], "dv": [..],
+                           "power": [..] } ],
+          "cameras":   [ { "name": "entrance", "from": [..],
+                           "at": [..], "up": [ 0,1,0 ] } ]
+        }
+
+      Model file names are relative to the scene file. Instances
+      scale (by a number, or per axis), then rotate (axis and
+      degrees), then translate; instead of all that, they can give a
+      "matrix" (16 numbers, column-major, glTF-style). Without any
+      "instances", every model gets placed once, as is.
+
+      Any other file is a model file, making for a scene of just that
+      model, placed once, as is */
+  struct Scene {
+    ~Scene() { delete model; }
+
+    /*! all models' meshes and textures, each model's once; the
+        instances place them */
+    Model                   *model { nullptr };
+    std::vector<QuadLight>   lights;
+    std::vector<NamedCamera> cameras;
+
+    /*! @{ what it takes to reload any of the files the scene came
+        from (see reloadSceneFile()): the scene file (empty for a
+        scene of a single model file), and the model files */
+    std::string              sceneFile;
+    std::vector<SceneFile>   files;
+    TextureOptions           textureOptions;
+    ModelPass                prepare;
+    /*! @} */
+  };
+
+  /*! load the given scene file, and all model files it references -
+      each once, no matter how often it gets instantiated, and all of
+      them in parallel. Each model file's model gets 'prepare'd right
+      after loading it, before it gets combined with the others. The
+      texture memory budget applies to all models' textures
+      together */
+  Scene *loadScene(const std::string &sceneFile,
+                   const TextureOptions &textureOptions = TextureOptions(),
+                   const ModelPass &prepare = ModelPass());
+
+  /*! what reloadSceneFile() changed in the scene's model */
+  struct SceneChanges {
+    /*! the meshes and textures that got replaced (under the same
+        IDs); all others are as they were */
+    std::vector<int> meshes, textures;
+    /*! if set, just the instances changed (in number, too), along
+        with maybe the lights and cameras: a scene file changed only
+        in where it places its models. The meshes and textures all
+        stay as they were, and so does whether the model has any
+        instances at all; 'meshes' and 'textures' then are empty */
+    bool             instances { false };
+    /*! if set, the model got rebuilt as a whole - meshes, textures,
+        or instances came or went, or the scene file itself changed
+        in more than where it places its models; 'meshes' and
+        'textures' then are empty */
+    bool             everything { false };
+  };
+
+  /*! all files the scene got loaded from: its scene file (if any),
+      its model files, and the image files their textures came from
+      (material libraries of .obj files are not included) */
+  std::vector<std::string> sceneDependencies(const Scene *scene);
+
+  /*! bring the scene up to date after given file (one of its
+      sceneDependencies()) changed, reloading just that one file: an
+      image file replaces the textures made from it; a model file gets
+      loaded and prepared anew, and compared to what it made for
+      before - only those of its meshes and textures that differ get
+      replaced, unless its meshes, textures, or instances came or
+      went. The scene file gets parsed anew, with the model files it
+      placed before keeping their models unless they changed since
+      (see SceneFile::stamp); only new or changed ones get loaded.
+      Throws if the file can not get loaded, leaving the scene as it
+      was */
+  SceneChanges reloadSceneFile(Scene *scene, const std::string &fileName);
+}
@@ -0,0 +1,362 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Model.h"
+#include "gdt/parallel/parallel_for.h"
+//std
+#include <algorithm>
+#include <math.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! meshes with at least that many triangles get processed one at a
+      time, with all threads working on each; smaller ones side by
+      side, one thread each */
+  enum { LARGE_MESH_TRIANGLES = 1<<16 };
+
+  /*! call task(begin,end) for blocks of [0..n) - in parallel, or
+      all at once */
+  template<typename TaskT>
+  static void forRange(size_t n, bool parallel, const TaskT &task)
+  {
+    if (parallel)
+      gdt::parallel_for_blocked(n,16*1024,task);
+    else
+      task(0,n);
+  }
+
+  /*! angle of triangle 'tri' at its k'th corner */
+  static float cornerAngle(const MeshArray<vec3f> &vertex, const vec3i &tri, int k)
+  {
+    const vec3f p = vertex[tri[k]];
+    const vec3f a = vertex[tri[(k+1)%3]]-p;
+    const vec3f b = vertex[tri[(k+2)%3]]-p;
+    const float len = length(a)*length(b);
+    return len > 0.f ? acosf(clamp(dot(a,b)/len,-1.f,1.f)) : 0.f;
+  }
+
+  /*! vertex (or position) -> corners (3*triangleID+k) in CSR form;
+      'key' maps each vertex to the vertex or position it counts for */
+  struct CornerAdjacency {
+    CornerAdjacency(const MeshArray<vec3i> &index, const int *key, int numKeys)
+    {
+      begin.assign(numKeys+1,0);
+      for (auto &tri : index)
+        for (int k=0;k<3;k++)
+          begin[(key ? key[tri[k]] : tri[k])+1]++;
+      for (int i=0;i<numKeys;i++)
+        begin[i+1] += begin[i];
+      corner.resize(begin[numKeys]);
+      std::vector<int> fill(begin.begin(),begin.end()-1);
+      for (int t=0;t<(int)index.size();t++)
+        for (int k=0;k<3;k++)
+          corner[fill[key ? key[index[t][k]] : index[t][k]]++] = 3*t+k;
+    }
+    std::vector<int> begin, corner;
+  };
+
+  /*! give a mesh that has none (angle-weighted) smooth normals; where
+      two triangles sharing an edge meet at more than the crease
+      angle, the edge stays sharp, and their vertices get split */
+  static size_t smoothNormals(TriangleMesh *mesh, float cosCrease, bool parallel)
+  {
+    const int numVertices  = (int)mesh->vertex.size();
+    const int numTriangles = (int)mesh->index.size();
+    const bool   creases   = cosCrease > -1.f;
+
+    // vertices the loader split for their texture coordinates still
+    // have to get the same normal, so everything is per position
+    const std::vector<int> rep = weldPositions(mesh->vertex);
+    const CornerAdjacency  atPosition(mesh->index,rep.data(),numVertices);
+
+    std::vector<vec3f> faceNormal(numTriangles);
+    forRange(numTriangles,parallel,[&](size_t begin, size_t end){
+        for (size_t t=begin;t<end;t++) {
+          const vec3i &tri = mesh->index[t];
+          const vec3f  N   = cross(mesh->vertex[tri.y]-mesh->vertex[tri.x],
+                                   mesh->vertex[tri.z]-mesh->vertex[tri.x]);
+          const float  len = length(N);
+          faceNormal[t] = len > 0.f ? N/len : vec3f(0.f);
+        }
+      });
+
+    // split the corners around each position into smoothing groups:
+    // triangles sharing an edge (ie, another position) are in the
+    // same group if their normals are within the crease angle.
+    // Degenerate triangles go with the first group.
+    std::vector<int> cornerGroup(creases ? 3*numTriangles : 0,0);
+    std::vector<int> numSplits(creases ? numVertices : 0,0);
+    auto groupOf = [&](int corner) {
+      return creases ? cornerGroup[corner] : 0;
+    };
+    if (creases)
+      forRange(numVertices,parallel,[&](size_t begin, size_t end){
+          std::vector<int> parent, pairs;
+          for (size_t r=begin;r<end;r++) {
+            const int first = atPosition.begin[r];
+            const int count = atPosition.begin[r+1]-first;
+            if (count < 2) continue;
+            const int *corner = &atPosition.corner[first];
+
+            parent.resize(count);
+            for (int i=0;i<count;i++) parent[i] = i;
+            auto find = [&](int i) {
+              while (parent[i] != i) i = parent[i] = parent[parent[i]];
+              return i;
+            };
+            for (int i=0;i<count;i++) {
+              const int ti = corner[i]/3, ki = corner[i]%3;
+              if (faceNormal[ti] == vec3f(0.f)) continue;
+              const vec3i &a = mesh->index[ti];
+              const int a1 = rep[a[(ki+1)%3]], a2 = rep[a[(ki+2)%3]];
+              for (int j=i+1;j<count;j++) {
+                const int tj = corner[j]/3, kj = corner[j]%3;
+                if (faceNormal[tj] == vec3f(0.f) ||
+                    dot(faceNormal[ti],faceNormal[tj]) < cosCrease) continue;
+                const vec3i &b = mesh->index[tj];
+                const int b1 = rep[b[(kj+1)%3]], b2 = rep[b[(kj+2)%3]];
+                if (a1 == b1 || a1 == b2 || a2 == b1 || a2 == b2) {
+                  // (the root is always the group's first corner)
+                  const int ri = find(i), rj = find(j);
+                  parent[std::max(ri,rj)] = std::min(ri,rj);
+                }
+              }
+            }
+
+            // number the groups (in order of first corner), with
+            // degenerate triangles' corners going to group 0
+            int numGroups = 0;
+            for (int i=0;i<count;i++) {
+              const int root = find(i);
+              if (faceNormal[corner[i]/3] == vec3f(0.f))
+                cornerGroup[corner[i]] = -1;
+              else if (root == i)
+                cornerGroup[corner[i]] = numGroups++;
+              else
+                cornerGroup[corner[i]] = cornerGroup[corner[root]];
+            }
+            // each (vertex,group) pair beyond the first per vertex
+            // needs a vertex of its own
+            pairs.clear();
+            for (int i=0;i<count;i++) {
+              int &group = cornerGroup[corner[i]];
+              group = std::max(group,0);
+              pairs.push_back(mesh->index[corner[i]/3][corner[i]%3]);
+              pairs.push_back(group);
+            }
+            int numPairs = 0, numUsed = 0;
+            for (int i=0;i<count;i++) {
+              bool newPair = true, newVertex = true;
+              for (int j=0;j<i;j++) {
+                if (pairs[2*j] != pairs[2*i]) continue;
+                newVertex = false;
+                if (pairs[2*j+1] == pairs[2*i+1]) { newPair = false; break; }
+              }
+              numPairs += newPair;
+              numUsed  += newVertex;
+            }
+            numSplits[r] = numPairs-numUsed;
+          }
+        });
+
+    // where each position's split-off vertices go
+    std::vector<int> splitBegin(numSplits.size()+1,numVertices);
+    for (size_t r=0;r<numSplits.size();r++)
+      splitBegin[r+1] = splitBegin[r]+numSplits[r];
+    const int numSplit = splitBegin.back()-numVertices;
+    std::vector<int> splitFrom(numSplit);
+
+    std::vector<vec3f> normal(numVertices+numSplit);
+    forRange(numVertices,parallel,[&](size_t begin, size_t end){
+        std::vector<vec3f> groupNormal;
+        std::vector<vec3i> assigned;
+        for (size_t r=begin;r<end;r++) {
+          const int first = atPosition.begin[r];
+          const int count = atPosition.begin[r+1]-first;
+          if (count == 0) continue;
+          const int *corner = &atPosition.corner[first];
+
+          groupNormal.clear();
+          for (int i=0;i<count;i++) {
+            const int t = corner[i]/3, k = corner[i]%3;
+            const int g = groupOf(corner[i]);
+            if (g >= (int)groupNormal.size()) groupNormal.resize(g+1,vec3f(0.f));
+            groupNormal[g]
+              += cornerAngle(mesh->vertex,mesh->index[t],k)*faceNormal[t];
+          }
+          for (auto &n : groupNormal) {
+            const float len = length(n);
+            // all-degenerate neighborhoods have no normal to speak of
+            n = len > 0.f ? n/len : vec3f(0.f,0.f,1.f);
+          }
+
+          // (vertex,group) -> the vertex that gets that group's normal
+          assigned.clear();
+          int nextSplit = creases ? splitBegin[r] : numVertices;
+          for (int i=0;i<count;i++) {
+            const int t = corner[i]/3, k = corner[i]%3;
+            const int v = mesh->index[t][k];
+            const int g = groupOf(corner[i]);
+            int id = -1;
+            bool vertexUsed = false;
+            for (auto &a : assigned)
+              if (a.x == v) {
+                vertexUsed = true;
+                if (a.y == g) { id = a.z; break; }
+              }
+            if (id < 0) {
+              id = vertexUsed ? nextSplit++ : v;
+              if (id != v) splitFrom[id-numVertices] = v;
+              normal[id] = groupNormal[g];
+              assigned.push_back(vec3i(v,g,id));
+            }
+            if (creases)
+              // other positions still read this triangle's vertices,
+              // so the index itself gets changed once they're done
+              cornerGroup[corner[i]] = id;
+          }
+        }
+      });
+    if (numSplit > 0)
+      forRange(numTriangles,parallel,[&](size_t begin, size_t end){
+          for (size_t t=begin;t<end;t++)
+            for (int k=0;k<3;k++)
+              mesh->index[t][k] = cornerGroup[3*t+k];
+        });
+
+    if (numSplit > 0) {
+      std::vector<vec3f> vertex(mesh->vertex.begin(),mesh->vertex.end());
+      vertex.resize(numVertices+numSplit);
+      for (int i=0;i<numSplit;i++)
+        vertex[numVertices+i] = vertex[splitFrom[i]];
+      mesh->vertex.assign(std::move(vertex));
+      if (!mesh->texcoord.empty()) {
+        std::vector<vec2f> texcoord(mesh->texcoord.begin(),mesh->texcoord.end());
+        texcoord.resize(numVertices+numSplit);
+        for (int i=0;i<numSplit;i++)
+          texcoord[numVertices+i] = texcoord[splitFrom[i]];
+        mesh->texcoord.assign(std::move(texcoord));
+      }
+    }
+    mesh->normal.assign(std::move(normal));
+    return numSplit;
+  }
+
+  /*! per-vertex tangents from the texture coordinates, built the way
+      MikkTSpace builds them: each triangle's (normalized) texture
+      space u direction, projected into each of its vertices' tangent
+      plane, angle-weighted and summed, with the handedness (w) from
+      the v direction */
+  static void computeTangents(TriangleMesh *mesh, bool parallel)
+  {
+    const int numVertices  = (int)mesh->vertex.size();
+    const int numTriangles = (int)mesh->index.size();
+
+    std::vector<vec3f> faceU(numTriangles), faceV(numTriangles);
+    forRange(numTriangles,parallel,[&](size_t begin, size_t end){
+        for (size_t t=begin;t<end;t++) {
+          const vec3i &tri = mesh->index[t];
+          const vec3f e1  = mesh->vertex[tri.y]-mesh->vertex[tri.x];
+          const vec3f e2  = mesh->vertex[tri.z]-mesh->vertex[tri.x];
+          const vec2f uv1 = mesh->texcoord[tri.y]-mesh->texcoord[tri.x];
+          const vec2f uv2 = mesh->texcoord[tri.z]-mesh->texcoord[tri.x];
+          const float det = uv1.x*uv2.y-uv2.x*uv1.y;
+          if (det == 0.f) {
+            // no texture space to speak of; contributes nothing
+            faceU[t] = faceV[t] = vec3f(0.f);
+            continue;
+          }
+          const float sign = det > 0.f ? 1.f : -1.f;
+          faceU[t] = (e1*uv2.y-e2*uv1.y)*sign;
+          faceV[t] = (e2*uv1.x-e1*uv2.x)*sign;
+          const float lenU = length(faceU[t]), lenV = length(faceV[t]);
+          faceU[t] = lenU > 0.f ? faceU[t]/lenU : vec3f(0.f);
+          faceV[t] = lenV > 0.f ? faceV[t]/lenV : vec3f(0.f);
+        }
+      });
+
+    const CornerAdjacency atVertex(mesh->index,nullptr,numVertices);
+    std::vector<vec4f> tangent(numVertices);
+    forRange(numVertices,parallel,[&](size_t begin, size_t end){
+        for (size_t v=begin;v<end;v++) {
+          const vec3f n = mesh->normal[v];
+          vec3f sumU(0.f), sumV(0.f);
+          for (int i=atVertex.begin[v];i<atVertex.begin[v+1];i++) {
+            const int t = atVertex.corner[i]/3, k = atVertex.corner[i]%3;
+            const float w = cornerAngle(mesh->vertex,mesh->index[t],k);
+            const vec3f u = faceU[t]-dot(n,faceU[t])*n;
+            const vec3f s = faceV[t]-dot(n,faceV[t])*n;
+            const float lenU = length(u), lenV = length(s);
+            if (lenU > 0.f) sumU += (w/lenU)*u;
+            if (lenV > 0.f) sumV += (w/lenV)*s;
+          }
+          vec3f t = sumU-dot(n,sumU)*n;
+          float len = length(t);
+          if (!(len > 0.f)) {
+            // no texture space here: any direction in the tangent plane
+            t   = cross(n,fabsf(n.x) < .9f ? vec3f(1.f,0.f,0.f) : vec3f(0.f,1.f,0.f));
+            len = length(t);
+          }
+          t = len > 0.f ? t/len : vec3f(1.f,0.f,0.f);
+          tangent[v] = vec4f(t,dot(cross(n,t),sumV) < 0.f ? -1.f : 1.f);
+        }
+      });
+    mesh->tangent.swap(tangent);
+  }
+
+  void generateNormals(Model *model, float creaseAngle, bool withTangents)
+  {
+    const double startTime = getCurrentTime();
+    const bool  wasPacked = isPacked(model);
+    const float cosCrease
+      = creaseAngle >= 180.f ? -2.f : cosf(creaseAngle*float(M_PI)/180.f);
+
+    size_t numNormals = 0, numTangents = 0;
+    std::vector<size_t> numSplit(model->meshes.size(),0);
+    auto process = [&](size_t meshID, bool parallel) {
+      TriangleMesh *mesh = model->meshes[meshID];
+      if (mesh->normal.empty())
+        numSplit[meshID] = smoothNormals(mesh,cosCrease,parallel);
+      if (withTangents && !mesh->texcoord.empty())
+        computeTangents(mesh,parallel);
+    };
+    std::vector<size_t> small;
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++)
+      if (model->meshes[meshID]->index.size() >= LARGE_MESH_TRIANGLES)
+        process(meshID,true);
+      else
+        small.push_back(meshID);
+    gdt::parallel_for(small.size(),[&](size_t i){ process(small[i],false); });
+    if (wasPacked)
+      packMeshes(model);
+
+    size_t totalSplit = 0;
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+      totalSplit += numSplit[meshID];
+      numNormals += model->meshes[meshID]->normal.size();
+      numTangents += model->meshes[meshID]->tangent.size();
+    }
+    std::cout << "generated smooth normals";
+    if (withTangents)
+      std::cout << " and tangents";
+    std::cout << " (" << totalSplit << " vertices split at creases; "
+              << prettyNumber(numNormals*sizeof(vec3f)+numTangents*sizeof(vec4f))
+              << "B of normals and tangents, in "
+              << (getCurrentTime()-startTime) << "s)" << std::endl;
+  }
+
+}
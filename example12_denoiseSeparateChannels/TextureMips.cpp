@@ -0,0 +1,202 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "TextureMips.h"
+//std
+#include <string.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! number of taps (in the finer level) of the Kaiser filter, per
+      dimension */
+  enum { KAISER_TAPS = 6 };
+
+  /*! zeroth order modified Bessel function of the first kind */
+  static double besselI0(double x)
+  {
+    double sum = 1., term = 1.;
+    for (int k=1;k<32;k++) {
+      term *= (x/(2.*k))*(x/(2.*k));
+      sum  += term;
+    }
+    return sum;
+  }
+
+  /*! weights of a Kaiser-windowed sinc for halving the resolution;
+      tap k covers the finer level's texel 2x-2+k for coarser texel x */
+  static const float *kaiserWeights()
+  {
+    struct Weights {
+      Weights()
+      {
+        const double alpha  = 4.;
+        const double radius = 1.5; // in coarser-level texels
+        double sum = 0.;
+        for (int k=0;k<KAISER_TAPS;k++) {
+          const double d = ((k-2)+.5-1.)/2.;
+          const double t = d/radius;
+          const double sinc = sin(M_PI*d)/(M_PI*d);
+          w[k] = float(sinc*besselI0(alpha*sqrt(1.-t*t))/besselI0(alpha));
+          sum += w[k];
+        }
+        for (int k=0;k<KAISER_TAPS;k++)
+          w[k] = float(w[k]/sum);
+      }
+      float w[KAISER_TAPS];
+    };
+    static const Weights weights;
+    return weights.w;
+  }
+
+  static inline int wrap(int i, int n)
+  {
+    i %= n;
+    return i < 0 ? i+n : i;
+  }
+
+  static void downsampleBox(const unsigned char *src, const vec2i &srcRes,
+                            unsigned char *dst, const vec2i &dstRes)
+  {
+    for (int y=0;y<dstRes.y;y++) {
+      const unsigned char *line0 = src + 4*size_t(wrap(2*y+0,srcRes.y))*srcRes.x;
+      const unsigned char *line1 = src + 4*size_t(wrap(2*y+1,srcRes.y))*srcRes.x;
+      for (int x=0;x<dstRes.x;x++) {
+        const int x0 = 4*wrap(2*x+0,srcRes.x);
+        const int x1 = 4*wrap(2*x+1,srcRes.x);
+        for (int c=0;c<4;c++)
+          dst[c] = (unsigned char)((line0[x0+c]+line0[x1+c]
+                                    +line1[x0+c]+line1[x1+c]+2)>>2);
+        dst += 4;
+      }
+    }
+  }
+
+  static void downsampleKaiser(const unsigned char *src, const vec2i &srcRes,
+                               unsigned char *dst, const vec2i &dstRes)
+  {
+    const float *w = kaiserWeights();
+
+    // (wrapped) byte offsets of all taps, for every column
+    std::vector<int> tapOffset(size_t(dstRes.x)*KAISER_TAPS);
+    for (int x=0;x<dstRes.x;x++)
+      for (int k=0;k<KAISER_TAPS;k++)
+        tapOffset[x*KAISER_TAPS+k] = 4*wrap(2*x-2+k,srcRes.x);
+    
+    // horizontal pass, into floats
+    std::vector<vec4f> tmp(size_t(dstRes.x)*srcRes.y);
+    for (int y=0;y<srcRes.y;y++) {
+      const unsigned char *line = src + 4*size_t(y)*srcRes.x;
+      vec4f *out = tmp.data() + size_t(y)*dstRes.x;
+      for (int x=0;x<dstRes.x;x++) {
+        const int *tap = &tapOffset[x*KAISER_TAPS];
+        float r = 0.f, g = 0.f, b = 0.f, a = 0.f;
+        for (int k=0;k<KAISER_TAPS;k++) {
+          const unsigned char *texel = line + tap[k];
+          r += w[k]*texel[0];
+          g += w[k]*texel[1];
+          b += w[k]*texel[2];
+          a += w[k]*texel[3];
+        }
+        out[x] = vec4f(r,g,b,a);
+      }
+    }
+
+    // vertical pass, back to bytes
+    for (int y=0;y<dstRes.y;y++) {
+      const vec4f *lines[KAISER_TAPS];
+      for (int k=0;k<KAISER_TAPS;k++)
+        lines[k] = tmp.data() + size_t(wrap(2*y-2+k,srcRes.y))*dstRes.x;
+      for (int x=0;x<dstRes.x;x++) {
+        vec4f sum = w[0]*lines[0][x];
+        for (int k=1;k<KAISER_TAPS;k++)
+          sum += w[k]*lines[k][x];
+        dst[0] = (unsigned char)clamp(sum.x+.5f,0.f,255.f);
+        dst[1] = (unsigned char)clamp(sum.y+.5f,0.f,255.f);
+        dst[2] = (unsigned char)clamp(sum.z+.5f,0.f,255.f);
+        dst[3] = (unsigned char)clamp(sum.w+.5f,0.f,255.f);
+        dst += 4;
+      }
+    }
+  }
+
+  void generateMipLevels(Texture *texture, MipFilter filter)
+  {
+    if (!texture->ownsPixels || texture->numLevels != 1)
+      return;
+
+    int    numLevels = 1;
+    size_t numBytes  = area(texture->resolution)*sizeof(uint32_t);
+    while (texture->levelResolution(numLevels-1) != vec2i(1)) {
+      numBytes += area(texture->levelResolution(numLevels))*sizeof(uint32_t);
+      numLevels++;
+    }
+    if (numLevels == 1)
+      return;
+
+    uint32_t *pixel = (uint32_t *)realloc(texture->pixel,numBytes);
+    if (!pixel)
+      throw std::bad_alloc();
+    texture->pixel     = pixel;
+    texture->numLevels = numLevels;
+
+    for (int level=1;level<numLevels;level++) {
+      const unsigned char *src = (const unsigned char *)texture->levelPixels(level-1);
+      unsigned char       *dst = (unsigned char *)texture->levelPixels(level);
+      if (filter == MIP_FILTER_KAISER)
+        downsampleKaiser(src,texture->levelResolution(level-1),
+                         dst,texture->levelResolution(level));
+      else
+        downsampleBox(src,texture->levelResolution(level-1),
+                      dst,texture->levelResolution(level));
+    }
+  }
+
+  size_t applyTextureMemoryBudget(Model *model, size_t budget)
+  {
+    size_t totalBytes = 0;
+    for (auto texture : model->textures)
+      totalBytes += texture->sizeInBytes();
+    if (budget == 0)
+      return totalBytes;
+
+    while (totalBytes > budget) {
+      Texture *largest = nullptr;
+      for (auto texture : model->textures)
+        if (texture->numLevels > 1 &&
+            (!largest ||
+             area(texture->resolution) > area(largest->resolution)))
+          largest = texture;
+      if (!largest)
+        break;
+
+      const size_t droppedBytes
+        = size_t(largest->resolution.x)*size_t(largest->resolution.y)*sizeof(uint32_t);
+      const size_t keptBytes = largest->sizeInBytes()-droppedBytes;
+      if (largest->ownsPixels) {
+        memmove(largest->pixel,largest->levelPixels(1),keptBytes);
+        if (uint32_t *shrunk = (uint32_t *)realloc(largest->pixel,keptBytes))
+          largest->pixel = shrunk;
+      } else
+        largest->pixel = largest->levelPixels(1);
+      largest->resolution = largest->levelResolution(1);
+      largest->numLevels--;
+      totalBytes -= droppedBytes;
+    }
+    return totalBytes;
+  }
+
+}
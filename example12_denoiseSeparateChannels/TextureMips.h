@@ -0,0 +1,57 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "Model.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! replace the (single-level) pixels of given texture with a full
+      mip chain, all the way down to 1x1, each level being filtered
+      from the one before. Texture has to own its pixels */
+  void generateMipLevels(Texture *texture, MipFilter filter);
+
+  /*! drop the finest mip level of whichever texture currently is
+      the largest, until the textures of the model take no more than
+      'budget' bytes (or no texture has any level left to drop).
+      Returns the number of bytes all textures take afterwards */
+  size_t applyTextureMemoryBudget(Model *model, size_t budget);
+
+  /*! fit the model's textures into the texture memory budget (if
+      the options have one) */
+  void applyTextureOptions(Model *model, const TextureOptions &textureOptions);
+
+  /*! turn an image the way stbi decoded it - top row first, with
+      'numChannels' (1..4) 8-bit channels per pixel - into a texture
+      with RGBA8 pixels, bottom row first. Flipping, expanding to four
+      channels, and (optionally) pre-multiplying alpha all happen in
+      a single pass over the image. RGBA images get done in place,
+      swapping whole rows; anything else gets expanded into a new
+      image, with 'image' being freed. Either way the texture takes
+      ownership of the pixels */
+  Texture *ingestTexture(unsigned char *image,
+                         const vec2i &res,
+                         int numChannels,
+                         bool premultiplyAlpha);
+
+  /*! load a texture from given image file (see ingestTexture());
+      returns nullptr if the file could not get loaded */
+  Texture *loadTexture(const std::string &fileName,
+                       bool premultiplyAlpha = false);
+
+}
@@ -0,0 +1,400 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Benchmarks.h"
+#include "gdt/parallel/parallel_for.h"
+#include "gdt/random/random.h"
+//std
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <sys/stat.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  static bool fileExists(const std::string &fileName)
+  {
+    struct stat st;
+    return stat(fileName.c_str(),&st) == 0;
+  }
+  
+  enum { NUM_SYNTHETIC_MATERIALS = 8 };
+
+  /*! the untextured materials of the synthetic OBJ files, named
+      material0 and up */
+  static void writeSyntheticMTL(const std::string &mtlFile)
+  {
+    FILE *mtl = fopen(mtlFile.c_str(),"w");
+    if (!mtl)
+      throw std::runtime_error("could not write "+mtlFile);
+    for (int i=0;i<NUM_SYNTHETIC_MATERIALS;i++)
+      fprintf(mtl,"newmtl material%i\nKd %f %f %f\n\n",
+              i,.3f+.1f*(i%3),.3f+.1f*(i/3%3),.8f-.1f*i/2);
+    fclose(mtl);
+  }
+  
+  /*! write an OBJ file of (about) 'numFaces' triangles - a wavy
+      height field, with one object (and one of eight untextured
+      materials) per band of rows, and positions, normals, and
+      texture coordinates shared between faces the way exporters write
+      them - unless there already is one from an earlier run */
+  static std::string syntheticOBJ(size_t numFaces)
+  {
+    const std::string objFile
+      = "ex12_synthetic_"+std::to_string(numFaces)+".obj";
+    const std::string mtlFile
+      = "ex12_synthetic_"+std::to_string(numFaces)+".mtl";
+    if (fileExists(objFile) && fileExists(mtlFile))
+      return objFile;
+    std::cout << "writing " << objFile << " ..." << std::endl;
+
+    writeSyntheticMTL(mtlFile);
+
+    FILE *obj = fopen(objFile.c_str(),"w");
+    if (!obj)
+      throw std::runtime_error("could not write "+objFile);
+    std::vector<char> buffer(1<<20);
+    setvbuf(obj,buffer.data(),_IOFBF,buffer.size());
+    const int size = std::max(1,(int)sqrt(numFaces/2.));
+    auto height = [&](int x, int y) {
+      return 4.f*sinf(.05f*x)*cosf(.03f*y);
+    };
+    fprintf(obj,"mtllib %s\n",mtlFile.c_str());
+    for (int y=0;y<=size;y++)
+      for (int x=0;x<=size;x++) {
+        const float dx = height(x+1,y)-height(x-1,y);
+        const float dy = height(x,y+1)-height(x,y-1);
+        const vec3f N = normalize(vec3f(-dx,2.f,-dy));
+        fprintf(obj,"v %.4f %.4f %.4f\nvn %.4f %.4f %.4f\nvt %.5f %.5f\n",
+                float(x),height(x,y),float(y),N.x,N.y,N.z,
+                x/float(size),y/float(size));
+      }
+    const int rowsPerObject = std::max(1,size/64);
+    for (int y=0;y<size;y++) {
+      if (y % rowsPerObject == 0)
+        fprintf(obj,"o band%i\nusemtl material%i\n",
+                y/rowsPerObject,y/rowsPerObject % NUM_SYNTHETIC_MATERIALS);
+      for (int x=0;x<size;x++) {
+        const int v00 = y*(size+1)+x+1, v01 = v00+1;
+        const int v10 = v00+size+1,     v11 = v10+1;
+        fprintf(obj,"f %i/%i/%i %i/%i/%i %i/%i/%i\nf %i/%i/%i %i/%i/%i %i/%i/%i\n",
+                v00,v00,v00,v10,v10,v10,v01,v01,v01,
+                v01,v01,v01,v10,v10,v10,v11,v11,v11);
+      }
+    }
+    if (fclose(obj) != 0)
+      throw std::runtime_error("could not write "+objFile);
+    return objFile;
+  }
+
+  /*! a bumpy, open tube around the y axis: 'numRings' rows of 8
+      quads each, 'ringHeight' apart, with normals (those of the
+      smooth tube, without the bumps) and texture coordinates; and
+      the bumps shifted around by 'phase' */
+  static TriangleMesh *tubeMesh(int numRings, float ringHeight, float phase)
+  {
+    const int numSegments = 8;
+    TriangleMesh *mesh = new TriangleMesh;
+    for (int ring=0;ring<=numRings;ring++)
+      for (int segment=0;segment<=numSegments;segment++) {
+        const float phi = 2.f*float(M_PI)*segment/numSegments;
+        const float r
+          = 1.f+.1f*sinf(3.f*phi+phase)*sinf(float(M_PI)*ring/numRings);
+        mesh->vertex.push_back(vec3f(r*cosf(phi),ringHeight*ring,r*sinf(phi)));
+        mesh->normal.push_back(vec3f(cosf(phi),0.f,sinf(phi)));
+        mesh->texcoord.push_back(vec2f(segment/float(numSegments),ring/float(numRings)));
+      }
+    for (int ring=0;ring<numRings;ring++)
+      for (int segment=0;segment<numSegments;segment++) {
+        const int v00 = ring*(numSegments+1)+segment, v01 = v00+1;
+        const int v10 = v00+numSegments+1,            v11 = v10+1;
+        mesh->index.push_back(vec3i(v00,v10,v01));
+        mesh->index.push_back(vec3i(v01,v10,v11));
+      }
+    mesh->diffuse = vec3f(.7f);
+    return mesh;
+  }
+
+  /*! write an OBJ file of 'numObjects' small objects on a grid,
+      each a copy of one of sixteen different tubes (of 48 to 160
+      triangles), with one of the synthetic materials per tube; every
+      other copy also is rotated and scaled. Unless there already is
+      one from an earlier run */
+  static std::string objectsOBJ(int numObjects)
+  {
+    const std::string objFile
+      = "ex12_objects_"+std::to_string(numObjects)+".obj";
+    const std::string mtlFile
+      = "ex12_objects_"+std::to_string(numObjects)+".mtl";
+    if (fileExists(objFile) && fileExists(mtlFile))
+      return objFile;
+    std::cout << "writing " << objFile << " ..." << std::endl;
+
+    writeSyntheticMTL(mtlFile);
+    FILE *obj = fopen(objFile.c_str(),"w");
+    if (!obj)
+      throw std::runtime_error("could not write "+objFile);
+    std::vector<char> buffer(1<<20);
+    setvbuf(obj,buffer.data(),_IOFBF,buffer.size());
+    fprintf(obj,"mtllib %s\n",mtlFile.c_str());
+    const int numShapes = 16;
+    std::vector<std::unique_ptr<TriangleMesh>> shapes;
+    for (int shape=0;shape<numShapes;shape++)
+      shapes.emplace_back(tubeMesh(3+shape % 8,.3f*(1+shape/8),float(shape)));
+    const int gridSize = std::max(1,(int)ceil(sqrt(numObjects)));
+    int numVertices = 0;
+    for (int objectID=0;objectID<numObjects;objectID++) {
+      const int shape = objectID % numShapes;
+      const TriangleMesh &tube = *shapes[shape];
+      linear3f l(one);
+      if (objectID & 1)
+        l = (1.f+.25f*(objectID % 3))*linear3f::rotate(vec3f(0.f,1.f,0.f),.7f*objectID);
+      const vec3f origin(4.f*(objectID % gridSize),0.f,4.f*(objectID / gridSize));
+      fprintf(obj,"o object%i\nusemtl material%i\n",
+              objectID,shape % NUM_SYNTHETIC_MATERIALS);
+      for (size_t i=0;i<tube.vertex.size();i++) {
+        const vec3f P = origin + xfmVector(l,tube.vertex[i]);
+        const vec3f N = normalize(xfmVector(l,tube.normal[i]));
+        fprintf(obj,"v %.6f %.6f %.6f\nvn %.6f %.6f %.6f\nvt %.6f %.6f\n",
+                P.x,P.y,P.z,N.x,N.y,N.z,tube.texcoord[i].x,tube.texcoord[i].y);
+      }
+      for (auto &tri : tube.index) {
+        const vec3i idx = tri + vec3i(numVertices+1);
+        fprintf(obj,"f %i/%i/%i %i/%i/%i %i/%i/%i\n",
+                idx.x,idx.x,idx.x,idx.y,idx.y,idx.y,idx.z,idx.z,idx.z);
+      }
+      numVertices += (int)tube.vertex.size();
+    }
+    if (fclose(obj) != 0)
+      throw std::runtime_error("could not write "+objFile);
+    return objFile;
+  }
+
+  /*! 'numInstances' instances of 'numMeshes' different tubes, each
+      placed somewhere on a square, and rotated and scaled at
+      random - made right in memory */
+  static Model *instancedModel(int numMeshes, int numInstances)
+  {
+    Model *model = new Model;
+    for (int meshID=0;meshID<numMeshes;meshID++)
+      model->meshes.push_back(tubeMesh(3+meshID % 8,.3f*(1+meshID % 3),float(meshID)));
+    LCG<16> random(0,0);
+    const float size = 4.f*sqrtf(float(numInstances));
+    for (int instanceID=0;instanceID<numInstances;instanceID++) {
+      const int meshID = int(random()*numMeshes) % numMeshes;
+      const float angle = 2.f*float(M_PI)*random();
+      const float scale = .5f+random();
+      const vec3f origin(size*random(),0.f,size*random());
+      model->instances.push_back({ meshID,
+            affine3f(scale*linear3f::rotate(vec3f(0.f,1.f,0.f),angle),origin) });
+    }
+    computeBounds(model);
+    return model;
+  }
+
+  /*! the wavy height field of syntheticOBJ(), as a single mesh of
+      (about) 'numFaces' triangles without normals or texture
+      coordinates, made right in memory - for sizes whose OBJ files
+      would take longer to parse than whatever gets benchmarked */
+  static Model *syntheticModel(size_t numFaces)
+  {
+    const int size = std::max(1,(int)sqrt(numFaces/2.));
+    Model *model = new Model;
+    TriangleMesh *mesh = new TriangleMesh;
+    model->meshes.push_back(mesh);
+    mesh->vertex.resize(size_t(size+1)*(size+1));
+    mesh->index.resize(2*size_t(size)*size);
+    mesh->diffuse = vec3f(.7f);
+    gdt::parallel_for(size+1,[&](size_t y){
+        for (int x=0;x<=size;x++)
+          mesh->vertex[y*(size+1)+x]
+            = vec3f(float(x),4.f*sinf(.05f*x)*cosf(.03f*y),float(y));
+        if (y == size_t(size)) return;
+        for (int x=0;x<size;x++) {
+          const int v00 = int(y)*(size+1)+x, v01 = v00+1;
+          const int v10 = v00+size+1,        v11 = v10+1;
+          mesh->index[2*(y*size+x)+0] = vec3i(v00,v10,v01);
+          mesh->index[2*(y*size+x)+1] = vec3i(v01,v10,v11);
+        }
+      });
+    computeBounds(model);
+    return model;
+  }
+
+  /*! the model for a benchmark that takes one rather than a file: a
+      synthetic one made in memory, if 'arg' is a face count, or else
+      (a temporary copy of) the given OBJ file */
+  static Model *benchmarkModel(const std::string &arg)
+  {
+    if (arg.find_first_not_of("0123456789") == std::string::npos)
+      return syntheticModel(atoll(arg.c_str()));
+    TemporaryModelCopy copy(arg);
+    return loadOBJ(copy.fileName);
+  }
+  
+  static void usage()
+  {
+    std::cout << "usage: ex12_benchmarks <benchmark> [args]\n"
+              << "  obj-loader [numFaces]   vertex dedup and loadOBJ triangles/s on a\n"
+              << "                          synthetic OBJ (default: 10M faces)\n"
+              << "  obj-parser [file.obj]   check parseOBJParallel against tinyobj, and\n"
+              << "                          bytes/s of both (default: synthetic 10M faces)\n"
+              << "  model-cache [file.obj]  check that model caches go stale, then load\n"
+              << "                          time without and with the model cache\n"
+              << "                          (default: synthetic 10M faces)\n"
+              << "  texture-ingest [size]   flip+convert time of 1K^2..size^2 textures, the\n"
+              << "                          old way and through ingestTexture (default: 4096)\n"
+              << "  texture-mips [size]     box and Kaiser mip chains for 512^2..size^2\n"
+              << "                          textures, and fitting them into a budget\n"
+              << "                          (default: 4096)\n"
+              << "  instancing [file.obj]   memory saved by detectInstances, and check its\n"
+              << "                          instances (default: 10K small objects)\n"
+              << "  merge-meshes [file.obj] mesh and buffer counts, and load time,\n"
+              << "                          without and with mergeMeshes (default: 10K\n"
+              << "                          small objects)\n"
+              << "  smooth-normals [file.obj] [creaseAngle]\n"
+              << "                          time, memory and error of generateNormals\n"
+              << "                          (default: synthetic 10M faces, 30 degrees)\n"
+              << "  lods [file.obj] [levels]\n"
+              << "                          triangles, time and error of generateLODs\n"
+              << "                          (default: synthetic 4M faces, 4 levels)\n"
+              << "  vertex-fetch [file.obj] vertex fetch time of a frame's visible triangles,\n"
+              << "                          before and after optimizeMeshes (also shuffled)\n"
+              << "                          (default: synthetic 4M faces)\n"
+              << "  compact-vertices [file.obj]\n"
+              << "                          round-trip error and read speed of the compact\n"
+              << "                          vertex attributes (default: synthetic 4M faces)\n"
+              << "  meshlets [file.obj]     buildMeshlets vs. cutting the index array into\n"
+              << "                          runs (default: synthetic 4M faces, shuffled)\n"
+              << "  gltf-loader [file.obj]  load time of an OBJ vs. the same meshes as glb\n"
+              << "                          (default: synthetic 10M faces)\n"
+              << "  bvh-build [numFaces|file.obj]\n"
+              << "                          build and check the host BVH, and report its\n"
+              << "                          build time, nodes and SAH cost (default: an\n"
+              << "                          in-memory synthetic 10M faces)\n"
+              << "  bvh-trace [numFaces|file.obj]\n"
+              << "                          check the host BVH against testing all triangles,\n"
+              << "                          and Mrays/s of primary, shadow and random rays\n"
+              << "                          (default: 10K small objects)\n"
+              << "  ray-packets [numFaces|file.obj]\n"
+              << "                          primary rays one by one vs. in packets, for 1..16\n"
+              << "                          samples per pixel at 1080p and 4K (default: 10K\n"
+              << "                          small objects)\n"
+              << "  two-level-bvh [numMeshes] [numInstances]\n"
+              << "                          check the two-level host BVH, and time tracing\n"
+              << "                          it and moving all instances (default: 100K\n"
+              << "                          instances of 300 meshes)\n"
+              << "  mesh-refit [numFaces|file.obj] [numFrames]\n"
+              << "                          refit vs. rebuild while twisting the largest\n"
+              << "                          mesh (default: an in-memory synthetic 1M faces,\n"
+              << "                          1000 frames)\n"
+              << "  scene-reload            check that reloadSceneFile replaces just the\n"
+              << "                          meshes, textures or models that changed\n"
+              << "  cpu-render [file.obj] [spp]\n"
+              << "                          check the CPU reference renderer's shading, then\n"
+              << "                          check and time it, and save what it renders\n"
+              << "                          (default: 100 small objects, instanced and\n"
+              << "                          checker textured; 1)\n"
+              << std::flush;
+    exit(1);
+  }
+  
+  /*! host-side benchmarks (and validations) of what ex12 does to its
+      models before they ever get to the GPU - so they run anywhere,
+      on synthetic input, unless given some */
+  extern "C" int main(int ac, char **av)
+  {
+    try {
+      if (ac < 2)
+        usage();
+      const std::string benchmark = av[1];
+      if (benchmark == "obj-loader")
+        benchmarkOBJLoader(syntheticOBJ(ac > 2 ? atoll(av[2]) : 10000000));
+      else if (benchmark == "obj-parser")
+        validateOBJParser(ac > 2 ? std::string(av[2]) : syntheticOBJ(10000000));
+      else if (benchmark == "model-cache") {
+        validateModelCacheStamps();
+        benchmarkModelCache(ac > 2 ? std::string(av[2]) : syntheticOBJ(10000000));
+      }
+      else if (benchmark == "texture-ingest")
+        benchmarkTextureIngest(ac > 2 ? atoi(av[2]) : 4096);
+      else if (benchmark == "texture-mips")
+        benchmarkTextureMips(ac > 2 ? atoi(av[2]) : 4096);
+      else if (benchmark == "instancing")
+        benchmarkInstancing(ac > 2 ? std::string(av[2]) : objectsOBJ(10000));
+      else if (benchmark == "merge-meshes")
+        benchmarkMergeMeshes(ac > 2 ? std::string(av[2]) : objectsOBJ(10000));
+      else if (benchmark == "smooth-normals")
+        benchmarkSmoothNormals(ac > 2 ? std::string(av[2]) : syntheticOBJ(10000000),
+                               ac > 3 ? (float)atof(av[3]) : 30.f);
+      else if (benchmark == "lods")
+        benchmarkLODs(ac > 2 ? std::string(av[2]) : syntheticOBJ(4000000),
+                      ac > 3 ? atoi(av[3]) : 4);
+      else if (benchmark == "vertex-fetch")
+        benchmarkMeshOptimize(ac > 2 ? std::string(av[2]) : syntheticOBJ(4000000));
+      else if (benchmark == "compact-vertices")
+        benchmarkCompactVertices(ac > 2 ? std::string(av[2]) : syntheticOBJ(4000000));
+      else if (benchmark == "meshlets")
+        // (the synthetic grid's rows already make for fine runs)
+        benchmarkMeshlets(ac > 2 ? std::string(av[2]) : syntheticOBJ(4000000),
+                          /*shuffle=*/ac <= 2);
+      else if (benchmark == "gltf-loader")
+        benchmarkGLTFLoader(ac > 2 ? std::string(av[2]) : syntheticOBJ(10000000));
+      else if (benchmark == "bvh-build") {
+        std::unique_ptr<Model> model(benchmarkModel(ac > 2 ? av[2] : "10000000"));
+        benchmarkBVHBuild(model.get());
+      }
+      else if (benchmark == "bvh-trace") {
+        std::unique_ptr<Model> model(benchmarkModel(ac > 2 ? std::string(av[2])
+                                                   : objectsOBJ(10000)));
+        benchmarkBVHTrace(model.get());
+      }
+      else if (benchmark == "ray-packets") {
+        std::unique_ptr<Model> model(benchmarkModel(ac > 2 ? std::string(av[2])
+                                                   : objectsOBJ(10000)));
+        benchmarkRayPackets(model.get());
+      }
+      else if (benchmark == "two-level-bvh") {
+        std::unique_ptr<Model> model(instancedModel(ac > 2 ? atoi(av[2]) : 300,
+                                                     ac > 3 ? atoi(av[3]) : 100000));
+        benchmarkTwoLevelBVH(model.get());
+      }
+      else if (benchmark == "mesh-refit") {
+        std::unique_ptr<Model> model(benchmarkModel(ac > 2 ? av[2] : "1000000"));
+        benchmarkMeshRefit(model.get(),ac > 3 ? atoi(av[3]) : 1000);
+      }
+      else if (benchmark == "scene-reload")
+        validateSceneReload();
+      else if (benchmark == "cpu-render") {
+        validateCPURenderer();
+        // (have the default scene take the renderer's instance and
+        // texture paths, too)
+        benchmarkCPURenderer(ac > 2 ? std::string(av[2]) : objectsOBJ(100),
+                             ac > 3 ? atoi(av[3]) : 1,
+                             /*instanceAndTexture=*/ac <= 2);
+      }
+      else
+        usage();
+    } catch (std::runtime_error& e) {
+      std::cout << GDT_TERMINAL_RED << "FATAL ERROR: " << e.what()
+                << GDT_TERMINAL_DEFAULT << std::endl;
+      exit(1);
+    }
+    return 0;
+  }
+  
+} // ::osc
@@ -65,6 +65,35 @@ namespace osc {
     const uint32_t u1 = optixGetPayload_1();
     return reinterpret_cast<T*>( unpackPointer( u0, u1 ) );
   }
+
+  //------------------------------------------------------------------------------
+  // vertex attribute fetches, from either the full-precision or the
+  // compact arrays, whichever the mesh has
+  //------------------------------------------------------------------------------
+
+  static __forceinline__ __device__
+  vec3f getVertex(const TriangleMeshSBTData &sbtData, int i)
+  {
+    return sbtData.vertex
+      ? sbtData.vertex[i]
+      : sbtData.vertexQuantizer.decode(sbtData.compactVertex[i]);
+  }
+
+  static __forceinline__ __device__
+  vec3f getNormal(const TriangleMeshSBTData &sbtData, int i)
+  {
+    return sbtData.normal
+      ? sbtData.normal[i]
+      : (vec3f)sbtData.compactNormal[i];
+  }
+
+  static __forceinline__ __device__
+  vec2f getTexcoord(const TriangleMeshSBTData &sbtData, int i)
+  {
+    return sbtData.texcoord
+      ? sbtData.texcoord[i]
+      : sbtData.compactTexcoord[i].decode(sbtData.halfTexcoords);
+  }
   
   //------------------------------------------------------------------------------
   // closest hit and anyhit programs for radiance-type rays.
@@ -99,15 +128,19 @@ namespace osc {
     // compute normal, using either shading normal (if avail), or
     // geometry normal (fallback)
     // ------------------------------------------------------------------
-    const vec3f &A     = sbtData.vertex[index.x];
-    const vec3f &B     = sbtData.vertex[index.y];
-    const vec3f &C     = sbtData.vertex[index.z];
+    const vec3f A      = getVertex(sbtData,index.x);
+    const vec3f B      = getVertex(sbtData,index.y);
+    const vec3f C      = getVertex(sbtData,index.z);
     vec3f Ng = cross(B-A,C-A);
-    vec3f Ns = (sbtData.normal)
-      ? ((1.f-u-v) * sbtData.normal[index.x]
-         +       u * sbtData.normal[index.y]
-         +       v * sbtData.normal[index.z])
+    vec3f Ns = (sbtData.normal || sbtData.compactNormal)
+      ? ((1.f-u-v) * getNormal(sbtData,index.x)
+         +       u * getNormal(sbtData,index.y)
+         +       v * getNormal(sbtData,index.z))
       : Ng;
+    // all of the above is in the mesh's space, which is world space
+    // unless the mesh got instanced
+    Ng = (vec3f)optixTransformNormalFromObjectToWorldSpace((float3)Ng);
+    Ns = (vec3f)optixTransformNormalFromObjectToWorldSpace((float3)Ns);
     
     // ------------------------------------------------------------------
     // face-forward and normalize normals
@@ -126,13 +159,40 @@ namespace osc {
     // available
     // ------------------------------------------------------------------
     vec3f diffuseColor = sbtData.color;
-    if (sbtData.hasTexture && sbtData.texcoord) {
+    if (sbtData.hasTexture && (sbtData.texcoord || sbtData.compactTexcoord)) {
+      const vec2f TA = getTexcoord(sbtData,index.x);
+      const vec2f TB = getTexcoord(sbtData,index.y);
+      const vec2f TC = getTexcoord(sbtData,index.z);
       const vec2f tc
-        = (1.f-u-v) * sbtData.texcoord[index.x]
-        +         u * sbtData.texcoord[index.y]
-        +         v * sbtData.texcoord[index.z];
+        = (1.f-u-v) * TA
+        +         u * TB
+        +         v * TC;
       
-      vec4f fromTexture = tex2D<float4>(sbtData.texture,tc.x,tc.y);
+      // pick a mip level from the footprint of this pixel's ray cone
+      // on the surface: texels per world-space area of the triangle,
+      // times width of the cone (with the camera's per-pixel spread
+      // angle) at the hit distance
+      const vec2f dTB = TB-TA;
+      const vec2f dTC = TC-TA;
+      const float texelArea
+        = fabsf(dTB.x*dTC.y-dTC.x*dTB.y)
+        * sbtData.textureSize.x * sbtData.textureSize.y;
+      const vec3f worldAB
+        = (vec3f)optixTransformVectorFromObjectToWorldSpace((float3)(B-A));
+      const vec3f worldAC
+        = (vec3f)optixTransformVectorFromObjectToWorldSpace((float3)(C-A));
+      const float worldArea  = length(cross(worldAB,worldAC));
+      const float pixelSpread
+        = length(optixLaunchParams.camera.horizontal)
+        / optixLaunchParams.frame.size.x;
+      const float coneWidth  = optixGetRayTmax() * pixelSpread;
+      const float cosine     = fmaxf(fabsf(dot(rayDir,Ng)),1e-3f);
+      const float lod
+        = (texelArea > 0.f && worldArea > 0.f)
+        ? 0.5f*log2f(texelArea/worldArea) + log2f(coneWidth/cosine)
+        : 0.f;
+      
+      vec4f fromTexture = tex2DLod<float4>(sbtData.texture,tc.x,tc.y,lod);
       diffuseColor *= (vec3f)fromTexture;
     }
 
@@ -143,17 +203,25 @@ namespace osc {
     // compute shadow
     // ------------------------------------------------------------------
     const vec3f surfPos
-      = (1.f-u-v) * sbtData.vertex[index.x]
-      +         u * sbtData.vertex[index.y]
-      +         v * sbtData.vertex[index.z];
+      = (vec3f)optixTransformPointFromObjectToWorldSpace
+      ((float3)((1.f-u-v) * A
+                +       u * B
+                +       v * C));
 
     const int numLightSamples = NUM_LIGHT_SAMPLES;
-    for (int lightSampleID=0;lightSampleID<numLightSamples;lightSampleID++) {
+    const int numLights       = optixLaunchParams.lights.count;
+    for (int lightSampleID=0;numLights>0 && lightSampleID<numLightSamples;lightSampleID++) {
+      // pick one of the lights at random - uniformly, so its
+      // contribution gets scaled by numLights below
+      int lightID = numLights > 1 ? int(prd.random()*numLights) : 0;
+      if (lightID >= numLights) lightID = numLights-1;
+      const QuadLightData &light = optixLaunchParams.lights.quads[lightID];
+      
       // produce random light sample
       const vec3f lightPos
-        = optixLaunchParams.light.origin
-        + prd.random() * optixLaunchParams.light.du
-        + prd.random() * optixLaunchParams.light.dv;
+        = light.origin
+        + prd.random() * light.du
+        + prd.random() * light.dv;
       vec3f lightDir = lightPos - surfPos;
       float lightDist = gdt::length(lightDir);
       lightDir = normalize(lightDir);
@@ -184,9 +252,9 @@ namespace osc {
                    u0, u1 );
         pixelColor
           += lightVisibility
-          *  optixLaunchParams.light.power
+          *  light.power
           *  diffuseColor
-          *  (NdotL / (lightDist*lightDist*numLightSamples));
+          *  (numLights * NdotL / (lightDist*lightDist*numLightSamples));
       }
     }
 
@@ -15,10 +15,14 @@
 // ======================================================================== //
 
 #include "SampleRenderer.h"
+#include "Scene.h"
+#include "FileWatcher.h"
 
 // our helper library for window handling
 #include "glfWindow/GLFWindow.h"
 #include <GL/gl.h>
+//std
+#include <algorithm>
 
 /*! \namespace osc - Optix Siggraph Course */
 namespace osc {
@@ -26,18 +30,60 @@ namespace osc {
   struct SampleWindow : public GLFCameraWindow
   {
     SampleWindow(const std::string &title,
-                 const Model *model,
+                 Scene *scene,
                  const Camera &camera,
-                 const QuadLight &light,
-                 const float worldScale)
+                 const std::vector<QuadLight> &defaultLights,
+                 const float worldScale,
+                 bool watchFiles)
       : GLFCameraWindow(title,camera.from,camera.at,camera.up,worldScale),
-        sample(model,light)
+        sample(scene->model,
+               scene->lights.empty() ? defaultLights : scene->lights),
+        scene(scene),
+        defaultLights(defaultLights),
+        cameras(scene->cameras)
     {
       sample.setCamera(camera);
+      if (watchFiles) {
+        watcher.reset(new FileWatcher);
+        for (auto &fileName : sceneDependencies(scene))
+          watcher->watch(fileName);
+      }
+    }
+
+    /*! reload whichever of the scene's files changed, and bring the
+        renderer up to date with that */
+    void reloadChangedFiles()
+    {
+      const std::vector<std::string> changed = watcher->changedFiles();
+      if (changed.empty())
+        return;
+      for (auto &fileName : changed)
+        try {
+          const SceneChanges changes = reloadSceneFile(scene,fileName);
+          if (changes.everything) {
+            sample.setModel(scene->model,
+                            scene->lights.empty() ? defaultLights : scene->lights);
+            cameras = scene->cameras;
+          } else if (changes.instances) {
+            sample.updateInstances(scene->lights.empty() ? defaultLights : scene->lights);
+            cameras = scene->cameras;
+          } else
+            sample.updateModel(changes.meshes,changes.textures);
+        } catch (std::runtime_error &e) {
+          // (say, a file that is still being written)
+          std::cout << GDT_TERMINAL_RED << "#osc: could not reload "
+                    << fileName << ": " << e.what()
+                    << GDT_TERMINAL_DEFAULT << std::endl;
+        }
+      // what got reloaded may use files it did not use before
+      for (auto &fileName : sceneDependencies(scene))
+        watcher->watch(fileName);
     }
     
     virtual void render() override
     {
+      if (watcher)
+        reloadChangedFiles();
       if (cameraFrame.modified) {
         sample.setCamera(Camera{ cameraFrame.get_from(),
                                  cameraFrame.get_at(),
@@ -124,6 +170,12 @@ namespace osc {
         std::cout << "num samples/pixel now "
                   << sample.launchParams.numPixelSamples << std::endl;
       }
+      if (key >= '1' && key <= '9' && key-'1' < (int)cameras.size()) {
+        const NamedCamera &named = cameras[key-'1'];
+        cameraFrame.setOrientation(named.camera.from,named.camera.at,named.camera.up);
+        cameraFrame.modified = true;
+        std::cout << "switched to camera '" << named.name << "'" << std::endl;
+      }
     }
     
 
@@ -131,6 +183,13 @@ namespace osc {
     GLuint                fbTexture {0};
     SampleRenderer        sample;
     std::vector<uint32_t> pixels;
+    Scene                *scene;
+    /*! the lights for scenes that do not bring their own */
+    std::vector<QuadLight> defaultLights;
+    /*! the scene's cameras, on keys '1' to '9' */
+    std::vector<NamedCamera> cameras;
+    /*! with --watch: tells which of the scene's files changed */
+    std::unique_ptr<FileWatcher> watcher;
   };
   
   
@@ -139,17 +198,99 @@ namespace osc {
   extern "C" int main(int ac, char **av)
   {
     try {
-      Model *model = loadOBJ(
+      TextureOptions textureOptions;
+      bool instanceMeshes = false;
+      bool affineInstances = false;
+      bool mergeModelMeshes = false;
+      bool optimizeModelMeshes = false;
+      bool smoothNormals = false;
+      float creaseAngle = 180.f;
+      bool tangents = false;
+      int  numLODs = 0;
+      bool meshlets = false;
+      bool compactVertices = false;
+      bool quantizePositions = false;
+      bool watchFiles = false;
+      std::string cameraName;
+      std::string modelFile =
 #ifdef _WIN32
-      // on windows, visual studio creates _two_ levels of build dir
-      // (x86/Release)
-      "../../models/sponza.obj"
+        // on windows, visual studio creates _two_ levels of build dir
+        // (x86/Release)
+        "../../models/sponza.obj"
 #else
-      // on linux, common practice is to have ONE level of build dir
-      // (say, <project>/build/)...
-      "../models/sponza.obj"
+        // on linux, common practice is to have ONE level of build dir
+        // (say, <project>/build/)...
+        "../models/sponza.obj"
 #endif
-                             );
+        ;
+      for (int i=1;i<ac;i++) {
+        const std::string arg = av[i];
+        if (arg == "--texture-budget" && i+1 < ac)
+          // in MB
+          textureOptions.memoryBudget = size_t(atof(av[++i])*(1<<20));
+        else if (arg == "--kaiser-mips")
+          textureOptions.mipFilter = MIP_FILTER_KAISER;
+        else if (arg == "--no-mips")
+          textureOptions.generateMips = false;
+        else if (arg == "--instance-meshes")
+          instanceMeshes = true;
+        else if (arg == "--instance-affine")
+          instanceMeshes = affineInstances = true;
+        else if (arg == "--merge-meshes")
+          mergeModelMeshes = true;
+        else if (arg == "--optimize-meshes")
+          optimizeModelMeshes = true;
+        else if (arg == "--smooth-normals")
+          smoothNormals = true;
+        else if (arg == "--crease-angle" && i+1 < ac) {
+          // in degrees
+          smoothNormals = true;
+          creaseAngle = (float)atof(av[++i]);
+        }
+        else if (arg == "--tangents")
+          smoothNormals = tangents = true;
+        else if (arg == "--lods" && i+1 < ac)
+          numLODs = atoi(av[++i]);
+        else if (arg == "--meshlets")
+          meshlets = true;
+        else if (arg == "--compact-vertices")
+          compactVertices = true;
+        else if (arg == "--quantize-positions")
+          compactVertices = quantizePositions = true;
+        else if (arg == "--camera" && i+1 < ac)
+          // one of the scene file's cameras, by name
+          cameraName = av[++i];
+        else if (arg == "--watch")
+          // reload the scene's files whenever they change
+          watchFiles = true;
+        else if (arg[0] != '-')
+          modelFile = arg;
+        else
+          throw std::runtime_error("unknown cmdline argument '"+arg+"'");
+      }
+
+      const double loadStartTime = getCurrentTime();
+      // what gets done to each model file (again, whenever it gets
+      // reloaded)
+      ModelPass prepare = [=](Model *model) {
+        if (instanceMeshes)
+          detectInstances(model,affineInstances);
+        if (mergeModelMeshes)
+          mergeMeshes(model);
+        if (optimizeModelMeshes)
+          optimizeMeshes(model);
+        if (smoothNormals)
+          generateNormals(model,creaseAngle,tangents);
+        if (numLODs > 0)
+          generateLODs(model,numLODs);
+        if (meshlets)
+          buildMeshlets(model);
+        if (compactVertices)
+          compactVertexAttributes(model,quantizePositions);
+      };
+      // a scene file, or a single model file
+      Scene *scene = loadScene(modelFile,textureOptions,prepare);
+      const Model *model = scene->model;
       Camera camera = { /*from*/vec3f(-1293.07f, 154.681f, -0.7304f),
                         /* at */model->bounds.center()-vec3f(0,400,0),
                         /* up */vec3f(0.f,1.f,0.f) };
@@ -160,19 +301,40 @@ namespace osc {
                           /* edge 1 */ vec3f(2.f*light_size,0,0),
                           /* edge 2 */ vec3f(0,0,2.f*light_size),
                           /* power */  vec3f(3000000.f) };
+
+      // ... unless the scene file brings its own
+      const std::vector<QuadLight>    defaultLights(1,light);
+      const std::vector<NamedCamera> &cameras = scene->cameras;
+      if (!cameras.empty())
+        camera = cameras[0].camera;
+      if (cameraName != "") {
+        auto named = std::find_if(cameras.begin(),cameras.end(),
+                                  [&](const NamedCamera &c){ return c.name == cameraName; });
+        if (named == cameras.end())
+          throw std::runtime_error("no camera named '"+cameraName+"'");
+        camera = named->camera;
+      }
                       
       // something approximating the scale of the world, so the
       // camera knows how much to move for any given user interaction:
       const float worldScale = length(model->bounds.span());
 
       SampleWindow *window = new SampleWindow("Optix 7 Course Example",
-                                              model,camera,light,worldScale);
+                                              scene,camera,defaultLights,
+                                              worldScale,watchFiles);
+      std::cout << "#osc: model loaded and renderer set up in "
+                << (getCurrentTime()-loadStartTime) << "s" << std::endl;
       window->enableFlyMode();
       
       std::cout << "Press 'a' to enable/disable accumulation/progressive refinement" << std::endl;
       std::cout << "Press ' ' to enable/disable denoising" << std::endl;
       std::cout << "Press ',' to reduce the number of paths/pixel" << std::endl;
       std::cout << "Press '.' to increase the number of paths/pixel" << std::endl;
+      if (!cameras.empty())
+        std::cout << "Press '1'..'" << std::min((int)cameras.size(),9)
+                  << "' to switch to the scene's cameras" << std::endl;
+      if (watchFiles)
+        std::cout << "Watching the scene's files - changed ones get reloaded" << std::endl;
       window->run();
       
     } catch (std::runtime_error& e) {